@@ -218,6 +218,10 @@ OIIO_API std::time_t last_write_time (const std::string& path);
 ///
 OIIO_API void last_write_time (const std::string& path, std::time_t time);
 
+/// Return the size of the file in bytes, or 0 if it doesn't exist.
+///
+OIIO_API unsigned long long file_size (const std::string& path);
+
 /// Ensure command line arguments are UTF-8 everywhere
 ///
 OIIO_API void convert_native_arguments (int argc, const char *argv[]);
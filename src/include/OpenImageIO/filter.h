@@ -33,6 +33,9 @@
 #ifndef OPENIMAGEIO_FILTER_H
 #define OPENIMAGEIO_FILTER_H
 
+#include <cmath>
+#include <vector>
+
 #include "oiioversion.h"
 #include "export.h"
 #include "string_view.h"
@@ -146,6 +149,95 @@ protected:
 };
 
 
+
+/// FilterTable is a tabulated copy of a Filter2D, meant to be built once
+/// per image operation and then evaluated for every filter tap.  For a
+/// separable filter, xfilt() and yfilt() are answered from a
+/// piecewise-linear lookup table of each (symmetric) axis, which is
+/// non-virtual, inlined, and much cheaper than evaluating filters such as
+/// lanczos3, blackman-harris or sinc directly.  The table is exact at the
+/// sample points and at the support boundary, and elsewhere agrees with
+/// the underlying filter to within 1e-4 for all the built-in filters
+/// (except right around lanczos3's center, where the filter itself jumps
+/// by about 0.02 and the table smooths it).  Non-separable filters are
+/// not tabulated; operator() just calls the underlying Filter2D.
+///
+/// A FilterTable does not own the Filter2D it was built from, and it is
+/// read-only after construction, so one table may be shared by many
+/// threads.
+class OIIO_API FilterTable {
+public:
+    /// Tabulate filter.  If resolution > 0, it is the number of table
+    /// intervals across each filter radius; the default (0) picks a
+    /// resolution that is accurate for all the built-in filters.
+    FilterTable (const Filter2D *filter, int resolution = 0);
+
+    /// The Filter2D this table was built from.
+    const Filter2D *filter (void) const { return m_filter; }
+
+    float width (void) const { return m_filter->width(); }
+    float height (void) const { return m_filter->height(); }
+    bool separable (void) const { return m_separable; }
+
+    /// Evaluate the horizontal filter (only valid if separable()).
+    float xfilt (float x) const {
+        return lookup (&m_xtable[0], m_xscale, m_xrad, m_xedge, x);
+    }
+
+    /// Evaluate the vertical filter (only valid if separable()).
+    float yfilt (float y) const {
+        return lookup (&m_ytable[0], m_yscale, m_yrad, m_yedge, y);
+    }
+
+    /// Evaluate the 2D filter at (x,y).
+    float operator() (float x, float y) const {
+        return m_separable ? xfilt(x) * yfilt(y) : (*m_filter)(x, y);
+    }
+
+    /// Evaluate the horizontal filter at the n evenly spaced positions
+    /// x0, x0+dx, ..., x0+(n-1)*dx, storing the weights in w[0..n-1] and
+    /// returning their sum.  Only valid if separable().
+    float xfilt (float x0, float dx, int n, float *w) const {
+        return lookup (&m_xtable[0], m_xscale, m_xrad, m_xedge, x0, dx, n, w);
+    }
+
+    /// Evaluate the vertical filter at n evenly spaced positions, like
+    /// the xfilt() above.  Only valid if separable().
+    float yfilt (float y0, float dy, int n, float *w) const {
+        return lookup (&m_ytable[0], m_yscale, m_yrad, m_yedge, y0, dy, n, w);
+    }
+
+private:
+    const Filter2D *m_filter;
+    bool m_separable;
+    // Each table holds the filter at n+1 evenly spaced points over
+    // [0,rad], with scale = n/rad, plus one padding copy of the last
+    // entry so that rounding of x*scale can never index past the end.
+    // The entry at rad is the limit approaching rad from inside; edge is
+    // the filter value exactly at rad (it differs for filters like box or
+    // gaussian that are discontinuous at the boundary).
+    std::vector<float> m_xtable, m_ytable;
+    float m_xscale, m_yscale;
+    float m_xrad, m_yrad;
+    float m_xedge, m_yedge;
+
+    static float lookup (const float *table, float scale, float rad,
+                         float edge, float x) {
+        x = fabsf (x);
+        if (x >= rad)
+            return x > rad ? 0.0f : edge;
+        float t = x * scale;
+        int i = (int) t;
+        t -= (float) i;
+        return table[i] + t * (table[i+1] - table[i]);
+    }
+
+    static float lookup (const float *table, float scale, float rad,
+                         float edge, float x0, float dx, int n, float *w);
+};
+
+
+
 }
 OIIO_NAMESPACE_EXIT
 
@@ -224,7 +224,8 @@ public:
     enum IBStorage { UNINITIALIZED,   // no pixel memory
                      LOCALBUFFER,     // The IB owns the memory
                      APPBUFFER,       // The IB wraps app's memory
-                     IMAGECACHE       // Backed by ImageCache
+                     IMAGECACHE,      // Backed by ImageCache
+                     SCRATCHFILE      // Tiles paged to a scratch file
                    };
 
     /// Restore the ImageBuf to an uninitialized state.
@@ -252,6 +253,18 @@ public:
     /// image of the given name and dimensions.
     void reset (string_view name, const ImageSpec &spec);
 
+    /// Forget all previous info, reset this ImageBuf to a blank (black)
+    /// image of the given name and dimensions, using the requested
+    /// storage, which must be LOCALBUFFER or SCRATCHFILE.  SCRATCHFILE
+    /// storage is writeable but never holds the whole image in memory:
+    /// the pixels are divided into tiles (of the size given by the
+    /// spec's tile dimensions, or 64x64 if it is not tiled), at most
+    /// "scratch_memory" MB of which are resident at any time, and the
+    /// rest are paged to and from a temporary file.  This allows images
+    /// larger than RAM to be assembled and processed with iterators and
+    /// ImageBufAlgo functions.
+    void reset (string_view name, const ImageSpec &spec, IBStorage storage);
+
     /// Which type of storage is being used for the pixels?
     IBStorage storage () const;
 
@@ -303,7 +316,8 @@ public:
     /// previously backed by ImageCache (storage was IMAGECACHE), it will
     /// force a full read so that the whole image is in local memory. This
     /// will invalidate any current iterators on the image. It has no effect
-    /// if the image storage not IMAGECACHE.  Return true if it works
+    /// if the image storage not IMAGECACHE (SCRATCHFILE images are already
+    /// writeable without being fully resident).  Return true if it works
     /// (including if no read was necessary), false if something went
     /// horribly wrong. If keep_cache_type is true, it preserves any IC-
     /// forced data types (you might want to do this if it is critical that
@@ -329,7 +343,8 @@ public:
     /// local pixel memory, or referring to a read-only image backed by
     /// ImageCache, then local pixel memory will be allocated to hold
     /// the new pixels and the call always succeeds unless the memory
-    /// cannot be allocated.
+    /// cannot be allocated.  If src has SCRATCHFILE storage, so will
+    /// the copy.
     ///
     /// If *this previously referred to an app-owned memory buffer, the
     /// memory cannot be re-allocated, so the call will only succeed if
@@ -741,18 +756,19 @@ public:
 
         ~IteratorBase () {
             if (m_tile)
-                m_ib->imagecache()->release_tile (m_tile);
+                m_ib->release_tile (m_tile);
         }
 
         /// Assign one IteratorBase to another
         ///
         const IteratorBase & assign_base (const IteratorBase &i) {
             if (m_tile)
-                m_ib->imagecache()->release_tile (m_tile);
+                m_ib->release_tile (m_tile);
             m_tile = NULL;
             m_proxydata = i.m_proxydata;
             m_ib = i.m_ib;
             init_ib (i.m_wrap);
+            m_writeable = i.m_writeable;
             m_rng_xbegin = i.m_rng_xbegin;  m_rng_xend = i.m_rng_xend;
             m_rng_ybegin = i.m_rng_ybegin;  m_rng_yend = i.m_rng_yend;
             m_rng_zbegin = i.m_rng_zbegin;  m_rng_zend = i.m_rng_zend;
@@ -849,7 +865,7 @@ public:
                 m_proxydata = (char *)m_ib->retile (x_, y_, z_, m_tile,
                                                     m_tilexbegin, m_tileybegin,
                                                     m_tilezbegin, m_tilexend,
-                                                    e, m_wrap);
+                                                    e, m_wrap, m_writeable);
             m_x = x_;  m_y = y_;  m_z = z_;
             m_valid = v;
             m_exists = e;
@@ -917,6 +933,7 @@ public:
         bool m_valid, m_exists;
         bool m_deep;
         bool m_localpixels;
+        bool m_writeable;      // Will pixels be modified through us?
         // Image boundaries
         int m_img_xbegin, m_img_xend, m_img_ybegin, m_img_yend,
             m_img_zbegin, m_img_zend;
@@ -938,6 +955,7 @@ public:
             const ImageSpec &spec (m_ib->spec());
             m_deep = spec.deep;
             m_localpixels = (m_ib->localpixels() != NULL);
+            m_writeable = false;
             m_img_xbegin = spec.x; m_img_xend = spec.x+spec.width;
             m_img_ybegin = spec.y; m_img_yend = spec.y+spec.height;
             m_img_zbegin = spec.z; m_img_zend = spec.z+spec.depth;
@@ -991,7 +1009,7 @@ public:
                 else {
                     m_proxydata = (char *)m_ib->retile (m_x, m_y, m_z, m_tile,
                                     m_tilexbegin, m_tileybegin, m_tilezbegin,
-                                    m_tilexend, e, m_wrap);
+                                    m_tilexend, e, m_wrap, m_writeable);
                     m_exists = e;
                 }
             }
@@ -1014,6 +1032,7 @@ public:
                 m_proxydata = NULL;
                 init_ib (m_wrap);
             }
+            m_writeable = true;
         }
     };
 
@@ -1123,8 +1142,9 @@ public:
 
         void * rawptr () const { return m_proxydata; }
 
-        /// Set the number of deep data samples at this pixel. (Only use
-        /// this if deep_alloc() has not yet been called on the buffer.)
+        /// Set the number of deep data samples at this pixel. (If
+        /// deep_alloc() has already been called on the buffer, existing
+        /// samples are preserved and new ones are zero.)
         void set_deep_samples (int n) {
             return const_cast<ImageBuf*>(m_ib)->set_deep_samples (m_x, m_y, m_z, n);
         }
@@ -1245,12 +1265,17 @@ protected:
 
     // Reset the ImageCache::Tile * to reserve and point to the correct
     // tile for the given pixel, and return the ptr to the actual pixel
-    // within the tile.
+    // within the tile.  If writeable is true, the caller may modify the
+    // pixels of the tile (only meaningful for SCRATCHFILE storage).
     const void * retile (int x, int y, int z,
                          ImageCache::Tile* &tile, int &tilexbegin,
                          int &tileybegin, int &tilezbegin,
                          int &tilexend, bool exists,
-                         WrapMode wrap=WrapDefault) const;
+                         WrapMode wrap=WrapDefault,
+                         bool writeable=false) const;
+
+    // Release a tile reserved by retile().
+    void release_tile (ImageCache::Tile *tile) const;
 
     const void *blackpixel () const;
 
@@ -296,6 +296,64 @@ bool OIIO_API flatten (ImageBuf &dst, const ImageBuf &src,
                        ROI roi = ROI::All(), int nthreads = 0);
 
 
+/// The deep_* functions below operate on deep images whose channels
+/// follow the OpenEXR deep conventions: a "Z" channel (and optionally
+/// "Zback", without which all samples are points), an "A" channel (or
+/// "RA", "GA", "BA" per-channel alphas), and other channels that are
+/// premultiplied by alpha -- except for integer channels such as object
+/// ids, which are carried along unaltered.  They all return false and
+/// set an error in dst if the inputs are not deep or lack Z or alpha.
+///
+/// 'roi' specifies the region of dst's pixels which will be computed;
+/// existing pixels outside this range will not be altered.  If not
+/// specified, the default ROI value will be the pixel data window of src
+/// (for deep_merge, the union of A and B).  If dst is not already an
+/// initialized ImageBuf, it will be sized to match.  dst may be the same
+/// image as one of the inputs.
+///
+/// The nthreads parameter specifies how many threads (potentially) may
+/// be used, but it's not a guarantee.  If nthreads == 0, it will use
+/// the global OIIO attribute "nthreads".  If nthreads == 1, it
+/// guarantees that it will not launch any new threads.
+
+/// Set dst to src with the samples of each pixel sorted front to back by
+/// Z (and then by Zback).
+bool OIIO_API deep_sort (ImageBuf &dst, const ImageBuf &src,
+                         ROI roi = ROI::All(), int nthreads = 0);
+
+/// Set dst to the "tidy" version of src: samples sorted front to back,
+/// volumetric samples split wherever another sample begins or ends so
+/// that no two samples partially overlap, and exactly coincident samples
+/// merged into one.  If occlusion_cull is true, all samples behind the
+/// first fully opaque one are also discarded.
+bool OIIO_API deep_tidy (ImageBuf &dst, const ImageBuf &src,
+                         bool occlusion_cull = false,
+                         ROI roi = ROI::All(), int nthreads = 0);
+
+/// Set dst to the tidy (see deep_tidy) union of the samples of deep
+/// images A and B, which must have the same channels.  If occlusion_cull
+/// is true, samples hidden behind opaque ones are discarded.
+bool OIIO_API deep_merge (ImageBuf &dst, const ImageBuf &A,
+                          const ImageBuf &B, bool occlusion_cull = true,
+                          ROI roi = ROI::All(), int nthreads = 0);
+
+/// Set dst to src with each sample attenuated by the transparency of
+/// the deep matte 'holdout' in front of it (that is, by the product of
+/// 1-alpha of the holdout samples nearer than the sample's Z, counting
+/// just the nearer fraction of holdout volumes that straddle it).
+/// Samples that are completely hidden are removed.
+bool OIIO_API deep_holdout (ImageBuf &dst, const ImageBuf &src,
+                            const ImageBuf &holdout,
+                            ROI roi = ROI::All(), int nthreads = 0);
+
+/// Set dst to the part of src lying within the depth range [zmin,zmax]:
+/// samples entirely outside are removed, and volumetric samples that
+/// straddle zmin or zmax are split there, keeping the inside piece.
+bool OIIO_API deep_trim (ImageBuf &dst, const ImageBuf &src,
+                         float zmin, float zmax,
+                         ROI roi = ROI::All(), int nthreads = 0);
+
+
 /// Reset dst to be the specified region of src.
 ///
 /// The nthreads parameter specifies how many threads (potentially) may
@@ -1068,6 +1126,7 @@ struct OIIO_API PixelStats {
     std::vector<imagesize_t> infcount;
     std::vector<imagesize_t> finitecount;
     std::vector<double> sum, sum2;  // for intermediate calculation
+    std::vector<imagesize_t> histogram;  // nchannels * bins, see below
 };
 
 
@@ -1084,6 +1143,20 @@ struct OIIO_API PixelStats {
 bool OIIO_API computePixelStats (PixelStats &stats, const ImageBuf &src,
                                  ROI roi=ROI::All(), int nthreads=0);
 
+/// Compute statistics about the ROI of the specified image, and in the
+/// same pass over the pixels, a histogram of each channel with the given
+/// number of bins evenly spanning [min,max].  The histogram counts are
+/// stored in stats.histogram, channel by channel: the count of bin b of
+/// channel c is stats.histogram[c*bins+b].  Values outside [min,max] (and
+/// NaNs) are not counted in any bin.  If bins == 0, no histogram is
+/// computed and this is equivalent to the version above.
+///
+/// Return true on success, false on error (with an appropriate error
+/// message set in src).
+bool OIIO_API computePixelStats (PixelStats &stats, const ImageBuf &src,
+                                 int bins, float min=0, float max=1,
+                                 ROI roi=ROI::All(), int nthreads=0);
+
 
 /// Struct holding all the results computed by ImageBufAlgo::compare().
 /// (maxx,maxy,maxz,maxc) gives the pixel coordintes (x,y,z) and color
@@ -1141,6 +1214,57 @@ int OIIO_API compare_Yee (const ImageBuf &A, const ImageBuf &B,
                           float luminance = 100, float fov = 45,
                           ROI roi = ROI::All(), int nthreads = 0);
 
+/// The part of a compare_Yee comparison that depends on only one of the
+/// images: its color opponent channels and its blurred luminance
+/// pyramid, computed over a given ROI (if undefined, the data window of
+/// img) at a given ambient luminance.  When one reference image is
+/// compared against many others, build its YeePyramid once and pass it
+/// to the compare_Yee variants below instead of rebuilding it every
+/// time.  A YeePyramid holds no reference to the image it came from.
+class OIIO_API YeePyramid {
+public:
+    /// Construct an empty pyramid; call reset() before using it.
+    YeePyramid ();
+    /// Construct the pyramid for img.
+    explicit YeePyramid (const ImageBuf &img, float luminance = 100,
+                         ROI roi = ROI::All(), int nthreads = 0);
+    ~YeePyramid ();
+
+    /// (Re)build the pyramid for img.  Return true on success, false
+    /// if img has no pixels in the ROI.
+    bool reset (const ImageBuf &img, float luminance = 100,
+                ROI roi = ROI::All(), int nthreads = 0);
+
+    /// Has the pyramid been built?
+    bool initialized () const;
+    /// The region (of the image it was built from) that it covers.
+    const ROI &roi () const;
+    /// The ambient luminance it was built for.
+    float luminance () const;
+
+    struct Impl;
+    const Impl *impl () const { return m_impl; }
+private:
+    Impl *m_impl;
+    // Not copyable
+    YeePyramid (const YeePyramid &);
+    const YeePyramid& operator= (const YeePyramid &);
+};
+
+/// Compare the image from which pyramid A was built against image B,
+/// as compare_Yee(ImageBuf,ImageBuf,...) does, using the ROI and
+/// luminance that A was built with for both images.
+int OIIO_API compare_Yee (const YeePyramid &A, const ImageBuf &B,
+                          CompareResults &result, float fov = 45,
+                          int nthreads = 0);
+
+/// Compare the images from which pyramids A and B were built, which
+/// must cover same-sized regions and have been built for the same
+/// luminance.  Return -1 (and set no results) if they do not match.
+int OIIO_API compare_Yee (const YeePyramid &A, const YeePyramid &B,
+                          CompareResults &result, float fov = 45,
+                          int nthreads = 0);
+
 
 /// Do all pixels within the ROI have the same values for channels
 /// [roi.chbegin..roi.chend-1]?  If so, return true and store that color
@@ -1745,8 +1869,8 @@ bool OIIO_API render_text (ImageBuf &dst, int x, int y,
 /// ImageBufAlgo::histogram --------------------------------------------------
 /// Parameters:
 /// src         - Input image that contains the one channel to be histogramed.
-///               src must contain float pixel data and have at least 1 channel,
-///               but it can have more.
+///               src may be of any pixel data type and must have at least
+///               1 channel, but it can have more.
 /// channel     - Only this channel in src will be histogramed. It must satisfy
 ///               0 <= channel < src.nchannels().
 /// histogram   - Clear old content and store the histogram here.
@@ -1758,11 +1882,14 @@ bool OIIO_API render_text (ImageBuf &dst, int x, int y,
 /// roi         - Only pixels in this region of the image are histogramed. If
 ///               roi is not defined then the full size image will be
 ///               histogramed.
+/// nthreads    - Number of threads to use, with the usual conventions
+///               (0 means the global "threads" attribute).
 /// --------------------------------------------------------------------------
 bool OIIO_API histogram (const ImageBuf &src, int channel,
                          std::vector<imagesize_t> &histogram, int bins=256,
                          float min=0, float max=1, imagesize_t *submin=NULL,
-                         imagesize_t *supermax=NULL, ROI roi=ROI::All());
+                         imagesize_t *supermax=NULL, ROI roi=ROI::All(),
+                         int nthreads=0);
 
 
 
@@ -1780,7 +1907,7 @@ bool OIIO_API histogram_draw (ImageBuf &dst,
 
 enum OIIO_API MakeTextureMode {
     MakeTxTexture, MakeTxShadow, MakeTxEnvLatl,
-    MakeTxEnvLatlFromLightProbe,
+    MakeTxEnvLatlFromLightProbe, MakeTxEnvCube,
     _MakeTxLast
 };
 
@@ -1791,6 +1918,9 @@ enum OIIO_API MakeTextureMode {
 ///    MakeTxEnvLatl    Latitude-longitude environment map
 ///    MakeTxEnvLatlFromLightProbe   Latitude-longitude environment map
 ///                     constructed from a "light probe" image.
+///    MakeTxEnvCube    Cube face environment map, from an image whose six
+///                     square faces (px, nx, py, ny, pz, nz) are stacked
+///                     vertically, or arranged 3x2 (px py pz / nx ny nz).
 ///
 /// If the outstream pointer is not NULL, it should point to a stream
 /// (for example, &std::out, or a pointer to a local std::stringstream
@@ -1829,6 +1959,10 @@ enum OIIO_API MakeTextureMode {
 ///                           If nonzero, detect images that are entirely
 ///                             one color, and change them to be low
 ///                             resolution (default: 0).
+///    maketx:constant_tile_detect (int)
+///                           If nonzero, count the top level tiles that
+///                             are one color and record the number in
+///                             "oiio:ConstantTiles" (default: 0).
 ///    maketx:monochrome_detect (int)
 ///                           If nonzero, change RGB images which have 
 ///                              R==G==B everywhere to single-channel 
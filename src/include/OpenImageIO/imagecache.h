@@ -85,6 +85,11 @@ public:
     /// if the name and type were recognized and the attrib was set.
     /// Documented attributes:
     ///     int max_open_files : maximum number of file handles held open
+    ///     int max_open_files_soft : open files above which a background
+    ///                         thread starts closing the least recently
+    ///                         used files (default: 7/8 of max_open_files)
+    ///     int async_file_close : if nonzero, close files in the
+    ///                         background past the soft limit (default=1)
     ///     float max_memory_MB : maximum tile cache size, in MB
     ///     string searchpath : colon-separated search path for images
     ///     string plugin_searchpath : colon-separated search path for plugins
@@ -101,6 +106,13 @@ public:
     ///     string substitute_image : uses the named image in place of all
     ///                               texture and image references.
     ///     int unassociatedalpha : if nonzero, keep unassociated alpha images
+    ///     int detect_constant_tiles : if nonzero, store tiles whose pixels
+    ///                         are all the same as a single pixel (def=1)
+    ///     int deduplicate_tiles : if nonzero, tiles with identical pixels
+    ///                         (from any files) share memory (def=0)
+    ///     string spec_index : file holding a persistent index of image
+    ///                         headers, so that files need not be opened
+    ///                         just to learn their specs (default: "")
     ///
     virtual bool attribute (string_view name, TypeDesc type,
                             const void *val) = 0;
@@ -244,7 +256,9 @@ public:
     /// enough to accommodate the requested rectangle (taking into
     /// consideration its dimensions, number of channels, and data
     /// format).  Requested pixels outside the valid pixel data region
-    /// will be filled in with 0 values.
+    /// will be filled in with 0 values.  Large requests spanning several
+    /// rows of tiles may be split among up to as many threads as the
+    /// global OIIO "threads" attribute allows.
     ///
     /// Return true if the file is found and could be opened by an
     /// available ImageIO plugin, otherwise return false.
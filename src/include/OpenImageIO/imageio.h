@@ -58,6 +58,7 @@
 #include "oiioversion.h"
 #include "platform.h"
 #include "typedesc.h"   /* Needed for TypeDesc definition */
+#include "array_view.h"
 #include "paramlist.h"
 
 OIIO_NAMESPACE_ENTER
@@ -394,16 +395,30 @@ public:
 
 
 /// Structure to hold "deep" data -- multiple samples per pixel.
+///
+/// The samples of each channel are stored contiguously ("structure of
+/// arrays"): channel c's samples for all pixels live in one array within
+/// data (starting at channeloffset[c]), and a pixel's samples occupy
+/// sample slots [sampleoffset[p], sampleoffset[p]+capacity[p]) of every
+/// channel array.  After alloc() the pixels are packed in order, so
+/// sampleoffset is just the running sum of nsamples.  Growing a pixel past
+/// its capacity moves its samples to the end of an arena that is enlarged
+/// geometrically (and compacted) as needed, so adding samples to an
+/// already-allocated DeepData is amortized O(1) per sample.
 struct OIIO_API DeepData {
 public:
     int npixels, nchannels;
     std::vector<TypeDesc> channeltypes;  // for each channel [c]
-    std::vector<unsigned int> nsamples;// for each pixel [z][y][x]
-    std::vector<void *> pointers;    // for each channel per pixel [z][y][x][c]
-    std::vector<char> data;          // for each sample [z][y][x][c][s]
+    std::vector<unsigned int> nsamples;  // for each pixel [z][y][x]
+    std::vector<unsigned int> capacity;  // for each pixel [z][y][x]
+    std::vector<size_t> sampleoffset;    // for each pixel [z][y][x]
+    std::vector<size_t> channeloffset;   // for each channel [c]
+    std::vector<char> data;              // for each channel, sample [c][s]
+    size_t arena_samples;                // sample slots per channel array
+    size_t arena_used;                   // slots used (including holes)
 
     /// Construct an empty DeepData.
-    DeepData () : npixels(0), nchannels(0) { }
+    DeepData () : npixels(0), nchannels(0), arena_samples(0), arena_used(0) { }
 
     /// Construct and init from an ImageSpec.
     DeepData (const ImageSpec &spec) {init (spec); }
@@ -413,14 +428,14 @@ public:
     /// Deallocate all space in the vectors
     void free ();
 
-    /// Initialize size and allocate nsamples, pointers. It is important to
+    /// Initialize size and allocate nsamples. It is important to
     /// completely fill in nsamples after init() but before alling alloc().
     /// DEPRECATED
     void init (int npix, int nchan,
                const TypeDesc *chbegin, const TypeDesc *chend);
 
-    /// Initialize size and allocate nsamples, pointers based on the number
-    /// of pixels, channels, and channel types in the ImageSpec. It is
+    /// Initialize size and allocate nsamples based on the number of
+    /// pixels, channels, and channel types in the ImageSpec. It is
     /// important to completely fill in nsamples after init() but before
     /// alling alloc().
     void init (const ImageSpec &spec);
@@ -435,14 +450,30 @@ public:
     /// Retrieve the number of samples for the given pixel index.
     int samples (int pixel) const;
 
-    /// Set the number of samples for the given pixel. This must be called
-    /// after init(), but before alloc().
+    /// Set the number of samples for the given pixel.  If called after
+    /// alloc(), existing samples are preserved and any new ones are
+    /// zero.
     void set_samples (int pixel, int samps);
 
+    /// Set the number of samples for all pixels at once (samples.size()
+    /// must equal pixels()).
+    void set_all_samples (array_view<const unsigned int> samples);
+
+    /// Insert n new (zero-valued) samples into a pixel, before position
+    /// samplepos.  May be called before or after alloc().
+    void insert_samples (int pixel, int samplepos, int n=1);
+
+    /// Remove n samples from a pixel, starting at position samplepos.
+    /// May be called before or after alloc().
+    void erase_samples (int pixel, int samplepos, int n=1);
+
     /// After set_samples() has been set for all pixels, call alloc() to
-    /// allocate enough scratch space for data and set up all the pointers.
+    /// allocate enough space for data and lay out the samples.
     void alloc ();
 
+    /// Total number of samples in all pixels.
+    size_t total_samples () const;
+
     /// Retrieve deep sample value within a pixel, cast to a float.
     float deep_value (int pixel, int channel, int sample) const;
     /// Retrieve deep sample value within a pixel, as an untigned int.
@@ -456,10 +487,43 @@ public:
     void set_deep_value (int pixel, int channel, int sample, uint32_t value);
 
     /// Retrieve the pointer to the first sample of the given pixel and
-    /// channel. Return NULL if there are no samples for that pixel.
-    /// Use with care.
+    /// channel. Return NULL if there are no samples for that pixel.  The
+    /// samples of one channel of one pixel are contiguous.  Use with
+    /// care: the pointer is invalidated by anything that adds samples.
     void *channel_ptr (int pixel, int channel);
     const void *channel_ptr (int pixel, int channel) const;
+
+    /// Retrieve the pointer to one sample of the given pixel and
+    /// channel, or NULL if there is no such sample.
+    void *data_ptr (int pixel, int channel, int sample);
+    const void *data_ptr (int pixel, int channel, int sample) const;
+
+    /// Fill in a table of channel_ptr() values for every pixel and
+    /// channel, laid out [pixel][channel], for APIs (such as OpenEXR's
+    /// DeepFrameBuffer) that want one pointer per pixel per channel.
+    /// If pointers is already the right size it is not reallocated.
+    void get_pointers (std::vector<void*> &pointers) const;
+
+    /// Copy one sample from src (which must have the same number of
+    /// channels, but may have different channel types).  Return false
+    /// if either sample does not exist.
+    bool copy_deep_sample (int pixel, int sample,
+                           const DeepData &src, int srcpixel, int srcsample);
+
+    /// Replace all the samples of a pixel with those of a pixel of src
+    /// (which must have the same number of channels).  Return false if
+    /// the pixels do not exist or the channels do not match.
+    bool copy_deep_pixel (int pixel, const DeepData &src, int srcpixel);
+
+    /// Append all the samples of a pixel of src to a pixel of *this (which
+    /// must have the same number of channels).  Return false if the
+    /// pixels do not exist or the channels do not match.
+    bool merge_deep_pixels (int pixel, const DeepData &src, int srcpixel);
+
+private:
+    void grow_arena (size_t needed);
+    void relocate (int pixel, size_t newcapacity);
+    void zero_samples (int pixel, int begin, int end);
 };
 
 
@@ -110,7 +110,9 @@ public:
         MipModeNoMIP,        ///< Just use highest-res image, no MIP mapping
         MipModeOneLevel,     ///< Use just one mipmap level
         MipModeTrilinear,    ///< Use two MIPmap levels (trilinear)
-        MipModeAniso         ///< Use two MIPmap levels w/ anisotropic
+        MipModeAniso,        ///< Use two MIPmap levels w/ anisotropic
+        MipModeStochasticTrilinear, ///< One MIP level, chosen using rnd
+        MipModeStochasticAniso      ///< Aniso, but one level & probe (rnd)
     };
 
     /// Interp mode determines how we sample within a mipmap level
@@ -134,6 +136,7 @@ public:
         fill(0.0f), missingcolor(NULL),
         // dresultds(NULL), dresultdt(NULL),
         time(0.0f), // bias(0.0f), samples(1),
+        rnd(-1.0f),
         rwrap(WrapDefault), rblur(0.0f), rwidth(1.0f), // dresultdr(NULL),
         // actualchannels(0),
         envlayout(0)
@@ -159,6 +162,8 @@ public:
     float time;               ///< Time (for time-dependent texture lookups)
     float bias;               ///< Bias for shadows
     int   samples;            ///< Number of samples for shadows
+    float rnd;                ///< Random value in [0,1) for stochastic
+                              ///<   mip modes (<0 = use deterministic)
 
     // For 3D volume texture lookups only:
     Wrap rwrap;               ///< Wrap mode in the r direction
@@ -214,7 +219,9 @@ public:
         MipModeNoMIP,        ///< Just use highest-res image, no MIP mapping
         MipModeOneLevel,     ///< Use just one mipmap level
         MipModeTrilinear,    ///< Use two MIPmap levels (trilinear)
-        MipModeAniso         ///< Use two MIPmap levels w/ anisotropic
+        MipModeAniso,        ///< Use two MIPmap levels w/ anisotropic
+        MipModeStochasticTrilinear, ///< One MIP level, chosen using rnd
+        MipModeStochasticAniso      ///< Aniso, but one level & probe (rnd)
     };
 
     /// Interp mode determines how we sample within a mipmap level
@@ -253,6 +260,7 @@ public:
     VaryingRef<float> fill;           ///< Fill value for missing channels
     VaryingRef<float> missingcolor;   ///< Color for missing texture
     VaryingRef<int>   samples;        ///< Number of samples
+    VaryingRef<float> rnd;            ///< Random value for stochastic modes
 
     // For 3D volume texture lookups only:
     Wrap rwrap;                ///< Wrap mode in the r direction
@@ -336,6 +344,8 @@ public:
     ///     int deduplicate : if nonzero, detect duplicate textures (default=1)
     ///     int gray_to_rgb : make 1-channel images fill RGB lookups
     ///     string latlong_up : default "up" direction for latlong ("y")
+    ///     string trace_file : if not empty, record a trace of all 2D
+    ///                         texture lookups to this file
     ///
     virtual bool attribute (string_view name, TypeDesc type, const void *val) = 0;
     // Shortcuts for common types
@@ -387,6 +397,13 @@ public:
     /// pointer thread_info is thread-specific information returned by
     /// get_perthread_info().  Return NULL if something has gone
     /// horribly wrong.
+    ///
+    /// If the filename contains "<UDIM>", the handle refers to the whole
+    /// set of UDIM tiles matching the pattern (e.g., "skin.<UDIM>.tx"),
+    /// and 2D texture() lookups with it select tile 1001 + floor(s) +
+    /// 10*floor(t), filtering with the fractional (s,t) within that tile.
+    /// The tiles present are found once, lookups that fall on missing
+    /// tiles return the missing/fill color.
     virtual TextureHandle * get_texture_handle (ustring filename,
                                             Perthread *thread_info=NULL) = 0;
 
@@ -453,6 +470,37 @@ public:
                           int nchannels, float *result,
                           float *dresultds=NULL, float *dresultdt=NULL) = 0;
 
+    /// One 2D lookup, for texture_sorted().  The texture coordinates and
+    /// derivatives have the same meaning as for the single point
+    /// texture() call, and the results are stored in result[] (and
+    /// dresultds[]/dresultdt[], if not NULL), which each need room for
+    /// nchannels floats.  ok is set to the return value that the single
+    /// point texture() would have had.
+    struct TextureQuery {
+        TextureHandle *texture_handle;  ///< Texture to look up
+        TextureOpt *options;            ///< Options for this lookup
+        float s, t;                     ///< Texture coordinates
+        float dsdx, dtdx, dsdy, dtdy;   ///< Derivatives of s and t
+        float *result;                  ///< Where to put the result
+        float *dresultds, *dresultdt;   ///< Result derivatives (or NULL)
+        bool ok;                        ///< Set upon return
+    };
+
+    /// Perform many 2D texture lookups at once, which may be spread
+    /// across any number of textures and be in any order.  Rather than
+    /// being done in the order given, the lookups are grouped by
+    /// texture, subimage, MIP level, and tile, and each group is done
+    /// together while its tiles are in the per-thread micro-cache.
+    /// Results land wherever each query points, so the order in which
+    /// they are computed is invisible to the caller.  Sorting has a cost,
+    /// so this pays off for large, incoherent sets of lookups (such as
+    /// those from secondary rays), not for small coherent batches.
+    ///
+    /// Return true if every lookup succeeded (i.e., all the ok fields
+    /// are true).
+    virtual bool texture_sorted (Perthread *thread_info, int nchannels,
+                                 TextureQuery *queries, int nqueries) = 0;
+
     /// Retrieve a 3D texture lookup at a single point.
     ///
     /// Return true if the file is found and could be opened by an
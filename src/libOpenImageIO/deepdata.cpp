@@ -30,6 +30,7 @@
 
 #include <cstdio>
 #include <cstdlib>
+#include <cstring>
 
 #include <OpenEXR/half.h>
 
@@ -41,6 +42,16 @@ OIIO_NAMESPACE_ENTER
 {
 
 
+// Bytes used by n samples of a channel of type t, padded so that every
+// channel array starts suitably aligned for any type.
+inline size_t
+channel_array_bytes (TypeDesc t, size_t n)
+{
+    return round_to_multiple (t.size() * n, 8);
+}
+
+
+
 void
 DeepData::init (int npix, int nchan,
                 const TypeDesc *chbegin, const TypeDesc *chend)
@@ -50,7 +61,6 @@ DeepData::init (int npix, int nchan,
     nchannels = nchan;
     channeltypes.assign (chbegin, chend);
     nsamples.resize (npixels, 0);
-    pointers.resize (size_t(npixels)*size_t(nchannels), NULL);
 }
 
 
@@ -64,7 +74,6 @@ DeepData::init (const ImageSpec &spec)
     channeltypes.reserve (nchannels);
     spec.get_channelformats (channeltypes);
     nsamples.resize (npixels, 0);
-    pointers.resize (size_t(npixels)*size_t(nchannels), NULL);
 }
 
 
@@ -72,32 +81,104 @@ DeepData::init (const ImageSpec &spec)
 void
 DeepData::alloc ()
 {
-    // Calculate the total size we need, align each channel to 4 byte boundary
-    size_t totalsamples = 0, totalbytes = 0;
+    // Pack the pixels in order, so each pixel's first sample slot is the
+    // running total of the samples of the pixels before it.
+    capacity = nsamples;
+    sampleoffset.resize (npixels);
+    size_t totalsamples = 0;
     for (int i = 0;  i < npixels;  ++i) {
-        if (int s = nsamples[i]) {
-            totalsamples += s;
-            for (int c = 0;  c < nchannels;  ++c)
-                totalbytes += round_to_multiple (channeltype(c).size() * s, 4);
-        }
+        sampleoffset[i] = totalsamples;
+        totalsamples += nsamples[i];
     }
 
-    // Allocate a minimum of 4 bytes so that we can tell if alloc() was
-    // called by whether data.size() > 0.
-    totalbytes = std::max (totalbytes, size_t(4));
+    // Lay out one contiguous array per channel.  Allocate a minimum of 4
+    // bytes so that we can tell if alloc() was called by whether
+    // data.size() > 0.
+    channeloffset.resize (nchannels);
+    size_t totalbytes = 0;
+    for (int c = 0;  c < nchannels;  ++c) {
+        channeloffset[c] = totalbytes;
+        totalbytes += channel_array_bytes (channeltype(c), totalsamples);
+    }
+    std::vector<char>().swap (data);
+    data.resize (std::max (totalbytes, size_t(4)));
+    arena_samples = totalsamples;
+    arena_used = totalsamples;
+}
 
-    // Set all the data pointers to the right offsets within the
-    // data block.  Leave the pointes NULL for pixels with no samples.
-    data.resize (totalbytes);
-    char *p = &data[0];
+
+
+void
+DeepData::grow_arena (size_t needed)
+{
+    // Compact the live samples into a new, bigger arena, leaving room
+    // for at least 'needed' more (and growing geometrically, so that
+    // a long sequence of insertions is amortized O(1) each).
+    std::vector<size_t> newoffset (npixels);
+    size_t live = 0;
     for (int i = 0;  i < npixels;  ++i) {
-        if (int s = nsamples[i]) {
-            for (int c = 0;  c < nchannels;  ++c) {
-                pointers[i*nchannels+c] = p;
-                p += round_to_multiple (channeltype(c).size()*s, 4);
-            }
+        newoffset[i] = live;
+        live += nsamples[i];
+    }
+    size_t newsize = std::max (live + needed, size_t(16));
+    newsize += newsize / 2;
+    std::vector<size_t> newchanneloffset (nchannels);
+    size_t totalbytes = 0;
+    for (int c = 0;  c < nchannels;  ++c) {
+        newchanneloffset[c] = totalbytes;
+        totalbytes += channel_array_bytes (channeltype(c), newsize);
+    }
+    std::vector<char> newdata (std::max (totalbytes, size_t(4)));
+    for (int c = 0;  c < nchannels;  ++c) {
+        size_t size = channeltype(c).size();
+        const char *src = &data[channeloffset[c]];
+        char *dst = &newdata[newchanneloffset[c]];
+        for (int i = 0;  i < npixels;  ++i)
+            if (nsamples[i])
+                memcpy (dst + newoffset[i]*size, src + sampleoffset[i]*size,
+                        nsamples[i]*size);
+    }
+    data.swap (newdata);
+    channeloffset.swap (newchanneloffset);
+    sampleoffset.swap (newoffset);
+    capacity = nsamples;
+    arena_samples = newsize;
+    arena_used = live;
+}
+
+
+
+void
+DeepData::relocate (int pixel, size_t newcapacity)
+{
+    // Move the pixel's samples to fresh space at the end of the arena.
+    // The slots it leaves behind are reclaimed by the next grow_arena().
+    if (arena_used + newcapacity > arena_samples)
+        grow_arena (newcapacity);
+    size_t newoffset = arena_used;
+    arena_used += newcapacity;
+    if (size_t n = nsamples[pixel]) {
+        for (int c = 0;  c < nchannels;  ++c) {
+            size_t size = channeltype(c).size();
+            char *base = &data[channeloffset[c]];
+            memcpy (base + newoffset*size, base + sampleoffset[pixel]*size,
+                    n*size);
         }
     }
+    sampleoffset[pixel] = newoffset;
+    capacity[pixel] = (unsigned int) newcapacity;
+}
+
+
+
+void
+DeepData::zero_samples (int pixel, int begin, int end)
+{
+    for (int c = 0;  c < nchannels;  ++c) {
+        size_t size = channeltype(c).size();
+        char *base = &data[channeloffset[c] + sampleoffset[pixel]*size];
+        memset (base + begin*size, 0, (end-begin)*size);
+    }
 }
 
 
@@ -109,8 +190,12 @@ DeepData::clear ()
     nchannels = 0;
     channeltypes.clear();
     nsamples.clear();
-    pointers.clear();
+    capacity.clear();
+    sampleoffset.clear();
+    channeloffset.clear();
     data.clear();
+    arena_samples = 0;
+    arena_used = 0;
 }
 
 
@@ -120,7 +205,9 @@ DeepData::free ()
 {
     clear ();
     std::vector<unsigned int>().swap (nsamples);
-    std::vector<void *>().swap (pointers);
+    std::vector<unsigned int>().swap (capacity);
+    std::vector<size_t>().swap (sampleoffset);
+    std::vector<size_t>().swap (channeloffset);
     std::vector<char>().swap (data);
 }
 
@@ -140,8 +227,82 @@ void
 DeepData::set_samples (int pixel, int samps)
 {
     ASSERT (pixel >= 0 && pixel < npixels && "invalid pixel index");
-    ASSERT (data.size() == 0 && "set_samples may not be called after alloc()");
+    ASSERT (samps >= 0);
+    if (data.size() == 0) {
+        // Not yet allocated -- just record the count
+        nsamples[pixel] = samps;
+        return;
+    }
+    int oldsamps = nsamples[pixel];
+    if (samps > (int)capacity[pixel])
+        relocate (pixel, std::max (size_t(samps), 2*size_t(capacity[pixel])));
     nsamples[pixel] = samps;
+    if (samps > oldsamps)
+        zero_samples (pixel, oldsamps, samps);
+}
+
+
+
+void
+DeepData::set_all_samples (array_view<const unsigned int> samples)
+{
+    ASSERT (samples.size() == size_t(npixels));
+    if (data.size() == 0)
+        nsamples.assign (samples.data(), samples.data() + samples.size());
+    else
+        for (int i = 0;  i < npixels;  ++i)
+            set_samples (i, (int) samples[i]);
+}
+
+
+
+void
+DeepData::insert_samples (int pixel, int samplepos, int n)
+{
+    ASSERT (pixel >= 0 && pixel < npixels && "invalid pixel index");
+    int oldsamps = nsamples[pixel];
+    ASSERT (samplepos >= 0 && samplepos <= oldsamps && n >= 0);
+    set_samples (pixel, oldsamps + n);
+    if (data.size() == 0 || samplepos == oldsamps)
+        return;   // nothing allocated, or the new ones went on the end
+    for (int c = 0;  c < nchannels;  ++c) {
+        size_t size = channeltype(c).size();
+        char *base = &data[channeloffset[c] + sampleoffset[pixel]*size];
+        memmove (base + (samplepos+n)*size, base + samplepos*size,
+                 (oldsamps-samplepos)*size);
+        memset (base + samplepos*size, 0, n*size);
+    }
+}
+
+
+
+void
+DeepData::erase_samples (int pixel, int samplepos, int n)
+{
+    ASSERT (pixel >= 0 && pixel < npixels && "invalid pixel index");
+    int oldsamps = nsamples[pixel];
+    ASSERT (samplepos >= 0 && samplepos <= oldsamps && n >= 0);
+    n = std::min (n, oldsamps - samplepos);
+    if (data.size()) {
+        for (int c = 0;  c < nchannels;  ++c) {
+            size_t size = channeltype(c).size();
+            char *base = &data[channeloffset[c] + sampleoffset[pixel]*size];
+            memmove (base + samplepos*size, base + (samplepos+n)*size,
+                     (oldsamps-samplepos-n)*size);
+        }
+    }
+    nsamples[pixel] = oldsamps - n;
+}
+
+
+
+size_t
+DeepData::total_samples () const
+{
+    size_t total = 0;
+    for (int i = 0;  i < npixels;  ++i)
+        total += nsamples[i];
+    return total;
 }
 
 
@@ -149,9 +310,11 @@ DeepData::set_samples (int pixel, int samps)
 void *
 DeepData::channel_ptr (int pixel, int channel)
 {
-    if (pixel < 0 || pixel >= npixels || channel < 0 || channel >= nchannels)
+    if (pixel < 0 || pixel >= npixels || channel < 0 || channel >= nchannels
+        || data.size() == 0 || nsamples[pixel] == 0)
         return NULL;
-    return pointers[pixel*nchannels + channel];
+    return &data[channeloffset[channel] +
+                 sampleoffset[pixel] * channeltype(channel).size()];
 }
 
 
@@ -159,9 +322,110 @@ DeepData::channel_ptr (int pixel, int channel)
 const void *
 DeepData::channel_ptr (int pixel, int channel) const
 {
-    if (pixel < 0 || pixel >= npixels || channel < 0 || channel >= nchannels)
+    return const_cast<DeepData *>(this)->channel_ptr (pixel, channel);
+}
+
+
+
+void *
+DeepData::data_ptr (int pixel, int channel, int sample)
+{
+    char *ptr = (char *) channel_ptr (pixel, channel);
+    if (! ptr || sample < 0 || sample >= (int)nsamples[pixel])
         return NULL;
-    return pointers[pixel*nchannels + channel];
+    return ptr + sample * channeltype(channel).size();
+}
+
+
+
+const void *
+DeepData::data_ptr (int pixel, int channel, int sample) const
+{
+    return const_cast<DeepData *>(this)->data_ptr (pixel, channel, sample);
+}
+
+
+
+void
+DeepData::get_pointers (std::vector<void*> &pointers) const
+{
+    pointers.resize (size_t(npixels) * size_t(nchannels));
+    for (int i = 0;  i < npixels;  ++i)
+        for (int c = 0;  c < nchannels;  ++c)
+            pointers[size_t(i)*nchannels+c] = (void *) channel_ptr (i, c);
+}
+
+
+
+bool
+DeepData::copy_deep_sample (int pixel, int sample,
+                            const DeepData &src, int srcpixel, int srcsample)
+{
+    if (nchannels != src.nchannels)
+        return false;
+    if (data.size() == 0)
+        alloc ();
+    if (sample < 0 || sample >= samples(pixel) ||
+        srcsample < 0 || srcsample >= src.samples(srcpixel))
+        return false;
+    for (int c = 0;  c < nchannels;  ++c) {
+        if (channeltype(c) == src.channeltype(c))
+            memcpy (data_ptr (pixel, c, sample),
+                    src.data_ptr (srcpixel, c, srcsample),
+                    channeltype(c).size());
+        else if (channeltype(c).basetype == TypeDesc::UINT)
+            set_deep_value (pixel, c, sample,
+                            src.deep_value_uint (srcpixel, c, srcsample));
+        else
+            set_deep_value (pixel, c, sample,
+                            src.deep_value (srcpixel, c, srcsample));
+    }
+    return true;
+}
+
+
+
+bool
+DeepData::merge_deep_pixels (int pixel, const DeepData &src, int srcpixel)
+{
+    if (pixel < 0 || pixel >= npixels || srcpixel < 0 ||
+        srcpixel >= src.npixels || nchannels != src.nchannels)
+        return false;
+    int srcsamps = src.samples (srcpixel);
+    if (srcsamps == 0)
+        return true;
+    if (data.size() == 0)
+        alloc ();
+    int oldsamps = samples (pixel);
+    set_samples (pixel, oldsamps + srcsamps);
+    // N.B. Only fetch pointers after set_samples(), which may move
+    // things (even within src, if it is *this).
+    if (channeltypes == src.channeltypes) {
+        for (int c = 0;  c < nchannels;  ++c)
+            memcpy (data_ptr (pixel, c, oldsamps),
+                    src.channel_ptr (srcpixel, c),
+                    srcsamps * channeltype(c).size());
+    } else {
+        for (int s = 0;  s < srcsamps;  ++s)
+            copy_deep_sample (pixel, oldsamps+s, src, srcpixel, s);
+    }
+    return true;
+}
+
+
+
+bool
+DeepData::copy_deep_pixel (int pixel, const DeepData &src, int srcpixel)
+{
+    if (pixel < 0 || pixel >= npixels || srcpixel < 0 ||
+        srcpixel >= src.npixels || nchannels != src.nchannels)
+        return false;
+    if (&src == this && pixel == srcpixel)
+        return true;
+    if (data.size() == 0)
+        alloc ();
+    set_samples (pixel, 0);
+    return merge_deep_pixels (pixel, src, srcpixel);
 }
 
 
@@ -174,7 +438,7 @@ DeepData::deep_value (int pixel, int channel, int sample) const
     int nsamps = nsamples[pixel];
     if (nsamps == 0 || sample < 0 || sample >= nsamps)
         return 0.0f;
-    const void *ptr = pointers[pixel*nchannels + channel];
+    const void *ptr = channel_ptr (pixel, channel);
     if (! ptr)
         return 0.0f;
     switch (channeltype(channel).basetype) {
@@ -214,7 +478,7 @@ DeepData::deep_value_uint (int pixel, int channel, int sample) const
     int nsamps = nsamples[pixel];
     if (nsamps == 0 || sample < 0 || sample >= nsamps)
         return 0.0f;
-    const void *ptr = pointers[pixel*nchannels + channel];
+    const void *ptr = channel_ptr (pixel, channel);
     if (! ptr)
         return 0.0f;
     switch (channeltype(channel).basetype) {
@@ -256,7 +520,7 @@ DeepData::set_deep_value (int pixel, int channel, int sample, float value)
         return;
     if (! data.size())
         alloc();
-    void *ptr = pointers[pixel*nchannels + channel];
+    void *ptr = channel_ptr (pixel, channel);
     if (! ptr)
         return;
     switch (channeltype(channel).basetype) {
@@ -297,7 +561,7 @@ DeepData::set_deep_value (int pixel, int channel, int sample, uint32_t value)
         return;
     if (! data.size())
         alloc();
-    void *ptr = pointers[pixel*nchannels + channel];
+    void *ptr = channel_ptr (pixel, channel);
     if (! ptr)
         return;
     switch (channeltype(channel).basetype) {
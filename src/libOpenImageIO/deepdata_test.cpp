@@ -0,0 +1,213 @@
+/*
+  Copyright 2015 Larry Gritz and the other authors and contributors.
+  All Rights Reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are
+  met:
+  * Redistributions of source code must retain the above copyright
+  notice, this list of conditions and the following disclaimer.
+  * Redistributions in binary form must reproduce the above copyright
+  notice, this list of conditions and the following disclaimer in the
+  documentation and/or other materials provided with the distribution.
+  * Neither the name of the software's owners nor the names of its
+  contributors may be used to endorse or promote products derived from
+  this software without specific prior written permission.
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+  (This is the Modified BSD License)
+*/
+
+
+#include <iostream>
+
+#include "OpenImageIO/imageio.h"
+#include "OpenImageIO/timer.h"
+#include "OpenImageIO/strutil.h"
+#include "OpenImageIO/unittest.h"
+
+OIIO_NAMESPACE_USING;
+
+
+
+// A small deep image: 4 pixels, channels R (half), A (float), Z (float),
+// id (uint).
+static void
+make_dd (DeepData &dd, int npixels=4)
+{
+    ImageSpec spec (npixels, 1, 4, TypeDesc::FLOAT);
+    spec.channelnames[0] = "R";  spec.channelnames[1] = "A";
+    spec.channelnames[2] = "Z";  spec.channelnames[3] = "id";
+    spec.channelformats.resize (4, TypeDesc::FLOAT);
+    spec.channelformats[0] = TypeDesc::HALF;
+    spec.channelformats[3] = TypeDesc::UINT;
+    spec.deep = true;
+    dd.init (spec);
+}
+
+
+
+static void
+test_alloc_and_values ()
+{
+    DeepData dd;
+    make_dd (dd);
+    unsigned int counts[] = { 2, 0, 3, 1 };
+    dd.set_all_samples (counts);
+    dd.alloc ();
+    OIIO_CHECK_EQUAL (dd.total_samples(), 6);
+    OIIO_CHECK_EQUAL (dd.samples(2), 3);
+    OIIO_CHECK_ASSERT (dd.channel_ptr (1, 0) == NULL);
+    for (int p = 0;  p < dd.pixels();  ++p)
+        for (int s = 0;  s < dd.samples(p);  ++s) {
+            dd.set_deep_value (p, 0, s, 0.5f*s);
+            dd.set_deep_value (p, 2, s, float(10*p+s));
+            dd.set_deep_value (p, 3, s, uint32_t(100*p+s));
+        }
+    OIIO_CHECK_EQUAL (dd.deep_value (2, 2, 1), 21.0f);
+    OIIO_CHECK_EQUAL (dd.deep_value (2, 0, 2), 1.0f);
+    OIIO_CHECK_EQUAL (dd.deep_value_uint (3, 3, 0), 300);
+    // Samples of a channel of a pixel are contiguous
+    const float *z = (const float *) dd.channel_ptr (2, 2);
+    OIIO_CHECK_EQUAL (z[2], 22.0f);
+    OIIO_CHECK_ASSERT (dd.data_ptr (2, 2, 2) == (const void *)&z[2]);
+    OIIO_CHECK_ASSERT (dd.data_ptr (2, 2, 3) == NULL);
+
+    // Copies don't share storage with the original
+    DeepData copy (dd);
+    dd.set_deep_value (2, 2, 0, 99.0f);
+    OIIO_CHECK_EQUAL (copy.deep_value (2, 2, 0), 20.0f);
+}
+
+
+
+static void
+test_insert_erase ()
+{
+    DeepData dd;
+    make_dd (dd);
+    dd.alloc ();
+    // Grow pixel 1 one sample at a time, inserting at the front, while
+    // interleaving growth of pixel 0 to force relocation and compaction.
+    for (int i = 0;  i < 100;  ++i) {
+        dd.insert_samples (1, 0);
+        dd.set_deep_value (1, 2, 0, float(i));
+        dd.insert_samples (0, dd.samples(0));
+        dd.set_deep_value (0, 3, dd.samples(0)-1, uint32_t(i));
+    }
+    OIIO_CHECK_EQUAL (dd.samples(1), 100);
+    OIIO_CHECK_EQUAL (dd.samples(0), 100);
+    OIIO_CHECK_EQUAL (dd.deep_value (1, 2, 0), 99.0f);
+    OIIO_CHECK_EQUAL (dd.deep_value (1, 2, 99), 0.0f);
+    OIIO_CHECK_EQUAL (dd.deep_value_uint (0, 3, 42), 42);
+    OIIO_CHECK_EQUAL (dd.deep_value (1, 0, 50), 0.0f);  // new ones are 0
+
+    dd.erase_samples (1, 10, 80);
+    OIIO_CHECK_EQUAL (dd.samples(1), 20);
+    OIIO_CHECK_EQUAL (dd.deep_value (1, 2, 9), 90.0f);
+    OIIO_CHECK_EQUAL (dd.deep_value (1, 2, 10), 9.0f);
+
+    // Shrinking then growing again must not resurrect old values
+    dd.set_samples (1, 5);
+    dd.set_samples (1, 8);
+    OIIO_CHECK_EQUAL (dd.deep_value (1, 2, 6), 0.0f);
+}
+
+
+
+static void
+test_copy_merge ()
+{
+    DeepData a, b;
+    make_dd (a);
+    make_dd (b);
+    unsigned int acounts[] = { 1, 2, 0, 0 };
+    unsigned int bcounts[] = { 3, 0, 0, 1 };
+    a.set_all_samples (acounts);
+    b.set_all_samples (bcounts);
+    for (int s = 0;  s < 3;  ++s)
+        b.set_deep_value (0, 2, s, float(s+1));
+    b.set_deep_value (3, 3, 0, uint32_t(7));
+    a.set_deep_value (0, 2, 0, 5.0f);
+
+    OIIO_CHECK_ASSERT (a.merge_deep_pixels (0, b, 0));
+    OIIO_CHECK_EQUAL (a.samples(0), 4);
+    OIIO_CHECK_EQUAL (a.deep_value (0, 2, 0), 5.0f);
+    OIIO_CHECK_EQUAL (a.deep_value (0, 2, 3), 3.0f);
+
+    OIIO_CHECK_ASSERT (a.copy_deep_pixel (1, b, 3));
+    OIIO_CHECK_EQUAL (a.samples(1), 1);
+    OIIO_CHECK_EQUAL (a.deep_value_uint (1, 3, 0), 7);
+
+    // Merging a pixel with itself doubles it
+    OIIO_CHECK_ASSERT (a.merge_deep_pixels (0, a, 0));
+    OIIO_CHECK_EQUAL (a.samples(0), 8);
+    OIIO_CHECK_EQUAL (a.deep_value (0, 2, 4), 5.0f);
+
+    OIIO_CHECK_ASSERT (a.copy_deep_sample (2, 0, b, 0, 0) == false); // no sample
+    a.set_samples (2, 1);
+    OIIO_CHECK_ASSERT (a.copy_deep_sample (2, 0, b, 0, 2));
+    OIIO_CHECK_EQUAL (a.deep_value (2, 2, 0), 3.0f);
+}
+
+
+
+// Build a sparse deep frame one sample at a time (as a renderer or a
+// deep compositing op would), then read every value back.
+static void
+benchmark (int res, int nchans)
+{
+    ImageSpec spec (res, res, nchans, TypeDesc::HALF);
+    spec.deep = true;
+    DeepData dd (spec);
+    dd.alloc ();
+    Timer timer;
+    for (int p = 0;  p < dd.pixels();  ++p) {
+        int n = (p % 7 == 0) ? (p % 13) : 0;   // sparse, varying depth
+        for (int s = 0;  s < n;  ++s)
+            dd.insert_samples (p, dd.samples(p));
+    }
+    double inserttime = timer();
+    timer.reset ();
+    timer.start ();
+    float sum = 0.0f;
+    for (int p = 0;  p < dd.pixels();  ++p)
+        for (int c = 0;  c < nchans;  ++c)
+            for (int s = 0, n = dd.samples(p);  s < n;  ++s)
+                sum += dd.deep_value (p, c, s);
+    double readtime = timer();
+    size_t bytes = dd.nsamples.capacity()*sizeof(unsigned int)
+                 + dd.capacity.capacity()*sizeof(unsigned int)
+                 + dd.sampleoffset.capacity()*sizeof(size_t)
+                 + dd.data.capacity();
+    std::cout << "  " << res << "x" << res << " x " << nchans << " chans, "
+              << dd.total_samples() << " samples: "
+              << Strutil::memformat (bytes) << ", insert "
+              << Strutil::timeintervalformat (inserttime, 3) << ", read "
+              << Strutil::timeintervalformat (readtime, 3) << "\n";
+    OIIO_CHECK_EQUAL (sum, 0.0f);
+}
+
+
+
+int
+main (int argc, char *argv[])
+{
+    test_alloc_and_values ();
+    test_insert_erase ();
+    test_copy_merge ();
+    std::cout << "Deep data benchmark:\n";
+    benchmark (512, 20);
+
+    return unit_test_failures;
+}
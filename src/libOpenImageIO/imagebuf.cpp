@@ -47,6 +47,7 @@
 #include "OpenImageIO/imagecache.h"
 #include "OpenImageIO/dassert.h"
 #include "OpenImageIO/strutil.h"
+#include "OpenImageIO/filesystem.h"
 #include "OpenImageIO/fmath.h"
 #include "OpenImageIO/thread.h"
 #include "OpenImageIO/simd.h"
@@ -135,6 +136,275 @@ roi_intersection (const ROI &A, const ROI &B)
 
 
 
+// ScratchTilePool holds the pixels of an ImageBuf with SCRATCHFILE
+// storage.  The image is divided into tiles laid out exactly like
+// ImageCache tiles (so the iterator retiling logic is shared), only a
+// bounded number of which are resident in memory at any time.  The rest
+// are written back to an unnamed scratch file and re-read on demand.
+// Tiles that have never been paged out have no file space and are
+// implicitly black.  The pool remembers its own tile layout, which is
+// fixed for its lifetime no matter what later happens to the ImageBuf's
+// spec.  All methods are thread-safe.
+class ScratchTilePool {
+public:
+    struct Slot {
+        int tile;          // Index of the tile held in this slot, or -1
+        int pins;          // Number of iterators currently using the slot
+        bool dirty;        // Modified since it was last read from disk?
+        bool referenced;   // Recently used (for clock replacement)
+        boost::scoped_array<char> pixels;
+    };
+
+    ScratchTilePool (const ImageSpec &spec, imagesize_t maxmem);
+    ~ScratchTilePool ();
+
+    // Pin the tile with the given index into memory and return its slot,
+    // or NULL (with an error message in err) if it could not be read.  If
+    // writeable is true, the tile will be written back when evicted.
+    Slot *pin (int tile, bool writeable, std::string &err);
+
+    // Release a slot returned by pin().
+    void unpin (Slot *slot);
+
+    // Copy every tile of src, which must have the same layout.
+    bool copy_from (const ScratchTilePool &src, std::string &err);
+
+    int ntiles () const { return (int) m_tileslot.size(); }
+    size_t tile_bytes () const { return m_tile_bytes; }
+    int tile_width () const { return m_tile_width; }
+    int tile_height () const { return m_tile_height; }
+    int tile_depth () const { return m_tile_depth; }
+
+    // Index of the tile with the given tile coordinates.
+    int tile_index (int xtile, int ytile, int ztile) const {
+        return (ztile * m_nytiles + ytile) * m_nxtiles + xtile;
+    }
+
+private:
+    mutable mutex m_mutex;
+    int m_tile_width, m_tile_height, m_tile_depth; // Tile layout
+    int m_nxtiles, m_nytiles;     // Number of tiles across and down
+    size_t m_tile_bytes;          // Bytes per tile
+    size_t m_maxslots;            // Resident tile budget
+    size_t m_clock;               // Clock hand for eviction
+    std::vector<Slot *> m_slots;  // Resident tiles
+    std::vector<int> m_tileslot;  // For each tile, its slot or -1
+    std::vector<bool> m_ondisk;   // For each tile, is it in the file?
+    std::string m_filename;       // Scratch file name
+    FILE *m_file;                 // Scratch file (opened lazily)
+
+    int find_slot (std::string &err);
+    bool read_tile (Slot *slot, std::string &err);
+    bool write_tile (Slot *slot, std::string &err);
+    bool seek (int tile);
+};
+
+
+
+ScratchTilePool::ScratchTilePool (const ImageSpec &spec, imagesize_t maxmem)
+    : m_tile_width(spec.tile_width), m_tile_height(spec.tile_height),
+      m_tile_depth(spec.tile_depth), m_tile_bytes(spec.tile_bytes()),
+      m_clock(0), m_file(NULL)
+{
+    DASSERT (spec.tile_width > 0 && spec.tile_height > 0 && spec.tile_depth > 0);
+    m_nxtiles = (spec.width  + m_tile_width  - 1) / m_tile_width;
+    m_nytiles = (spec.height + m_tile_height - 1) / m_tile_height;
+    int nz = (spec.depth  + m_tile_depth  - 1) / m_tile_depth;
+    m_tileslot.resize (size_t(m_nxtiles) * size_t(m_nytiles) * size_t(nz), -1);
+    m_ondisk.resize (m_tileslot.size(), false);
+    m_maxslots = std::max (size_t(1), size_t(maxmem / m_tile_bytes));
+}
+
+
+
+ScratchTilePool::~ScratchTilePool ()
+{
+    for (size_t i = 0;  i < m_slots.size();  ++i)
+        delete m_slots[i];
+    if (m_file) {
+        fclose (m_file);
+#ifdef _WIN32
+        std::string err;
+        Filesystem::remove (m_filename, err);
+#endif
+    }
+}
+
+
+
+bool
+ScratchTilePool::seek (int tile)
+{
+    imagesize_t offset = imagesize_t(tile) * m_tile_bytes;
+#ifdef _WIN32
+    return _fseeki64 (m_file, (__int64)offset, SEEK_SET) == 0;
+#else
+    return fseeko (m_file, (off_t)offset, SEEK_SET) == 0;
+#endif
+}
+
+
+
+bool
+ScratchTilePool::read_tile (Slot *slot, std::string &err)
+{
+    if (! m_ondisk[slot->tile]) {
+        // Never paged out, so it's still black
+        memset (&slot->pixels[0], 0, m_tile_bytes);
+        return true;
+    }
+    if (! seek (slot->tile) ||
+        fread (&slot->pixels[0], 1, m_tile_bytes, m_file) != m_tile_bytes) {
+        err = Strutil::format ("Could not read tile from scratch file \"%s\"",
+                               m_filename);
+        return false;
+    }
+    return true;
+}
+
+
+
+bool
+ScratchTilePool::write_tile (Slot *slot, std::string &err)
+{
+    if (! m_file) {
+        std::string dir;
+        ustring scratchdir;
+        if (getattribute ("scratch_directory", TypeDesc::TypeString, &scratchdir))
+            dir = scratchdir.string();
+        if (dir.empty())
+            dir = Filesystem::temp_directory_path();
+        m_filename = dir + "/" + Filesystem::unique_path ("oiio-scratch-%%%%-%%%%-%%%%-%%%%.tmp");
+        m_file = Filesystem::fopen (m_filename, "w+b");
+        if (! m_file) {
+            err = Strutil::format ("Could not create scratch file \"%s\"",
+                                   m_filename);
+            return false;
+        }
+#ifndef _WIN32
+        // Unlink it right away so it's cleaned up however we exit.
+        std::string e;
+        Filesystem::remove (m_filename, e);
+#endif
+    }
+    if (! seek (slot->tile) ||
+        fwrite (&slot->pixels[0], 1, m_tile_bytes, m_file) != m_tile_bytes) {
+        err = Strutil::format ("Could not write tile to scratch file \"%s\"",
+                               m_filename);
+        return false;
+    }
+    m_ondisk[slot->tile] = true;
+    slot->dirty = false;
+    return true;
+}
+
+
+
+int
+ScratchTilePool::find_slot (std::string &err)
+{
+    // Use a second-chance clock sweep over the resident tiles, as long as
+    // we're at the memory budget.  If every resident tile is pinned,
+    // exceed the budget rather than fail.
+    if (m_slots.size() >= m_maxslots) {
+        for (size_t i = 0, n = 2*m_slots.size();  i < n;  ++i) {
+            int s = (int) m_clock;
+            Slot *slot = m_slots[s];
+            m_clock = (m_clock + 1) % m_slots.size();
+            if (slot->pins)
+                continue;
+            if (slot->tile < 0)
+                return s;
+            if (slot->referenced) {
+                slot->referenced = false;
+                continue;
+            }
+            if (slot->dirty && ! write_tile (slot, err))
+                return -1;
+            m_tileslot[slot->tile] = -1;
+            slot->tile = -1;
+            return s;
+        }
+    }
+    Slot *slot = new Slot;
+    slot->tile = -1;
+    slot->pins = 0;
+    slot->dirty = false;
+    slot->referenced = false;
+    slot->pixels.reset (new char [m_tile_bytes]);
+    m_slots.push_back (slot);
+    return (int) m_slots.size() - 1;
+}
+
+
+
+ScratchTilePool::Slot *
+ScratchTilePool::pin (int tile, bool writeable, std::string &err)
+{
+    DASSERT (tile >= 0 && tile < ntiles());
+    lock_guard lock (m_mutex);
+    int s = m_tileslot[tile];
+    if (s < 0) {
+        s = find_slot (err);
+        if (s < 0)
+            return NULL;
+        Slot *slot = m_slots[s];
+        slot->tile = tile;
+        if (! read_tile (slot, err)) {
+            slot->tile = -1;
+            return NULL;
+        }
+        slot->dirty = false;
+        m_tileslot[tile] = s;
+    }
+    Slot *slot = m_slots[s];
+    ++slot->pins;
+    slot->referenced = true;
+    slot->dirty |= writeable;
+    return slot;
+}
+
+
+
+void
+ScratchTilePool::unpin (Slot *slot)
+{
+    lock_guard lock (m_mutex);
+    DASSERT (slot->pins > 0);
+    --slot->pins;
+}
+
+
+
+bool
+ScratchTilePool::copy_from (const ScratchTilePool &src, std::string &err)
+{
+    ASSERT (src.ntiles() == ntiles() && src.tile_bytes() == tile_bytes());
+    ScratchTilePool &s (const_cast<ScratchTilePool &>(src));
+    for (int t = 0, n = ntiles();  t < n;  ++t) {
+        {
+            // Skip tiles that were never touched -- they're black
+            lock_guard lock (s.m_mutex);
+            if (s.m_tileslot[t] < 0 && ! s.m_ondisk[t])
+                continue;
+        }
+        Slot *from = s.pin (t, false, err);
+        if (! from)
+            return false;
+        Slot *to = pin (t, true, err);
+        if (to) {
+            memcpy (&to->pixels[0], &from->pixels[0], m_tile_bytes);
+            unpin (to);
+        }
+        s.unpin (from);
+        if (! to)
+            return false;
+    }
+    return true;
+}
+
+
+
 
 // Expansion of the opaque type that hides all the ImageBuf implementation
 // detail.
@@ -150,8 +420,10 @@ public:
     void reset (string_view name, int subimage, int miplevel,
                 ImageCache *imagecache, const ImageSpec *config);
     void reset (string_view name, const ImageSpec &spec);
-    void alloc (const ImageSpec &spec);
+    void alloc (const ImageSpec &spec,
+                ImageBuf::IBStorage storage=ImageBuf::LOCALBUFFER);
     void realloc ();
+    void alloc_scratch ();
     bool init_spec (string_view filename, int subimage, int miplevel);
     bool read (int subimage=0, int miplevel=0, bool force=false,
                TypeDesc convert=TypeDesc::UNKNOWN,
@@ -171,7 +443,7 @@ public:
 
     TypeDesc pixeltype () const {
         validate_spec ();
-        return m_localpixels ? m_spec.format : m_cachedpixeltype;
+        return (m_localpixels || m_scratch) ? m_spec.format : m_cachedpixeltype;
     }
 
     DeepData *deepdata () {
@@ -192,7 +464,9 @@ public:
 
     const void *retile (int x, int y, int z, ImageCache::Tile* &tile,
                     int &tilexbegin, int &tileybegin, int &tilezbegin,
-                    int &tilexend, bool exists, ImageBuf::WrapMode wrap) const;
+                    int &tilexend, bool exists, ImageBuf::WrapMode wrap,
+                    bool writeable) const;
+    void release_tile (ImageCache::Tile *tile) const;
 
     bool do_wrap (int &x, int &y, int &z, ImageBuf::WrapMode wrap) const;
 
@@ -270,6 +544,7 @@ private:
     ImageCache *m_imagecache;    ///< ImageCache to use
     TypeDesc m_cachedpixeltype;  ///< Data type stored in the cache
     DeepData m_deepdata;         ///< Deep data
+    boost::scoped_ptr<ScratchTilePool> m_scratch; ///< Paged tiles, if any
     size_t m_allocated_size;     ///< How much memory we've allocated
     std::vector<char> m_blackpixel; ///< Pixel-sized zero bytes
     TypeDesc m_write_format;     /// Format to use for write()
@@ -359,6 +634,13 @@ ImageBufImpl::ImageBufImpl (const ImageBufImpl &src)
     m_pixels_valid = src.m_pixels_valid;
     m_allocated_size = src.m_localpixels ? src.spec().image_bytes() : 0;
     IB_local_mem_current += m_allocated_size;
+    if (src.m_scratch) {
+        // Source was paged to a scratch file -- make our own
+        alloc_scratch ();
+        std::string err;
+        if (! m_scratch->copy_from (*src.m_scratch, err))
+            error ("%s", err);
+    }
     if (src.m_localpixels) {
         // Source had the image fully in memory (no cache)
         if (m_storage == ImageBuf::APPBUFFER) {
@@ -531,6 +813,7 @@ ImageBufImpl::clear ()
     m_plane_bytes = 0;
     m_imagecache = NULL;
     m_deepdata.free ();
+    m_scratch.reset ();
     m_blackpixel.clear ();
     m_write_format = TypeDesc::UNKNOWN;
     m_write_tile_width = 0;
@@ -618,6 +901,21 @@ ImageBuf::reset (const ImageSpec &spec)
 
 
 
+void
+ImageBuf::reset (string_view filename, const ImageSpec &spec,
+                 IBStorage storage)
+{
+    ASSERT (storage == LOCALBUFFER || storage == SCRATCHFILE);
+    ImageBufImpl *impl = this->impl();
+    impl->clear ();
+    impl->m_name = ustring (filename);
+    impl->m_current_subimage = 0;
+    impl->m_current_miplevel = 0;
+    impl->alloc (spec, storage);
+}
+
+
+
 void
 ImageBufImpl::realloc ()
 {
@@ -626,6 +924,7 @@ ImageBufImpl::realloc ()
     IB_local_mem_current += m_allocated_size;
     m_pixels.reset (m_allocated_size ? new char [m_allocated_size] : NULL);
     m_localpixels = m_pixels.get();
+    m_scratch.reset ();
     m_storage = m_allocated_size ? ImageBuf::LOCALBUFFER : ImageBuf::UNINITIALIZED;
     m_pixel_bytes = m_spec.pixel_bytes();
     m_scanline_bytes = m_spec.scanline_bytes();
@@ -646,7 +945,31 @@ ImageBufImpl::realloc ()
 
 
 void
-ImageBufImpl::alloc (const ImageSpec &spec)
+ImageBufImpl::alloc_scratch ()
+{
+    // The tiles are laid out just like ImageCache tiles, so the spec's
+    // tile size is what retile() will use to find pixels within them.
+    if (m_spec.tile_width <= 0 || m_spec.tile_height <= 0) {
+        m_spec.tile_width = 64;
+        m_spec.tile_height = 64;
+    }
+    m_spec.tile_depth = std::max (1, m_spec.tile_depth);
+    m_pixel_bytes = m_spec.pixel_bytes();
+    m_scanline_bytes = m_spec.scanline_bytes();
+    m_plane_bytes = clamped_mult64 (m_scanline_bytes, (imagesize_t)m_spec.height);
+    m_blackpixel.resize (round_to_multiple (m_pixel_bytes, OIIO_SIMD_MAX_SIZE_BYTES), 0);
+    // NB make it big enough for SSE
+    int maxmem_MB = 256;
+    getattribute ("scratch_memory", maxmem_MB);
+    m_scratch.reset (new ScratchTilePool (m_spec, imagesize_t(maxmem_MB) << 20));
+    m_storage = ImageBuf::SCRATCHFILE;
+    m_pixels_valid = true;
+}
+
+
+
+void
+ImageBufImpl::alloc (const ImageSpec &spec, ImageBuf::IBStorage storage)
 {
     m_spec = spec;
 
@@ -657,7 +980,15 @@ ImageBufImpl::alloc (const ImageSpec &spec)
     m_spec.nchannels = std::max (1, m_spec.nchannels);
 
     m_nativespec = spec;
-    realloc ();
+    if (storage == ImageBuf::SCRATCHFILE && ! m_spec.deep) {
+        IB_local_mem_current -= m_allocated_size;
+        m_allocated_size = 0;
+        m_pixels.reset ();
+        m_localpixels = NULL;
+        alloc_scratch ();
+    } else {
+        realloc ();
+    }
     m_spec_valid = true;
 }
 
@@ -955,14 +1286,32 @@ ImageBuf::write (ImageOutput *out,
         // Deep image record
         ok = out->write_deep_image (impl->m_deepdata);
     } else {
-        // Backed by ImageCache
-        boost::scoped_array<char> tmp (new char [m_spec.image_bytes()]);
-        ok = get_pixels (xbegin(), xend(), ybegin(), yend(), zbegin(), zend(),
-                         m_spec.format, &tmp[0]);
-        ok &= out->write_image (m_spec.format, &tmp[0], as, as, as,
-                                progress_callback, progress_callback_data);
-        // FIXME -- not good for huge images.  Instead, we should read
-        // little bits at a time (scanline or tile blocks).
+        // Backed by ImageCache or a scratch file.  The whole image may
+        // not fit in memory, so copy out and write one strip at a time.
+        const ImageSpec &outspec (out->spec());
+        int chunkheight = outspec.tile_width ? outspec.tile_height
+                                             : std::max (m_spec.tile_height, 64);
+        int chunkdepth = outspec.tile_width ? std::max (outspec.tile_depth, 1) : 1;
+        boost::scoped_array<char> tmp (new char [m_spec.scanline_bytes() *
+                                                 chunkheight * chunkdepth]);
+        for (int z = zbegin();  z < zend() && ok;  z += chunkdepth) {
+            int zend_ = std::min (z+chunkdepth, zend());
+            for (int y = ybegin();  y < yend() && ok;  y += chunkheight) {
+                int yend_ = std::min (y+chunkheight, yend());
+                ok &= get_pixels (xbegin(), xend(), y, yend_, z, zend_,
+                                  m_spec.format, &tmp[0]);
+                if (outspec.tile_width)
+                    ok &= out->write_tiles (xbegin(), xend(), y, yend_,
+                                            z, zend_, m_spec.format, &tmp[0]);
+                else
+                    ok &= out->write_scanlines (y, yend_, z, m_spec.format,
+                                                &tmp[0]);
+                if (progress_callback &&
+                    progress_callback (progress_callback_data,
+                                       float(y-ybegin())/m_spec.height))
+                    return ok;
+            }
+        }
     }
     if (! ok)
         error ("%s", out->geterror ());
@@ -1049,7 +1398,10 @@ ImageBufImpl::copy_metadata (const ImageBufImpl &src)
     m_spec.full_width = srcspec.full_width;
     m_spec.full_height = srcspec.full_height;
     m_spec.full_depth = srcspec.full_depth;
-    if (src.storage() == ImageBuf::IMAGECACHE) {
+    if (m_storage == ImageBuf::SCRATCHFILE) {
+        // A scratch-file buffer keeps the tile layout its pages were
+        // allocated with.
+    } else if (src.storage() == ImageBuf::IMAGECACHE) {
         // If we're copying metadata from a cached image, be sure to
         // get the file's tile size, not the cache's tile size.
         m_spec.tile_width = src.nativespec().tile_width;
@@ -1312,13 +1664,15 @@ ImageBuf::copy (const ImageBuf &src, TypeDesc format)
         clear();
         return true;
     }
+    IBStorage storage = (src.storage() == SCRATCHFILE) ? SCRATCHFILE
+                                                       : LOCALBUFFER;
     if (format.basetype == TypeDesc::UNKNOWN)
-        reset (src.name(), src.spec());
+        reset (src.name(), src.spec(), storage);
     else {
         ImageSpec newspec (src.spec());
         newspec.set_format (format);
         newspec.channelformats.clear ();
-        reset (src.name(), newspec);
+        reset (src.name(), newspec, storage);
     }
     return this->copy_pixels (src);
 }
@@ -2017,9 +2371,9 @@ ImageBuf::set_roi_full (const ROI &newroi)
 const void *
 ImageBufImpl::pixeladdr (int x, int y, int z) const
 {
-    if (cachedpixels())
-        return NULL;
     validate_pixels ();
+    if (! m_localpixels)
+        return NULL;
     x -= m_spec.x;
     y -= m_spec.y;
     z -= m_spec.z;
@@ -2034,7 +2388,7 @@ void *
 ImageBufImpl::pixeladdr (int x, int y, int z)
 {
     validate_pixels ();
-    if (cachedpixels())
+    if (! m_localpixels)
         return NULL;
     x -= m_spec.x;
     y -= m_spec.y;
@@ -2125,7 +2479,7 @@ const void *
 ImageBufImpl::retile (int x, int y, int z, ImageCache::Tile* &tile,
                       int &tilexbegin, int &tileybegin, int &tilezbegin,
                       int &tilexend, bool exists,
-                      ImageBuf::WrapMode wrap) const
+                      ImageBuf::WrapMode wrap, bool writeable) const
 {
     if (! exists) {
         // Special case -- (x,y,z) describes a location outside the data
@@ -2146,14 +2500,20 @@ ImageBufImpl::retile (int x, int y, int z, ImageCache::Tile* &tile,
              z >= m_spec.z && z < m_spec.z+m_spec.depth);
 
     int tw = m_spec.tile_width, th = m_spec.tile_height;
-    int td = m_spec.tile_depth;  DASSERT(m_spec.tile_depth >= 1);
+    int td = m_spec.tile_depth;
+    if (m_scratch) {
+        tw = m_scratch->tile_width();
+        th = m_scratch->tile_height();
+        td = m_scratch->tile_depth();
+    }
+    DASSERT (td >= 1);
     DASSERT (tile == NULL || tilexend == (tilexbegin+tw));
     if (tile == NULL || x < tilexbegin || x >= tilexend ||
                         y < tileybegin || y >= (tileybegin+th) ||
                         z < tilezbegin || z >= (tilezbegin+td)) {
         // not the same tile as before
         if (tile)
-            m_imagecache->release_tile (tile);
+            release_tile (tile);
         int xtile = (x-m_spec.x) / tw;
         int ytile = (y-m_spec.y) / th;
         int ztile = (z-m_spec.z) / td;
@@ -2161,8 +2521,19 @@ ImageBufImpl::retile (int x, int y, int z, ImageCache::Tile* &tile,
         tileybegin = m_spec.y + ytile*th;
         tilezbegin = m_spec.z + ztile*td;
         tilexend = tilexbegin + tw;
-        tile = m_imagecache->get_tile (m_name, m_current_subimage,
-                                       m_current_miplevel, x, y, z);
+        if (m_scratch) {
+            std::string err;
+            tile = (ImageCache::Tile *) m_scratch->pin (
+                        m_scratch->tile_index (xtile, ytile, ztile),
+                        writeable, err);
+            if (! tile) {
+                error ("%s", err);
+                return &m_blackpixel[0];
+            }
+        } else {
+            tile = m_imagecache->get_tile (m_name, m_current_subimage,
+                                           m_current_miplevel, x, y, z);
+        }
         if (! tile) {
             // Even though tile is NULL, ensure valid black pixel data
             std::string e = m_imagecache->geterror();
@@ -2177,6 +2548,8 @@ ImageBufImpl::retile (int x, int y, int z, ImageCache::Tile* &tile,
     DASSERTMSG (m_spec.pixel_bytes() == m_pixel_bytes,
                 "%d vs %d", (int)m_spec.pixel_bytes(), (int)m_pixel_bytes);
 
+    if (m_scratch)
+        return &((ScratchTilePool::Slot *) tile)->pixels[offset];
     TypeDesc format;
     const void* pixeldata = m_imagecache->tile_pixels (tile, format);
     return pixeldata ? (const char *)pixeldata + offset : NULL;
@@ -2184,14 +2557,33 @@ ImageBufImpl::retile (int x, int y, int z, ImageCache::Tile* &tile,
 
 
 
+void
+ImageBufImpl::release_tile (ImageCache::Tile *tile) const
+{
+    if (m_scratch)
+        m_scratch->unpin ((ScratchTilePool::Slot *) tile);
+    else
+        m_imagecache->release_tile (tile);
+}
+
+
+
 const void *
 ImageBuf::retile (int x, int y, int z, ImageCache::Tile* &tile,
                   int &tilexbegin, int &tileybegin, int &tilezbegin,
                   int &tilexend, bool exists,
-                  WrapMode wrap) const
+                  WrapMode wrap, bool writeable) const
 {
     return impl()->retile (x, y, z, tile, tilexbegin, tileybegin, tilezbegin,
-                           tilexend, exists, wrap);
+                           tilexend, exists, wrap, writeable);
+}
+
+
+
+void
+ImageBuf::release_tile (ImageCache::Tile *tile) const
+{
+    impl()->release_tile (tile);
 }
 
 
@@ -325,6 +325,64 @@ test_set_get_pixels ()
 
 
 
+// Tests SCRATCHFILE storage, with a memory budget much smaller than the
+// image so that tiles are forced to page in and out.
+void
+test_scratchfile ()
+{
+    std::cout << "\nTesting SCRATCHFILE storage:\n";
+    int oldmem = 256;
+    OIIO::getattribute ("scratch_memory", oldmem);
+    OIIO::attribute ("scratch_memory", 1);  // MB
+    ImageSpec spec (600, 500, 4, TypeDesc::FLOAT);
+    ImageBuf A;
+    A.reset ("A", spec, ImageBuf::SCRATCHFILE);
+    ImageBuf B (spec);
+    OIIO_CHECK_EQUAL (A.storage(), ImageBuf::SCRATCHFILE);
+    OIIO_CHECK_ASSERT (A.localpixels() == NULL);
+
+    // Never-written tiles read as black
+    float pixel[4] = { 1, 1, 1, 1 };
+    A.getpixel (300, 250, pixel);
+    OIIO_CHECK_EQUAL (pixel[0], 0.0f);
+
+    // Write through iterators, in multiple threads, and with set_pixels
+    for (ImageBuf::Iterator<float> a (A), b (B);  ! a.done();  ++a, ++b)
+        for (int c = 0;  c < 4;  ++c)
+            a[c] = b[c] = float(a.x() + 1000*a.y() + c);
+    const float red[4] = { 1, 0, 0, 1 };
+    ROI roi (100, 400, 50, 450);
+    ImageBufAlgo::fill (A, red, roi);
+    ImageBufAlgo::fill (B, red, roi);
+    float newdata[2*2*4] = { 1,2,3,4,  5,6,7,8,  9,10,11,12,  13,14,15,16 };
+    A.set_pixels (ROI(590,592,490,492), TypeDesc::FLOAT, newdata);
+    B.set_pixels (ROI(590,592,490,492), TypeDesc::FLOAT, newdata);
+
+    // Read back after everything has been paged through the file
+    ImageBufAlgo::CompareResults cr;
+    ImageBufAlgo::compare (A, B, 0.0f, 0.0f, cr);
+    OIIO_CHECK_EQUAL (cr.nfail, 0);
+    A.getpixel (599, 499, pixel);
+    OIIO_CHECK_EQUAL (pixel[3], float(599 + 1000*499 + 3));
+
+    // Copies stay out-of-core and are independent of the original
+    ImageBuf C (A);
+    OIIO_CHECK_EQUAL (C.storage(), ImageBuf::SCRATCHFILE);
+    ImageBufAlgo::zero (A);
+    ImageBufAlgo::compare (C, B, 0.0f, 0.0f, cr);
+    OIIO_CHECK_EQUAL (cr.nfail, 0);
+
+    // Copying metadata from an untiled image keeps the scratch tile layout
+    int tw = C.spec().tile_width;
+    C.copy_metadata (B);
+    OIIO_CHECK_EQUAL (C.spec().tile_width, tw);
+    ImageBufAlgo::compare (C, B, 0.0f, 0.0f, cr);
+    OIIO_CHECK_EQUAL (cr.nfail, 0);
+    OIIO::attribute ("scratch_memory", oldmem);
+}
+
+
+
 int
 main (int argc, char **argv)
 {
@@ -345,6 +403,7 @@ main (int argc, char **argv)
     test_open_with_config ();
 
     test_set_get_pixels ();
+    test_scratchfile ();
 
     return unit_test_failures;
 }
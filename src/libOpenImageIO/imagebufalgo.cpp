@@ -29,12 +29,14 @@
 */
 
 #include <boost/bind.hpp>
-#include <boost/shared_ptr.hpp>
+#include <boost/scoped_array.hpp>
 #include <boost/regex.hpp>
 
 #include <OpenEXR/half.h>
 
+#include <algorithm>
 #include <cmath>
+#include <vector>
 
 #include "OpenImageIO/imagebuf.h"
 #include "OpenImageIO/imagebufalgo.h"
@@ -43,6 +45,7 @@
 #include "OpenImageIO/platform.h"
 #include "OpenImageIO/filter.h"
 #include "OpenImageIO/thread.h"
+#include "OpenImageIO/simd.h"
 #include "kissfft.hh"
 
 
@@ -509,6 +512,234 @@ ImageBufAlgo::unsharp_mask (ImageBuf &dst, const ImageBuf &src,
 
 
 
+namespace {
+
+// Comparator networks that leave element n/2 of the sorted order of 9
+// or 25 values in the middle slot.  They are Batcher merge-exchange
+// sorting networks pruned to just the comparators that can influence
+// that slot (checked exhaustively via the 0-1 principle).
+static const unsigned char median9_network[][2] = {
+    {0,8}, {0,4}, {1,5}, {2,6}, {3,7}, {4,8}, {0,2}, {1,3}, {4,6}, {5,7},
+    {2,8}, {2,4}, {3,5}, {6,8}, {0,1}, {2,3}, {4,5}, {6,7}, {1,8}, {1,4},
+    {3,6}, {3,4}
+};
+
+static const unsigned char median25_network[][2] = {
+    {0,16}, {1,17}, {2,18}, {3,19}, {4,20}, {5,21}, {6,22}, {7,23}, {8,24},
+    {0,8}, {1,9}, {2,10}, {3,11}, {4,12}, {5,13}, {6,14}, {7,15}, {16,24},
+    {8,16}, {9,17}, {10,18}, {11,19}, {12,20}, {13,21}, {14,22}, {15,23},
+    {0,4}, {1,5}, {2,6}, {3,7}, {8,12}, {9,13}, {10,14}, {11,15}, {16,20},
+    {17,21}, {18,22}, {19,23}, {4,16}, {5,17}, {6,18}, {7,19}, {12,24},
+    {4,8}, {5,9}, {6,10}, {7,11}, {12,16}, {13,17}, {14,18}, {15,19},
+    {20,24}, {0,2}, {1,3}, {4,6}, {5,7}, {8,10}, {9,11}, {12,14}, {13,15},
+    {16,18}, {17,19}, {20,22}, {21,23}, {2,16}, {3,17}, {6,20}, {7,21},
+    {10,24}, {2,8}, {3,9}, {6,12}, {7,13}, {10,16}, {11,17}, {14,20},
+    {15,21}, {18,24}, {2,4}, {3,5}, {6,8}, {7,9}, {10,12}, {11,13}, {14,16},
+    {15,17}, {18,20}, {19,21}, {22,24}, {0,1}, {2,3}, {4,5}, {6,7}, {8,9},
+    {10,11}, {12,13}, {14,15}, {16,17}, {18,19}, {20,21}, {22,23}, {1,16},
+    {3,18}, {5,20}, {7,22}, {9,24}, {5,12}, {7,14}, {9,16}, {11,18}, {9,12},
+    {11,14}, {11,12}
+};
+
+
+template<int N>
+inline float
+network_median (float *v, const unsigned char (&network)[N][2], int mid)
+{
+    for (int i = 0;  i < N;  ++i) {
+        float a = v[network[i][0]], b = v[network[i][1]];
+        v[network[i][0]] = std::min (a, b);
+        v[network[i][1]] = std::max (a, b);
+    }
+    return v[mid];
+}
+
+
+// Return the value that std::sort would leave in v[n/2].  If 'special'
+// is set (the values include NaNs or negative zeros, which the cheaper
+// selection methods might order differently), just sort.
+inline float
+select_median (float *v, int n, bool special)
+{
+    int mid = n/2;
+    if (special) {
+        std::sort (v, v+n);
+    } else if (n == 9) {
+        return network_median (v, median9_network, mid);
+    } else if (n == 25) {
+        return network_median (v, median25_network, mid);
+    } else {
+        std::nth_element (v, v+mid, v+n);
+    }
+    return v[mid];
+}
+
+
+
+// Histogram of BITS-bit unsigned values, for the sliding window median.
+// It's kept as a hierarchy of BITS/4 levels of 16-way bins, so adding
+// or removing a value touches BITS/4 counters and finding the n-th
+// smallest value scans at most 16 bins per level.
+template<int BITS>
+class MedianHistogram {
+public:
+    MedianHistogram () {
+        int size = 0;
+        for (int l = 0;  l < Levels;  ++l) {
+            m_offset[l] = size;
+            size += 1 << (4*(l+1));
+        }
+        m_count.resize (size, 0);
+    }
+
+    void update (unsigned int v, int delta) {
+        for (int l = 0;  l < Levels;  ++l)
+            m_count[m_offset[l] + (v >> (BITS - 4*(l+1)))] += delta;
+    }
+
+    /// Return the value with rank k (0-based) in sorted order.
+    unsigned int nth (int k) const {
+        unsigned int v = 0;
+        for (int l = 0;  l < Levels;  ++l) {
+            const int *bins = &m_count[m_offset[l] + 16*v];
+            int b = 0;
+            while (k >= bins[b])
+                k -= bins[b++];
+            v = 16*v + b;
+        }
+        return v;
+    }
+
+private:
+    enum { Levels = BITS/4 };
+    int m_offset[Levels+1];
+    std::vector<int> m_count;
+};
+
+// Bits per value of the types that use the histogram method (0 = don't).
+template<class T> struct MedianHistogramBits { enum { value = 0 }; };
+template<> struct MedianHistogramBits<unsigned char> { enum { value = 8 }; };
+template<> struct MedianHistogramBits<unsigned short> { enum { value = 16 }; };
+
+
+
+// Median over windows gathered pixel by pixel from local pixels, with
+// the window clipped to A's data window just like the iterator version.
+template<class Rtype, class Atype>
+static void
+median_filter_gather (ImageBuf &R, const ImageBuf &A, int width, int height,
+                      int w_2, int h_2, ROI roi)
+{
+    const ImageSpec &spec (A.spec());
+    int nchannels = R.nchannels();
+    size_t ystride = size_t(spec.width) * nchannels;
+    int windowsize = width*height;
+    float **chans = OIIO_ALLOCA (float*, nchannels);
+    for (int c = 0;  c < nchannels;  ++c)
+        chans[c] = OIIO_ALLOCA (float, windowsize);
+    bool *special = OIIO_ALLOCA (bool, nchannels);
+
+    for (ImageBuf::Iterator<Rtype> r (R, roi);  !r.done();  ++r) {
+        int xbegin = std::max (r.x()-w_2, spec.x);
+        int xend = std::min (r.x()-w_2+width, spec.x+spec.width);
+        int ybegin = std::max (r.y()-h_2, spec.y);
+        int yend = std::min (r.y()-h_2+height, spec.y+spec.height);
+        if (xbegin >= xend || ybegin >= yend ||
+            r.z() < spec.z || r.z() >= spec.z+spec.depth) {
+            for (int c = 0;  c < nchannels;  ++c)
+                r[c] = 0.0f;
+            continue;
+        }
+        for (int c = 0;  c < nchannels;  ++c)
+            special[c] = false;
+        int n = 0;
+        const Atype *row = (const Atype *)A.pixeladdr (xbegin, ybegin, r.z());
+        for (int y = ybegin;  y < yend;  ++y, row += ystride) {
+            const Atype *p = row;
+            for (int x = xbegin;  x < xend;  ++x, ++n) {
+                for (int c = 0;  c < nchannels;  ++c, ++p) {
+                    float v = convert_type<Atype,float> (*p);
+                    chans[c][n] = v;
+                    if (v != v || (v == 0.0f && std::signbit (v)))
+                        special[c] = true;
+                }
+            }
+        }
+        for (int c = 0;  c < nchannels;  ++c)
+            r[c] = select_median (chans[c], n, special[c]);
+    }
+}
+
+
+
+// Sliding window histogram median (Huang) for 8 and 16 bit data: each
+// step to the right removes the column leaving the window and adds the
+// one entering it, so the cost per pixel is proportional to the window
+// height rather than its area.
+template<class Rtype, class Atype, int BITS>
+static void
+median_filter_histogram (ImageBuf &R, const ImageBuf &A, int width,
+                         int height, int w_2, int h_2, ROI roi)
+{
+    const ImageSpec &spec (A.spec());
+    int nchannels = R.nchannels();
+    size_t ystride = size_t(spec.width) * nchannels;
+    std::vector<MedianHistogram<BITS> > hist (nchannels);
+
+    ImageBuf::Iterator<Rtype> r (R, roi);
+    for (int z = roi.zbegin;  z < roi.zend;  ++z) {
+        bool zexists = (z >= spec.z && z < spec.z+spec.depth);
+        for (int y = roi.ybegin;  y < roi.yend;  ++y) {
+            int ybegin = std::max (y-h_2, spec.y);
+            int yend = std::min (y-h_2+height, spec.y+spec.height);
+            int nrows = zexists ? std::max (0, yend-ybegin) : 0;
+            // The histograms hold columns [cbegin,cend) of rows
+            // [ybegin,yend); they start and end each scanline empty.
+            int cbegin = 0, cend = 0;
+            for (int x = roi.xbegin;  x < roi.xend;  ++x, ++r) {
+                int xbegin = std::max (x-w_2, spec.x);
+                int xend = std::max (xbegin, std::min (x-w_2+width,
+                                                      spec.x+spec.width));
+                if (nrows) {
+                    for (int col = cbegin;  col < cend;  ++col) {
+                        if (col >= xbegin && col < xend)
+                            continue;
+                        const Atype *p = (const Atype *)A.pixeladdr (col, ybegin, z);
+                        for (int i = 0;  i < nrows;  ++i, p += ystride)
+                            for (int c = 0;  c < nchannels;  ++c)
+                                hist[c].update (p[c], -1);
+                    }
+                    for (int col = xbegin;  col < xend;  ++col) {
+                        if (col >= cbegin && col < cend)
+                            continue;
+                        const Atype *p = (const Atype *)A.pixeladdr (col, ybegin, z);
+                        for (int i = 0;  i < nrows;  ++i, p += ystride)
+                            for (int c = 0;  c < nchannels;  ++c)
+                                hist[c].update (p[c], +1);
+                    }
+                    cbegin = xbegin;
+                    cend = xend;
+                }
+                int n = nrows * (cend - cbegin);
+                for (int c = 0;  c < nchannels;  ++c)
+                    r[c] = n ? convert_type<Atype,float> ((Atype)hist[c].nth (n/2))
+                             : 0.0f;
+            }
+            // Empty the histograms for the next scanline
+            for (int col = cbegin;  col < cend;  ++col) {
+                const Atype *p = (const Atype *)A.pixeladdr (col, ybegin, z);
+                for (int i = 0;  i < nrows;  ++i, p += ystride)
+                    for (int c = 0;  c < nchannels;  ++c)
+                        hist[c].update (p[c], -1);
+            }
+        }
+    }
+}
+
+}  // anon namespace
+
+
+
 template<class Rtype, class Atype>
 static bool
 median_filter_impl (ImageBuf &R, const ImageBuf &A, int width, int height,
@@ -530,6 +761,22 @@ median_filter_impl (ImageBuf &R, const ImageBuf &A, int width, int height,
         height = width;
     int w_2 = std::max (1, width/2);
     int h_2 = std::max (1, height/2);
+
+    if (A.localpixels() && ! A.deep()) {
+        // Local pixels: 8 and 16 bit data slide a histogram along each
+        // scanline, except for 3x3 windows, where gathering each window
+        // into the sorting network is faster.  Other types always
+        // gather (with networks for 3x3 and 5x5, nth_element otherwise).
+        const int bits = MedianHistogramBits<Atype>::value;
+        if (bits && width*height > 9)
+            median_filter_histogram<Rtype,Atype,bits> (R, A, width, height,
+                                                       w_2, h_2, roi);
+        else
+            median_filter_gather<Rtype,Atype> (R, A, width, height,
+                                               w_2, h_2, roi);
+        return true;
+    }
+
     int windowsize = width*height;
     int nchannels = R.nchannels();
     float **chans = OIIO_ALLOCA (float*, nchannels);
@@ -584,42 +831,238 @@ ImageBufAlgo::median_filter (ImageBuf &dst, const ImageBuf &src,
 
 
 
-// Helper function: fft of the horizontal rows
+// The DFT of a real image is Hermitian, F(u,v) == conj(F(-u,-v)), so the
+// FFT helpers below only compute columns 0..width/2 of the spectrum.
+// That "half spectrum" is stored column-major, half[k*height+y], so that
+// the column transforms run over contiguous memory; the row passes move
+// data in and out of it a block of fft_block rows at a time, which keeps
+// the transposition cache-friendly.  Each thread copies the shared
+// kissfft plans rather than recomputing their twiddle factors.
+static const int fft_block = 16;
+
+
+
+// Forward FFT of rows roi.ybegin..roi.yend-1 of the channel of src
+// described by srcroi, into the half spectrum.  Two real rows are
+// transformed at once, as the real and imaginary parts of one complex
+// row, and their spectra separated by symmetry afterwards.
 static bool
-hfft_ (ImageBuf &dst, const ImageBuf &src, bool inverse, bool unitary,
-       ROI roi, int nthreads)
+fft_rows_ (std::complex<float> *half, const ImageBuf &src, ROI srcroi,
+           const kissfft<float> &plan, ROI roi, int nthreads)
 {
-    ASSERT (dst.spec().format.basetype == TypeDesc::FLOAT &&
-            src.spec().format.basetype == TypeDesc::FLOAT &&
-            dst.spec().nchannels == 2 && src.spec().nchannels == 2 &&
-            dst.roi() == src.roi() &&
-            (dst.storage() == ImageBuf::LOCALBUFFER || dst.storage() == ImageBuf::APPBUFFER) &&
-            (src.storage() == ImageBuf::LOCALBUFFER || src.storage() == ImageBuf::APPBUFFER)
-        );
+    if (nthreads != 1 && roi.npixels() >= 1000) {
+        // Lots of pixels and request for multi threads? Parallelize.
+        ImageBufAlgo::parallel_image (
+            boost::bind (fft_rows_, half, boost::cref(src), srcroi,
+                         boost::cref(plan), _1 /*roi*/, 1 /*nthreads*/),
+            roi, nthreads);
+        return true;
+    }
 
+    // Serial case
+    int width = roi.width(), height = srcroi.height();
+    int nhalf = width/2 + 1;
+    kissfft<float> F (plan);
+    std::vector<float> rows (2*width);
+    std::vector<std::complex<float> > in (width), out (width);
+    std::vector<std::complex<float> > block (fft_block*nhalf);
+    const std::complex<float> minus_i_half (0.0f, -0.5f);
+    for (int y0 = roi.ybegin;  y0 < roi.yend;  y0 += fft_block) {
+        int y1 = std::min (y0+fft_block, roi.yend);
+        for (int y = y0;  y < y1;  y += 2) {
+            bool pair = (y+1 < y1);
+            ROI r (srcroi.xbegin, srcroi.xend,
+                   srcroi.ybegin+y, srcroi.ybegin+y+(pair ? 2 : 1),
+                   srcroi.zbegin, srcroi.zbegin+1,
+                   srcroi.chbegin, srcroi.chbegin+1);
+            src.get_pixels (r, TypeDesc::FLOAT, &rows[0]);
+            if (! pair)
+                std::fill (rows.begin()+width, rows.end(), 0.0f);
+            for (int x = 0;  x < width;  ++x)
+                in[x] = std::complex<float> (rows[x], rows[width+x]);
+            F.transform (&in[0], &out[0]);
+            std::complex<float> *a = &block[(y-y0)*nhalf];
+            std::complex<float> *b = a + nhalf;
+            for (int k = 0;  k < nhalf;  ++k) {
+                std::complex<float> z = out[k];
+                std::complex<float> zc = std::conj (out[(width-k) % width]);
+                a[k] = 0.5f * (z + zc);
+                if (pair)
+                    b[k] = minus_i_half * (z - zc);
+            }
+        }
+        for (int k = 0;  k < nhalf;  ++k) {
+            std::complex<float> *h = half + (size_t)k*height;
+            for (int y = y0;  y < y1;  ++y)
+                h[y] = block[(y-y0)*nhalf + k];
+        }
+    }
+    return true;
+}
+
+
+
+// In-place FFT of columns roi.ybegin..roi.yend-1 of the half spectrum,
+// each of length roi.width().
+static bool
+fft_columns_ (std::complex<float> *half, const kissfft<float> &plan,
+              ROI roi, int nthreads)
+{
     if (nthreads != 1 && roi.npixels() >= 1000) {
         // Lots of pixels and request for multi threads? Parallelize.
         ImageBufAlgo::parallel_image (
-            boost::bind (hfft_, boost::ref(dst), boost::cref(src),
-                         inverse, unitary,
+            boost::bind (fft_columns_, half, boost::cref(plan),
                          _1 /*roi*/, 1 /*nthreads*/),
             roi, nthreads);
         return true;
     }
 
     // Serial case
-    int width = roi.width();
-    float rescale = sqrtf (1.0f / width);
-    kissfft<float> F (width, inverse);
-    for (int z = roi.zbegin;  z < roi.zend;  ++z) {
-        for (int y = roi.ybegin;  y < roi.yend;  ++y) {
-            std::complex<float> *s, *d;
-            s = (std::complex<float> *)src.pixeladdr(roi.xbegin, y, z);
-            d = (std::complex<float> *)dst.pixeladdr(roi.xbegin, y, z);
-            F.transform (s, d);
-            if (unitary)
+    int height = roi.width();
+    kissfft<float> F (plan);
+    std::vector<std::complex<float> > column (height);
+    for (int k = roi.ybegin;  k < roi.yend;  ++k) {
+        std::complex<float> *h = half + (size_t)k*height;
+        std::copy (h, h+height, column.begin());
+        F.transform (&column[0], h);
+    }
+    return true;
+}
+
+
+
+// Fill rows roi.ybegin..roi.yend-1 of dst (2-channel float, origin at
+// 0) with the full spectrum, scaled, mirroring the half spectrum for
+// the columns that weren't computed.
+static bool
+fft_expand_ (ImageBuf &dst, const std::complex<float> *half, float scale,
+             ROI roi, int nthreads)
+{
+    if (nthreads != 1 && roi.npixels() >= 1000) {
+        // Lots of pixels and request for multi threads? Parallelize.
+        ImageBufAlgo::parallel_image (
+            boost::bind (fft_expand_, boost::ref(dst), half, scale,
+                         _1 /*roi*/, 1 /*nthreads*/),
+            roi, nthreads);
+        return true;
+    }
+
+    // Serial case
+    int width = dst.spec().width, height = dst.spec().height;
+    int nhalf = width/2 + 1;
+    for (int y0 = roi.ybegin;  y0 < roi.yend;  y0 += fft_block) {
+        int y1 = std::min (y0+fft_block, roi.yend);
+        for (int x0 = 0;  x0 < width;  x0 += fft_block) {
+            int x1 = std::min (x0+fft_block, width);
+            for (int y = y0;  y < y1;  ++y) {
+                std::complex<float> *d = (std::complex<float> *)dst.pixeladdr (x0, y);
+                int ym = (height-y) % height;
+                for (int x = x0;  x < x1;  ++x, ++d) {
+                    if (x < nhalf)
+                        *d = scale * half[(size_t)x*height + y];
+                    else
+                        *d = scale * std::conj (half[(size_t)(width-x)*height + ym]);
+                }
+            }
+        }
+    }
+    return true;
+}
+
+
+
+// Gather columns roi.ybegin..roi.yend-1 of the Hermitian part,
+// (X(u,v) + conj(X(-u,-v)))/2, of the 2-channel float image src over
+// srcroi into the half spectrum.  Only the Hermitian part of a spectrum
+// contributes to the real part of its inverse, which is all that ifft
+// keeps.
+static bool
+ifft_gather_ (std::complex<float> *half, const ImageBuf &src, ROI srcroi,
+              ROI roi, int nthreads)
+{
+    if (nthreads != 1 && roi.npixels() >= 1000) {
+        // Lots of pixels and request for multi threads? Parallelize.
+        ImageBufAlgo::parallel_image (
+            boost::bind (ifft_gather_, half, boost::cref(src), srcroi,
+                         _1 /*roi*/, 1 /*nthreads*/),
+            roi, nthreads);
+        return true;
+    }
+
+    // Serial case
+    int width = srcroi.width(), height = roi.width();
+    for (int k0 = roi.ybegin;  k0 < roi.yend;  k0 += fft_block) {
+        int k1 = std::min (k0+fft_block, roi.yend);
+        for (int y = 0;  y < height;  ++y) {
+            const std::complex<float> *s, *m;
+            s = (const std::complex<float> *)src.pixeladdr (srcroi.xbegin, srcroi.ybegin+y);
+            m = (const std::complex<float> *)src.pixeladdr (srcroi.xbegin, srcroi.ybegin+(height-y)%height);
+            for (int k = k0;  k < k1;  ++k)
+                half[(size_t)k*height + y] = 0.5f * (s[k] + std::conj (m[(width-k) % width]));
+        }
+    }
+    return true;
+}
+
+
+
+// Inverse FFT of rows roi.ybegin..roi.yend-1 of the (Hermitian) half
+// spectrum into the 1-channel float image dst (origin at 0), scaled.
+// Each row's inverse is real, so two rows are transformed at once, as
+// the real and imaginary parts of one complex row.
+static bool
+ifft_rows_ (ImageBuf &dst, const std::complex<float> *half,
+            const kissfft<float> &plan, float scale, ROI roi, int nthreads)
+{
+    if (nthreads != 1 && roi.npixels() >= 1000) {
+        // Lots of pixels and request for multi threads? Parallelize.
+        ImageBufAlgo::parallel_image (
+            boost::bind (ifft_rows_, boost::ref(dst), half,
+                         boost::cref(plan), scale,
+                         _1 /*roi*/, 1 /*nthreads*/),
+            roi, nthreads);
+        return true;
+    }
+
+    // Serial case
+    int width = roi.width(), height = dst.spec().height;
+    int nhalf = width/2 + 1;
+    kissfft<float> F (plan);
+    std::vector<std::complex<float> > in (width), out (width);
+    std::vector<std::complex<float> > block (fft_block*nhalf);
+    for (int y0 = roi.ybegin;  y0 < roi.yend;  y0 += fft_block) {
+        int y1 = std::min (y0+fft_block, roi.yend);
+        for (int k = 0;  k < nhalf;  ++k) {
+            const std::complex<float> *h = half + (size_t)k*height;
+            for (int y = y0;  y < y1;  ++y)
+                block[(y-y0)*nhalf + k] = h[y];
+        }
+        for (int y = y0;  y < y1;  y += 2) {
+            bool pair = (y+1 < y1);
+            const std::complex<float> *a = &block[(y-y0)*nhalf];
+            const std::complex<float> *b = a + nhalf;
+            for (int k = 0;  k < width;  ++k) {
+                // in = a + i*b, with a and b extended by symmetry
+                std::complex<float> ak, bk;
+                if (k < nhalf) {
+                    ak = a[k];
+                    bk = pair ? b[k] : std::complex<float>(0.0f);
+                } else {
+                    ak = std::conj (a[width-k]);
+                    bk = pair ? std::conj (b[width-k]) : std::complex<float>(0.0f);
+                }
+                in[k] = std::complex<float> (ak.real() - bk.imag(),
+                                             ak.imag() + bk.real());
+            }
+            F.transform (&in[0], &out[0]);
+            float *d = (float *)dst.pixeladdr (0, y);
+            for (int x = 0;  x < width;  ++x)
+                d[x] = scale * out[x].real();
+            if (pair) {
+                d = (float *)dst.pixeladdr (0, y+1);
                 for (int x = 0;  x < width;  ++x)
-                    d[x] *= rescale;
+                    d[x] = scale * out[x].imag();
+            }
         }
     }
     return true;
@@ -654,43 +1097,20 @@ ImageBufAlgo::fft (ImageBuf &dst, const ImageBuf &src,
     spec.channelnames.push_back ("real");
     spec.channelnames.push_back ("imag");
 
-    // And a spec that describes the transposed intermediate
-    ImageSpec specT = spec;
-    std::swap (specT.width, specT.height);
-    std::swap (specT.full_width, specT.full_height);
-
     // Resize dst
     dst.reset (dst.name(), spec);
 
-    // Copy src to a 2-channel (for "complex") float buffer
-    ImageBuf A (spec);
-    if (src.nchannels() < 2) {
-        // If we're pasting fewer than 2 channels, zero out channel 1.
-        ROI r = roi;
-        r.chbegin = 1; r.chend = 2;
-        zero (A, r);
-    }
-    if (! ImageBufAlgo::paste (A, 0, 0, 0, 0, src, roi, nthreads)) {
-        dst.error ("%s", A.geterror());
-        return false;
-    }
-
-    // FFT the rows (into temp buffer B).
-    ImageBuf B (spec);
-    hfft_ (B, A, false /*inverse*/, true /*unitary*/,
-           get_roi(B.spec()), nthreads);
-
-    // Transpose and shift back to A
-    A.clear ();
-    ImageBufAlgo::transpose (A, B, ROI::All(), nthreads);
-
-    // FFT what was originally the columns (back to B)
-    B.reset (specT);
-    hfft_ (B, A, false /*inverse*/, true /*unitary*/,
-           get_roi(A.spec()), nthreads);
-
-    // Transpose again, into the dest
-    ImageBufAlgo::transpose (dst, B, ROI::All(), nthreads);
+    // FFT the rows of src into the half spectrum, FFT its columns, then
+    // expand it into the full (unitary) spectrum in dst.
+    int width = spec.width, height = spec.height;
+    std::vector<std::complex<float> > half ((size_t)(width/2+1) * height);
+    kissfft<float> rowplan (width, false), colplan (height, false);
+    fft_rows_ (&half[0], src, roi, rowplan,
+               ROI (0, width, 0, height), nthreads);
+    fft_columns_ (&half[0], colplan,
+                  ROI (0, height, 0, width/2+1), nthreads);
+    fft_expand_ (dst, &half[0], sqrtf (1.0f / width) * sqrtf (1.0f / height),
+                 get_roi (spec), nthreads);
 
     return true;
 }
@@ -730,29 +1150,37 @@ ImageBufAlgo::ifft (ImageBuf &dst, const ImageBuf &src,
     spec.channelnames.push_back ("real");
     spec.channelnames.push_back ("imag");
 
-    // Inverse FFT the rows (into temp buffer B).
-    ImageBuf B (spec);
-    hfft_ (B, src, true /*inverse*/, true /*unitary*/,
-           get_roi(B.spec()), nthreads);
-
-    // Transpose and shift back to A
-    ImageBuf A;
-    ImageBufAlgo::transpose (A, B, ROI::All(), nthreads);
-
-    // Inverse FFT what was originally the columns (back to B)
-    B.reset (A.spec());
-    hfft_ (B, A, true /*inverse*/, true /*unitary*/,
-           get_roi(A.spec()), nthreads);
+    // The spectrum is read directly from src if it's all in memory,
+    // otherwise from a local copy.
+    const ImageBuf *S = &src;
+    ImageBuf local;
+    if (! src.localpixels() || roi_intersection (roi, src.roi()) != roi) {
+        local.reset (spec);
+        if (! ImageBufAlgo::paste (local, 0, 0, 0, 0, src, roi, nthreads)) {
+            dst.error ("%s", local.geterror());
+            return false;
+        }
+        S = &local;
+        roi = get_roi (spec);
+    }
 
-    // Transpose again, into the dst, in the process throw out the
-    // imaginary part and go back to a single (real) channel.
+    // Gather the Hermitian half spectrum, inverse FFT its columns, then
+    // inverse FFT the rows, keeping only the real part of the result in
+    // a single channel of dst.
+    int width = spec.width, height = spec.height;
+    std::vector<std::complex<float> > half ((size_t)(width/2+1) * height);
+    kissfft<float> rowplan (width, true), colplan (height, true);
+    ifft_gather_ (&half[0], *S, roi,
+                  ROI (0, height, 0, width/2+1), nthreads);
+    fft_columns_ (&half[0], colplan,
+                  ROI (0, height, 0, width/2+1), nthreads);
     spec.nchannels = 1;
     spec.channelnames.clear ();
     spec.channelnames.push_back ("R");
     dst.reset (dst.name(), spec);
-    ROI Broi = get_roi(B.spec());
-    Broi.chend = 1;
-    ImageBufAlgo::transpose (dst, B, Broi, nthreads);
+    ifft_rows_ (dst, &half[0], rowplan,
+                sqrtf (1.0f / width) * sqrtf (1.0f / height),
+                ROI (0, width, 0, height), nthreads);
 
     return true;
 }
@@ -864,30 +1292,193 @@ ImageBufAlgo::complex_to_polar (ImageBuf &dst, const ImageBuf &src,
 
 
 
-// Helper for fillholes_pp: for any nonzero alpha pixels in dst, divide
-// all components by alpha.
+// One level of the fillholes_pushpull pyramid: a float image with
+// nchannels channels, whose pixels live in the pyramid's shared arena.
+// Pixel (x,y) of the data window is at
+// pixels[((y-ybegin)*width + (x-xbegin)) * nchannels].
+struct PushPullLevel {
+    float *pixels;
+    int xbegin, ybegin, width, height;           // data window
+    int full_x, full_y, full_width, full_height; // display window
+};
+
+
+
+// Source pixels (relative to the source data window) and normalized
+// weights along one axis, for resampling a level of the pyramid into the
+// next.  These are the weights that resize() computes for its default
+// "triangle" filter, so the pyramid is built and expanded exactly as it
+// was when it used resize(), just without the generic machinery: taps
+// are clamped to the display window, and those that still fall outside
+// the data window are black (zero weight, but counted in the
+// normalization).
+struct PushPullTaps {
+    int ntaps;
+    std::vector<int> index;
+    std::vector<float> weight;
+};
+
+
+static void
+pushpull_taps (PushPullTaps &taps, int dbegin, int dsize,
+               int dfull, int dfullsize,
+               int sbegin, int ssize, int sfull, int sfullsize)
+{
+    // The triangle is 2*max(1,ratio) dst pixels wide, so it interpolates
+    // when enlarging and averages when shrinking.
+    float ratio = float(dfullsize) / float(sfullsize);
+    float filterrad = std::max (1.0f, ratio);
+    int rad = (int) ceilf (filterrad / ratio);
+    taps.ntaps = 2*rad + 1;
+    taps.index.resize (dsize * taps.ntaps);
+    taps.weight.resize (dsize * taps.ntaps);
+    float dstpixelwidth = 1.0f / dfullsize;
+    for (int d = 0;  d < dsize;  ++d) {
+        float s = (dbegin + d - dfull + 0.5f) * dstpixelwidth;
+        int si;
+        float frac = floorfrac (sfull + s * sfullsize, &si);
+        int *index = &taps.index[d * taps.ntaps];
+        float *weight = &taps.weight[d * taps.ntaps];
+        float total = 0.0f;
+        for (int i = -rad;  i <= rad;  ++i) {
+            float w = 1.0f - fabsf (ratio * (i - (frac - 0.5f))) / filterrad;
+            weight[i+rad] = std::max (0.0f, w);
+            total += weight[i+rad];
+            index[i+rad] = clamp (si + i, sfull, sfull + sfullsize - 1) - sbegin;
+        }
+        for (int i = 0;  i < taps.ntaps;  ++i) {
+            weight[i] /= total;
+            if (index[i] < 0 || index[i] >= ssize) {
+                index[i] = 0;
+                weight[i] = 0.0f;
+            }
+        }
+    }
+}
+
+
+
+// Sum the taps of a row of pixels (nchannels each) into one pixel.
+inline void
+pushpull_row_taps (float *d, const float *row, const int *index,
+                   const float *weight, int ntaps, int nchannels)
+{
+    if (nchannels == 4) {
+        simd::float4 sum (0.0f);
+        for (int i = 0;  i < ntaps;  ++i)
+            if (weight[i] != 0.0f)
+                sum += simd::float4 (weight[i]) * simd::float4 (row + 4*index[i]);
+        sum.store (d);
+        return;
+    }
+    for (int c = 0;  c < nchannels;  ++c)
+        d[c] = 0.0f;
+    for (int i = 0;  i < ntaps;  ++i) {
+        float w = weight[i];
+        const float *s = row + nchannels*index[i];
+        if (w != 0.0f)
+            for (int c = 0;  c < nchannels;  ++c)
+                d[c] += w * s[c];
+    }
+}
+
+
+
+// Sum the taps of whole rows of level L (vertical taps for row y) into
+// row, which holds L.width pixels.
+inline void
+pushpull_column_taps (float *row, const PushPullLevel &L, int y,
+                      const PushPullTaps &ytaps, int nchannels)
+{
+    size_t n = size_t(L.width) * nchannels;
+    const int *index = &ytaps.index[y * ytaps.ntaps];
+    const float *weight = &ytaps.weight[y * ytaps.ntaps];
+    std::fill (row, row+n, 0.0f);
+    for (int j = 0;  j < ytaps.ntaps;  ++j) {
+        float w = weight[j];
+        const float *s = L.pixels + index[j] * n;
+        if (w != 0.0f)
+            for (size_t i = 0;  i < n;  ++i)
+                row[i] += w * s[i];
+    }
+}
+
+
+
+// Compute rows roi.ybegin..roi.yend-1 of pyramid level small by
+// filtering level big, then divide the pixels with nonzero alpha by
+// their alpha (this "spreads out" the defined part of the image).
 static bool
-divide_by_alpha (ImageBuf &dst, ROI roi, int nthreads)
+pushpull_reduce_ (const PushPullLevel &big, PushPullLevel &small,
+                  int nchannels, int alpha_channel,
+                  const PushPullTaps &xtaps, const PushPullTaps &ytaps,
+                  ROI roi, int nthreads)
 {
     if (nthreads != 1 && roi.npixels() >= 1000) {
         // Lots of pixels and request for multi threads? Parallelize.
         ImageBufAlgo::parallel_image (
-            boost::bind(divide_by_alpha, boost::ref(dst),
-                        _1 /*roi*/, 1 /*nthreads*/),
+            boost::bind (pushpull_reduce_, boost::cref(big), boost::ref(small),
+                         nchannels, alpha_channel,
+                         boost::cref(xtaps), boost::cref(ytaps),
+                         _1 /*roi*/, 1 /*nthreads*/),
+            roi, nthreads);
+        return true;
+    }
+
+    // Serial case
+    std::vector<float> row (size_t(big.width) * nchannels);
+    for (int y = roi.ybegin;  y < roi.yend;  ++y) {
+        pushpull_column_taps (&row[0], big, y, ytaps, nchannels);
+        float *d = small.pixels + size_t(y) * small.width * nchannels;
+        for (int x = 0;  x < small.width;  ++x, d += nchannels) {
+            pushpull_row_taps (d, &row[0], &xtaps.index[x * xtaps.ntaps],
+                               &xtaps.weight[x * xtaps.ntaps], xtaps.ntaps,
+                               nchannels);
+            float alpha = d[alpha_channel];
+            if (alpha != 0.0f)
+                for (int c = 0;  c < nchannels;  ++c)
+                    d[c] = d[c] / alpha;
+        }
+    }
+    return true;
+}
+
+
+
+// For rows roi.ybegin..roi.yend-1 of pyramid level big, composite big
+// over the enlargement of (already filled) level small, in place,
+// filling the alpha holes of big.
+static bool
+pushpull_expand_ (PushPullLevel &big, const PushPullLevel &small,
+                  int nchannels, int alpha_channel,
+                  const PushPullTaps &xtaps, const PushPullTaps &ytaps,
+                  ROI roi, int nthreads)
+{
+    if (nthreads != 1 && roi.npixels() >= 1000) {
+        // Lots of pixels and request for multi threads? Parallelize.
+        ImageBufAlgo::parallel_image (
+            boost::bind (pushpull_expand_, boost::ref(big), boost::cref(small),
+                         nchannels, alpha_channel,
+                         boost::cref(xtaps), boost::cref(ytaps),
+                         _1 /*roi*/, 1 /*nthreads*/),
             roi, nthreads);
         return true;
     }
 
     // Serial case
-    const ImageSpec &spec (dst.spec());
-    ASSERT (spec.format == TypeDesc::FLOAT);
-    int nc = spec.nchannels;
-    int ac = spec.alpha_channel;
-    for (ImageBuf::Iterator<float> d (dst, roi);  ! d.done();  ++d) {
-        float alpha = d[ac];
-        if (alpha != 0.0f) {
-            for (int c = 0; c < nc; ++c)
-                d[c] = d[c] / alpha;
+    std::vector<float> row (size_t(small.width) * nchannels);
+    float *blowup = ALLOCA (float, nchannels);
+    for (int y = roi.ybegin;  y < roi.yend;  ++y) {
+        pushpull_column_taps (&row[0], small, y, ytaps, nchannels);
+        float *d = big.pixels + size_t(y) * big.width * nchannels;
+        for (int x = 0;  x < big.width;  ++x, d += nchannels) {
+            pushpull_row_taps (blowup, &row[0], &xtaps.index[x * xtaps.ntaps],
+                               &xtaps.weight[x * xtaps.ntaps], xtaps.ntaps,
+                               nchannels);
+            float alpha = clamp (d[alpha_channel], 0.0f, 1.0f);
+            float one_minus_alpha = 1.0f - alpha;
+            for (int c = 0;  c < nchannels;  ++c)
+                d[c] = d[c] + one_minus_alpha * blowup[c];
         }
     }
     return true;
@@ -917,50 +1508,80 @@ ImageBufAlgo::fillholes_pushpull (ImageBuf &dst, const ImageBuf &src,
         return false;
     }
 
-    // We generate a bunch of temp images to form an image pyramid.
-    // These give us a place to stash them and make sure they are
-    // auto-deleted when the function exits.
-    std::vector<boost::shared_ptr<ImageBuf> > pyramid;
+    // The top level of the pyramid is a float copy of src (with its
+    // data and display windows), and each level below it is half the
+    // size of the one above, down to 1x1.  All the levels share a
+    // single arena, allocated up front.
+    const ImageSpec &srcspec (src.spec());
+    int nchannels = srcspec.nchannels;
+    std::vector<PushPullLevel> pyramid;
+    PushPullLevel level = { NULL, srcspec.x, srcspec.y,
+                            srcspec.width, srcspec.height,
+                            srcspec.full_x, srcspec.full_y,
+                            srcspec.full_width, srcspec.full_height };
+    pyramid.push_back (level);
+    while (level.width > 1 || level.height > 1) {
+        level.xbegin = level.ybegin = 0;
+        level.width = std::max (1, level.width/2);
+        level.height = std::max (1, level.height/2);
+        level.full_x = level.full_y = 0;
+        level.full_width = level.width;
+        level.full_height = level.height;
+        pyramid.push_back (level);
+    }
+    imagesize_t arenasize = 0;
+    for (size_t i = 0;  i < pyramid.size();  ++i)
+        arenasize += imagesize_t(pyramid[i].width) * pyramid[i].height * nchannels;
+    boost::scoped_array<float> arena (new float [arenasize]);
+    float *p = arena.get();
+    for (size_t i = 0;  i < pyramid.size();  ++i) {
+        pyramid[i].pixels = p;
+        p += imagesize_t(pyramid[i].width) * pyramid[i].height * nchannels;
+    }
 
-    // First, make a writeable copy of the original image (converting
-    // to float as a convenience) as the top level of the pyramid.
-    ImageSpec topspec = src.spec();
+    ImageSpec topspec = srcspec;
     topspec.set_format (TypeDesc::FLOAT);
-    ImageBuf *top = new ImageBuf (topspec);
-    paste (*top, topspec.x, topspec.y, topspec.z, 0, src);
-    pyramid.push_back (boost::shared_ptr<ImageBuf>(top));
-
-    // Construct the rest of the pyramid by successive x/2 resizing and
-    // then dividing nonzero alpha pixels by their alpha (this "spreads
-    // out" the defined part of the image).
-    int w = src.spec().width, h = src.spec().height;
-    while (w > 1 || h > 1) {
-        w = std::max (1, w/2);
-        h = std::max (1, h/2);
-        ImageSpec smallspec (w, h, src.nchannels(), TypeDesc::FLOAT);
-        ImageBuf *small = new ImageBuf (smallspec);
-        ImageBufAlgo::resize (*small, *pyramid.back(), "triangle");
-        divide_by_alpha (*small, get_roi(smallspec), nthreads);
-        pyramid.push_back (boost::shared_ptr<ImageBuf>(small));
-        //debug small->save();
-    }
-
-    // Now pull back up the pyramid by doing an alpha composite of level
-    // i over a resized level i+1, thus filling in the alpha holes.  By
-    // time we get to the top, pixels whose original alpha are
-    // unchanged, those with alpha < 1 are replaced by the blended
-    // colors of the higher pyramid levels.
+    ImageBuf top (topspec, pyramid[0].pixels);
+    paste (top, topspec.x, topspec.y, topspec.z, 0, src, ROI::All(), nthreads);
+
+    // Push: construct the rest of the pyramid by successive x/2
+    // resizing and then dividing nonzero alpha pixels by their alpha.
+    int alpha_channel = srcspec.alpha_channel;
+    PushPullTaps xtaps, ytaps;
+    for (size_t i = 1;  i < pyramid.size();  ++i) {
+        const PushPullLevel &big (pyramid[i-1]);
+        PushPullLevel &small (pyramid[i]);
+        pushpull_taps (xtaps, small.xbegin, small.width, small.full_x,
+                       small.full_width, big.xbegin, big.width,
+                       big.full_x, big.full_width);
+        pushpull_taps (ytaps, small.ybegin, small.height, small.full_y,
+                       small.full_height, big.ybegin, big.height,
+                       big.full_y, big.full_height);
+        pushpull_reduce_ (big, small, nchannels, alpha_channel, xtaps, ytaps,
+                          ROI (0, small.width, 0, small.height), nthreads);
+    }
+
+    // Pull: back up the pyramid, composite each level over the
+    // enlargement of the (filled) level below it, thus filling in the
+    // alpha holes.  By time we get to the top, pixels whose original
+    // alpha was 1 are unchanged, those with alpha < 1 are replaced by
+    // the blended colors of the lower-resolution levels.
     for (int i = (int)pyramid.size()-2;  i >= 0;  --i) {
-        ImageBuf &big(*pyramid[i]), &small(*pyramid[i+1]);
-        ImageBuf blowup (big.spec());
-        ImageBufAlgo::resize (blowup, small, "triangle");
-        ImageBufAlgo::over (big, big, blowup);
-        //debug big.save (Strutil::format ("after%d.exr", i));
+        PushPullLevel &big (pyramid[i]);
+        const PushPullLevel &small (pyramid[i+1]);
+        pushpull_taps (xtaps, big.xbegin, big.width, big.full_x,
+                       big.full_width, small.xbegin, small.width,
+                       small.full_x, small.full_width);
+        pushpull_taps (ytaps, big.ybegin, big.height, big.full_y,
+                       big.full_height, small.ybegin, small.height,
+                       small.full_y, small.full_height);
+        pushpull_expand_ (big, small, nchannels, alpha_channel, xtaps, ytaps,
+                          ROI (0, big.width, 0, big.height), nthreads);
     }
 
     // Now copy the completed base layer of the pyramid back to the
     // original requested output.
-    paste (dst, dstspec.x, dstspec.y, dstspec.z, 0, *pyramid[0]);
+    paste (dst, dstspec.x, dstspec.y, dstspec.z, 0, top, ROI::All(), nthreads);
 
     return true;
 }
@@ -42,6 +42,7 @@
 
 #include <OpenEXR/half.h>
 
+#include <algorithm>
 #include <cmath>
 #include <iostream>
 #include <limits>
@@ -50,6 +51,8 @@
 #include "OpenImageIO/imagebufalgo.h"
 #include "OpenImageIO/imagebufalgo_util.h"
 #include "OpenImageIO/dassert.h"
+#include "OpenImageIO/simd.h"
+#include "OpenImageIO/thread.h"
 
 #ifdef USE_OPENSSL
 #ifdef __APPLE__
@@ -138,16 +141,190 @@ finalize (ImageBufAlgo::PixelStats &p)
 
 
 
-template <class T>
+// Load channels [roi.chbegin,roi.chend) of pixels [roi.xbegin,roi.xend)
+// of row (y,z) into buf as float, one channel after another, so that
+// the value of channel c of pixel x ends up in
+// buf[(c-roi.chbegin)*roi.width() + (x-roi.xbegin)].  Rows that lie
+// entirely within local pixel memory are read directly; anything else
+// goes through an iterator, which also supplies black outside the data
+// window.
+template<typename T>
+static void
+load_row_ (const ImageBuf &src, const ROI &roi, int y, int z, float *buf)
+{
+    const ImageSpec &spec (src.spec());
+    int width = roi.width();
+    if (src.localpixels() && ! src.deep() &&
+          roi.xbegin >= spec.x && roi.xend <= spec.x+spec.width &&
+          y >= spec.y && y < spec.y+spec.height &&
+          z >= spec.z && z < spec.z+spec.depth) {
+        int nchannels = spec.nchannels;
+        const T *p = (const T *) src.pixeladdr (roi.xbegin, y, z);
+        for (int c = roi.chbegin;  c < roi.chend;  ++c) {
+            float *b = buf + (c-roi.chbegin) * width;
+            const T *pc = p + c;
+            for (int x = 0;  x < width;  ++x, pc += nchannels)
+                b[x] = convert_type<T,float> (*pc);
+        }
+    } else {
+        ROI row (roi.xbegin, roi.xend, y, y+1, z, z+1);
+        int x = 0;
+        for (ImageBuf::ConstIterator<T> s (src, row);  ! s.done();  ++s, ++x)
+            for (int c = roi.chbegin;  c < roi.chend;  ++c)
+                buf[(c-roi.chbegin) * width + x] = s[c];
+    }
+}
+
+
+
+// Shared state of one pass of the statistics/histogram engine.  Each
+// thread accumulates its band of the image privately and merges into
+// this under the lock once, at the end.  Only the channels of the ROI
+// are binned, so hist holds just those, starting with roi.chbegin.  The
+// histogram of each channel has bins+2 slots: slot 0 counts values below
+// min, slots 1..bins the bins themselves, and slot bins+1 values above
+// max and NaNs.
+struct StatsPass {
+    StatsPass (int nchannels, ROI roi, bool stats, int bins,
+               float min, float max)
+        : stats(stats), bins(bins), chbegin(roi.chbegin), min(min), max(max),
+          hist (bins ? roi.nchannels() * (bins+2) : 0, 0)
+    {
+        reset (result, nchannels);
+    }
+    bool stats;            // Compute the PixelStats?
+    int bins;              // Number of histogram bins (0 = no histogram)
+    int chbegin;           // First channel binned
+    float min, max;        // Range spanned by the bins
+    ImageBufAlgo::PixelStats result;
+    std::vector<imagesize_t> hist;
+    spin_mutex mutex;
+};
+
+
+
+// Add n values to the histogram h (bins+2 slots, laid out as described
+// for StatsPass), which holds 4 interleaved copies of each slot -- one
+// for each SIMD lane -- so that runs of equal values don't all wait on
+// the same counter.  The bin indices are computed 4 at a time.
+static void
+bin_values (const float *v, int n, int bins, float min, float max,
+            imagesize_t *h)
+{
+    float ratio = bins / (max - min);
+    simd::float4 vmin (min), vmax (max), vratio (ratio);
+    simd::int4 below (0), one (1), last (bins), above (bins+1);
+    simd::int4 four (4), lane (0, 1, 2, 3);
+    int x = 0;
+    for ( ;  x+4 <= n;  x += 4) {
+        simd::float4 f (v+x);
+        // Map [min,max) to slots 1..bins, clamping in case rounding
+        // pushes a value just below max into slot bins+1.
+        simd::int4 slot = simd::min (simd::int4 ((f-vmin)*vratio) + one, last);
+        slot = simd::blend (above, slot, (f >= vmin) & (f < vmax));
+        slot = simd::blend (slot, last, f == vmax);
+        slot = simd::blend (slot, below, f < vmin);
+        slot = slot * four + lane;
+        int s[4];
+        slot.store (s);
+        ++h[s[0]];  ++h[s[1]];  ++h[s[2]];  ++h[s[3]];
+    }
+    for ( ;  x < n;  ++x) {
+        float f = v[x];
+        int slot;
+        if (f >= min && f < max)
+            slot = std::min ((int)((f-min)*ratio) + 1, bins);
+        else if (f == max)
+            slot = bins;
+        else if (f < min)
+            slot = 0;
+        else
+            slot = bins+1;
+        ++h[4*slot];
+    }
+}
+
+
+
+template<typename T>
 static bool
-computePixelStats_ (const ImageBuf &src, ImageBufAlgo::PixelStats &stats,
-                    ROI roi, int nthreads)
+stats_pass_ (const ImageBuf &src, StatsPass &pass, ROI roi, int nthreads)
 {
-    if (! roi.defined())
-        roi = get_roi (src.spec());
-    else
-        roi.chend = std::min (roi.chend, src.nchannels());
+    if (nthreads != 1 && roi.npixels() >= 1000) {
+        // Lots of pixels and request for multi threads? Parallelize.
+        ImageBufAlgo::parallel_image (
+            boost::bind(stats_pass_<T>, boost::cref(src), boost::ref(pass),
+                        _1 /*roi*/, 1 /*nthreads*/),
+            roi, nthreads);
+        return true;
+    }
+
+    // Serial case
+    int width = roi.width();
+    int nchannels = src.nchannels();
+    int slots = pass.bins ? pass.bins + 2 : 0;
+    std::vector<float> row (roi.nchannels() * width);
+    std::vector<imagesize_t> hist (4 * slots * roi.nchannels(), 0);
+    ImageBufAlgo::PixelStats stats;
+    reset (stats, nchannels);
+    for (int z = roi.zbegin;  z < roi.zend;  ++z) {
+        for (int y = roi.ybegin;  y < roi.yend;  ++y) {
+            load_row_<T> (src, roi, y, z, &row[0]);
+            for (int c = roi.chbegin;  c < roi.chend;  ++c) {
+                const float *v = &row[(c-roi.chbegin) * width];
+                if (slots)
+                    bin_values (v, width, pass.bins, pass.min, pass.max,
+                                &hist[4 * slots * (c-roi.chbegin)]);
+                if (! pass.stats)
+                    continue;
+                // Sum each row separately before adding it to the
+                // totals, so that large images don't lose the precision
+                // of individual values to an already huge running sum.
+                double sum = 0.0, sum2 = 0.0;
+                float mn = stats.min[c], mx = stats.max[c];
+                imagesize_t finite = 0;
+                for (int x = 0;  x < width;  ++x) {
+                    float f = v[x];
+                    if (isfinite (f)) {
+                        ++finite;
+                        sum += f;
+                        sum2 += f*f;
+                        mn = std::min (f, mn);
+                        mx = std::max (f, mx);
+                    } else if (isnan (f)) {
+                        ++stats.nancount[c];
+                    } else {
+                        ++stats.infcount[c];
+                    }
+                }
+                stats.finitecount[c] += finite;
+                stats.sum[c] += sum;
+                stats.sum2[c] += sum2;
+                stats.min[c] = mn;
+                stats.max[c] = mx;
+            }
+        }
+    }
+
+    spin_lock lock (pass.mutex);
+    if (pass.stats)
+        merge (pass.result, stats);
+    for (int c = roi.chbegin;  c < roi.chend && slots;  ++c) {
+        const imagesize_t *h = &hist[4 * slots * (c-roi.chbegin)];
+        imagesize_t *total = &pass.hist[slots * (c-pass.chbegin)];
+        for (int i = 0;  i < slots;  ++i)
+            total[i] += h[4*i] + h[4*i+1] + h[4*i+2] + h[4*i+3];
+    }
+    return true;
+}
 
+
+
+template <class T>
+static bool
+deep_pixel_stats_ (const ImageBuf &src, ImageBufAlgo::PixelStats &stats,
+                   ROI roi, int nthreads)
+{
     int nchannels = src.spec().nchannels;
 
     // Use local storage for smaller batches, then merge the batches
@@ -166,28 +343,14 @@ computePixelStats_ (const ImageBuf &src, ImageBufAlgo::PixelStats &stats,
     int PIXELS_PER_BATCH = std::max (1024,
             static_cast<int>(sqrt((double)src.spec().image_pixels())));
     
-    if (src.deep()) {
-        // Loop over all pixels ...
-        for (ImageBuf::ConstIterator<T> s(src, roi); ! s.done();  ++s) {
-            int samples = s.deep_samples();
-            if (! samples)
-                continue;
-            for (int c = roi.chbegin;  c < roi.chend;  ++c) {
-                for (int i = 0;  i < samples;  ++i) {
-                    float value = s.deep_value (c, i);
-                    val (tmp, c, value);
-                    if ((tmp.finitecount[c] % PIXELS_PER_BATCH) == 0) {
-                        merge (stats, tmp);
-                        reset (tmp, nchannels);
-                    }
-                }
-            }
-        }
-    } else {  // Non-deep case
-        // Loop over all pixels ...
-        for (ImageBuf::ConstIterator<T> s(src, roi); ! s.done();  ++s) {
-            for (int c = roi.chbegin;  c < roi.chend;  ++c) {
-                float value = s[c];
+    // Loop over all pixels ...
+    for (ImageBuf::ConstIterator<T> s(src, roi); ! s.done();  ++s) {
+        int samples = s.deep_samples();
+        if (! samples)
+            continue;
+        for (int c = roi.chbegin;  c < roi.chend;  ++c) {
+            for (int i = 0;  i < samples;  ++i) {
+                float value = s.deep_value (c, i);
                 val (tmp, c, value);
                 if ((tmp.finitecount[c] % PIXELS_PER_BATCH) == 0) {
                     merge (stats, tmp);
@@ -211,6 +374,16 @@ computePixelStats_ (const ImageBuf &src, ImageBufAlgo::PixelStats &stats,
 bool
 ImageBufAlgo::computePixelStats (PixelStats &stats, const ImageBuf &src,
                                  ROI roi, int nthreads)
+{
+    return computePixelStats (stats, src, 0, 0.0f, 1.0f, roi, nthreads);
+}
+
+
+
+bool
+ImageBufAlgo::computePixelStats (PixelStats &stats, const ImageBuf &src,
+                                 int bins, float min, float max,
+                                 ROI roi, int nthreads)
 {
     if (! roi.defined())
         roi = get_roi (src.spec());
@@ -221,11 +394,40 @@ ImageBufAlgo::computePixelStats (PixelStats &stats, const ImageBuf &src,
         src.error ("%d-channel images not supported", nchannels);
         return false;
     }
+    if (bins < 0) {
+        src.error ("The number of bins must not be negative");
+        return false;
+    }
+    if (bins && max <= min) {
+        src.error ("Invalid range, min must be strictly smaller than max");
+        return false;
+    }
 
     bool ok;
-    OIIO_DISPATCH_TYPES (ok, "computePixelStats", computePixelStats_,
-                         src.spec().format, src, stats, roi, nthreads);
-    return ok;
+    if (src.deep()) {
+        if (bins) {
+            src.error ("Histograms of deep images are not supported");
+            return false;
+        }
+        OIIO_DISPATCH_TYPES (ok, "computePixelStats", deep_pixel_stats_,
+                             src.spec().format, src, stats, roi, nthreads);
+        stats.histogram.clear ();
+        return ok;
+    }
+
+    StatsPass pass (nchannels, roi, true, bins, min, max);
+    OIIO_DISPATCH_TYPES (ok, "computePixelStats", stats_pass_,
+                         src.spec().format, src, pass, roi, nthreads);
+    if (! ok)
+        return false;
+    finalize (pass.result);
+    std::swap (stats, pass.result);
+    stats.histogram.assign (nchannels * bins, 0);
+    for (int c = roi.chbegin;  c < roi.chend && bins;  ++c) {
+        const imagesize_t *h = &pass.hist[(c-roi.chbegin)*(bins+2)+1];
+        std::copy (h, h + bins, &stats.histogram[c*bins]);
+    }
+    return ! src.has_error();
 }
 
 
@@ -899,72 +1101,12 @@ ImageBufAlgo::computePixelHashSHA1 (const ImageBuf &src,
 
 
 
-/// histogram_impl -----------------------------------------------------------
-/// Fully type-specialized version of histogram.
-///
-/// Pixel values in min->max range are mapped to 0->(bins-1) range, so that
-/// each value is placed in the appropriate bin. The formula used is:
-/// y = (x-min) * bins/(max-min), where y is the value in the 0->(bins-1)
-/// range and x is the value in the min->max range. There is one special
-/// case x==max for which the formula is not used and x is assigned to the
-/// last bin at position (bins-1) in the vector histogram.
-/// --------------------------------------------------------------------------
-template<class Atype>
-static bool
-histogram_impl (const ImageBuf &A, int channel,
-                std::vector<imagesize_t> &histogram, int bins,
-                float min, float max, imagesize_t *submin,
-                imagesize_t *supermax, ROI roi)
-{
-    // Double check A's type.
-    if (A.spec().format != BaseTypeFromC<Atype>::value) {
-        A.error ("Unsupported pixel data format '%s'", A.spec().format);
-        return false;
-    }
-
-    // Initialize.
-    ImageBuf::ConstIterator<Atype, float> a (A, roi);
-    float ratio = bins / (max-min);
-    int bins_minus_1 = bins-1;
-    bool submin_ok = submin != NULL;
-    bool supermax_ok = supermax != NULL;
-    if (submin_ok)
-        *submin = 0;
-    if (supermax_ok)
-        *supermax = 0;
-    histogram.assign(bins, 0);
-
-    // Compute histogram.
-    for ( ; ! a.done(); a++) {
-        float c = a[channel];
-        if (c >= min && c < max) {
-            // Map range min->max to 0->(bins-1).
-            histogram[ (int) ((c-min) * ratio) ]++;
-        } else if (c == max) {
-            histogram[bins_minus_1]++;
-        } else {
-            if (submin_ok && c < min)
-                (*submin)++;
-            else if (supermax_ok)
-                (*supermax)++;
-        }
-    }
-    return true;
-}
-
-
-
 bool
 ImageBufAlgo::histogram (const ImageBuf &A, int channel,
                          std::vector<imagesize_t> &histogram, int bins,
                          float min, float max, imagesize_t *submin,
-                         imagesize_t *supermax, ROI roi)
+                         imagesize_t *supermax, ROI roi, int nthreads)
 {
-    if (A.spec().format != TypeDesc::TypeFloat) {
-        A.error ("Unsupported pixel data format '%s'", A.spec().format);
-        return false;
-    }
-
     if (A.nchannels() == 0) {
         A.error ("Input image must have at least 1 channel");
         return false;
@@ -989,9 +1131,25 @@ ImageBufAlgo::histogram (const ImageBuf &A, int channel,
     // Specified ROI -> use it. Unspecified ROI -> initialize from A.
     if (! roi.defined())
         roi = get_roi (A.spec());
+    roi.chbegin = channel;
+    roi.chend = channel+1;
 
-    histogram_impl<float> (A, channel, histogram, bins, min, max,
-                                  submin, supermax, roi);
+    // Pixel values in [min,max) are mapped to bins 0..bins-1 by
+    // (x-min)*bins/(max-min); x == max goes to the last bin.
+    StatsPass pass (A.nchannels(), roi, false, bins, min, max);
+    bool ok;
+    OIIO_DISPATCH_TYPES (ok, "histogram", stats_pass_, A.spec().format,
+                         A, pass, roi, nthreads);
+    if (! ok)
+        return false;
+    const imagesize_t *h = &pass.hist[0];
+    histogram.assign (h+1, h+1+bins);
+    if (submin)
+        *submin = h[0];
+    // Without a place to count them separately, values below min are
+    // lumped in with those above max (and NaNs).
+    if (supermax)
+        *supermax = h[bins+1] + (submin ? 0 : h[0]);
 
     return ! A.has_error();
 }
@@ -38,6 +38,7 @@
 #include <OpenEXR/half.h>
 
 #include <cmath>
+#include <cstring>
 #include <iostream>
 
 #include "OpenImageIO/imagebuf.h"
@@ -51,6 +52,64 @@ OIIO_NAMESPACE_ENTER
 {
 
 
+// Copy the pixels of src within srcroi to dst, with srcroi's corner and
+// first channel landing at dstroi's, directly through memory when both
+// images are local, flat, and store the same pixel type T, and srcroi
+// lies within src's data window.  Pixels that fall outside dst's data
+// window are skipped.  Scanlines of whole pixels are copied with one
+// memcpy each; a subset of channels is copied pixel by pixel.  Return
+// false, having copied nothing, if the layout doesn't allow this, in
+// which case the caller should fall back to iterators.
+template<class T>
+static bool
+copy_block_ (ImageBuf &dst, ROI dstroi, const ImageBuf &src, ROI srcroi)
+{
+    if (dst.spec().format != src.spec().format || dst.deep() || src.deep()
+          || ! dst.localpixels() || ! src.localpixels())
+        return false;
+    int nchans = srcroi.nchannels();
+    int dstnchans = dst.nchannels(), srcnchans = src.nchannels();
+    if (srcroi.chbegin < 0 || srcroi.chend > srcnchans ||
+        dstroi.chbegin < 0 || dstroi.chbegin + nchans > dstnchans)
+        return false;
+    int xoff = srcroi.xbegin - dstroi.xbegin;
+    int yoff = srcroi.ybegin - dstroi.ybegin;
+    int zoff = srcroi.zbegin - dstroi.zbegin;
+    // Clip to dst's data window; the corresponding source pixels must
+    // all exist, or they'd need to read as black.
+    ROI droi = roi_intersection (dstroi, dst.roi());
+    if (droi.width() <= 0 || droi.height() <= 0 || droi.depth() <= 0)
+        return true;   // nothing lands in dst
+    if (droi.xbegin+xoff < src.xbegin() || droi.xend+xoff > src.xend() ||
+        droi.ybegin+yoff < src.ybegin() || droi.yend+yoff > src.yend() ||
+        droi.zbegin+zoff < src.zbegin() || droi.zend+zoff > src.zend())
+        return false;
+
+    bool wholepixels = (nchans == dstnchans && nchans == srcnchans);
+    size_t rowbytes = size_t(droi.width()) * dstnchans * sizeof(T);
+    for (int z = droi.zbegin;  z < droi.zend;  ++z) {
+        for (int y = droi.ybegin;  y < droi.yend;  ++y) {
+            T *d = (T *) dst.pixeladdr (droi.xbegin, y, z) + dstroi.chbegin;
+            const T *s = (const T *) src.pixeladdr (droi.xbegin+xoff,
+                                                   y+yoff, z+zoff)
+                         + srcroi.chbegin;
+            if (wholepixels) {
+                memcpy (d, s, rowbytes);
+                continue;
+            }
+            for (int x = droi.xbegin;  x < droi.xend;  ++x) {
+                for (int c = 0;  c < nchans;  ++c)
+                    d[c] = s[c];
+                d += dstnchans;
+                s += srcnchans;
+            }
+        }
+    }
+    return true;
+}
+
+
+
 template<class D, class S>
 static bool
 paste_ (ImageBuf &dst, ROI dstroi,
@@ -63,6 +122,8 @@ paste_ (ImageBuf &dst, ROI dstroi,
     // would benefit little from parallelizing. We can always revisit
     // this later. But in the mean time, we maintain the 'nthreads'
     // parameter for uniformity with the rest of IBA.
+    if (copy_block_<D> (dst, dstroi, src, srcroi))
+        return true;
     int src_nchans = src.nchannels ();
     int dst_nchans = dst.nchannels ();
     ImageBuf::ConstIterator<S,D> s (src, srcroi);
@@ -137,6 +198,8 @@ crop_ (ImageBuf &dst, const ImageBuf &src,
     }
     // Below is the non-deep case
 
+    if (copy_block_<D> (dst, roi, src, roi))
+        return true;
     ImageBuf::ConstIterator<S,D> s (src, roi);
     ImageBuf::Iterator<D,D> d (dst, roi);
     for ( ;  ! d.done();  ++d, ++s) {
@@ -628,6 +691,45 @@ ImageBufAlgo::circular_shift (ImageBuf &dst, const ImageBuf &src,
 
 
 
+// Gather the channels of src into dst (which covers the same pixels
+// and stores the same pixel type T) pixel by pixel: dst channel c gets
+// src channel srcchan[c], or literal[c] if srcchan[c] is negative.
+template<class T>
+static bool
+channels_ (ImageBuf &dst, const ImageBuf &src, const int *srcchan,
+           const float *literal, ROI roi, int nthreads)
+{
+    if (nthreads != 1 && roi.npixels() >= 1000) {
+        // Lots of pixels and request for multi threads? Parallelize.
+        ImageBufAlgo::parallel_image (
+            boost::bind(channels_<T>, boost::ref(dst), boost::cref(src),
+                        srcchan, literal, _1 /*roi*/, 1 /*nthreads*/),
+            roi, nthreads);
+        return true;
+    }
+
+    // Serial case
+    int dstnchans = dst.nchannels(), srcnchans = src.nchannels();
+    T *lit = ALLOCA (T, dstnchans);
+    for (int c = 0;  c < dstnchans;  ++c)
+        lit[c] = convert_type<float,T> (literal[c]);
+    for (int z = roi.zbegin;  z < roi.zend;  ++z) {
+        for (int y = roi.ybegin;  y < roi.yend;  ++y) {
+            T *d = (T *) dst.pixeladdr (roi.xbegin, y, z);
+            const T *s = (const T *) src.pixeladdr (roi.xbegin, y, z);
+            for (int x = roi.xbegin;  x < roi.xend;  ++x) {
+                for (int c = 0;  c < dstnchans;  ++c)
+                    d[c] = srcchan[c] >= 0 ? s[srcchan[c]] : lit[c];
+                d += dstnchans;
+                s += srcnchans;
+            }
+        }
+    }
+    return true;
+}
+
+
+
 bool
 ImageBufAlgo::channels (ImageBuf &dst, const ImageBuf &src,
                         int nchannels, const int *channelorder,
@@ -713,8 +815,7 @@ ImageBufAlgo::channels (ImageBuf &dst, const ImageBuf &src,
         const DeepData &srcdata (*src.deepdata());
         DeepData &dstdata (*dst.deepdata());
         // The earlier dst.alloc() already called dstdata.init()
-        for (int p = 0, npels = (int)newspec.image_pixels(); p < npels; ++p)
-            dstdata.set_samples (p, srcdata.samples(p));
+        dstdata.set_all_samples (srcdata.nsamples);
         dst.deep_alloc ();
         for (int p = 0, npels = (int)newspec.image_pixels(); p < npels; ++p) {
             if (! dstdata.samples(p))
@@ -746,6 +847,26 @@ ImageBufAlgo::channels (ImageBuf &dst, const ImageBuf &src,
     }
     // Below is the non-deep case
 
+    // Local pixels (necessarily of the same type, since dst takes its
+    // format from src) can be gathered directly.
+    if (src.localpixels() && dst.localpixels()) {
+        int *srcchan = ALLOCA (int, nchannels);
+        float *literal = ALLOCA (float, nchannels);
+        for (int c = 0;  c < nchannels;  ++c) {
+            bool valid = (channelorder[c] >= 0 &&
+                          channelorder[c] < src.spec().nchannels);
+            srcchan[c] = valid ? channelorder[c] : -1;
+            literal[c] = (channelorder[c] < 0 && channelvalues)
+                       ? channelvalues[c] : 0.0f;
+        }
+        ROI roi = get_roi (dst.spec());
+        bool ok;
+        OIIO_DISPATCH_TYPES (ok, "channels", channels_,
+                             newspec.format, dst, src, srcchan, literal,
+                             roi, 0);
+        return ok;
+    }
+
     // Copy the channels individually
     stride_t dstxstride = AutoStride, dstystride = AutoStride, dstzstride = AutoStride;
     ImageSpec::auto_stride (dstxstride, dstystride, dstzstride,
@@ -778,6 +899,26 @@ ImageBufAlgo::channels (ImageBuf &dst, const ImageBuf &src,
 
 
 
+// Can channel_append_impl copy straight between the three images'
+// memory over roi?
+static bool
+channel_append_local (const ImageBuf &dst, const ImageBuf &A,
+                      const ImageBuf &B, ROI roi)
+{
+    const ImageBuf *bufs[3] = { &dst, &A, &B };
+    for (int i = 0;  i < 3;  ++i) {
+        const ImageBuf &ib (*bufs[i]);
+        if (ib.deep() || ! ib.localpixels() ||
+            roi.xbegin < ib.xbegin() || roi.xend > ib.xend() ||
+            roi.ybegin < ib.ybegin() || roi.yend > ib.yend() ||
+            roi.zbegin < ib.zbegin() || roi.zend > ib.zend())
+            return false;
+    }
+    return true;
+}
+
+
+
 template<class ABtype>
 static bool
 channel_append_impl (ImageBuf &dst, const ImageBuf &A, const ImageBuf &B,
@@ -786,6 +927,30 @@ channel_append_impl (ImageBuf &dst, const ImageBuf &A, const ImageBuf &B,
     if (nthreads == 1 || roi.npixels() < 1000) {
         int na = A.nchannels(), nb = B.nchannels();
         int n = std::min (dst.nchannels(), na+nb);
+        if (channel_append_local (dst, A, B, roi)) {
+            // All three images are local and cover the ROI, so there
+            // are no missing pixels: copy (converting A and B's type to
+            // float) straight from their memory.
+            int nr = dst.nchannels();
+            int nfroma = std::min (n, na), nfromb = n - nfroma;
+            for (int z = roi.zbegin;  z < roi.zend;  ++z) {
+                for (int y = roi.ybegin;  y < roi.yend;  ++y) {
+                    float *r = (float *) dst.pixeladdr (roi.xbegin, y, z);
+                    const ABtype *a = (const ABtype *) A.pixeladdr (roi.xbegin, y, z);
+                    const ABtype *b = (const ABtype *) B.pixeladdr (roi.xbegin, y, z);
+                    for (int x = roi.xbegin;  x < roi.xend;  ++x) {
+                        for (int c = 0;  c < nfroma;  ++c)
+                            r[c] = convert_type<ABtype,float> (a[c]);
+                        for (int c = 0;  c < nfromb;  ++c)
+                            r[nfroma+c] = convert_type<ABtype,float> (b[c]);
+                        r += nr;
+                        a += na;
+                        b += nb;
+                    }
+                }
+            }
+            return true;
+        }
         ImageBuf::Iterator<float> r (dst, roi);
         ImageBuf::ConstIterator<ABtype> a (A, roi);
         ImageBuf::ConstIterator<ABtype> b (B, roi);
@@ -30,9 +30,12 @@
 
 
 #include <boost/bind.hpp>
+#include <boost/shared_ptr.hpp>
 #include <OpenEXR/half.h>
 
+#include <algorithm>
 #include <cmath>
+#include <limits>
 #include <iostream>
 #include <stdexcept>
 
@@ -40,6 +43,7 @@
 #include "OpenImageIO/imagebufalgo.h"
 #include "OpenImageIO/imagebufalgo_util.h"
 #include "OpenImageIO/dassert.h"
+#include "OpenImageIO/fmath.h"
 #include "OpenImageIO/thread.h"
 
 
@@ -286,5 +290,757 @@ ImageBufAlgo::deepen (ImageBuf &dst, const ImageBuf &src, float zvalue,
 
 
 
+// The roles that the channels of a deep image play in compositing: which
+// channels hold the near and far depths, and for each channel, the alpha
+// channel that it is premultiplied by (or -1 for channels, such as the
+// depths or integer object ids, that are never scaled by alpha).
+struct DeepChannelRoles {
+    int Z, Zback, A, RA, GA, BA;
+    std::vector<int> alpha;   // for each channel [c]
+
+    DeepChannelRoles (const ImageSpec &spec) {
+        int R, G, B;
+        find_deep_channels (spec, A, RA, GA, BA, R, G, B, Z, Zback);
+        if (Z < 0 && spec.z_channel >= 0)
+            Z = Zback = spec.z_channel;
+        if (! (RA >= 0 && GA >= 0 && BA >= 0))
+            RA = GA = BA = -1;   // only use per-channel alpha if complete
+        if (A < 0 && RA < 0)
+            A = spec.alpha_channel;
+        alpha.resize (spec.nchannels, A);
+        for (int c = 0;  c < spec.nchannels;  ++c) {
+            TypeDesc t = spec.channelformat (c);
+            if (c == Z || c == Zback || t.basetype == TypeDesc::UINT ||
+                  t.basetype == TypeDesc::INT ||
+                  t.basetype == TypeDesc::UINT64 ||
+                  t.basetype == TypeDesc::INT64)
+                alpha[c] = -1;
+            else if (RA >= 0 && (c == R || c == RA))
+                alpha[c] = RA;
+            else if (GA >= 0 && (c == G || c == GA))
+                alpha[c] = GA;
+            else if (BA >= 0 && (c == B || c == BA))
+                alpha[c] = BA;
+        }
+    }
+
+    bool valid () const { return Z >= 0 && (A >= 0 || RA >= 0); }
+
+    // Scalar opacity of a sample.
+    float opacity (const float *s) const {
+        return A >= 0 ? s[A] : (s[RA] + s[GA] + s[BA]) * (1.0f/3.0f);
+    }
+
+    // Does the sample block everything behind it?
+    bool opaque (const float *s) const {
+        return A >= 0 ? s[A] >= 1.0f
+                      : (s[RA] >= 1.0f && s[GA] >= 1.0f && s[BA] >= 1.0f);
+    }
+};
+
+
+
+// Check that a deep image has the channels needed for depth compositing,
+// setting an error in dst if not.
+static bool
+check_deep_roles (ImageBuf &dst, const ImageBuf &img,
+                  const DeepChannelRoles &roles)
+{
+    if (! img.deep()) {
+        dst.error ("Deep operations require deep input images");
+        return false;
+    }
+    if (roles.Z < 0) {
+        dst.error ("No Z channel could be identified");
+        return false;
+    }
+    if (! roles.valid()) {
+        dst.error ("No alpha channel could be identified");
+        return false;
+    }
+    return true;
+}
+
+
+
+// Index of pixel (x,y,z) within the DeepData of an image, or -1 if it is
+// outside the data window.
+inline int
+deep_pixel_index (const ImageSpec &spec, int x, int y, int z)
+{
+    x -= spec.x;  y -= spec.y;  z -= spec.z;
+    if (x < 0 || y < 0 || z < 0 ||
+        x >= spec.width || y >= spec.height || z >= spec.depth)
+        return -1;
+    return (z * spec.height + y) * spec.width + x;
+}
+
+
+
+// Working copy of one deep pixel: the samples of every channel, as
+// floats, laid out [sample][channel] so that sorting, splitting, and
+// merging move whole samples at a time.  Channels whose output type is
+// UINT (typically object ids) carry their bits verbatim rather than a
+// converted value, so that they survive the round trip exactly.
+class DeepPixel {
+public:
+    DeepPixel (const std::vector<TypeDesc> &types)
+        : nc(int(types.size())), n(0), m_types(types), m_bits(types.size())
+    {
+        for (int c = 0;  c < nc;  ++c)
+            m_bits[c] = (types[c].basetype == TypeDesc::UINT);
+    }
+
+    int nc;                   // number of channels
+    int n;                    // number of samples
+
+    float *sample (int s) { return &m_val[size_t(s)*nc]; }
+    const float *sample (int s) const { return &m_val[size_t(s)*nc]; }
+
+    void clear () { n = 0;  m_val.clear(); }
+
+    // Append all the samples of a pixel of dd (which must have the same
+    // number of channels, but may have different channel types).
+    void append (const DeepData &dd, int pixel) {
+        int ns = pixel >= 0 ? dd.samples (pixel) : 0;
+        if (! ns)
+            return;
+        size_t first = size_t(n) * nc;
+        n += ns;
+        m_val.resize (size_t(n) * nc);
+        for (int c = 0;  c < nc;  ++c) {
+            float *v = &m_val[first + c];
+            const void *ptr = dd.channel_ptr (pixel, c);
+            TypeDesc t = dd.channeltype (c);
+            if (m_bits[c]) {
+                for (int s = 0;  s < ns;  ++s, v += nc) {
+                    unsigned int u = (t.basetype == TypeDesc::UINT)
+                                   ? ((const unsigned int *)ptr)[s]
+                                   : dd.deep_value_uint (pixel, c, s);
+                    memcpy (v, &u, sizeof(float));
+                }
+            } else if (t == TypeDesc::FLOAT) {
+                for (int s = 0;  s < ns;  ++s, v += nc)
+                    *v = ((const float *)ptr)[s];
+            } else if (t == TypeDesc::HALF) {
+                for (int s = 0;  s < ns;  ++s, v += nc)
+                    *v = ((const half *)ptr)[s];
+            } else {
+                for (int s = 0;  s < ns;  ++s, v += nc)
+                    *v = dd.deep_value (pixel, c, s);
+            }
+        }
+    }
+
+    // Replace the samples of a pixel of dd (whose channel types must be
+    // the ones we were constructed with) with n samples laid out like
+    // ours.
+    void store (DeepData &dd, int pixel, const float *val, int n) const {
+        dd.set_samples (pixel, n);
+        if (! n)
+            return;
+        for (int c = 0;  c < nc;  ++c) {
+            const float *v = val + c;
+            void *ptr = dd.channel_ptr (pixel, c);
+            if (m_bits[c]) {
+                for (int s = 0;  s < n;  ++s, v += nc)
+                    memcpy ((unsigned int *)ptr + s, v, sizeof(float));
+            } else if (m_types[c] == TypeDesc::FLOAT) {
+                for (int s = 0;  s < n;  ++s, v += nc)
+                    ((float *)ptr)[s] = *v;
+            } else if (m_types[c] == TypeDesc::HALF) {
+                for (int s = 0;  s < n;  ++s, v += nc)
+                    ((half *)ptr)[s] = *v;
+            } else {
+                for (int s = 0;  s < n;  ++s, v += nc)
+                    dd.set_deep_value (pixel, c, s, *v);
+            }
+        }
+    }
+
+    // Rearranging samples: begin_rebuild(), then add_sample() for each
+    // sample of the new list (in order), then end_rebuild() to make it
+    // the current list.
+    void begin_rebuild () { m_tmp.clear(); }
+    float *add_sample () {
+        m_tmp.resize (m_tmp.size() + nc);
+        return &m_tmp[m_tmp.size() - nc];
+    }
+    void add_sample (const float *s) {
+        memcpy (add_sample(), s, nc*sizeof(float));
+    }
+    void end_rebuild () {
+        m_val.swap (m_tmp);
+        n = nc ? int(m_val.size() / nc) : 0;
+    }
+
+    // Scratch space of at least size floats, for per-pixel temporaries
+    // that scale with the number of samples (too many for the stack).
+    // It is reused from pixel to pixel, and its contents are undefined.
+    float *scratch (size_t size) {
+        if (m_scratch.size() < size)
+            m_scratch.resize (size);
+        return size ? &m_scratch[0] : NULL;
+    }
+
+private:
+    std::vector<TypeDesc> m_types;
+    std::vector<bool> m_bits;
+    std::vector<float> m_val;   // [s][c]
+    std::vector<float> m_tmp;   // scratch for rebuilding
+    std::vector<float> m_scratch;  // see scratch()
+};
+
+
+
+// Comparison functor ordering samples by near depth, then far depth.
+struct DeepSampleLess {
+    DeepSampleLess (const DeepPixel &pix, const DeepChannelRoles &roles)
+        : pix(pix), Z(roles.Z), Zback(roles.Zback) {}
+    bool operator() (int a, int b) const {
+        const float *sa = pix.sample(a), *sb = pix.sample(b);
+        return sa[Z] < sb[Z] || (sa[Z] == sb[Z] && sa[Zback] < sb[Zback]);
+    }
+    const DeepPixel &pix;
+    int Z, Zback;
+};
+
+
+
+// Sort the samples of a pixel front to back (stably, so that samples at
+// the same depth keep their relative order).  Return true if any samples
+// overlap in depth other than by exactly coinciding, i.e. if they will
+// need splitting to be tidy.
+static bool
+sort_samples (DeepPixel &pix, const DeepChannelRoles &roles)
+{
+    const int Z = roles.Z, Zback = roles.Zback;
+    DeepSampleLess less (pix, roles);
+    bool sorted = true;
+    for (int s = 1;  s < pix.n && sorted;  ++s)
+        sorted = ! less (s, s-1);
+    if (! sorted) {
+        std::vector<int> order (pix.n);
+        for (int s = 0;  s < pix.n;  ++s)
+            order[s] = s;
+        std::stable_sort (order.begin(), order.end(), less);
+        pix.begin_rebuild ();
+        for (int s = 0;  s < pix.n;  ++s)
+            pix.add_sample (pix.sample (order[s]));
+        pix.end_rebuild ();
+    }
+    float farthest = -std::numeric_limits<float>::max();
+    for (int s = 0;  s < pix.n;  ++s) {
+        const float *samp = pix.sample (s);
+        if (samp[Z] < farthest) {
+            const float *prev = pix.sample (s-1);
+            if (samp[Z] != prev[Z] || samp[Zback] != prev[Zback] ||
+                  prev[Zback] != farthest)
+                return true;
+        }
+        farthest = std::max (farthest, samp[Zback]);
+    }
+    return false;
+}
+
+
+
+// Split volumetric sample src at depth d (which must lie between its Z
+// and Zback) into front and back pieces, following the rules in
+// "Interpreting OpenEXR Deep Pixels": alpha of a fraction x of a sample
+// is 1-(1-alpha)^x, and premultiplied colors scale along with it.  It's
+// ok for front or back to be the same memory as src.
+static void
+split_sample (const float *insrc, float *front, float *back, float d,
+              const DeepChannelRoles &roles, int nc)
+{
+    float *src = OIIO_ALLOCA (float, nc);
+    memcpy (src, insrc, nc*sizeof(float));
+    float z = src[roles.Z], zback = src[roles.Zback];
+    float x = (d - z) / (zback - z);
+    for (int c = 0;  c < nc;  ++c) {
+        int ac = roles.alpha[c];
+        if (ac < 0) {
+            front[c] = back[c] = src[c];
+            continue;
+        }
+        float a = src[ac];
+        if (a >= 1.0f) {
+            front[c] = back[c] = src[c];
+        } else if (a <= 0.0f) {
+            front[c] = src[c] * x;
+            back[c] = src[c] * (1.0f - x);
+        } else {
+            float frontalpha = 1.0f - powf (1.0f - a, x);
+            float backalpha = 1.0f - powf (1.0f - a, 1.0f - x);
+            front[c] = src[c] * (frontalpha / a);
+            back[c] = src[c] * (backalpha / a);
+        }
+    }
+    front[roles.Z] = z;
+    front[roles.Zback] = d;
+    back[roles.Z] = d;
+    back[roles.Zback] = zback;
+}
+
+
+
+// Split every volumetric sample at every depth where another sample
+// begins or ends, so that any two samples either coincide exactly or do
+// not overlap at all.  The result is left unsorted.
+static void
+split_overlaps (DeepPixel &pix, const DeepChannelRoles &roles)
+{
+    float *depths = pix.scratch (2*size_t(pix.n));
+    for (int s = 0;  s < pix.n;  ++s) {
+        depths[2*s] = pix.sample(s)[roles.Z];
+        depths[2*s+1] = pix.sample(s)[roles.Zback];
+    }
+    std::sort (depths, depths + 2*pix.n);
+    float *depthsend = std::unique (depths, depths + 2*pix.n);
+
+    float *piece = OIIO_ALLOCA (float, pix.nc);
+    pix.begin_rebuild ();
+    for (int s = 0;  s < pix.n;  ++s) {
+        memcpy (piece, pix.sample(s), pix.nc*sizeof(float));
+        const float *d = std::upper_bound (depths, depthsend, piece[roles.Z]);
+        for ( ;  d != depthsend && *d < piece[roles.Zback];  ++d)
+            split_sample (piece, pix.add_sample(), piece, *d, roles, pix.nc);
+        pix.add_sample (piece);
+    }
+    pix.end_rebuild ();
+}
+
+
+
+// Combine a run of n samples that occupy exactly the same depth range
+// into one, as coincident volumes of mixed media: the optical densities
+// (-log(1-alpha)) add, and each sample contributes color in proportion
+// to its share of the density.
+static void
+merge_coincident (const float *run, int n, float *result,
+                  const DeepChannelRoles &roles, int nc)
+{
+    for (int c = 0;  c < nc;  ++c) {
+        int ac = roles.alpha[c];
+        if (ac < 0) {
+            result[c] = run[c];   // depths, ids: take the first
+            continue;
+        }
+        // Opaque samples dominate everything coincident with them
+        int nopaque = 0;
+        float opaquesum = 0.0f;
+        for (int s = 0;  s < n;  ++s)
+            if (run[s*nc+ac] >= 1.0f) {
+                ++nopaque;
+                opaquesum += run[s*nc+c];
+            }
+        if (nopaque) {
+            result[c] = opaquesum / nopaque;
+            continue;
+        }
+        float density = 0.0f, sum = 0.0f;
+        for (int s = 0;  s < n;  ++s) {
+            float a = std::max (run[s*nc+ac], 0.0f);
+            float u = -logf (1.0f - a);
+            density += u;
+            sum += run[s*nc+c] * (a > 0.0f ? u / a : 1.0f);
+        }
+        float a = 1.0f - expf (-density);
+        result[c] = sum * (density > 0.0f ? a / density : 1.0f);
+    }
+}
+
+
+
+// Put the samples of a pixel into tidy form: sorted front to back, with
+// overlapping volumes split and coincident samples merged.  If
+// occlusion_cull is true, also discard all samples behind the first
+// opaque one.
+static void
+tidy_samples (DeepPixel &pix, const DeepChannelRoles &roles,
+              bool occlusion_cull)
+{
+    if (sort_samples (pix, roles)) {
+        split_overlaps (pix, roles);
+        sort_samples (pix, roles);
+    }
+    const int Z = roles.Z, Zback = roles.Zback, nc = pix.nc;
+    bool coincident = false;
+    for (int s = 1;  s < pix.n && ! coincident;  ++s)
+        coincident = (pix.sample(s)[Z] == pix.sample(s-1)[Z] &&
+                      pix.sample(s)[Zback] == pix.sample(s-1)[Zback]);
+    if (coincident) {
+        pix.begin_rebuild ();
+        for (int s = 0;  s < pix.n;  ) {
+            int e = s + 1;
+            while (e < pix.n && pix.sample(e)[Z] == pix.sample(s)[Z] &&
+                   pix.sample(e)[Zback] == pix.sample(s)[Zback])
+                ++e;
+            if (e - s == 1)
+                pix.add_sample (pix.sample(s));
+            else
+                merge_coincident (pix.sample(s), e-s, pix.add_sample(),
+                                  roles, nc);
+            s = e;
+        }
+        pix.end_rebuild ();
+    }
+    if (occlusion_cull) {
+        for (int s = 0;  s < pix.n;  ++s)
+            if (roles.opaque (pix.sample(s))) {
+                pix.n = s + 1;
+                break;
+            }
+    }
+}
+
+
+
+// Per-pixel kernels for deep_apply.  Each fills in pix (which is empty
+// on entry) with the result for pixel (x,y,z).
+
+struct DeepSortKernel {
+    DeepSortKernel (const ImageBuf &src)
+        : src(src), roles(src.spec()) {}
+    void operator() (DeepPixel &pix, int x, int y, int z) const {
+        pix.append (*src.deepdata(), deep_pixel_index (src.spec(), x, y, z));
+        sort_samples (pix, roles);
+    }
+    const ImageBuf &src;
+    DeepChannelRoles roles;
+};
+
+
+struct DeepTidyKernel {
+    DeepTidyKernel (const ImageBuf &src, bool occlusion_cull)
+        : src(src), roles(src.spec()), occlusion_cull(occlusion_cull) {}
+    void operator() (DeepPixel &pix, int x, int y, int z) const {
+        pix.append (*src.deepdata(), deep_pixel_index (src.spec(), x, y, z));
+        tidy_samples (pix, roles, occlusion_cull);
+    }
+    const ImageBuf &src;
+    DeepChannelRoles roles;
+    bool occlusion_cull;
+};
+
+
+struct DeepMergeKernel {
+    DeepMergeKernel (const ImageBuf &A, const ImageBuf &B,
+                     bool occlusion_cull)
+        : A(A), B(B), roles(A.spec()), occlusion_cull(occlusion_cull) {}
+    void operator() (DeepPixel &pix, int x, int y, int z) const {
+        pix.append (*A.deepdata(), deep_pixel_index (A.spec(), x, y, z));
+        pix.append (*B.deepdata(), deep_pixel_index (B.spec(), x, y, z));
+        tidy_samples (pix, roles, occlusion_cull);
+    }
+    const ImageBuf &A, &B;
+    DeepChannelRoles roles;
+    bool occlusion_cull;
+};
+
+
+struct DeepHoldoutKernel {
+    DeepHoldoutKernel (const ImageBuf &src, const ImageBuf &holdout)
+        : src(src), holdout(holdout), roles(src.spec()),
+          hroles(holdout.spec()) {}
+    void operator() (DeepPixel &pix, int x, int y, int z) const {
+        pix.append (*src.deepdata(), deep_pixel_index (src.spec(), x, y, z));
+        int hp = deep_pixel_index (holdout.spec(), x, y, z);
+        const DeepData &hd (*holdout.deepdata());
+        int hn = hd.samples (hp);
+        if (! hn || ! pix.n)
+            return;
+        // Gather the holdout's depths and opacities once per pixel
+        float *hz = pix.scratch (3*size_t(hn));
+        float *hzback = hz + hn, *halpha = hz + 2*hn;
+        for (int h = 0;  h < hn;  ++h) {
+            hz[h] = hd.deep_value (hp, hroles.Z, h);
+            hzback[h] = hd.deep_value (hp, hroles.Zback, h);
+            halpha[h] = hroles.A >= 0 ? hd.deep_value (hp, hroles.A, h)
+                      : (hd.deep_value (hp, hroles.RA, h) +
+                         hd.deep_value (hp, hroles.GA, h) +
+                         hd.deep_value (hp, hroles.BA, h)) * (1.0f/3.0f);
+            halpha[h] = clamp (halpha[h], 0.0f, 1.0f);
+        }
+        pix.begin_rebuild ();
+        for (int s = 0;  s < pix.n;  ++s) {
+            // Transmission of the holdout in front of the sample
+            float d = pix.sample(s)[roles.Z];
+            float t = 1.0f;
+            for (int h = 0;  h < hn;  ++h) {
+                if (hz[h] >= d)
+                    continue;
+                if (hzback[h] > d)   // partly in front: use that fraction
+                    t *= powf (1.0f - halpha[h],
+                               (d - hz[h]) / (hzback[h] - hz[h]));
+                else
+                    t *= 1.0f - halpha[h];
+            }
+            if (t <= 0.0f)
+                continue;   // completely held out
+            float *out = pix.add_sample ();
+            const float *in = pix.sample (s);
+            for (int c = 0;  c < pix.nc;  ++c)
+                out[c] = roles.alpha[c] >= 0 ? in[c] * t : in[c];
+        }
+        pix.end_rebuild ();
+    }
+    const ImageBuf &src, &holdout;
+    DeepChannelRoles roles, hroles;
+};
+
+
+struct DeepTrimKernel {
+    DeepTrimKernel (const ImageBuf &src, float zmin, float zmax)
+        : src(src), roles(src.spec()), zmin(zmin), zmax(zmax) {}
+    void operator() (DeepPixel &pix, int x, int y, int z) const {
+        pix.append (*src.deepdata(), deep_pixel_index (src.spec(), x, y, z));
+        if (! pix.n)
+            return;
+        float *discard = OIIO_ALLOCA (float, pix.nc);
+        pix.begin_rebuild ();
+        for (int s = 0;  s < pix.n;  ++s) {
+            const float *in = pix.sample (s);
+            float sz = in[roles.Z], szback = in[roles.Zback];
+            if (szback < zmin || sz > zmax ||
+                  (sz < szback && (szback == zmin || sz == zmax)))
+                continue;
+            float *out = pix.add_sample ();
+            memcpy (out, in, pix.nc*sizeof(float));
+            if (sz < zmin)
+                split_sample (out, discard, out, zmin, roles, pix.nc);
+            if (szback > zmax)
+                split_sample (out, out, discard, zmax, roles, pix.nc);
+        }
+        pix.end_rebuild ();
+    }
+    const ImageBuf &src;
+    DeepChannelRoles roles;
+    float zmin, zmax;
+};
+
+
+
+// The results computed by one thread of deep_apply: the samples of each
+// pixel of roi, in DeepPixel layout, one pixel after another.
+struct DeepChunk {
+    ROI roi;
+    std::vector<unsigned int> nsamples;   // for each pixel
+    std::vector<size_t> first;            // for each pixel, index in values
+    std::vector<float> values;
+};
+typedef boost::shared_ptr<DeepChunk> DeepChunkRef;
+
+
+
+template<class KERNEL>
+static void
+deep_apply_chunk (const KERNEL &kernel, const std::vector<TypeDesc> &types,
+                  std::vector<DeepChunkRef> &chunks, mutex &chunks_mutex,
+                  ROI roi)
+{
+    DeepChunkRef chunk (new DeepChunk);
+    chunk->roi = roi;
+    chunk->nsamples.resize (roi.npixels());
+    chunk->first.resize (roi.npixels());
+    DeepPixel pix (types);
+    int p = 0;
+    for (int z = roi.zbegin;  z < roi.zend;  ++z)
+        for (int y = roi.ybegin;  y < roi.yend;  ++y)
+            for (int x = roi.xbegin;  x < roi.xend;  ++x, ++p) {
+                pix.clear ();
+                kernel (pix, x, y, z);
+                chunk->nsamples[p] = pix.n;
+                chunk->first[p] = chunk->values.size();
+                if (pix.n)
+                    chunk->values.insert (chunk->values.end(), pix.sample(0),
+                                          pix.sample(0) + size_t(pix.n)*pix.nc);
+            }
+    lock_guard lock (chunks_mutex);
+    chunks.push_back (chunk);
+}
+
+
+
+static void
+deep_copy_chunks (DeepData &dst, const ImageSpec &dstspec,
+                  const std::vector<DeepChunkRef> &chunks, ROI roi)
+{
+    DeepPixel pix (dst.channeltypes);
+    for (size_t i = 0;  i < chunks.size();  ++i) {
+        const DeepChunk &chunk (*chunks[i]);
+        ROI r = roi_intersection (roi, chunk.roi);
+        if (r.npixels() <= 0)
+            continue;
+        for (int z = r.zbegin;  z < r.zend;  ++z)
+            for (int y = r.ybegin;  y < r.yend;  ++y)
+                for (int x = r.xbegin;  x < r.xend;  ++x) {
+                    int p = ((z - chunk.roi.zbegin) * chunk.roi.height() +
+                             (y - chunk.roi.ybegin)) * chunk.roi.width() +
+                            (x - chunk.roi.xbegin);
+                    if (int n = chunk.nsamples[p])
+                        pix.store (dst, deep_pixel_index (dstspec, x, y, z),
+                                   &chunk.values[chunk.first[p]], n);
+                }
+    }
+}
+
+
+
+// Compute each pixel of roi in deep image dst with kernel.  Threads never
+// add samples to a shared DeepData: each one builds its pixels in a
+// private buffer, then the sample counts are set in dst (growing its
+// arena at most once per pixel), and finally the sample values are copied
+// in parallel into space that is already reserved.  This means that the
+// kernel's inputs may include dst itself.
+template<class KERNEL>
+static bool
+deep_apply (ImageBuf &dst, const KERNEL &kernel, ROI roi, int nthreads)
+{
+    DeepData &dd (*dst.deepdata());
+    std::vector<DeepChunkRef> chunks;
+    mutex chunks_mutex;
+    ImageBufAlgo::parallel_image (
+        boost::bind (deep_apply_chunk<KERNEL>, boost::cref(kernel),
+                     boost::cref(dd.channeltypes), boost::ref(chunks),
+                     boost::ref(chunks_mutex), _1),
+        roi, nthreads);
+
+    const ImageSpec &spec (dst.spec());
+    for (size_t i = 0;  i < chunks.size();  ++i) {
+        const DeepChunk &chunk (*chunks[i]);
+        const ROI &r (chunk.roi);
+        int p = 0;
+        for (int z = r.zbegin;  z < r.zend;  ++z)
+            for (int y = r.ybegin;  y < r.yend;  ++y)
+                for (int x = r.xbegin;  x < r.xend;  ++x, ++p)
+                    dd.set_samples (deep_pixel_index (spec, x, y, z),
+                                    chunk.nsamples[p]);
+    }
+    if (dd.data.size() == 0)
+        dst.deep_alloc ();
+
+    ImageBufAlgo::parallel_image (
+        boost::bind (deep_copy_chunks, boost::ref(dd), boost::cref(spec),
+                     boost::cref(chunks), _1),
+        roi, nthreads);
+    return true;
+}
+
+
+
+// Common setup for the deep ops: make dst a deep image like src (if it
+// isn't already initialized) and check that src has what we need.
+static bool
+deep_prep (ROI &roi, ImageBuf &dst, const ImageBuf &src,
+           const ImageBuf *B = NULL)
+{
+    if (! ImageBufAlgo::IBAprep (roi, &dst, &src, B, NULL,
+                                 ImageBufAlgo::IBAprep_SUPPORT_DEEP))
+        return false;
+    if (! dst.deep()) {
+        dst.error ("Cannot write deep results to a flat image");
+        return false;
+    }
+    if (dst.nchannels() != src.nchannels()) {
+        dst.error ("Images must have the same number of channels");
+        return false;
+    }
+    return check_deep_roles (dst, src, DeepChannelRoles (src.spec()));
+}
+
+
+
+bool
+ImageBufAlgo::deep_sort (ImageBuf &dst, const ImageBuf &src,
+                         ROI roi, int nthreads)
+{
+    if (! deep_prep (roi, dst, src))
+        return false;
+    return deep_apply (dst, DeepSortKernel (src), roi, nthreads);
+}
+
+
+
+bool
+ImageBufAlgo::deep_tidy (ImageBuf &dst, const ImageBuf &src,
+                         bool occlusion_cull, ROI roi, int nthreads)
+{
+    if (! deep_prep (roi, dst, src))
+        return false;
+    return deep_apply (dst, DeepTidyKernel (src, occlusion_cull),
+                       roi, nthreads);
+}
+
+
+
+bool
+ImageBufAlgo::deep_merge (ImageBuf &dst, const ImageBuf &A,
+                          const ImageBuf &B, bool occlusion_cull,
+                          ROI roi, int nthreads)
+{
+    if (! A.deep() || ! B.deep()) {
+        dst.error ("deep_merge requires deep input images");
+        return false;
+    }
+    if (A.spec().channelnames != B.spec().channelnames) {
+        dst.error ("deep_merge requires images with the same channels");
+        return false;
+    }
+    if (! dst.initialized() && A.initialized() && B.initialized()) {
+        // Make a result that covers both inputs, with each channel in
+        // the type of the inputs if they agree, or float if they don't
+        // (but preserve integer ids).
+        ImageSpec spec = A.spec();
+        const ImageSpec &Bspec (B.spec());
+        std::vector<TypeDesc> types;
+        spec.get_channelformats (types);
+        for (int c = 0;  c < spec.nchannels;  ++c)
+            if (Bspec.channelformat(c) != types[c] &&
+                  types[c].basetype != TypeDesc::UINT)
+                types[c] = Bspec.channelformat(c).basetype == TypeDesc::UINT
+                         ? TypeDesc::UINT : TypeDesc::FLOAT;
+        spec.channelformats = types;
+        spec.tile_width = spec.tile_height = spec.tile_depth = 0;
+        if (! roi.defined())
+            roi = roi_union (A.roi(), B.roi());
+        set_roi (spec, roi);
+        set_roi_full (spec, roi_union (A.roi_full(), B.roi_full()));
+        spec.erase_attribute ("oiio:SHA-1");
+        dst.reset (spec);
+    }
+    if (! deep_prep (roi, dst, A, &B) ||
+          ! check_deep_roles (dst, B, DeepChannelRoles (B.spec())))
+        return false;
+    return deep_apply (dst, DeepMergeKernel (A, B, occlusion_cull),
+                       roi, nthreads);
+}
+
+
+
+bool
+ImageBufAlgo::deep_holdout (ImageBuf &dst, const ImageBuf &src,
+                            const ImageBuf &holdout, ROI roi, int nthreads)
+{
+    if (! deep_prep (roi, dst, src) ||
+          ! check_deep_roles (dst, holdout, DeepChannelRoles (holdout.spec())))
+        return false;
+    return deep_apply (dst, DeepHoldoutKernel (src, holdout), roi, nthreads);
+}
+
+
+
+bool
+ImageBufAlgo::deep_trim (ImageBuf &dst, const ImageBuf &src,
+                         float zmin, float zmax, ROI roi, int nthreads)
+{
+    if (! deep_prep (roi, dst, src))
+        return false;
+    return deep_apply (dst, DeepTrimKernel (src, zmin, zmax), roi, nthreads);
+}
+
+
+
 }
 OIIO_NAMESPACE_EXIT
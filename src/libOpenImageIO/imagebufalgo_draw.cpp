@@ -35,6 +35,7 @@
 #include <OpenEXR/half.h>
 
 #include <cmath>
+#include <map>
 
 #include "OpenImageIO/imagebuf.h"
 #include "OpenImageIO/imagebufalgo.h"
@@ -406,39 +407,54 @@ static bool ft_broken = false;
 static const char * default_font_name[] = {
         "DroidSans", "cour", "Courier New", "FreeMono", NULL
      };
-} // anon namespace
-#endif
 
+// A rasterized glyph: its 8-bit coverage mask and its placement relative
+// to the pen position.  Glyphs are never modified once cached, so they
+// may be composited without holding ft_mutex.
+struct TextGlyph {
+    int left, top;        // offset of the bitmap from the pen position
+    int width, rows;      // bitmap size
+    int advance;          // pen advance, in pixels
+    std::vector<unsigned char> coverage;   // width*rows, 0-255
+};
+typedef boost::shared_ptr<TextGlyph> TextGlyphRef;
+
+// A font face at one pixel size, and the glyphs rasterized from it so far
+// (a NULL entry means FreeType could not render that character).
+struct TextFace {
+    FT_Face face;
+    long long last_use;   // ft_use_clock when last looked up, for LRU
+    std::map<uint32_t,TextGlyphRef> glyphs;
+};
 
-bool
-ImageBufAlgo::render_text (ImageBuf &R, int x, int y, string_view text,
-                           int fontsize, string_view font_,
-                           const float *textcolor)
-{
-    if (R.spec().depth > 1) {
-        R.error ("ImageBufAlgo::render_text does not support volume images");
-        return false;
-    }
-
-#ifdef USE_FREETYPE
-    // If we know FT is broken, don't bother trying again
-    if (ft_broken)
-        return false;
+// Process-wide caches, all protected by ft_mutex: the font file that each
+// requested font name resolved to, and the faces opened from them,
+// keyed by (file, size).  They are bounded: past ft_max_faces open faces
+// the least recently used one is closed, a face drops its glyphs once it
+// has ft_max_glyphs of them, and the font file lookups are forgotten once
+// there are ft_max_font_files of them.
+static const size_t ft_max_faces = 16;
+static const size_t ft_max_glyphs = 1024;
+static const size_t ft_max_font_files = 64;
+static std::map<std::string,std::string> ft_font_files;
+static std::map<std::pair<std::string,int>,TextFace *> ft_faces;
+static long long ft_use_clock = 0;
+
+// A glyph positioned on the target image.
+struct PlacedGlyph {
+    PlacedGlyph (const TextGlyphRef &g, int x, int y) : glyph(g), x(x), y(y) { }
+    TextGlyphRef glyph;
+    int x, y;             // image position of the bitmap's upper left
+};
 
-    // Thread safety
-    lock_guard ft_lock (ft_mutex);
-    int error = 0;
 
-    // If FT not yet initialized, do it now.
-    if (! ft_library) {
-        error = FT_Init_FreeType (&ft_library);
-        if (error) {
-            ft_broken = true;
-            R.error ("Could not initialize FreeType for font rendering");
-            return false;
-        }
-    }
 
+// Find the font file for the font name (or path) requested, searching
+// the usual font directories.  Return the empty string and set err if it
+// can't be found.
+static std::string
+find_font_file (const std::string &font_, std::string &err)
+{
     // A set of likely directories for fonts to live, across several systems.
     std::vector<std::string> search_dirs;
     const char *home = getenv ("HOME");
@@ -479,8 +495,8 @@ ImageBufAlgo::render_text (ImageBuf &R, int x, int y, string_view text,
                                                  search_dirs, true, true);
         }
         if (font.empty()) {
-            R.error ("Could not set default font face");
-            return false;
+            err = "Could not set default font face";
+            return std::string();
         }
     } else if (Filesystem::is_regular (font)) {
         // directly specified a filename -- use it
@@ -492,23 +508,51 @@ ImageBufAlgo::render_text (ImageBuf &R, int x, int y, string_view text,
             f = Filesystem::searchpath_find (font+extensions[i],
                                              search_dirs, true, true);
         if (f.empty()) {
-            R.error ("Could not set font face to \"%s\"", font);
-            return false;
+            err = Strutil::format ("Could not set font face to \"%s\"", font);
+            return std::string();
         }
         font = f;
     }
 
     ASSERT (! font.empty());
     if (! Filesystem::is_regular (font)) {
-        R.error ("Could not find font \"%s\"", font);
-        return false;
+        err = Strutil::format ("Could not find font \"%s\"", font);
+        return std::string();
+    }
+    return font;
+}
+
+
+
+// Return the cached face for the requested font and size, opening it if
+// necessary.  Return NULL and set err on failure.  The caller must hold
+// ft_mutex.
+static TextFace *
+get_text_face (const std::string &fontname, int fontsize, std::string &err)
+{
+    std::map<std::string,std::string>::iterator f = ft_font_files.find (fontname);
+    if (f == ft_font_files.end()) {
+        std::string file = find_font_file (fontname, err);
+        if (file.empty())
+            return NULL;
+        if (ft_font_files.size() >= ft_max_font_files)
+            ft_font_files.clear ();
+        f = ft_font_files.insert (std::make_pair (fontname, file)).first;
+    }
+    const std::string &font (f->second);
+
+    std::pair<std::string,int> key (font, fontsize);
+    std::map<std::pair<std::string,int>,TextFace *>::iterator found = ft_faces.find (key);
+    if (found != ft_faces.end()) {
+        found->second->last_use = ++ft_use_clock;
+        return found->second;
     }
 
     FT_Face face;      // handle to face object
-    error = FT_New_Face (ft_library, font.c_str(), 0 /* face index */, &face);
+    int error = FT_New_Face (ft_library, font.c_str(), 0 /* face index */, &face);
     if (error) {
-        R.error ("Could not set font face to \"%s\"", font);
-        return false;  // couldn't open the face
+        err = Strutil::format ("Could not set font face to \"%s\"", font);
+        return NULL;  // couldn't open the face
     }
 
     error = FT_Set_Pixel_Sizes (face,        // handle to face object
@@ -516,46 +560,189 @@ ImageBufAlgo::render_text (ImageBuf &R, int x, int y, string_view text,
                                 fontsize);   // pixel_heigh
     if (error) {
         FT_Done_Face (face);
-        R.error ("Could not set font size to %d", fontsize);
-        return false;  // couldn't set the character size
+        err = Strutil::format ("Could not set font size to %d", fontsize);
+        return NULL;  // couldn't set the character size
+    }
+
+    if (ft_faces.size() >= ft_max_faces) {
+        // Close the least recently used face.  Glyphs already handed out
+        // are reference counted copies, so they outlive it.
+        std::map<std::pair<std::string,int>,TextFace *>::iterator lru = ft_faces.begin();
+        for (found = ft_faces.begin();  found != ft_faces.end();  ++found)
+            if (found->second->last_use < lru->second->last_use)
+                lru = found;
+        FT_Done_Face (lru->second->face);
+        delete lru->second;
+        ft_faces.erase (lru);
+    }
+
+    TextFace *tf = new TextFace;
+    tf->face = face;
+    tf->last_use = ++ft_use_clock;
+    ft_faces[key] = tf;
+    return tf;
+}
+
+
+
+// Return the cached glyph for character ch, rasterizing it if necessary
+// (NULL if FreeType can't render it).  The caller must hold ft_mutex.
+static TextGlyphRef
+get_text_glyph (TextFace *tf, uint32_t ch)
+{
+    std::map<uint32_t,TextGlyphRef>::iterator found = tf->glyphs.find (ch);
+    if (found != tf->glyphs.end())
+        return found->second;
+
+    if (tf->glyphs.size() >= ft_max_glyphs)
+        tf->glyphs.clear ();
+    TextGlyphRef glyph;
+    if (FT_Load_Char (tf->face, ch, FT_LOAD_RENDER) == 0) {
+        FT_GlyphSlot slot = tf->face->glyph;  // a small shortcut
+        glyph.reset (new TextGlyph);
+        glyph->left = slot->bitmap_left;
+        glyph->top = slot->bitmap_top;
+        glyph->width = static_cast<int>(slot->bitmap.width);
+        glyph->rows = static_cast<int>(slot->bitmap.rows);
+        glyph->advance = slot->advance.x >> 6;
+        glyph->coverage.resize (glyph->width * glyph->rows);
+        for (int j = 0;  j < glyph->rows;  ++j)
+            for (int i = 0;  i < glyph->width;  ++i)
+                glyph->coverage[j*glyph->width+i] =
+                    slot->bitmap.buffer[slot->bitmap.pitch*j+i];
     }
+    tf->glyphs[ch] = glyph;
+    return glyph;
+}
+
+} // anon namespace
+
 
-    FT_GlyphSlot slot = face->glyph;  // a small shortcut
+
+// Blend the coverage masks of the placed glyphs, in order, over the
+// pixels of R within roi.
+template<typename T>
+static bool
+render_glyphs_ (ImageBuf &R, const std::vector<PlacedGlyph> &glyphs,
+                const float *textcolor, ROI roi, int nthreads)
+{
+    if (nthreads != 1 && roi.npixels() >= 1000) {
+        // Lots of pixels and request for multi threads? Parallelize.
+        ImageBufAlgo::parallel_image (
+            boost::bind(render_glyphs_<T>, boost::ref(R),
+                        boost::cref(glyphs), textcolor,
+                        _1 /*roi*/, 1 /*nthreads*/),
+            roi, nthreads);
+        return true;
+    }
+
+    // Serial case
     int nchannels = R.spec().nchannels;
-    float *pixelcolor = ALLOCA (float, nchannels);
-    if (! textcolor) {
-        float *localtextcolor = ALLOCA (float, nchannels);
-        for (int c = 0;  c < nchannels;  ++c)
-            localtextcolor[c] = 1.0f;
-        textcolor = localtextcolor;
+    for (size_t g = 0, e = glyphs.size();  g < e;  ++g) {
+        const TextGlyph &glyph (*glyphs[g].glyph);
+        ROI groi = roi_intersection (roi, ROI (glyphs[g].x, glyphs[g].x+glyph.width,
+                                               glyphs[g].y, glyphs[g].y+glyph.rows,
+                                               roi.zbegin, roi.zend));
+        if (groi.width() <= 0 || groi.height() <= 0)
+            continue;
+        for (ImageBuf::Iterator<T> r (R, groi);  ! r.done();  ++r) {
+            int b8 = glyph.coverage[(r.y()-glyphs[g].y)*glyph.width
+                                    + (r.x()-glyphs[g].x)];
+            if (b8 == 0)
+                continue;   // no coverage, pixel is unchanged
+            float b = b8 / 255.0f;
+            for (int c = 0;  c < nchannels;  ++c)
+                r[c] = b*textcolor[c] + (1.0f-b) * r[c];
+        }
+    }
+    return true;
+}
+#endif
+
+
+
+bool
+ImageBufAlgo::render_text (ImageBuf &R, int x, int y, string_view text,
+                           int fontsize, string_view font_,
+                           const float *textcolor)
+{
+    if (R.spec().depth > 1) {
+        R.error ("ImageBufAlgo::render_text does not support volume images");
+        return false;
     }
 
+#ifdef USE_FREETYPE
+    // If we know FT is broken, don't bother trying again
+    if (ft_broken)
+        return false;
+
     std::vector<uint32_t> utext;
     utext.reserve(text.size()); //Possible overcommit, but most text will be ascii
     Strutil::utf8_to_unicode(text, utext);
 
-    for (size_t n = 0, e = utext.size();  n < e;  ++n) {
-        error = FT_Load_Char (face, utext[n], FT_LOAD_RENDER);
-        if (error)
-            continue;  // ignore errors
-        // now, draw to our target surface
-        for (int j = 0;  j < static_cast<int>(slot->bitmap.rows); ++j) {
-            int ry = y + j - slot->bitmap_top;
-            for (int i = 0;  i < static_cast<int>(slot->bitmap.width); ++i) {
-                int rx = x + i + slot->bitmap_left;
-                float b = slot->bitmap.buffer[slot->bitmap.pitch*j+i] / 255.0f;
-                R.getpixel (rx, ry, pixelcolor);
-                for (int c = 0;  c < nchannels;  ++c)
-                    pixelcolor[c] = b*textcolor[c] + (1.0f-b) * pixelcolor[c];
-                R.setpixel (rx, ry, pixelcolor);
+    // Look up (or rasterize, the first time they're used) the glyphs and
+    // lay them out.  Only this part needs the lock; the cached glyphs are
+    // immutable, so compositing them can proceed without it.
+    std::vector<PlacedGlyph> glyphs;
+    ROI textroi;
+    {
+        // Thread safety
+        lock_guard ft_lock (ft_mutex);
+
+        // If FT not yet initialized, do it now.
+        if (! ft_library) {
+            int error = FT_Init_FreeType (&ft_library);
+            if (error) {
+                ft_broken = true;
+                R.error ("Could not initialize FreeType for font rendering");
+                return false;
+            }
+        }
+
+        std::string err;
+        TextFace *face = get_text_face (font_, fontsize, err);
+        if (! face) {
+            R.error ("%s", err);
+            return false;
+        }
+
+        glyphs.reserve (utext.size());
+        for (size_t n = 0, e = utext.size();  n < e;  ++n) {
+            TextGlyphRef glyph = get_text_glyph (face, utext[n]);
+            if (! glyph)
+                continue;  // ignore errors
+            if (glyph->width > 0 && glyph->rows > 0) {
+                glyphs.push_back (PlacedGlyph (glyph, x + glyph->left,
+                                               y - glyph->top));
+                textroi = roi_union (textroi,
+                                     ROI (x + glyph->left, x + glyph->left + glyph->width,
+                                          y - glyph->top, y - glyph->top + glyph->rows));
             }
+            // increment pen position
+            x += glyph->advance;
         }
-        // increment pen position
-        x += slot->advance.x >> 6;
     }
 
-    FT_Done_Face (face);
-    return true;
+    int nchannels = R.spec().nchannels;
+    if (! textcolor) {
+        float *localtextcolor = ALLOCA (float, nchannels);
+        for (int c = 0;  c < nchannels;  ++c)
+            localtextcolor[c] = 1.0f;
+        textcolor = localtextcolor;
+    }
+
+    // Pixels outside the data window are not touched
+    if (glyphs.empty() || ! R.initialized())
+        return true;
+    ROI roi = roi_intersection (textroi, R.roi());
+    if (roi.width() <= 0 || roi.height() <= 0)
+        return true;
+    roi.chbegin = 0;
+    roi.chend = nchannels;
+    bool ok;
+    OIIO_DISPATCH_TYPES (ok, "render_text", render_glyphs_, R.spec().format,
+                         R, glyphs, textcolor, roi, 0);
+    return ok;
 
 #else
     R.error ("OpenImageIO was not compiled with FreeType for font rendering");
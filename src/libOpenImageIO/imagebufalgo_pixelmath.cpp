@@ -44,6 +44,8 @@
 #include "OpenImageIO/imagebufalgo.h"
 #include "OpenImageIO/imagebufalgo_util.h"
 #include "OpenImageIO/dassert.h"
+#include "OpenImageIO/fmath.h"
+#include "OpenImageIO/simd.h"
 
 
 
@@ -51,32 +53,398 @@ OIIO_NAMESPACE_ENTER
 {
 
 
-template<class D, class S>
+namespace {
+
+// Span kernels for pointwise operations.
+//
+// Most of the operations in this file compute each channel value of the
+// result from the same channel of one or more inputs, plus perhaps some
+// per-channel constants.  Each is written as a small functor with a
+// scalar float operator() and a float4 one.  The pixelmath_* drivers
+// below split the ROI among threads, then walk it a scanline at a time.
+// When every image involved has local, non-deep pixels covering the ROI,
+// each scanline is handed to a span function as a run of native-typed
+// data -- a single flat run of values when all channels of identically
+// laid out images are being processed, which is the case where all-float
+// images get the SIMD treatment.  Anything else (ImageCache-backed
+// images, ROIs reaching outside the data window) falls back on the
+// ImageBuf iterators.
+//
+// Per-channel constants are passed as "channel patterns": 4*nc values
+// where entry i is the constant for channel roi.chbegin + i%nc.  Four
+// pixels' worth of channels is always a whole number of float4's, so
+// the SIMD loop can use the pattern without any shuffling.
+
+
+// Can the pixels of ib within roi be addressed directly?
+inline bool
+span_addressable (const ImageBuf &ib, const ROI &roi)
+{
+    if (! ib.localpixels() || ib.deep())
+        return false;
+    const ImageSpec &spec (ib.spec());
+    return roi.xbegin >= spec.x && roi.xend <= spec.x+spec.width &&
+           roi.ybegin >= spec.y && roi.yend <= spec.y+spec.height &&
+           roi.zbegin >= spec.z && roi.zend <= spec.z+spec.depth;
+}
+
+
+
+// Fill pattern[0..4*nc-1] with the channel pattern of k for the
+// nc channels starting at chbegin.
+inline void
+channel_pattern (float *pattern, const float *k, int chbegin, int nc)
+{
+    for (int i = 0;  i < 4*nc;  ++i)
+        pattern[i] = k[chbegin + i % nc];
+}
+
+
+
+// Apply op to n values of a (channel pattern constants k0, k1), storing
+// the results in r.  Generic version: convert through float.
+template<class Rtype, class Atype, class OP>
+inline void
+unary_span (Rtype *r, const Atype *a, int n, int nc,
+            const float *k0, const float *k1, const OP &op)
+{
+    for (int i = 0, c = 0;  i < n;  ++i) {
+        r[i] = convert_type<float,Rtype> (
+                   op (convert_type<Atype,float>(a[i]), k0[c], k1[c]));
+        if (++c == nc)
+            c = 0;
+    }
+}
+
+
+// All-float version of unary_span: SIMD over blocks of 4 pixels.
+template<class OP>
+inline void
+unary_span (float *r, const float *a, int n, int nc,
+            const float *k0, const float *k1, const OP &op)
+{
+    int i = 0;
+    for ( ;  i + 4*nc <= n;  i += 4*nc) {
+        for (int j = 0;  j < 4*nc;  j += 4) {
+            simd::float4 v = op (simd::float4(a+i+j), simd::float4(k0+j),
+                                 simd::float4(k1+j));
+            v.store (r+i+j);
+        }
+    }
+    for (int c = 0;  i < n;  ++i) {
+        r[i] = op (a[i], k0[c], k1[c]);
+        if (++c == nc)
+            c = 0;
+    }
+}
+
+
+
+template<class Rtype, class Atype, class Btype, class OP>
+inline void
+binary_span (Rtype *r, const Atype *a, const Btype *b, int n, const OP &op)
+{
+    for (int i = 0;  i < n;  ++i)
+        r[i] = convert_type<float,Rtype> (op (convert_type<Atype,float>(a[i]),
+                                              convert_type<Btype,float>(b[i])));
+}
+
+
+template<class OP>
+inline void
+binary_span (float *r, const float *a, const float *b, int n, const OP &op)
+{
+    int i = 0;
+    for ( ;  i + 4 <= n;  i += 4) {
+        simd::float4 v = op (simd::float4(a+i), simd::float4(b+i));
+        v.store (r+i);
+    }
+    for ( ;  i < n;  ++i)
+        r[i] = op (a[i], b[i]);
+}
+
+
+
+template<class Rtype, class Atype, class OP>
+inline void
+ternary_span (Rtype *r, const Atype *a, const Atype *b, const Atype *c,
+              int n, const OP &op)
+{
+    for (int i = 0;  i < n;  ++i)
+        r[i] = convert_type<float,Rtype> (op (convert_type<Atype,float>(a[i]),
+                                              convert_type<Atype,float>(b[i]),
+                                              convert_type<Atype,float>(c[i])));
+}
+
+
+template<class OP>
+inline void
+ternary_span (float *r, const float *a, const float *b, const float *c,
+              int n, const OP &op)
+{
+    int i = 0;
+    for ( ;  i + 4 <= n;  i += 4) {
+        simd::float4 v = op (simd::float4(a+i), simd::float4(b+i),
+                             simd::float4(c+i));
+        v.store (r+i);
+    }
+    for ( ;  i < n;  ++i)
+        r[i] = op (a[i], b[i], c[i]);
+}
+
+
+
+// R = op(A, k0, k1), where k0 and k1 are per-channel constants (indexed
+// by channel number; ops that need only one may pass it twice).
+template<class Rtype, class Atype, class OP>
 static bool
-clamp_ (ImageBuf &dst, const ImageBuf &src,
-        const float *min, const float *max,
-        bool clampalpha01, ROI roi, int nthreads)
+pixelmath_unary (ImageBuf &R, const ImageBuf &A,
+                 const float *k0, const float *k1, OP op,
+                 ROI roi, int nthreads)
 {
     if (nthreads != 1 && roi.npixels() >= 1000) {
-        // Lots of pixels and request for multi threads? Parallelize.
+        // Possible multiple thread case -- recurse via parallel_image
         ImageBufAlgo::parallel_image (
-            boost::bind(clamp_<D,S>, boost::ref(dst), boost::cref(src),
-                        min, max, clampalpha01,
+            boost::bind(pixelmath_unary<Rtype,Atype,OP>,
+                        boost::ref(R), boost::cref(A), k0, k1, op,
                         _1 /*roi*/, 1 /*nthreads*/),
             roi, nthreads);
         return true;
     }
 
     // Serial case
-    ImageBuf::ConstIterator<S> s (src, roi);
-    for (ImageBuf::Iterator<D> d (dst, roi);  ! d.done();  ++d, ++s) {
+    if (roi.nchannels() < 1)
+        return true;   // Nothing to do (and the patterns would be empty)
+    if (span_addressable (R, roi) && span_addressable (A, roi)) {
+        int nc = roi.nchannels();
+        int rstride = R.nchannels(), astride = A.nchannels();
+        float *kp0 = ALLOCA (float, 4*nc);
+        float *kp1 = ALLOCA (float, 4*nc);
+        channel_pattern (kp0, k0, roi.chbegin, nc);
+        channel_pattern (kp1, k1, roi.chbegin, nc);
+        bool flat = (nc == rstride && nc == astride);
+        for (int z = roi.zbegin;  z < roi.zend;  ++z) {
+            for (int y = roi.ybegin;  y < roi.yend;  ++y) {
+                Rtype *r = (Rtype *)R.pixeladdr (roi.xbegin, y, z) + roi.chbegin;
+                const Atype *a = (const Atype *)A.pixeladdr (roi.xbegin, y, z) + roi.chbegin;
+                if (flat) {
+                    unary_span (r, a, roi.width()*nc, nc, kp0, kp1, op);
+                } else {
+                    for (int x = 0;  x < roi.width();  ++x)
+                        unary_span (r + x*rstride, a + x*astride, nc, nc,
+                                    kp0, kp1, op);
+                }
+            }
+        }
+        return true;
+    }
+
+    ImageBuf::Iterator<Rtype> r (R, roi);
+    ImageBuf::ConstIterator<Atype> a (A, roi);
+    for ( ;  !r.done();  ++r, ++a)
         for (int c = roi.chbegin;  c < roi.chend;  ++c)
-            d[c] = OIIO::clamp<float> (s[c], min[c], max[c]);
+            r[c] = op (a[c], k0[c], k1[c]);
+    return true;
+}
+
+
+
+// R = op(A, B)
+template<class Rtype, class Atype, class Btype, class OP>
+static bool
+pixelmath_binary (ImageBuf &R, const ImageBuf &A, const ImageBuf &B,
+                  OP op, ROI roi, int nthreads)
+{
+    if (nthreads != 1 && roi.npixels() >= 1000) {
+        // Possible multiple thread case -- recurse via parallel_image
+        ImageBufAlgo::parallel_image (
+            boost::bind(pixelmath_binary<Rtype,Atype,Btype,OP>,
+                        boost::ref(R), boost::cref(A), boost::cref(B), op,
+                        _1 /*roi*/, 1 /*nthreads*/),
+            roi, nthreads);
+        return true;
     }
+
+    // Serial case
+    if (span_addressable (R, roi) && span_addressable (A, roi) &&
+        span_addressable (B, roi)) {
+        int nc = roi.nchannels();
+        int rstride = R.nchannels(), astride = A.nchannels();
+        int bstride = B.nchannels();
+        bool flat = (nc == rstride && nc == astride && nc == bstride);
+        for (int z = roi.zbegin;  z < roi.zend;  ++z) {
+            for (int y = roi.ybegin;  y < roi.yend;  ++y) {
+                Rtype *r = (Rtype *)R.pixeladdr (roi.xbegin, y, z) + roi.chbegin;
+                const Atype *a = (const Atype *)A.pixeladdr (roi.xbegin, y, z) + roi.chbegin;
+                const Btype *b = (const Btype *)B.pixeladdr (roi.xbegin, y, z) + roi.chbegin;
+                if (flat) {
+                    binary_span (r, a, b, roi.width()*nc, op);
+                } else {
+                    for (int x = 0;  x < roi.width();  ++x)
+                        binary_span (r + x*rstride, a + x*astride,
+                                     b + x*bstride, nc, op);
+                }
+            }
+        }
+        return true;
+    }
+
+    ImageBuf::Iterator<Rtype> r (R, roi);
+    ImageBuf::ConstIterator<Atype> a (A, roi);
+    ImageBuf::ConstIterator<Btype> b (B, roi);
+    for ( ;  !r.done();  ++r, ++a, ++b)
+        for (int c = roi.chbegin;  c < roi.chend;  ++c)
+            r[c] = op (a[c], b[c]);
+    return true;
+}
+
+
+
+// R = op(A, B, C), where A, B, C all have the same pixel type
+template<class Rtype, class ABCtype, class OP>
+static bool
+pixelmath_ternary (ImageBuf &R, const ImageBuf &A, const ImageBuf &B,
+                   const ImageBuf &C, OP op, ROI roi, int nthreads)
+{
+    if (nthreads != 1 && roi.npixels() >= 1000) {
+        // Possible multiple thread case -- recurse via parallel_image
+        ImageBufAlgo::parallel_image (
+            boost::bind(pixelmath_ternary<Rtype,ABCtype,OP>, boost::ref(R),
+                        boost::cref(A), boost::cref(B), boost::cref(C), op,
+                        _1 /*roi*/, 1 /*nthreads*/),
+            roi, nthreads);
+        return true;
+    }
+
+    // Serial case
+    if (span_addressable (R, roi) && span_addressable (A, roi) &&
+        span_addressable (B, roi) && span_addressable (C, roi)) {
+        int nc = roi.nchannels();
+        int rstride = R.nchannels(), astride = A.nchannels();
+        int bstride = B.nchannels(), cstride = C.nchannels();
+        bool flat = (nc == rstride && nc == astride && nc == bstride &&
+                     nc == cstride);
+        for (int z = roi.zbegin;  z < roi.zend;  ++z) {
+            for (int y = roi.ybegin;  y < roi.yend;  ++y) {
+                Rtype *r = (Rtype *)R.pixeladdr (roi.xbegin, y, z) + roi.chbegin;
+                const ABCtype *a = (const ABCtype *)A.pixeladdr (roi.xbegin, y, z) + roi.chbegin;
+                const ABCtype *b = (const ABCtype *)B.pixeladdr (roi.xbegin, y, z) + roi.chbegin;
+                const ABCtype *c = (const ABCtype *)C.pixeladdr (roi.xbegin, y, z) + roi.chbegin;
+                if (flat) {
+                    ternary_span (r, a, b, c, roi.width()*nc, op);
+                } else {
+                    for (int x = 0;  x < roi.width();  ++x)
+                        ternary_span (r + x*rstride, a + x*astride,
+                                      b + x*bstride, c + x*cstride, nc, op);
+                }
+            }
+        }
+        return true;
+    }
+
+    ImageBuf::Iterator<Rtype> r (R, roi);
+    ImageBuf::ConstIterator<ABCtype> a (A, roi);
+    ImageBuf::ConstIterator<ABCtype> b (B, roi);
+    ImageBuf::ConstIterator<ABCtype> c (C, roi);
+    for ( ;  !r.done();  ++r, ++a, ++b, ++c)
+        for (int ch = roi.chbegin;  ch < roi.chend;  ++ch)
+            r[ch] = op (a[ch], b[ch], c[ch]);
+    return true;
+}
+
+
+
+// The pointwise operations themselves.
+
+struct AddOp {
+    float operator() (float a, float b, float) const { return a + b; }
+    float operator() (float a, float b) const { return a + b; }
+    simd::float4 operator() (const simd::float4 &a, const simd::float4 &b,
+                             const simd::float4 &) const { return a + b; }
+    simd::float4 operator() (const simd::float4 &a,
+                             const simd::float4 &b) const { return a + b; }
+};
+
+struct SubOp {
+    float operator() (float a, float b) const { return a - b; }
+    simd::float4 operator() (const simd::float4 &a,
+                             const simd::float4 &b) const { return a - b; }
+};
+
+struct AbsDiffOp {
+    float operator() (float a, float b, float) const { return std::abs (a - b); }
+    float operator() (float a, float b) const { return std::abs (a - b); }
+    simd::float4 operator() (const simd::float4 &a, const simd::float4 &b,
+                             const simd::float4 &) const { return simd::abs (a - b); }
+    simd::float4 operator() (const simd::float4 &a,
+                             const simd::float4 &b) const { return simd::abs (a - b); }
+};
+
+struct MulOp {
+    float operator() (float a, float b, float) const { return a * b; }
+    float operator() (float a, float b) const { return a * b; }
+    simd::float4 operator() (const simd::float4 &a, const simd::float4 &b,
+                             const simd::float4 &) const { return a * b; }
+    simd::float4 operator() (const simd::float4 &a,
+                             const simd::float4 &b) const { return a * b; }
+};
+
+struct DivOp {
+    float operator() (float a, float b) const {
+        return (b == 0.0f) ? 0.0f : (a / b);
+    }
+    simd::float4 operator() (const simd::float4 &a,
+                             const simd::float4 &b) const {
+        return simd::blend0not (a / b, b == simd::float4(0.0f));
+    }
+};
+
+struct MadOp {
+    float operator() (float a, float b, float c) const { return a * b + c; }
+    simd::float4 operator() (const simd::float4 &a, const simd::float4 &b,
+                             const simd::float4 &c) const { return a * b + c; }
+};
+
+struct PowOp {
+    float operator() (float a, float b, float) const { return pow (a, b); }
+    simd::float4 operator() (const simd::float4 &a, const simd::float4 &b,
+                             const simd::float4 &) const {
+        // No SIMD pow; do it a lane at a time
+        return simd::float4 (pow (a[0], b[0]), pow (a[1], b[1]),
+                             pow (a[2], b[2]), pow (a[3], b[3]));
+    }
+};
+
+struct ClampOp {
+    float operator() (float a, float lo, float hi) const {
+        return OIIO::clamp<float> (a, lo, hi);
+    }
+    simd::float4 operator() (const simd::float4 &a, const simd::float4 &lo,
+                             const simd::float4 &hi) const {
+        // Same as the scalar clamp, including passing NaN through
+        return simd::blend (simd::blend (a, hi, a > hi), lo, a < lo);
+    }
+};
+
+}  // anon namespace
+
+
+
+template<class D, class S>
+static bool
+clamp_ (ImageBuf &dst, const ImageBuf &src,
+        const float *min, const float *max,
+        bool clampalpha01, ROI roi, int nthreads)
+{
+    pixelmath_unary<D,S> (dst, src, min, max, ClampOp(), roi, nthreads);
     int a = src.spec().alpha_channel;
     if (clampalpha01 && a >= roi.chbegin && a < roi.chend) {
-        for (ImageBuf::Iterator<D> d (dst, roi);  ! d.done();  ++d)
-            d[a] = OIIO::clamp<float> (d[a], 0.0f, 1.0f);
+        ROI alpharoi = roi;
+        alpharoi.chbegin = a;
+        alpharoi.chend = a+1;
+        std::vector<float> zero (a+1, 0.0f), one (a+1, 1.0f);
+        pixelmath_unary<D,D> (dst, dst, &zero[0], &one[0], ClampOp(),
+                              alpharoi, nthreads);
     }
     return true;
 }
@@ -125,24 +493,7 @@ static bool
 add_impl (ImageBuf &R, const ImageBuf &A, const ImageBuf &B,
           ROI roi, int nthreads)
 {
-    if (nthreads != 1 && roi.npixels() >= 1000) {
-        // Possible multiple thread case -- recurse via parallel_image
-        ImageBufAlgo::parallel_image (
-            boost::bind(add_impl<Rtype,Atype,Btype>,
-                        boost::ref(R), boost::cref(A), boost::cref(B),
-                        _1 /*roi*/, 1 /*nthreads*/),
-            roi, nthreads);
-        return true;
-    }
-
-    // Serial case
-    ImageBuf::Iterator<Rtype> r (R, roi);
-    ImageBuf::ConstIterator<Atype> a (A, roi);
-    ImageBuf::ConstIterator<Btype> b (B, roi);
-    for ( ;  !r.done();  ++r, ++a, ++b)
-        for (int c = roi.chbegin;  c < roi.chend;  ++c)
-            r[c] = a[c] + b[c];
-    return true;
+    return pixelmath_binary<Rtype,Atype,Btype> (R, A, B, AddOp(), roi, nthreads);
 }
 
 
@@ -152,23 +503,7 @@ static bool
 add_impl (ImageBuf &R, const ImageBuf &A, const float *b,
           ROI roi, int nthreads)
 {
-    if (nthreads != 1 && roi.npixels() >= 1000) {
-        // Possible multiple thread case -- recurse via parallel_image
-        ImageBufAlgo::parallel_image (
-            boost::bind(add_impl<Rtype,Atype>,
-                        boost::ref(R), boost::cref(A), b,
-                        _1 /*roi*/, 1 /*nthreads*/),
-            roi, nthreads);
-        return true;
-    }
-
-    // Serial case
-    ImageBuf::Iterator<Rtype> r (R, roi);
-    ImageBuf::ConstIterator<Atype> a (A, roi);
-    for ( ;  !r.done();  ++r, ++a)
-        for (int c = roi.chbegin;  c < roi.chend;  ++c)
-            r[c] = a[c] + b[c];
-    return true;
+    return pixelmath_unary<Rtype,Atype> (R, A, b, b, AddOp(), roi, nthreads);
 }
 
 
@@ -226,24 +561,7 @@ static bool
 sub_impl (ImageBuf &R, const ImageBuf &A, const ImageBuf &B,
           ROI roi, int nthreads)
 {
-    if (nthreads != 1 && roi.npixels() >= 1000) {
-        // Possible multiple thread case -- recurse via parallel_image
-        ImageBufAlgo::parallel_image (
-            boost::bind(sub_impl<Rtype,Atype,Btype>,
-                        boost::ref(R), boost::cref(A), boost::cref(B),
-                        _1 /*roi*/, 1 /*nthreads*/),
-            roi, nthreads);
-        return true;
-    }
-
-    // Serial case
-    ImageBuf::Iterator<Rtype> r (R, roi);
-    ImageBuf::ConstIterator<Atype> a (A, roi);
-    ImageBuf::ConstIterator<Btype> b (B, roi);
-    for ( ;  !r.done();  ++r, ++a, ++b)
-        for (int c = roi.chbegin;  c < roi.chend;  ++c)
-            r[c] = a[c] - b[c];
-    return true;
+    return pixelmath_binary<Rtype,Atype,Btype> (R, A, B, SubOp(), roi, nthreads);
 }
 
 
@@ -304,24 +622,8 @@ static bool
 absdiff_impl (ImageBuf &R, const ImageBuf &A, const ImageBuf &B,
               ROI roi, int nthreads)
 {
-    if (nthreads != 1 && roi.npixels() >= 1000) {
-        // Possible multiple thread case -- recurse via parallel_image
-        ImageBufAlgo::parallel_image (
-            boost::bind(absdiff_impl<Rtype,Atype,Btype>,
-                        boost::ref(R), boost::cref(A), boost::cref(B),
-                        _1 /*roi*/, 1 /*nthreads*/),
-            roi, nthreads);
-        return true;
-    }
-
-    // Serial case
-    ImageBuf::Iterator<Rtype> r (R, roi);
-    ImageBuf::ConstIterator<Atype> a (A, roi);
-    ImageBuf::ConstIterator<Btype> b (B, roi);
-    for ( ;  !r.done();  ++r, ++a, ++b)
-        for (int c = roi.chbegin;  c < roi.chend;  ++c)
-            r[c] = std::abs (a[c] - b[c]);
-    return true;
+    return pixelmath_binary<Rtype,Atype,Btype> (R, A, B, AbsDiffOp(),
+                                               roi, nthreads);
 }
 
 
@@ -330,23 +632,7 @@ static bool
 absdiff_impl (ImageBuf &R, const ImageBuf &A, const float *b,
               ROI roi, int nthreads)
 {
-    if (nthreads != 1 && roi.npixels() >= 1000) {
-        // Possible multiple thread case -- recurse via parallel_image
-        ImageBufAlgo::parallel_image (
-            boost::bind(absdiff_impl<Rtype,Atype>,
-                        boost::ref(R), boost::cref(A), b,
-                        _1 /*roi*/, 1 /*nthreads*/),
-            roi, nthreads);
-        return true;
-    }
-
-    // Serial case
-    ImageBuf::Iterator<Rtype> r (R, roi);
-    ImageBuf::ConstIterator<Atype> a (A, roi);
-    for ( ;  !r.done();  ++r, ++a)
-        for (int c = roi.chbegin;  c < roi.chend;  ++c)
-            r[c] = std::abs (a[c] - b[c]);
-    return true;
+    return pixelmath_unary<Rtype,Atype> (R, A, b, b, AbsDiffOp(), roi, nthreads);
 }
 
 
@@ -414,24 +700,7 @@ static bool
 mul_impl (ImageBuf &R, const ImageBuf &A, const ImageBuf &B,
           ROI roi, int nthreads)
 {
-    if (nthreads != 1 && roi.npixels() >= 1000) {
-        // Possible multiple thread case -- recurse via parallel_image
-        ImageBufAlgo::parallel_image (
-            boost::bind(mul_impl<Rtype,Atype,Btype>,
-                        boost::ref(R), boost::cref(A), boost::cref(B),
-                        _1 /*roi*/, 1 /*nthreads*/),
-            roi, nthreads);
-        return true;
-    }
-
-    // Serial case
-    ImageBuf::Iterator<Rtype> r (R, roi);
-    ImageBuf::ConstIterator<Atype> a (A, roi);
-    ImageBuf::ConstIterator<Btype> b (B, roi);
-    for ( ;  !r.done();  ++r, ++a, ++b)
-        for (int c = roi.chbegin;  c < roi.chend;  ++c)
-            r[c] = a[c] * b[c];
-    return true;
+    return pixelmath_binary<Rtype,Atype,Btype> (R, A, B, MulOp(), roi, nthreads);
 }
 
 
@@ -456,20 +725,7 @@ static bool
 mul_impl (ImageBuf &R, const ImageBuf &A, const float *b,
           ROI roi, int nthreads)
 {
-    if (nthreads != 1 && roi.npixels() >= 1000) {
-        // Possible multiple thread case -- recurse via parallel_image
-        ImageBufAlgo::parallel_image (
-            boost::bind(mul_impl<Rtype,Atype>, boost::ref(R), boost::cref(A), b,
-                        _1 /*roi*/, 1 /*nthreads*/),
-            roi, nthreads);
-        return true;
-    }
-
-    ImageBuf::ConstIterator<Atype> a (A, roi);
-    for (ImageBuf::Iterator<Rtype> r (R, roi);  !r.done();  ++r, ++a)
-        for (int c = roi.chbegin;  c < roi.chend;  ++c)
-            r[c] = a[c] * b[c];
-    return true;
+    return pixelmath_unary<Rtype,Atype> (R, A, b, b, MulOp(), roi, nthreads);
 }
 
 
@@ -511,26 +767,7 @@ static bool
 div_impl (ImageBuf &R, const ImageBuf &A, const ImageBuf &B,
           ROI roi, int nthreads)
 {
-    if (nthreads != 1 && roi.npixels() >= 1000) {
-        // Possible multiple thread case -- recurse via parallel_image
-        ImageBufAlgo::parallel_image (
-            boost::bind(div_impl<Rtype,Atype,Btype>,
-                        boost::ref(R), boost::cref(A), boost::cref(B),
-                        _1 /*roi*/, 1 /*nthreads*/),
-            roi, nthreads);
-        return true;
-    }
-
-    // Serial case
-    ImageBuf::Iterator<Rtype> r (R, roi);
-    ImageBuf::ConstIterator<Atype> a (A, roi);
-    ImageBuf::ConstIterator<Btype> b (B, roi);
-    for ( ;  !r.done();  ++r, ++a, ++b)
-        for (int c = roi.chbegin;  c < roi.chend;  ++c) {
-            float v = b[c];
-            r[c] = (v == 0.0f) ? 0.0f : (a[c] / v);
-        }
-    return true;
+    return pixelmath_binary<Rtype,Atype,Btype> (R, A, B, DivOp(), roi, nthreads);
 }
 
 
@@ -592,25 +829,7 @@ static bool
 mad_impl (ImageBuf &R, const ImageBuf &A, const ImageBuf &B, const ImageBuf &C,
           ROI roi, int nthreads)
 {
-    if (nthreads != 1 && roi.npixels() >= 1000) {
-        // Possible multiple thread case -- recurse via parallel_image
-        ImageBufAlgo::parallel_image (
-            boost::bind(mad_impl<Rtype,ABCtype>, boost::ref(R),
-                        boost::cref(A), boost::cref(B), boost::cref(C),
-                        _1 /*roi*/, 1 /*nthreads*/),
-            roi, nthreads);
-        return true;
-    }
-
-    // Serial case
-    ImageBuf::Iterator<Rtype> r (R, roi);
-    ImageBuf::ConstIterator<ABCtype> a (A, roi);
-    ImageBuf::ConstIterator<ABCtype> b (B, roi);
-    ImageBuf::ConstIterator<ABCtype> c (C, roi);
-    for ( ;  !r.done();  ++r, ++a, ++b, ++c)
-        for (int ch = roi.chbegin;  ch < roi.chend;  ++ch)
-            r[ch] = a[ch] * b[ch] + c[ch];
-    return true;
+    return pixelmath_ternary<Rtype,ABCtype> (R, A, B, C, MadOp(), roi, nthreads);
 }
 
 
@@ -620,23 +839,7 @@ static bool
 mad_implf (ImageBuf &R, const ImageBuf &A, const float *b, const float *c,
           ROI roi, int nthreads)
 {
-    if (nthreads != 1 && roi.npixels() >= 1000) {
-        // Possible multiple thread case -- recurse via parallel_image
-        ImageBufAlgo::parallel_image (
-            boost::bind(mad_implf<Rtype,Atype>, boost::ref(R),
-                        boost::cref(A), b, c,
-                        _1 /*roi*/, 1 /*nthreads*/),
-            roi, nthreads);
-        return true;
-    }
-
-    // Serial case
-    ImageBuf::Iterator<Rtype> r (R, roi);
-    ImageBuf::ConstIterator<Atype> a (A, roi);
-    for ( ;  !r.done();  ++r, ++a)
-        for (int ch = roi.chbegin;  ch < roi.chend;  ++ch)
-            r[ch] = a[ch] * b[ch] + c[ch];
-    return true;
+    return pixelmath_unary<Rtype,Atype> (R, A, b, c, MadOp(), roi, nthreads);
 }
 
 
@@ -736,20 +939,7 @@ static bool
 pow_impl (ImageBuf &R, const ImageBuf &A, const float *b,
           ROI roi, int nthreads)
 {
-    if (nthreads != 1 && roi.npixels() >= 1000) {
-        // Possible multiple thread case -- recurse via parallel_image
-        ImageBufAlgo::parallel_image (
-            boost::bind(pow_impl<Rtype,Atype>, boost::ref(R), boost::cref(A), b,
-                        _1 /*roi*/, 1 /*nthreads*/),
-            roi, nthreads);
-        return true;
-    }
-
-    ImageBuf::ConstIterator<Atype> a (A, roi);
-    for (ImageBuf::Iterator<Rtype> r (R, roi);  !r.done();  ++r, ++a)
-        for (int c = roi.chbegin;  c < roi.chend;  ++c)
-            r[c] = pow (a[c], b[c]);
-    return true;
+    return pixelmath_unary<Rtype,Atype> (R, A, b, b, PowOp(), roi, nthreads);
 }
 
 
@@ -1074,7 +1264,31 @@ unpremult_ (ImageBuf &R, const ImageBuf &A, ROI roi, int nthreads)
 
     int alpha_channel = A.spec().alpha_channel;
     int z_channel = A.spec().z_channel;
-    if (&R == &A) {
+    if (span_addressable (R, roi) && span_addressable (A, roi)) {
+        // Local pixels: run along each scanline directly
+        bool inplace = (&R == &A);
+        int rstride = R.nchannels(), astride = A.nchannels();
+        for (int z = roi.zbegin;  z < roi.zend;  ++z) {
+            for (int y = roi.ybegin;  y < roi.yend;  ++y) {
+                Rtype *r = (Rtype *)R.pixeladdr (roi.xbegin, y, z);
+                const Atype *a = (const Atype *)A.pixeladdr (roi.xbegin, y, z);
+                for (int x = roi.xbegin;  x < roi.xend;
+                       ++x, r += rstride, a += astride) {
+                    float alpha = convert_type<Atype,float> (a[alpha_channel]);
+                    bool skip = (alpha == 0.0f || alpha == 1.0f);
+                    if (skip && inplace)
+                        continue;
+                    for (int c = roi.chbegin;  c < roi.chend;  ++c) {
+                        float v = convert_type<Atype,float> (a[c]);
+                        if (! skip && c != alpha_channel && c != z_channel)
+                            r[c] = convert_type<float,Rtype> (v / alpha);
+                        else if (! inplace)
+                            r[c] = convert_type<float,Rtype> (v);
+                    }
+                }
+            }
+        }
+    } else if (&R == &A) {
         for (ImageBuf::Iterator<Rtype> r (R, roi);  !r.done();  ++r) {
             float alpha = r[alpha_channel];
             if (alpha == 0.0f || alpha == 1.0f)
@@ -1140,7 +1354,30 @@ premult_ (ImageBuf &R, const ImageBuf &A, ROI roi, int nthreads)
 
     int alpha_channel = A.spec().alpha_channel;
     int z_channel = A.spec().z_channel;
-        if (&R == &A) {
+    if (span_addressable (R, roi) && span_addressable (A, roi)) {
+        // Local pixels: run along each scanline directly
+        bool inplace = (&R == &A);
+        int rstride = R.nchannels(), astride = A.nchannels();
+        for (int z = roi.zbegin;  z < roi.zend;  ++z) {
+            for (int y = roi.ybegin;  y < roi.yend;  ++y) {
+                Rtype *r = (Rtype *)R.pixeladdr (roi.xbegin, y, z);
+                const Atype *a = (const Atype *)A.pixeladdr (roi.xbegin, y, z);
+                for (int x = roi.xbegin;  x < roi.xend;
+                       ++x, r += rstride, a += astride) {
+                    float alpha = convert_type<Atype,float> (a[alpha_channel]);
+                    if (alpha == 1.0f && inplace)
+                        continue;
+                    for (int c = roi.chbegin;  c < roi.chend;  ++c) {
+                        float v = convert_type<Atype,float> (a[c]);
+                        if (c != alpha_channel && c != z_channel)
+                            r[c] = convert_type<float,Rtype> (v * alpha);
+                        else if (! inplace)
+                            r[c] = convert_type<float,Rtype> (v);
+                    }
+                }
+            }
+        }
+    } else if (&R == &A) {
         for (ImageBuf::Iterator<Rtype> r (R, roi);  !r.done();  ++r) {
             float alpha = r[alpha_channel];
             if (alpha == 1.0f)
@@ -35,12 +35,18 @@
 #include "OpenImageIO/imagebuf.h"
 #include "OpenImageIO/imagebufalgo.h"
 #include "OpenImageIO/imagebufalgo_util.h"
+#include "OpenImageIO/imagecache.h"
+#include "OpenImageIO/filesystem.h"
+#include "OpenImageIO/texture.h"
 #include "OpenImageIO/unittest.h"
 
+#include <algorithm>
 #include <iostream>
 #include <iomanip>
 #include <string>
 #include <cstdio>
+#include <cmath>
+#include <limits>
 
 OIIO_NAMESPACE_USING;
 
@@ -247,6 +253,32 @@ void test_channel_append ()
 
 
 
+void test_channels ()
+{
+    std::cout << "test channels\n";
+    ImageSpec spec (3, 2, 4, TypeDesc::UINT8);
+    ImageBuf A (spec);
+    for (ImageBuf::Iterator<unsigned char> a (A);  !a.done();  ++a)
+        for (int c = 0;  c < 4;  ++c)
+            a[c] = 0.1f * (a.y() * 3 + a.x()) + 0.2f * c;
+
+    // Shuffle, drop a channel, and add a constant one
+    int order[] = { 3, 0, -1 };
+    float values[] = { 0.0f, 0.0f, 1.0f };
+    ImageBuf R;
+    ImageBufAlgo::channels (R, A, 3, order, values);
+    OIIO_CHECK_EQUAL (R.nchannels(), 3);
+    OIIO_CHECK_EQUAL (R.spec().format, TypeDesc::UINT8);
+    ImageBuf::ConstIterator<unsigned char> a (A);
+    for (ImageBuf::ConstIterator<unsigned char> r (R);  !r.done();  ++r, ++a) {
+        OIIO_CHECK_EQUAL (r[0], a[3]);
+        OIIO_CHECK_EQUAL (r[1], a[0]);
+        OIIO_CHECK_EQUAL (r[2], 1.0f);
+    }
+}
+
+
+
 // Tests ImageBufAlgo::add
 void test_add ()
 {
@@ -429,6 +461,263 @@ void test_compare ()
 
 
 
+// Tests ImageBufAlgo::compare_Yee
+void test_compare_Yee ()
+{
+    std::cout << "test compare_Yee\n";
+    // A smooth image, and a copy with a red square in the middle
+    ImageSpec spec (64, 64, 3, TypeDesc::FLOAT);
+    ImageBuf A (spec);
+    for (ImageBuf::Iterator<float> a (A);  !a.done();  ++a)
+        for (int c = 0;  c < 3;  ++c)
+            a[c] = 0.25f + 0.5f * a.x() / 64.0f;
+    ImageBuf B;
+    B.copy (A);
+    const float red[3] = { 1.0f, 0.0f, 0.0f };
+    ImageBufAlgo::fill (B, red, ROI (24, 40, 24, 40));
+
+    ImageBufAlgo::CompareResults comp;
+    OIIO_CHECK_EQUAL (ImageBufAlgo::compare_Yee (A, A, comp), 0);
+    int nfail = ImageBufAlgo::compare_Yee (A, B, comp, 100, 45, ROI::All(), 1);
+    OIIO_CHECK_ASSERT (nfail > 0 && nfail <= 16*16);
+    OIIO_CHECK_ASSERT (comp.maxx >= 24 && comp.maxx < 40);
+    OIIO_CHECK_ASSERT (comp.maxy >= 24 && comp.maxy < 40);
+
+    // Threaded, and with a reused reference pyramid, give the same answer
+    ImageBufAlgo::CompareResults comp2;
+    OIIO_CHECK_EQUAL (ImageBufAlgo::compare_Yee (A, B, comp2, 100, 45,
+                                                 ROI::All(), 4), nfail);
+    OIIO_CHECK_EQUAL (comp2.maxerror, comp.maxerror);
+    OIIO_CHECK_EQUAL (comp2.maxx, comp.maxx);
+    OIIO_CHECK_EQUAL (comp2.maxy, comp.maxy);
+    ImageBufAlgo::YeePyramid PA (A);
+    OIIO_CHECK_ASSERT (PA.initialized());
+    OIIO_CHECK_EQUAL (ImageBufAlgo::compare_Yee (PA, A, comp2), 0);
+    OIIO_CHECK_EQUAL (ImageBufAlgo::compare_Yee (PA, B, comp2), nfail);
+    OIIO_CHECK_EQUAL (comp2.maxx, comp.maxx);
+    OIIO_CHECK_EQUAL (comp2.maxy, comp.maxy);
+
+    // Pyramids built for different luminances can't be compared
+    ImageBufAlgo::YeePyramid PB (B, 50.0f);
+    OIIO_CHECK_EQUAL (ImageBufAlgo::compare_Yee (PA, PB, comp2), -1);
+
+    // A difference in luminance alone (no change in color) also fails
+    ImageBuf C;
+    C.copy (A);
+    const float white[3] = { 1.0f, 1.0f, 1.0f };
+    ImageBufAlgo::fill (C, white, ROI (24, 40, 24, 40));
+    nfail = ImageBufAlgo::compare_Yee (A, C, comp, 100, 45);
+    OIIO_CHECK_ASSERT (nfail > 0 && nfail <= 16*16);
+    OIIO_CHECK_ASSERT (comp.maxx >= 24 && comp.maxx < 40);
+}
+
+
+
+// Test computePixelStats and histogram, including the single pass that
+// gathers both, against counts made by hand.
+void test_computePixelStats ()
+{
+    std::cout << "test computePixelStats\n";
+    const int WIDTH = 67, HEIGHT = 45, CHANNELS = 3, BINS = 10;
+    ImageSpec spec (WIDTH, HEIGHT, CHANNELS, TypeDesc::FLOAT);
+    ImageBuf A (spec);
+    std::vector<imagesize_t> expected (CHANNELS*BINS, 0);
+    imagesize_t below = 0, above = 0;
+    for (ImageBuf::Iterator<float> a (A);  ! a.done();  ++a) {
+        float v[CHANNELS] = { (a.x() - 5) / float(WIDTH-10),  // -0.07..1.07
+                              a.y() / float(HEIGHT-1),        // 0..1 exactly
+                              0.5f };
+        if (a.x() == 3 && a.y() == 4)
+            v[2] = std::numeric_limits<float>::quiet_NaN();
+        for (int c = 0;  c < CHANNELS;  ++c) {
+            a[c] = v[c];
+            if (v[c] >= 0.0f && v[c] <= 1.0f)
+                ++expected[c*BINS + std::min (int(v[c]*BINS), BINS-1)];
+        }
+        below += (v[0] < 0.0f);
+        above += (v[0] > 1.0f);
+    }
+
+    ImageBufAlgo::PixelStats stats, stats1;
+    OIIO_CHECK_ASSERT (ImageBufAlgo::computePixelStats (stats, A, BINS));
+    OIIO_CHECK_ASSERT (stats.histogram == expected);
+    OIIO_CHECK_EQUAL (stats.min[1], 0.0f);
+    OIIO_CHECK_EQUAL (stats.max[1], 1.0f);
+    OIIO_CHECK_EQUAL_THRESH (stats.avg[1], 0.5f, 1.0e-6f);
+    OIIO_CHECK_EQUAL (stats.nancount[2], 1);
+    OIIO_CHECK_EQUAL (stats.finitecount[2], WIDTH*HEIGHT-1);
+    OIIO_CHECK_EQUAL (stats.stddev[2], 0.0f);
+
+    // The threaded and unthreaded passes, with and without the
+    // histogram, agree.
+    OIIO_CHECK_ASSERT (ImageBufAlgo::computePixelStats (stats1, A, ROI::All(), 1));
+    OIIO_CHECK_ASSERT (stats1.histogram.empty());
+    for (int c = 0;  c < CHANNELS;  ++c) {
+        OIIO_CHECK_EQUAL (stats1.min[c], stats.min[c]);
+        OIIO_CHECK_EQUAL (stats1.max[c], stats.max[c]);
+        OIIO_CHECK_EQUAL_THRESH (stats1.avg[c], stats.avg[c], 1.0e-6f);
+        OIIO_CHECK_EQUAL (stats1.finitecount[c], stats.finitecount[c]);
+    }
+
+    // An ROI that skips the first channel bins only the channels it
+    // names, and leaves the others' histograms empty.
+    ROI roi = get_roi (spec);
+    roi.chbegin = 1;
+    OIIO_CHECK_ASSERT (ImageBufAlgo::computePixelStats (stats1, A, BINS,
+                                                        0.0f, 1.0f, roi));
+    OIIO_CHECK_EQUAL (stats1.histogram.size(), expected.size());
+    for (int i = 0;  i < CHANNELS*BINS;  ++i)
+        OIIO_CHECK_EQUAL (stats1.histogram[i], i < BINS ? 0 : expected[i]);
+
+    // The single-channel histogram works on any pixel type, and counts
+    // what falls outside the range.
+    std::vector<imagesize_t> hist;
+    imagesize_t submin = 0, supermax = 0;
+    OIIO_CHECK_ASSERT (ImageBufAlgo::histogram (A, 0, hist, BINS, 0.0f, 1.0f,
+                                                &submin, &supermax));
+    OIIO_CHECK_ASSERT (std::equal (hist.begin(), hist.end(), &expected[0]));
+    OIIO_CHECK_EQUAL (submin, below);
+    OIIO_CHECK_EQUAL (supermax, above);
+    ImageBuf B;
+    B.copy (A, TypeDesc::UINT16);
+    OIIO_CHECK_ASSERT (ImageBufAlgo::histogram (B, 1, hist, BINS, 0.0f, 1.0f,
+                                                NULL, NULL, ROI::All(), 1));
+    OIIO_CHECK_ASSERT (std::equal (hist.begin(), hist.end(), &expected[BINS]));
+}
+
+
+
+// Test fft against a direct evaluation of the (unitary) DFT, for odd and
+// even sizes, and that ifft undoes it.
+void test_fft ()
+{
+    std::cout << "test fft\n";
+    const int sizes[][2] = { { 12, 7 }, { 9, 16 }, { 40, 33 } };
+    for (int s = 0;  s < 3;  ++s) {
+        const int WIDTH = sizes[s][0], HEIGHT = sizes[s][1];
+        ImageSpec spec (WIDTH, HEIGHT, 2, TypeDesc::FLOAT);
+        ImageBuf A (spec);
+        for (ImageBuf::Iterator<float> a (A);  ! a.done();  ++a) {
+            a[0] = 0.01f * ((a.x()*7 + a.y()*13) % 23) + (a.y() == 3 ? 0.5f : 0.0f);
+            a[1] = 1.0f;   // fft only looks at the first channel
+        }
+        ImageBuf F;
+        OIIO_CHECK_ASSERT (ImageBufAlgo::fft (F, A));
+        OIIO_CHECK_EQUAL (F.spec().width, WIDTH);
+        OIIO_CHECK_EQUAL (F.spec().height, HEIGHT);
+        OIIO_CHECK_EQUAL (F.nchannels(), 2);
+        float maxerr = 0.0f;
+        for (int v = 0;  v < HEIGHT;  ++v) {
+            for (int u = 0;  u < WIDTH;  ++u) {
+                double re = 0.0, im = 0.0;
+                for (ImageBuf::ConstIterator<float> a (A);  ! a.done();  ++a) {
+                    double phase = -2.0 * M_PI * (double(u*a.x())/WIDTH +
+                                                  double(v*a.y())/HEIGHT);
+                    re += a[0] * cos(phase);
+                    im += a[0] * sin(phase);
+                }
+                double scale = 1.0 / sqrt (double(WIDTH*HEIGHT));
+                maxerr = std::max (maxerr, fabsf (F.getchannel(u,v,0,0) - float(re*scale)));
+                maxerr = std::max (maxerr, fabsf (F.getchannel(u,v,0,1) - float(im*scale)));
+            }
+        }
+        OIIO_CHECK_LE (maxerr, 1.0e-5f);
+
+        ImageBuf I;
+        OIIO_CHECK_ASSERT (ImageBufAlgo::ifft (I, F, ROI::All(), 1));
+        OIIO_CHECK_EQUAL (I.nchannels(), 1);
+        maxerr = 0.0f;
+        for (ImageBuf::ConstIterator<float> a (A);  ! a.done();  ++a)
+            maxerr = std::max (maxerr, fabsf (I.getchannel(a.x(),a.y(),0,0) - a[0]));
+        OIIO_CHECK_LE (maxerr, 1.0e-5f);
+    }
+}
+
+
+// Test fillholes_pushpull: opaque pixels are untouched, and holes are
+// filled with (opaque) colors from their surroundings, both with the
+// alpha in the usual place and with fewer channels.
+void test_fillholes ()
+{
+    std::cout << "test fillholes_pushpull\n";
+    const int WIDTH = 37, HEIGHT = 21;
+    for (int nc = 2;  nc <= 4;  nc += 2) {
+        ImageSpec spec (WIDTH, HEIGHT, nc, TypeDesc::FLOAT);
+        spec.alpha_channel = nc-1;
+        ImageBuf A (spec);
+        for (ImageBuf::Iterator<float> a (A);  ! a.done();  ++a) {
+            bool hole = (a.x() > 5 && a.x() < 20 && a.y() > 3 && a.y() < 15);
+            for (int c = 0;  c < nc-1;  ++c)
+                a[c] = hole ? 0.0f : 0.25f + 0.01f * a.x() + 0.1f * c;
+            a[nc-1] = hole ? 0.0f : 1.0f;
+        }
+        ImageBuf F (spec);
+        OIIO_CHECK_ASSERT (ImageBufAlgo::fillholes_pushpull (F, A));
+        for (ImageBuf::ConstIterator<float> a (A);  ! a.done();  ++a) {
+            OIIO_CHECK_EQUAL_THRESH (F.getchannel(a.x(),a.y(),0,nc-1), 1.0f, 1.0e-5f);
+            for (int c = 0;  c < nc-1;  ++c) {
+                float f = F.getchannel (a.x(), a.y(), 0, c);
+                if (a[nc-1] == 1.0f)
+                    OIIO_CHECK_EQUAL (f, a[c]);
+                else {
+                    // Filled from neighbors whose values span this range
+                    OIIO_CHECK_GE (f, 0.25f + 0.1f * c - 1.0e-5f);
+                    OIIO_CHECK_LE (f, 0.25f + 0.01f * (WIDTH-1) + 0.1f * c + 1.0e-5f);
+                }
+            }
+        }
+    }
+}
+
+
+
+// Test median_filter against a brute force median (sort the window,
+// clipped to the image, and take the middle value) for the types and
+// window sizes that take the different code paths, over the whole image
+// including its edges.
+void test_median_filter ()
+{
+    std::cout << "test median_filter\n";
+    const int WIDTH = 41, HEIGHT = 37, CHANNELS = 2;
+    const TypeDesc types[] = { TypeDesc::UINT8, TypeDesc::HALF, TypeDesc::FLOAT };
+    const int windows[][2] = { { 3, 3 }, { 4, 4 }, { 5, 5 }, { 6, 3 }, { 7, 7 } };
+    ImageBuf F (ImageSpec (WIDTH, HEIGHT, CHANNELS, TypeDesc::FLOAT));
+    for (ImageBuf::Iterator<float> f (F);  ! f.done();  ++f) {
+        // Few enough distinct values that windows have ties
+        f[0] = ((f.x()*7 + f.y()*13) % 17) / 16.0f;
+        f[1] = ((f.x()*f.x() + 3*f.y()) % 251) / 255.0f;
+    }
+    for (int t = 0;  t < 3;  ++t) {
+        ImageBuf A;
+        A.copy (F, types[t]);
+        for (int w = 0;  w < 5;  ++w) {
+            const int width = windows[w][0], height = windows[w][1];
+            const int w_2 = width/2, h_2 = height/2;
+            ImageBuf R;
+            OIIO_CHECK_ASSERT (ImageBufAlgo::median_filter (R, A, width, height));
+            OIIO_CHECK_EQUAL (R.spec().format, types[t]);
+            int nwrong = 0;
+            std::vector<float> window;
+            for (int j = 0;  j < HEIGHT;  ++j) {
+                for (int i = 0;  i < WIDTH;  ++i) {
+                    for (int c = 0;  c < CHANNELS;  ++c) {
+                        window.clear ();
+                        for (int y = j-h_2;  y < j-h_2+height;  ++y)
+                            for (int x = i-w_2;  x < i-w_2+width;  ++x)
+                                if (x >= 0 && x < WIDTH && y >= 0 && y < HEIGHT)
+                                    window.push_back (A.getchannel (x, y, 0, c));
+                        std::sort (window.begin(), window.end());
+                        nwrong += (R.getchannel (i, j, 0, c) != window[window.size()/2]);
+                    }
+                }
+            }
+            OIIO_CHECK_EQUAL (nwrong, 0);
+        }
+    }
+}
+
+
+
 // Tests ImageBufAlgo::isConstantColor
 void test_isConstantColor ()
 {
@@ -507,6 +796,86 @@ void test_isMonochrome ()
 
 
 
+// Test render_text: text drawn with a cached face matches the same text
+// drawn with a face that was opened fresh, after enough other sizes were
+// used to push the first one out of the font cache.
+void test_render_text ()
+{
+    std::cout << "test render_text\n";
+    ImageSpec spec (64, 32, 3, TypeDesc::FLOAT);
+    ImageBuf A (spec);
+    ImageBufAlgo::zero (A);
+    if (! ImageBufAlgo::render_text (A, 4, 24, "Hello", 20)) {
+        std::cout << "  skipped: " << A.geterror() << "\n";
+        return;
+    }
+    OIIO_CHECK_ASSERT (! ImageBufAlgo::isConstantColor (A));
+
+    // A second size is a different face, and doesn't disturb the first
+    ImageBufAlgo::CompareResults comp;
+    ImageBuf B (spec);
+    ImageBufAlgo::zero (B);
+    OIIO_CHECK_ASSERT (ImageBufAlgo::render_text (B, 4, 24, "Hello", 12));
+    ImageBufAlgo::compare (A, B, 0.0f, 0.0f, comp);
+    OIIO_CHECK_ASSERT (comp.maxerror > 0.0f);
+    ImageBufAlgo::zero (B);
+    OIIO_CHECK_ASSERT (ImageBufAlgo::render_text (B, 4, 24, "Hello", 20));
+    ImageBufAlgo::compare (A, B, 0.0f, 0.0f, comp);
+    OIIO_CHECK_EQUAL (comp.maxerror, 0.0f);
+
+    // Cycle through more sizes than the cache holds, then redraw
+    for (int size = 6;  size < 40;  ++size)
+        ImageBufAlgo::render_text (B, 0, 20, "x", size);
+    ImageBufAlgo::zero (B);
+    OIIO_CHECK_ASSERT (ImageBufAlgo::render_text (B, 4, 24, "Hello", 20));
+    ImageBufAlgo::compare (A, B, 0.0f, 0.0f, comp);
+    OIIO_CHECK_EQUAL (comp.maxerror, 0.0f);
+}
+
+
+
+// Test ImageBufAlgo::warp for transforms that map pixel centers onto
+// pixel centers, where an interpolating filter should just move pixels.
+void test_warp ()
+{
+    std::cout << "test warp\n";
+    const int W = 16, H = 12, CHANNELS = 3;
+    ImageBuf A (ImageSpec (W, H, CHANNELS, TypeDesc::FLOAT));
+    for (ImageBuf::Iterator<float> it (A);  !it.done();  ++it) {
+        it[0] = float(it.x()) / float(W-1);
+        it[1] = float(it.y()) / float(H-1);
+        it[2] = float((it.x() * 7 + it.y() * 3) % 5) * 0.25f;
+    }
+    float a[CHANNELS], b[CHANNELS];
+
+    // Integer translation: a shifted copy, black where there's no source
+    ImageBuf B (A.spec());
+    Imath::M33f T;
+    T.translate (Imath::V2f (3.0f, 2.0f));
+    OIIO_CHECK_ASSERT (ImageBufAlgo::warp (B, A, T, "triangle"));
+    for (int y = 0;  y < H;  ++y)
+        for (int x = 0;  x < W;  ++x) {
+            B.getpixel (x, y, b);
+            A.getpixel (x-3, y-2, a);   // zero outside A
+            for (int c = 0;  c < CHANNELS;  ++c)
+                OIIO_CHECK_EQUAL_THRESH (b[c], a[c], 1.0e-6f);
+        }
+
+    // Rotate 90 degrees: (x,y) -> (H-y, x), into a HxW image
+    ImageBuf R (ImageSpec (H, W, CHANNELS, TypeDesc::FLOAT));
+    Imath::M33f M (0.0f, 1.0f, 0.0f,  -1.0f, 0.0f, 0.0f,  float(H), 0.0f, 1.0f);
+    OIIO_CHECK_ASSERT (ImageBufAlgo::warp (R, A, M, "lanczos3"));
+    for (int y = 0;  y < W;  ++y)
+        for (int x = 0;  x < H;  ++x) {
+            R.getpixel (x, y, b);
+            A.getpixel (y, H-1-x, a);
+            for (int c = 0;  c < CHANNELS;  ++c)
+                OIIO_CHECK_EQUAL_THRESH (b[c], a[c], 1.0e-3f);
+        }
+}
+
+
+
 // Test ability to do a maketx directly from an ImageBuf
 void
 test_maketx_from_imagebuf()
@@ -538,6 +907,387 @@ test_maketx_from_imagebuf()
 
 
 
+// Test reading from tiles that the ImageCache stores as a single pixel
+// because they are constant: whole, partial (at the image edges), and
+// with regions that start and end inside them, through get_pixels and
+// through texture lookups, against the same reads with the detection
+// turned off.
+void
+test_constant_tiles ()
+{
+    std::cout << "test constant tiles\n";
+    // Tile column 0 is all red, tile column 3 (partial) is all blue, and
+    // tile row 2 (partial) is green in the middle.  The rest varies.
+    const int WIDTH = 100, HEIGHT = 70, CHANNELS = 3, TILE = 32;
+    ImageBuf A (ImageSpec (WIDTH, HEIGHT, CHANNELS, TypeDesc::UINT8));
+    for (ImageBuf::Iterator<unsigned char,float> a (A);  ! a.done();  ++a) {
+        int x = a.x(), y = a.y();
+        float red[] = { 1, 0, 0 }, blue[] = { 0, 0, 1 }, green[] = { 0, 1, 0 };
+        const float *c = (x < 48) ? red : (x >= 96) ? blue
+                       : (y >= 64) ? green : NULL;
+        for (int ch = 0;  ch < CHANNELS;  ++ch)
+            a[ch] = c ? c[ch] : ((x * 7 + y * 13 + ch * 5) % 256) / 255.0f;
+    }
+    const char *filename = "oiio-constant-tiles.png";
+    remove (filename);
+    OIIO_CHECK_ASSERT (A.write (filename));
+    ustring ufilename (filename);
+
+    TextureSystem *ts[2];
+    for (int detect = 0;  detect < 2;  ++detect) {
+        ts[detect] = TextureSystem::create (false);
+        ts[detect]->attribute ("autotile", TILE);
+        ts[detect]->attribute ("detect_constant_tiles", detect);
+    }
+    ImageCache *ic = ImageCache::create (false);
+    ic->attribute ("autotile", TILE);
+
+    // Whole image and a region that starts and ends mid-tile
+    ROI rois[] = { ROI (0, WIDTH, 0, HEIGHT), ROI (10, 99, 20, 70) };
+    for (int r = 0;  r < 2;  ++r) {
+        ROI roi = rois[r];
+        std::vector<unsigned char> cached (roi.npixels() * CHANNELS);
+        std::vector<unsigned char> direct (roi.npixels() * CHANNELS);
+        OIIO_CHECK_ASSERT (ic->get_pixels (ufilename, 0, 0, roi.xbegin,
+                                           roi.xend, roi.ybegin, roi.yend,
+                                           0, 1, TypeDesc::UINT8, &cached[0]));
+        A.get_pixels (roi, TypeDesc::UINT8, &direct[0]);
+        OIIO_CHECK_ASSERT (cached == direct);
+    }
+    // All of tile columns 0 and 3, and the green one in row 2
+    int nconstant = 0;
+    ic->getattribute ("stat:constant_tiles", nconstant);
+    OIIO_CHECK_EQUAL (nconstant, 7);
+
+    // Closest lookups at every texel center give back the pixels, and
+    // bilinear lookups everywhere agree with the undetected tiles.
+    TextureOpt opt;
+    opt.mipmode = TextureOpt::MipModeNoMIP;
+    float maxerr = 0.0f;
+    for (int y = 0;  y < HEIGHT;  ++y) {
+        for (int x = 0;  x < WIDTH;  ++x) {
+            float s = (x + 0.5f) / WIDTH, t = (y + 0.5f) / HEIGHT;
+            float result[2][CHANNELS];
+            opt.interpmode = TextureOpt::InterpClosest;
+            ts[1]->texture (ufilename, opt, s, t, 0, 0, 0, 0,
+                            CHANNELS, result[1]);
+            for (int c = 0;  c < CHANNELS;  ++c)
+                maxerr = std::max (maxerr, fabsf (result[1][c] -
+                                                  A.getchannel (x, y, 0, c)));
+            opt.interpmode = TextureOpt::InterpBilinear;
+            s += 0.37f / WIDTH;
+            t -= 0.21f / HEIGHT;
+            for (int detect = 0;  detect < 2;  ++detect)
+                ts[detect]->texture (ufilename, opt, s, t, 0, 0, 0, 0,
+                                     CHANNELS, result[detect]);
+            for (int c = 0;  c < CHANNELS;  ++c)
+                maxerr = std::max (maxerr, fabsf (result[1][c] - result[0][c]));
+        }
+    }
+    OIIO_CHECK_LE (maxerr, 1.0e-6f);
+    ts[1]->getattribute ("stat:constant_tiles", nconstant);
+    OIIO_CHECK_EQUAL (nconstant, 7);
+
+    ImageCache::destroy (ic);
+    TextureSystem::destroy (ts[0]);
+    TextureSystem::destroy (ts[1]);
+    remove (filename);  // clean up
+}
+
+
+
+// Test that ImageCache::get_pixels over regions big enough to be split
+// into bands for several threads, including ones that don't start or end
+// on a tile boundary, gives the same pixels as the ImageBuf.
+void
+test_get_pixels_threaded ()
+{
+    std::cout << "test threaded get_pixels\n";
+    const int WIDTH = 1024, HEIGHT = 256, CHANNELS = 3, TILE = 64;
+    ImageBuf A (ImageSpec (WIDTH, HEIGHT, CHANNELS, TypeDesc::UINT8));
+    for (ImageBuf::Iterator<unsigned char,float> a (A);  ! a.done();  ++a)
+        for (int ch = 0;  ch < CHANNELS;  ++ch)
+            a[ch] = ((a.x() * 3 + a.y() * 11 + ch * 5) % 256) / 255.0f;
+    const char *filename = "oiio-threaded-get-pixels.png";
+    remove (filename);
+    OIIO_CHECK_ASSERT (A.write (filename));
+    ustring ufilename (filename);
+
+    int oldthreads = 0;
+    OIIO::getattribute ("threads", oldthreads);
+    ImageCache *ic = ImageCache::create (false);
+    ic->attribute ("autotile", TILE);
+    ROI rois[] = { ROI (0, WIDTH, 0, HEIGHT), ROI (0, WIDTH, 32, 160),
+                   ROI (5, 1000, 33, 250) };
+    const int threads[] = { 2, 3, 4 };
+    for (int t = 0;  t < 3;  ++t) {
+        OIIO::attribute ("threads", threads[t]);
+        for (int r = 0;  r < 3;  ++r) {
+            ROI roi = rois[r];
+            std::vector<unsigned char> cached (roi.npixels() * CHANNELS);
+            std::vector<unsigned char> direct (roi.npixels() * CHANNELS);
+            ic->invalidate_all (true);
+            OIIO_CHECK_ASSERT (ic->get_pixels (ufilename, 0, 0, roi.xbegin,
+                                               roi.xend, roi.ybegin, roi.yend,
+                                               0, 1, TypeDesc::UINT8, &cached[0]));
+            A.get_pixels (roi, TypeDesc::UINT8, &direct[0]);
+            OIIO_CHECK_ASSERT (cached == direct);
+        }
+    }
+    OIIO::attribute ("threads", oldthreads);
+    ImageCache::destroy (ic);
+    remove (filename);  // clean up
+}
+
+
+
+// Make an ImageCache that uses the given spec index.
+static ImageCache *
+spec_index_cache (const char *indexname)
+{
+    ImageCache *ic = ImageCache::create (false);
+    ic->attribute ("spec_index", indexname);
+    return ic;
+}
+
+
+
+// Check that the ImageCache gives the right resolution for each of the
+// files, and return how many of them came from its spec index.
+static int
+spec_index_check (ImageCache *ic, const char * const *files,
+                  const int res[][2], int nfiles)
+{
+    for (int i = 0;  i < nfiles;  ++i) {
+        ImageSpec spec;
+        OIIO_CHECK_ASSERT (ic->get_imagespec (ustring(files[i]), spec));
+        OIIO_CHECK_EQUAL (spec.width, res[i][0]);
+        OIIO_CHECK_EQUAL (spec.height, res[i][1]);
+        OIIO_CHECK_EQUAL (spec.nchannels, 3);
+    }
+    int hits = 0;
+    ic->getattribute ("stat:spec_index_hits", hits);
+    return hits;
+}
+
+
+
+// Test the persistent spec index: a fresh ImageCache serves specs from
+// an index written by another, ignores the entries of files that changed
+// since, merges rather than clobbers when two caches write the same
+// index, and rejects an index that is truncated or corrupt without
+// harm.  Destroying a cache is what writes its index.
+void
+test_spec_index ()
+{
+    std::cout << "test spec index\n";
+    const char *files[] = { "oiio-spec-index-a.png", "oiio-spec-index-b.png" };
+    const int res[][2] = { { 32, 16 }, { 24, 40 } };
+    for (int i = 0;  i < 2;  ++i) {
+        ImageBuf A (ImageSpec (res[i][0], res[i][1], 3, TypeDesc::UINT8));
+        const float color[] = { 0.25f, 0.5f, 0.75f };
+        ImageBufAlgo::fill (A, color);
+        remove (files[i]);
+        OIIO_CHECK_ASSERT (A.write (files[i]));
+    }
+    const char *indexname = "oiio-spec-index.spx";
+    remove (indexname);
+
+    // Write the index, then read it back in a fresh cache
+    ImageCache *ic = spec_index_cache (indexname);
+    OIIO_CHECK_EQUAL (spec_index_check (ic, files, res, 2), 0);
+    ImageCache::destroy (ic);
+    OIIO_CHECK_ASSERT (Filesystem::exists (indexname));
+    ic = spec_index_cache (indexname);
+    OIIO_CHECK_EQUAL (spec_index_check (ic, files, res, 2), 2);
+    ImageCache::destroy (ic);
+
+    // A file whose modification time changed is reopened, and its entry
+    // is brought up to date for next time.
+    Filesystem::last_write_time (files[1],
+                                 Filesystem::last_write_time (files[1]) - 10);
+    ic = spec_index_cache (indexname);
+    OIIO_CHECK_EQUAL (spec_index_check (ic, files, res, 2), 1);
+    ImageCache::destroy (ic);
+    ic = spec_index_cache (indexname);
+    OIIO_CHECK_EQUAL (spec_index_check (ic, files, res, 2), 2);
+    ImageCache::destroy (ic);
+
+    // Two caches that read the index before either wrote it each add
+    // one file; the index ends up with both.
+    remove (indexname);
+    ImageCache *ic2[2];
+    for (int i = 0;  i < 2;  ++i)
+        ic2[i] = spec_index_cache (indexname);
+    for (int i = 0;  i < 2;  ++i) {
+        OIIO_CHECK_EQUAL (spec_index_check (ic2[i], files+i, res+i, 1), 0);
+        ImageCache::destroy (ic2[i]);
+    }
+    ic = spec_index_cache (indexname);
+    OIIO_CHECK_EQUAL (spec_index_check (ic, files, res, 2), 2);
+    ImageCache::destroy (ic);
+
+    // Truncate the good index, or replace it by one with the right magic
+    // number but an absurd entry count, or by garbage.  Each is rejected
+    // with an error, the files are opened as usual, and a good index is
+    // written in its place.
+    std::vector<char> good ((size_t) Filesystem::file_size (indexname));
+    FILE *f = Filesystem::fopen (indexname, "rb");
+    OIIO_CHECK_ASSERT (f && fread (&good[0], 1, good.size(), f) == good.size());
+    if (f)
+        fclose (f);
+    std::vector<char> bad[3];
+    bad[0].assign (good.begin(), good.begin() + good.size()/2);
+    bad[1].assign (good.begin(), good.begin() + 9);
+    bad[1].resize (bad[1].size() + 64, char(0xff));
+    bad[2].assign (good.size(), 'x');
+    for (int b = 0;  b < 3;  ++b) {
+        f = Filesystem::fopen (indexname, "wb");
+        OIIO_CHECK_ASSERT (f && fwrite (&bad[b][0], 1, bad[b].size(), f)
+                                    == bad[b].size());
+        if (f)
+            fclose (f);
+        ic = spec_index_cache (indexname);
+        OIIO_CHECK_ASSERT (ic->geterror().size());
+        OIIO_CHECK_EQUAL (spec_index_check (ic, files, res, 2), 0);
+        ImageCache::destroy (ic);
+        ic = spec_index_cache (indexname);
+        OIIO_CHECK_EQUAL (spec_index_check (ic, files, res, 2), 2);
+        ImageCache::destroy (ic);
+    }
+
+    remove (files[0]);  // clean up
+    remove (files[1]);
+    remove (indexname);
+    remove ((std::string(indexname) + ".lock").c_str());
+}
+
+
+
+
+// Make a small deep image with channels R, A, Z, Zback, id.
+static ImageSpec
+deep_test_spec (int width)
+{
+    ImageSpec spec (width, 1, 5, TypeDesc::FLOAT);
+    spec.channelnames[0] = "R";
+    spec.channelnames[1] = "A";
+    spec.channelnames[2] = "Z";
+    spec.channelnames[3] = "Zback";
+    spec.channelnames[4] = "id";
+    spec.channelformats.resize (5, TypeDesc::FLOAT);
+    spec.channelformats[4] = TypeDesc::UINT;
+    spec.alpha_channel = 1;
+    spec.z_channel = 2;
+    spec.deep = true;
+    return spec;
+}
+
+
+static void
+add_deep_sample (ImageBuf &buf, int x, float R, float A, float Z,
+                 float Zback, uint32_t id = 0)
+{
+    int s = buf.deep_samples (x, 0, 0);
+    buf.deepdata()->insert_samples (x, s);
+    buf.set_deep_value (x, 0, 0, 0, s, R);
+    buf.set_deep_value (x, 0, 0, 1, s, A);
+    buf.set_deep_value (x, 0, 0, 2, s, Z);
+    buf.set_deep_value (x, 0, 0, 3, s, Zback);
+    buf.set_deep_value_uint (x, 0, 0, 4, s, id);
+}
+
+
+// Tests ImageBufAlgo::deep_sort, deep_tidy, deep_merge, deep_holdout,
+// deep_trim
+void test_deep_ops ()
+{
+    std::cout << "test deep ops\n";
+    const float eps = 1.0e-5f;
+    ImageBuf A (deep_test_spec (3)), B (deep_test_spec (3));
+    A.deep_alloc ();
+    B.deep_alloc ();
+    // Pixel 0: two unsorted point samples, the nearer one opaque
+    add_deep_sample (A, 0, 0.5f, 0.5f, 5.0f, 5.0f);
+    add_deep_sample (A, 0, 1.0f, 1.0f, 1.0f, 1.0f, 0xfffffff1);
+    // Pixel 1: a volume in A, and a point inside it in B
+    add_deep_sample (A, 1, 0.75f, 0.75f, 0.0f, 2.0f);
+    add_deep_sample (B, 1, 0.5f, 0.5f, 1.0f, 1.0f);
+    // Pixel 2: coincident samples in A and B
+    add_deep_sample (A, 2, 0.5f, 0.5f, 3.0f, 3.0f, 42);
+    add_deep_sample (B, 2, 0.5f, 0.5f, 3.0f, 3.0f, 42);
+
+    ImageBuf R;
+    OIIO_CHECK_ASSERT (ImageBufAlgo::deep_sort (R, A));
+    OIIO_CHECK_EQUAL (R.deep_samples (0, 0), 2);
+    OIIO_CHECK_EQUAL (R.deep_value (0, 0, 0, 2, 0), 1.0f);
+    OIIO_CHECK_EQUAL (R.deep_value_uint (0, 0, 0, 4, 0), 0xfffffff1);
+
+    R.clear ();
+    OIIO_CHECK_ASSERT (ImageBufAlgo::deep_tidy (R, A, true));
+    OIIO_CHECK_EQUAL (R.deep_samples (0, 0), 1);   // culled behind opaque
+
+    // Merge splits A's volume at B's point: [0,1], [1,1], [1,2]
+    R.clear ();
+    OIIO_CHECK_ASSERT (ImageBufAlgo::deep_merge (R, A, B));
+    OIIO_CHECK_EQUAL (R.deep_samples (1, 0), 3);
+    OIIO_CHECK_EQUAL_THRESH (R.deep_value (1, 0, 0, 1, 0), 0.5f, eps);
+    OIIO_CHECK_EQUAL_THRESH (R.deep_value (1, 0, 0, 0, 0), 0.5f, eps);
+    OIIO_CHECK_EQUAL (R.deep_value (1, 0, 0, 3, 0), 1.0f);
+    OIIO_CHECK_EQUAL (R.deep_value (1, 0, 0, 2, 1), 1.0f);
+    OIIO_CHECK_EQUAL (R.deep_value (1, 0, 0, 3, 2), 2.0f);
+    // Coincident samples combine as mixed media
+    OIIO_CHECK_EQUAL (R.deep_samples (2, 0), 1);
+    OIIO_CHECK_EQUAL_THRESH (R.deep_value (2, 0, 0, 1, 0), 0.75f, eps);
+    OIIO_CHECK_EQUAL_THRESH (R.deep_value (2, 0, 0, 0, 0), 0.75f, eps);
+    OIIO_CHECK_EQUAL (R.deep_value_uint (2, 0, 0, 4, 0), 42);
+
+    // Holdout: pixel 0 of A is completely hidden by an opaque sample,
+    // pixel 2 is behind a half-transparent one, pixel 1 is untouched.
+    ImageBuf H (deep_test_spec (3));
+    H.deep_alloc ();
+    add_deep_sample (H, 0, 0.0f, 1.0f, 0.5f, 0.5f);
+    add_deep_sample (H, 2, 0.0f, 0.5f, 1.0f, 1.0f);
+    R.clear ();
+    OIIO_CHECK_ASSERT (ImageBufAlgo::deep_holdout (R, A, H));
+    OIIO_CHECK_EQUAL (R.deep_samples (0, 0), 0);
+    OIIO_CHECK_EQUAL (R.deep_samples (1, 0), 1);
+    OIIO_CHECK_EQUAL (R.deep_value (1, 0, 0, 1, 0), 0.75f);
+    OIIO_CHECK_EQUAL (R.deep_samples (2, 0), 1);
+    OIIO_CHECK_EQUAL_THRESH (R.deep_value (2, 0, 0, 0, 0), 0.25f, eps);
+    OIIO_CHECK_EQUAL_THRESH (R.deep_value (2, 0, 0, 1, 0), 0.25f, eps);
+    OIIO_CHECK_EQUAL (R.deep_value_uint (2, 0, 0, 4, 0), 42);
+    // A holdout pixel with far more samples than would fit on the stack,
+    // all of them behind the volume in pixel 1.
+    const int dense = 1000000;
+    H.deepdata()->set_samples (1, dense);
+    for (int h = 0;  h < dense;  ++h) {
+        H.set_deep_value (1, 0, 0, 1, h, 0.5f);
+        H.set_deep_value (1, 0, 0, 2, h, 100.0f + h);
+        H.set_deep_value (1, 0, 0, 3, h, 100.0f + h);
+    }
+    R.clear ();
+    OIIO_CHECK_ASSERT (ImageBufAlgo::deep_holdout (R, A, H));
+    OIIO_CHECK_EQUAL (R.deep_samples (1, 0), 1);
+    OIIO_CHECK_EQUAL (R.deep_value (1, 0, 0, 1, 0), 0.75f);
+
+    // Trimming to [1,10] removes the front half of the volume
+    R.clear ();
+    OIIO_CHECK_ASSERT (ImageBufAlgo::deep_trim (R, A, 1.0f, 10.0f));
+    OIIO_CHECK_EQUAL (R.deep_samples (1, 0), 1);
+    OIIO_CHECK_EQUAL (R.deep_value (1, 0, 0, 2, 0), 1.0f);
+    OIIO_CHECK_EQUAL_THRESH (R.deep_value (1, 0, 0, 1, 0), 0.5f, eps);
+    OIIO_CHECK_EQUAL (R.deep_samples (0, 0), 2);
+
+    // In-place, and on a flat image (which is an error)
+    OIIO_CHECK_ASSERT (ImageBufAlgo::deep_tidy (A, A));
+    OIIO_CHECK_EQUAL (A.deep_value (0, 0, 0, 2, 0), 1.0f);
+    ImageBuf flat (ImageSpec (3, 1, 4, TypeDesc::FLOAT));
+    R.clear ();
+    OIIO_CHECK_ASSERT (! ImageBufAlgo::deep_tidy (R, flat));
+}
+
+
 
 int
 main (int argc, char **argv)
@@ -547,15 +1297,27 @@ main (int argc, char **argv)
     test_crop ();
     test_paste ();
     test_channel_append ();
+    test_channels ();
     test_add ();
     test_sub ();
     test_mul ();
     test_mad ();
     test_compare ();
+    test_compare_Yee ();
+    test_computePixelStats ();
+    test_fft ();
+    test_fillholes ();
+    test_median_filter ();
     test_isConstantColor ();
     test_isConstantChannel ();
     test_isMonochrome ();
+    test_render_text ();
+    test_warp ();
     test_maketx_from_imagebuf ();
+    test_constant_tiles ();
+    test_get_pixels_threaded ();
+    test_spec_index ();
+    test_deep_ops ();
     
     return unit_test_failures;
 }
@@ -40,12 +40,14 @@
 #include <OpenEXR/ImathBox.h>
 
 #include <cmath>
+#include <vector>
 
 #include "OpenImageIO/imagebuf.h"
 #include "OpenImageIO/imagebufalgo.h"
 #include "OpenImageIO/imagebufalgo_util.h"
 #include "OpenImageIO/dassert.h"
 #include "OpenImageIO/filter.h"
+#include "OpenImageIO/simd.h"
 #include "OpenImageIO/thread.h"
 
 OIIO_NAMESPACE_ENTER {
@@ -144,17 +146,16 @@ template<typename SRCTYPE>
 inline void
 filtered_sample (const ImageBuf &src, float s, float t,
                  float dsdx, float dtdx, float dsdy, float dtdy,
-                 const Filter2D *filter, ImageBuf::WrapMode wrap,
+                 const FilterTable &filter, ImageBuf::WrapMode wrap,
                  float *result)
 {
-    DASSERT (filter);
     // Just use isotropic filtering
     float ds = std::max (1.0f, std::max (fabsf(dsdx), fabsf(dsdy)));
     float dt = std::max (1.0f, std::max (fabsf(dtdx), fabsf(dtdy)));
     float ds_inv = 1.0f / ds;
     float dt_inv = 1.0f / dt;
-    float filterrad_s = 0.5f * ds * filter->width();
-    float filterrad_t = 0.5f * dt * filter->width();
+    float filterrad_s = 0.5f * ds * filter.width();
+    float filterrad_t = 0.5f * dt * filter.width();
     ImageBuf::ConstIterator<SRCTYPE> samp (src, 
                       (int)floorf(s-filterrad_s), (int)ceilf(s+filterrad_s),
                       (int)floorf(t-filterrad_t), (int)ceilf(t+filterrad_t),
@@ -164,7 +165,7 @@ filtered_sample (const ImageBuf &src, float s, float t,
     memset (sum, 0, nc*sizeof(float));
     float total_w = 0.0f;
     for ( ; ! samp.done(); ++samp) {
-        float w = (*filter) (ds_inv*(samp.x()+0.5f-s), dt_inv*(samp.y()+0.5f-t));
+        float w = filter (ds_inv*(samp.x()+0.5f-s), dt_inv*(samp.y()+0.5f-t));
         for (int c = 0; c < nc; ++c)
             sum[c] += w * samp[c];
         total_w += w;
@@ -177,6 +178,106 @@ filtered_sample (const ImageBuf &src, float s, float t,
             result[c] = 0.0f;
 }
 
+// Load four consecutive channel values as a float4.
+template<typename T>
+inline simd::float4
+load4 (const T *p)
+{
+    return simd::float4 (convert_type<T,float>(p[0]), convert_type<T,float>(p[1]),
+                         convert_type<T,float>(p[2]), convert_type<T,float>(p[3]));
+}
+
+inline simd::float4
+load4 (const float *p)
+{
+    return simd::float4 (p);
+}
+
+
+
+// Weighted sum over a footprint of a local source image: the taps are
+// the rows ybase+yoff[j] and columns xbase+xoff[i], with separable
+// weights wy[j]*wx[i].  The footprint must lie inside the data window.
+// Four-channel images accumulate all channels at once in a float4.
+template<typename SRCTYPE>
+inline void
+footprint_sum (const SRCTYPE *srcbase, int nc, stride_t ystride,
+               int xbase, int ybase,
+               const int *xoff, const float *wx, int nx,
+               const int *yoff, const float *wy, int ny, float *sum)
+{
+    if (nc == 4) {
+        simd::float4 acc (0.0f);
+        for (int j = 0;  j < ny;  ++j) {
+            if (wy[j] == 0.0f)
+                continue;
+            const SRCTYPE *row = srcbase + (ybase+yoff[j])*ystride + xbase*4;
+            simd::float4 racc (0.0f);
+            for (int i = 0;  i < nx;  ++i)
+                racc += simd::float4(wx[i]) * load4 (row + 4*xoff[i]);
+            acc += simd::float4(wy[j]) * racc;
+        }
+        acc.store (sum);
+        return;
+    }
+    for (int c = 0;  c < nc;  ++c)
+        sum[c] = 0.0f;
+    for (int j = 0;  j < ny;  ++j) {
+        if (wy[j] == 0.0f)
+            continue;
+        const SRCTYPE *row = srcbase + (ybase+yoff[j])*ystride + xbase*nc;
+        for (int i = 0;  i < nx;  ++i) {
+            float w = wy[j] * wx[i];
+            const SRCTYPE *p = row + nc*xoff[i];
+            for (int c = 0;  c < nc;  ++c)
+                sum[c] += w * convert_type<SRCTYPE,float>(p[c]);
+        }
+    }
+}
+
+
+
+// Source position (s,t) of (x,y) under the affine Minv, computed exactly
+// as robust_multVecMatrix does so that filter taps agree with the
+// general warp.
+inline void
+affine_source (const Imath::M33f &Minv, float winv, float x, float y,
+               float &s, float &t)
+{
+    s = (x * Minv[0][0] + y * Minv[1][0] + Minv[2][0]) * winv;
+    t = (x * Minv[0][1] + y * Minv[1][1] + Minv[2][1]) * winv;
+}
+
+
+
+// Weights of the n footprint taps x0..x0+n-1 along one axis for a
+// sample at s with filter scale 1/ds, evaluated with the same arguments
+// filtered_sample uses (so that ties at the edge of a box filter resolve
+// the same way).  Return their sum.
+inline float
+footprint_weights (const FilterTable &filter, bool xaxis, float s,
+                   float ds_inv, int x0, int n, float *w)
+{
+    float total = 0.0f;
+    for (int i = 0;  i < n;  ++i) {
+        float x = ds_inv * (float(x0+i) + 0.5f - s);
+        w[i] = xaxis ? filter.xfilt (x) : filter.yfilt (x);
+        total += w[i];
+    }
+    return total;
+}
+
+
+
+// Is x within eps of an integer in [-1,1]?
+inline bool
+unit_or_zero (float x, float eps = 1.0e-6f)
+{
+    return fabsf(x) < eps || fabsf(fabsf(x) - 1.0f) < eps;
+}
+
+
+
 } // end anon namespace
 
 
@@ -185,13 +286,13 @@ filtered_sample (const ImageBuf &src, float s, float t,
 template<typename DSTTYPE, typename SRCTYPE>
 static bool
 resize_ (ImageBuf &dst, const ImageBuf &src,
-         Filter2D *filter, ROI roi, int nthreads)
+         const FilterTable &filter, ROI roi, int nthreads)
 {
     if (nthreads != 1 && roi.npixels() >= 1000) {
         // Lots of pixels and request for multi threads? Parallelize.
         ImageBufAlgo::parallel_image (
             boost::bind(resize_<DSTTYPE,SRCTYPE>, boost::ref(dst),
-                        boost::cref(src), filter,
+                        boost::cref(src), boost::cref(filter),
                         _1 /*roi*/, 1 /*nthreads*/),
             roi, nthreads);
         return true;
@@ -224,7 +325,7 @@ resize_ (ImageBuf &dst, const ImageBuf &src,
     float dstpixelwidth = 1.0f / dstfw;
     float dstpixelheight = 1.0f / dstfh;
     float *pel = ALLOCA (float, nchannels);
-    float filterrad = filter->width() / 2.0f;
+    float filterrad = filter.width() / 2.0f;
 
     // radi,radj is the filter radius, as an integer, in source pixels.  We
     // will filter the source over [x-radi, x+radi] X [y-radj,y+radj].
@@ -232,7 +333,7 @@ resize_ (ImageBuf &dst, const ImageBuf &src,
     int radj = (int) ceilf (filterrad/yratio);
     int xtaps = 2*radi + 1;
     int ytaps = 2*radj + 1;
-    bool separable = filter->separable();
+    bool separable = filter.separable();
     float *xfiltval = NULL, *yfiltval = NULL;
     if (separable) {
         // Allocate temp space to cache the filter weights
@@ -273,11 +374,8 @@ resize_ (ImageBuf &dst, const ImageBuf &src,
         // compute and normalize them once.
         float totalweight_y = 0.0f;
         if (separable) {
-            for (int j = 0;  j < ytaps;  ++j) {
-                float w = filter->yfilt (yratio * (j-radj-(src_yf_frac-0.5f)));
-                yfiltval[j] = w;
-                totalweight_y += w;
-            }
+            totalweight_y = filter.yfilt (yratio * (-radj-(src_yf_frac-0.5f)),
+                                          yratio, ytaps, yfiltval);
             for (int i = 0;  i < ytaps;  ++i)
                 yfiltval[i] /= totalweight_y;
         }
@@ -293,12 +391,9 @@ resize_ (ImageBuf &dst, const ImageBuf &src,
                 // Cache and normalize the horizontal filter tap weights
                 // just once for this (x,y) position, reuse for all vertical
                 // taps.
-                float totalweight_x = 0.0f;
-                for (int i = 0;  i < xtaps;  ++i) {
-                    float w = filter->xfilt (xratio * (i-radi-(src_xf_frac-0.5f)));
-                    xfiltval[i] = w;
-                    totalweight_x += w;
-                }
+                float totalweight_x =
+                    filter.xfilt (xratio * (-radi-(src_xf_frac-0.5f)),
+                                  xratio, xtaps, xfiltval);
 
                 if (totalweight_x != 0.0f) {
                     for (int i = 0;  i < xtaps;  ++i)  // normalize x filter
@@ -338,8 +433,8 @@ resize_ (ImageBuf &dst, const ImageBuf &src,
                                                        0, 1, ImageBuf::WrapClamp);
                 for (int j = -radj;  j <= radj;  ++j) {
                     for (int i = -radi;  i <= radi;  ++i, ++srcpel) {
-                        float w = (*filter)(xratio * (i-(src_xf_frac-0.5f)),
-                                            yratio * (j-(src_yf_frac-0.5f)));
+                        float w = filter (xratio * (i-(src_xf_frac-0.5f)),
+                                          yratio * (j-(src_yf_frac-0.5f)));
                         totalweight += w;
                         if (w == 0.0f)
                             continue;
@@ -396,10 +491,12 @@ ImageBufAlgo::resize (ImageBuf &dst, const ImageBuf &src,
         filterptr.reset (filter);
     }
 
+    // Tabulate the filter once, rather than evaluating it for every tap.
+    FilterTable ftable (filter);
     bool ok;
     OIIO_DISPATCH_COMMON_TYPES2 (ok, "resize", resize_,
                           dst.spec().format, src.spec().format,
-                          dst, src, filter, roi, nthreads);
+                          dst, src, ftable, roi, nthreads);
     return ok;
 }
 
@@ -447,10 +544,11 @@ ImageBufAlgo::resize (ImageBuf &dst, const ImageBuf &src,
         return false;
     }
 
+    FilterTable ftable (filter.get());
     bool ok;
     OIIO_DISPATCH_COMMON_TYPES2 (ok, "resize", resize_,
                           dstspec.format, srcspec.format,
-                          dst, src, filter.get(), roi, nthreads);
+                          dst, src, ftable, roi, nthreads);
     return ok;
 }
 
@@ -574,10 +672,148 @@ affine_resample_ (ImageBuf &dst, const ImageBuf &src, const Imath::M33f &Minv,
 
 
 
+// Serial warp for an affine M, separable filter, and local source.  For
+// an affine transform the filter footprint has the same size everywhere,
+// so we walk the source coordinates incrementally along each output
+// scanline and compute each footprint's weights as two batched,
+// separable tables (instead of one filter evaluation per tap), then sum
+// the source pixels directly.  When Minv is a pure translation or a
+// multiple of 90 degrees (plus translation), the footprint weights are
+// the same for every output pixel, so they are computed just once and
+// zero taps are dropped -- for an interpolating filter at an integer
+// offset that is a straight copy.  The output is done in tiles to keep
+// rotated source access local.  Footprints that reach outside the
+// source data window use filtered_sample, and so honor the wrap mode
+// exactly as the general case does.
+template<typename DSTTYPE, typename SRCTYPE>
+static bool
+warp_affine_ (ImageBuf &dst, const ImageBuf &src, const Imath::M33f &Minv,
+              const FilterTable &filter, ImageBuf::WrapMode wrap, ROI roi)
+{
+    const ImageSpec &srcspec (src.spec());
+    int nc = srcspec.nchannels;
+    int dstnc = dst.nchannels();
+    float *pel = ALLOCA (float, std::max (nc, 4));
+
+    // Source position of output pixel (x,y) is (x+0.5,y+0.5)*Minv, with
+    // constant derivatives.
+    float winv = 1.0f / Minv[2][2];
+    float dsdx = Minv[0][0] * winv, dtdx = Minv[0][1] * winv;
+    float dsdy = Minv[1][0] * winv, dtdy = Minv[1][1] * winv;
+
+    // Same isotropic footprint as filtered_sample
+    float ds = std::max (1.0f, std::max (fabsf(dsdx), fabsf(dsdy)));
+    float dt = std::max (1.0f, std::max (fabsf(dtdx), fabsf(dtdy)));
+    float ds_inv = 1.0f / ds, dt_inv = 1.0f / dt;
+    float rs = 0.5f * ds * filter.width();
+    float rt = 0.5f * dt * filter.width();
+    // The footprint grows with the minification, without bound, so its
+    // weights and offsets go on the heap rather than the stack.
+    int maxnx = (int) ceilf (2.0f * rs) + 2;
+    int maxny = (int) ceilf (2.0f * rt) + 2;
+    std::vector<float> weights (maxnx + maxny);
+    std::vector<int> offsets (maxnx + maxny);
+    float *wx = &weights[0], *wy = &weights[maxnx];
+    int *xoff = &offsets[0], *yoff = &offsets[maxnx];
+    for (int i = 0;  i < maxnx;  ++i)
+        xoff[i] = i;
+    for (int j = 0;  j < maxny;  ++j)
+        yoff[j] = j;
+
+    // Translation or 90 degree multiple: the footprint is congruent for
+    // every output pixel, so compute its weights once, relative to the
+    // first pixel, and keep only the nonzero taps.
+    bool constant_weights = unit_or_zero(dsdx) && unit_or_zero(dtdx) &&
+                            unit_or_zero(dsdy) && unit_or_zero(dtdy);
+    float s0, t0;
+    affine_source (Minv, winv, roi.xbegin+0.5f, roi.ybegin+0.5f, s0, t0);
+    int cx0 = 0, cy0 = 0, cnx = 0, cny = 0, cxspan = 0, cyspan = 0;
+    float ctotal = 0.0f;
+    if (constant_weights) {
+        cx0 = (int) floorf (s0 - rs);
+        cy0 = (int) floorf (t0 - rt);
+        int nx = (int) ceilf (s0 + rs) - cx0;
+        int ny = (int) ceilf (t0 + rt) - cy0;
+        float totx = footprint_weights (filter, true, s0, ds_inv, cx0, nx, wx);
+        float toty = footprint_weights (filter, false, t0, dt_inv, cy0, ny, wy);
+        ctotal = totx * toty;
+        for (int i = 0;  i < nx;  ++i)
+            if (wx[i] != 0.0f) {
+                wx[cnx] = wx[i];
+                xoff[cnx++] = i;
+            }
+        for (int j = 0;  j < ny;  ++j)
+            if (wy[j] != 0.0f) {
+                wy[cny] = wy[j];
+                yoff[cny++] = j;
+            }
+        cxspan = cnx ? xoff[cnx-1]+1 : 0;
+        cyspan = cny ? yoff[cny-1]+1 : 0;
+    }
+
+    const SRCTYPE *srcbase = (const SRCTYPE *) src.pixeladdr (src.xbegin(), src.ybegin());
+    int sxbegin = src.xbegin(), sxend = src.xend();
+    int sybegin = src.ybegin(), syend = src.yend();
+    stride_t ystride = stride_t(srcspec.width) * nc;
+    const int tilesize = 64;
+    for (int ty = roi.ybegin;  ty < roi.yend;  ty += tilesize) {
+        int tyend = std::min (ty+tilesize, roi.yend);
+        for (int tx = roi.xbegin;  tx < roi.xend;  tx += tilesize) {
+            int txend = std::min (tx+tilesize, roi.xend);
+            for (int y = ty;  y < tyend;  ++y) {
+                DSTTYPE *d = (DSTTYPE *) dst.pixeladdr (tx, y, roi.zbegin);
+                for (int x = tx;  x < txend;  ++x, d += dstnc) {
+                    float s, t;
+                    affine_source (Minv, winv, x+0.5f, y+0.5f, s, t);
+                    int x0, y0, nx, ny, xspan, yspan;
+                    float total = 0.0f;
+                    if (constant_weights) {
+                        // Integer displacement from the first pixel
+                        x0 = cx0 + (int) floorf (s - s0 + 0.5f);
+                        y0 = cy0 + (int) floorf (t - t0 + 0.5f);
+                        nx = cnx;  ny = cny;
+                        xspan = cxspan;  yspan = cyspan;
+                        total = ctotal;
+                    } else {
+                        x0 = (int) floorf (s - rs);
+                        y0 = (int) floorf (t - rt);
+                        xspan = nx = (int) ceilf (s + rs) - x0;
+                        yspan = ny = (int) ceilf (t + rt) - y0;
+                    }
+                    if (x0 >= sxbegin && x0 + xspan <= sxend &&
+                        y0 >= sybegin && y0 + yspan <= syend) {
+                        if (! constant_weights)
+                            total = footprint_weights (filter, true, s, ds_inv, x0, nx, wx)
+                                  * footprint_weights (filter, false, t, dt_inv, y0, ny, wy);
+                        if (total != 0.0f) {
+                            footprint_sum (srcbase, nc, ystride,
+                                           x0-sxbegin, y0-sybegin,
+                                           xoff, wx, nx, yoff, wy, ny, pel);
+                            for (int c = 0;  c < nc;  ++c)
+                                pel[c] /= total;
+                        } else {
+                            for (int c = 0;  c < nc;  ++c)
+                                pel[c] = 0.0f;
+                        }
+                    } else {
+                        filtered_sample<SRCTYPE> (src, s, t, dsdx, dtdx,
+                                                  dsdy, dtdy, filter, wrap, pel);
+                    }
+                    for (int c = roi.chbegin;  c < roi.chend;  ++c)
+                        d[c] = convert_type<float,DSTTYPE>(pel[c]);
+                }
+            }
+        }
+    }
+    return true;
+}
+
+
+
 template<typename DSTTYPE, typename SRCTYPE>
 static bool
 warp_ (ImageBuf &dst, const ImageBuf &src, const Imath::M33f &M,
-       const Filter2D *filter, ImageBuf::WrapMode wrap,
+       const FilterTable &filter, ImageBuf::WrapMode wrap,
        ROI roi, int nthreads)
 {
     if (nthreads != 1 && roi.npixels() >= 1000) {
@@ -585,16 +821,21 @@ warp_ (ImageBuf &dst, const ImageBuf &src, const Imath::M33f &M,
         ImageBufAlgo::parallel_image (
             boost::bind(warp_<DSTTYPE,SRCTYPE>,
                         boost::ref(dst), boost::cref(src), M,
-                        filter, wrap, _1 /*roi*/, 1 /*nthreads*/),
+                        boost::cref(filter), wrap, _1 /*roi*/, 1 /*nthreads*/),
             roi, nthreads);
         return true;
     }
 
     // Serial case
+    Imath::M33f Minv = M.inverse();
+    if (Minv[0][2] == 0.0f && Minv[1][2] == 0.0f && Minv[2][2] != 0.0f &&
+        filter.separable() && src.localpixels() && ! src.deep() &&
+        dst.localpixels())
+        return warp_affine_<DSTTYPE,SRCTYPE> (dst, src, Minv, filter, wrap, roi);
+
     int nc = dst.nchannels();
     float *pel = ALLOCA (float, nc);
     memset (pel, 0, nc*sizeof(float));
-    Imath::M33f Minv = M.inverse();
     ImageBuf::Iterator<DSTTYPE> out (dst, roi);
     for (  ;  ! out.done();  ++out) {
         Dual2 x (out.x()+0.5f, 1.0f, 0.0f);
@@ -643,10 +884,11 @@ ImageBufAlgo::warp (ImageBuf &dst, const ImageBuf &src,
         filter = filterptr.get();
     }
 
+    FilterTable ftable (filter);
     bool ok;
     OIIO_DISPATCH_COMMON_TYPES2 (ok, "warp", warp_,
                           dst.spec().format, src.spec().format,
-                          dst, src, M, filter, wrap, dst_roi, nthreads);
+                          dst, src, M, ftable, wrap, dst_roi, nthreads);
     return ok;
 }
 
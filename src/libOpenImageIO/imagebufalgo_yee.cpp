@@ -34,6 +34,9 @@
 
 #include <iostream>
 #include <cmath>
+#include <vector>
+
+#include <boost/bind.hpp>
 
 #include <OpenEXR/ImathFun.h>
 #include <OpenEXR/ImathColor.h>
@@ -44,6 +47,9 @@ using Imath::Color3f;
 #include "OpenImageIO/imagebufalgo.h"
 #include "OpenImageIO/imagebufalgo_util.h"
 #include "OpenImageIO/dassert.h"
+#include "OpenImageIO/filter.h"
+#include "OpenImageIO/simd.h"
+#include "OpenImageIO/thread.h"
 
 
 template<class T>
@@ -59,49 +65,25 @@ powf (const Imath::Vec3<T> &x, float y)
 OIIO_NAMESPACE_ENTER
 {
 
-namespace
-{
-
 #define PYRAMID_MAX_LEVELS 8
 
 
-class GaussianPyramid
+// The planes of a YeePyramid, each width x height floats in scanline
+// order: the luminance blurred by successively more, and the A and B
+// channels of the LAB image.
+struct ImageBufAlgo::YeePyramid::Impl
 {
-public:
-    GaussianPyramid (ImageBuf &image)
-    {
-        level[0].swap (image);  // swallow the source as the top level
-        ImageBuf kernel;
-        ImageBufAlgo::make_kernel (kernel, "gaussian", 5, 5);
-        for (int i = 1;  i < PYRAMID_MAX_LEVELS;  ++i)
-            ImageBufAlgo::convolve (level[i], level[i-1], kernel);
-    }
-
-    ~GaussianPyramid () { }
-
-    float value (int x, int y, int lev) const {
-        if (lev >= PYRAMID_MAX_LEVELS)
-            return 0.0f;
-	else
-            return level[lev].getchannel(x,y,0,1);
-    }
-
-    ImageBuf &operator[] (int lev) {
-        DASSERT (lev < PYRAMID_MAX_LEVELS);
-        return level[lev];
-    }
-
-    float operator() (int x, int y, int lev) const {
-        DASSERT (lev < PYRAMID_MAX_LEVELS);
-        return level[lev].getchannel(x,y,0,1);
-    }
-
-private:
-    ImageBuf level[PYRAMID_MAX_LEVELS];
+    ROI roi;            // region of the source image
+    float luminance;    // ambient luminance
+    int width, height;
+    std::vector<float> level[PYRAMID_MAX_LEVELS];
+    std::vector<float> A, B;
 };
 
 
 
+namespace
+{
 
 // Adobe RGB (1998) with reference white D65 -> XYZ
 // matrix is from http://www.brucelindbloom.com/
@@ -115,30 +97,6 @@ AdobeRGBToXYZ (const Color3f &rgb)
 
 
 
-static bool
-AdobeRGBToXYZ (ImageBuf &A, ROI roi, int nthreads)
-{
-    if (nthreads != 1 && roi.npixels() >= 1000) {
-        // Possible multiple thread case -- recurse via parallel_image
-        ImageBufAlgo::parallel_image (boost::bind(AdobeRGBToXYZ, boost::ref(A),
-                                                  _1 /*roi*/, 1 /*nthreads*/),
-                                      roi, nthreads);
-        return true;
-    }
-
-    // Serial case
-    for (ImageBuf::Iterator<float> a (A, roi);  !a.done();  ++a) {
-        Color3f rgb (a[0], a[1], a[2]);
-        Color3f XYZ = AdobeRGBToXYZ (rgb);
-        a[0] = XYZ[0];
-        a[1] = XYZ[1];
-        a[2] = XYZ[2];
-    }
-    return true;
-}
-
-
-
 /// Convert a color in XYZ space to LAB space.
 ///
 static Color3f
@@ -166,38 +124,31 @@ XYZToLAB (const Color3f xyz)
 
 
 
-static bool
-XYZToLAB (ImageBuf &A, ROI roi, int nthreads)
+// Contrast sensitivity function (Barten SPIE 1989).  The a and b
+// coefficients depend only on the luminance, so callers evaluating it
+// at several frequencies for the same luminance can compute them once.
+inline void
+contrast_sensitivity_coefs (float luminance, float &a, float &b)
 {
-    if (nthreads != 1 && roi.npixels() >= 1000) {
-        // Possible multiple thread case -- recurse via parallel_image
-        ImageBufAlgo::parallel_image (boost::bind(XYZToLAB, boost::ref(A),
-                                                  _1 /*roi*/, 1 /*nthreads*/),
-                                      roi, nthreads);
-        return true;
-    }
-
-    // Serial case
-    for (ImageBuf::Iterator<float> a (A, roi);  !a.done();  ++a) {
-        Color3f XYZ (a[0], a[1], a[2]);
-        Color3f LAB = XYZToLAB (XYZ);
-        a[0] = LAB[0];
-        a[1] = LAB[1];
-        a[2] = LAB[2];
-    }
-    return true;
+    a = 440.0f * powf ((1.0f + 0.7f / luminance), -0.2f);
+    b = 0.3f * powf ((1.0f + 100.0f / luminance), 0.15f);
 }
 
 
+inline float
+contrast_sensitivity (float cyclesperdegree, float a, float b)
+{
+    return a * cyclesperdegree * expf(-b * cyclesperdegree) 
+             * sqrtf(1.0f + 0.06f * expf(b * cyclesperdegree)); 
+}
+
 
-// Contrast sensitivity function (Barten SPIE 1989)
 static float
 contrast_sensitivity (float cyclesperdegree, float luminance)
 {
-    float a = 440.0f * powf ((1.0f + 0.7f / luminance), -0.2f);
-    float b = 0.3f * powf ((1.0f + 100.0f / luminance), 0.15f);
-    return a * cyclesperdegree * expf(-b * cyclesperdegree) 
-             * sqrtf(1.0f + 0.06f * expf(b * cyclesperdegree)); 
+    float a, b;
+    contrast_sensitivity_coefs (luminance, a, b);
+    return contrast_sensitivity (cyclesperdegree, a, b);
 }
 
 
@@ -238,87 +189,207 @@ tvi (float adaptation_luminance)
 }
 
 
+// Convert the Adobe RGB (1998) pixels of rgb, a 0-origin 3-channel
+// float image, to the planes of a YeePyramid: the luminance (Y scaled
+// by the ambient luminance) and the A and B channels of LAB.  (L is
+// never used by the comparison.)
+static bool
+yee_convert (const ImageBuf &rgb, float luminance,
+             float *lum, float *A, float *B, ROI roi, int nthreads)
+{
+    if (nthreads != 1 && roi.npixels() >= 1000) {
+        // Possible multiple thread case -- recurse via parallel_image
+        ImageBufAlgo::parallel_image (
+            boost::bind(yee_convert, boost::cref(rgb), luminance,
+                        lum, A, B, _1 /*roi*/, 1 /*nthreads*/),
+            roi, nthreads);
+        return true;
+    }
+
+    // Serial case
+    int width = rgb.spec().width;
+    for (int y = roi.ybegin;  y < roi.yend;  ++y) {
+        const float *p = (const float *) rgb.pixeladdr (roi.xbegin, y);
+        for (int x = roi.xbegin;  x < roi.xend;  ++x, p += 3) {
+            Color3f XYZ = AdobeRGBToXYZ (Color3f (p[0], p[1], p[2]));
+            Color3f LAB = XYZToLAB (XYZ);
+            imagesize_t i = imagesize_t(y) * width + x;
+            lum[i] = XYZ[1] * luminance;
+            A[i] = LAB[1];
+            B[i] = LAB[2];
+        }
+    }
+    return true;
 }
 
 
 
-int
-ImageBufAlgo::compare_Yee (const ImageBuf &img0, const ImageBuf &img1,
-                           CompareResults &result,
-                           float luminance, float fov,
-                           ROI roi, int nthreads)
+// Weights of the 5-tap kernel that successive pyramid levels are
+// blurred with: a 5-wide gaussian, sampled at pixel centers and
+// normalized.  The 5x5 kernel it stands for is the outer product of
+// this with itself.
+static void
+pyramid_kernel (float k[5])
 {
-    if (! roi.defined())
-        roi = roi_union (get_roi(img0.spec()), get_roi(img1.spec()));
-    roi.chend = std::max (roi.chend, roi.chbegin+3);  // max of 3 channels
+    Filter2D *filter = Filter2D::create ("gaussian", 5.0f, 5.0f);
+    float sum = 0.0f;
+    for (int i = 0;  i < 5;  ++i)
+        sum += (k[i] = filter->xfilt (float(i - 2)));
+    for (int i = 0;  i < 5;  ++i)
+        k[i] /= sum;
+    Filter2D::destroy (filter);
+}
 
-    result.maxerror = 0;
-    result.maxx=0, result.maxy=0, result.maxz=0, result.maxc=0;
-    result.nfail = 0, result.nwarn = 0;
 
-    int nscanlines = roi.height() * roi.depth();
 
-    bool luminanceOnly = false;
+// Blur one row of width pixels horizontally by kernel k, clamping to
+// the row's ends.
+static void
+blur_row (float *dst, const float *src, int width, const float *k)
+{
+    int x = 0;
+    // Left edge, and all of a row too narrow to have an interior
+    for ( ;  x < std::min (2, width);  ++x) {
+        float sum = 0.0f;
+        for (int j = -2;  j <= 2;  ++j)
+            sum += k[j+2] * src[Imath::clamp (x+j, 0, width-1)];
+        dst[x] = sum;
+    }
+    // Interior, four at a time and then the leftovers
+    simd::float4 k0 (k[0]), k1 (k[1]), k2 (k[2]), k3 (k[3]), k4 (k[4]);
+    for ( ;  x + 4 <= width - 2;  x += 4) {
+        simd::float4 sum = k0 * simd::float4 (src+x-2)
+                         + k1 * simd::float4 (src+x-1)
+                         + k2 * simd::float4 (src+x)
+                         + k3 * simd::float4 (src+x+1)
+                         + k4 * simd::float4 (src+x+2);
+        sum.store (dst+x);
+    }
+    for ( ;  x < width - 2;  ++x)
+        dst[x] = k[0] * src[x-2] + k[1] * src[x-1] + k[2] * src[x]
+               + k[3] * src[x+1] + k[4] * src[x+2];
+    // Right edge
+    for ( ;  x < width;  ++x) {
+        float sum = 0.0f;
+        for (int j = -2;  j <= 2;  ++j)
+            sum += k[j+2] * src[Imath::clamp (x+j, 0, width-1)];
+        dst[x] = sum;
+    }
+}
 
-    // assuming colorspaces are in Adobe RGB (1998), convert to LAB
 
-    // paste() to copy of up to 3 channels, converting to float, and
-    // ending up with a 0-origin image.  End up with an LAB image in
-    // aLAB, and a luminance image in aLum.
-    ImageSpec spec (roi.width(), roi.height(), 3 /*chans*/, TypeDesc::FLOAT);
-    ImageBuf aLAB (spec);
-    ImageBufAlgo::paste (aLAB, 0, 0, 0, 0, img0, roi, nthreads);
-    AdobeRGBToXYZ (aLAB, ROI::All(), nthreads);  // contains XYZ now
-    ImageBuf aLum;
-    int channelorder[] = { 1 };  // channel to copy
-    ImageBufAlgo::channels (aLum, aLAB, 1, channelorder);
-    ImageBufAlgo::mul (aLum, aLum, luminance, ROI::All(), nthreads);
-    XYZToLAB (aLAB, ROI::All(), nthreads);  // now it's LAB
-
-    // Same thing for img1/bLAB/bLum
-    ImageBuf bLAB (spec);
-    ImageBufAlgo::paste (bLAB, 0, 0, 0, 0, img1, roi, nthreads);
-    AdobeRGBToXYZ (bLAB, ROI::All(), nthreads);  // contains XYZ now
-    ImageBuf bLum;
-    ImageBufAlgo::channels (bLum, bLAB, 1, channelorder);
-    ImageBufAlgo::mul (bLum, bLum, luminance, ROI::All(), nthreads);
-    XYZToLAB (bLAB, ROI::All(), nthreads);  // now it's LAB
 
-    // Construct Gaussian pyramids (not really pyramids, because they all
-    // have the same resolution, but really just a bunch of successively
-    // more blurred images).
-    GaussianPyramid la (aLum);
-    GaussianPyramid lb (bLum);
+// Compute rows [roi.ybegin,roi.yend) of the next pyramid level: dst is
+// src (width x height) blurred by the separable 5x5 kernel k, clamping
+// at the image edges, just like convolve() with the equivalent 5x5
+// kernel image but in two passes of five taps each.  The horizontally
+// blurred rows that the vertical pass needs are kept in a ring of five.
+static bool
+blur_level (float *dst, const float *src, int width, int height,
+            const float *k, ROI roi, int nthreads)
+{
+    if (nthreads != 1 && roi.npixels() >= 1000) {
+        // Possible multiple thread case -- recurse via parallel_image
+        ImageBufAlgo::parallel_image (
+            boost::bind(blur_level, dst, src, width, height, k,
+                        _1 /*roi*/, 1 /*nthreads*/),
+            roi, nthreads);
+        return true;
+    }
 
-    float num_one_degree_pixels = (float) (2 * tan(fov * 0.5 * M_PI / 180) * 180 / M_PI);
-    float pixels_per_degree = roi.width() / num_one_degree_pixels;
+    // Serial case
+    std::vector<float> ringbuf (5 * size_t(width));
+    float *ring[5];   // ring[(r - roi.ybegin + 2) % 5] holds row r
+    for (int i = 0;  i < 5;  ++i)
+        ring[i] = &ringbuf[i * size_t(width)];
+    for (int r = roi.ybegin - 2;  r < roi.ybegin + 2;  ++r)
+        blur_row (ring[r - roi.ybegin + 2], 
+                  src + imagesize_t(Imath::clamp (r, 0, height-1)) * width,
+                  width, k);
+
+    simd::float4 k0 (k[0]), k1 (k[1]), k2 (k[2]), k3 (k[3]), k4 (k[4]);
+    for (int y = roi.ybegin;  y < roi.yend;  ++y) {
+        int r = y + 2, slot = (r - roi.ybegin + 2) % 5;
+        blur_row (ring[slot],
+                  src + imagesize_t(std::min (r, height-1)) * width,
+                  width, k);
+        const float *r0 = ring[(slot+1) % 5], *r1 = ring[(slot+2) % 5];
+        const float *r2 = ring[(slot+3) % 5], *r3 = ring[(slot+4) % 5];
+        const float *r4 = ring[slot];
+        float *d = dst + imagesize_t(y) * width;
+        int x = 0;
+        for ( ;  x + 4 <= width;  x += 4) {
+            simd::float4 sum = k0 * simd::float4 (r0+x)
+                             + k1 * simd::float4 (r1+x)
+                             + k2 * simd::float4 (r2+x)
+                             + k3 * simd::float4 (r3+x)
+                             + k4 * simd::float4 (r4+x);
+            sum.store (d+x);
+        }
+        for ( ;  x < width;  ++x)
+            d[x] = k[0] * r0[x] + k[1] * r1[x] + k[2] * r2[x]
+                 + k[3] * r3[x] + k[4] * r4[x];
+    }
+    return true;
+}
 
-    unsigned int adaptation_level = 0;
-    for (int i = 0, npixels = 1;
-             i < PYRAMID_MAX_LEVELS && npixels <= num_one_degree_pixels;
-             ++i, npixels *= 2) 
-        adaptation_level = i;
 
-    float cpd[PYRAMID_MAX_LEVELS];
-    cpd[0] = 0.5f * pixels_per_degree;
-    for (int i = 1;  i < PYRAMID_MAX_LEVELS;  ++i)
-        cpd[i] = 0.5f * cpd[i - 1];
-    float csf_max = contrast_sensitivity (3.248f, 100.0f);
 
+// Per-comparison constants: they depend on the field of view and the
+// image size, but not on either image's pixels.
+struct YeeParams {
+    float cpd[PYRAMID_MAX_LEVELS];           // cycles per degree
     float F_freq[PYRAMID_MAX_LEVELS - 2];
-    for (int i = 0; i < PYRAMID_MAX_LEVELS - 2;  ++i)
-        F_freq[i] = csf_max / contrast_sensitivity (cpd[i], 100.0f);
+    int adaptation_level;
+    bool luminanceOnly;
+};
 
-    for (int y = 0; y < nscanlines;  ++y) {
-        for (int x = 0;  x < roi.width();  ++x) {
+
+
+// Compare rows [roi.ybegin,roi.yend) of two pyramids, accumulating the
+// failures and the worst one into result.  Each thread keeps its own
+// counts and merges them under the mutex when done.  The worst failure
+// found first in scanline order wins ties, as it would serially.
+static bool
+yee_compare (const ImageBufAlgo::YeePyramid::Impl &a,
+             const ImageBufAlgo::YeePyramid::Impl &b,
+             const YeeParams &params, ImageBufAlgo::CompareResults &result,
+             spin_mutex &mutex, ROI roi, int nthreads)
+{
+    if (nthreads != 1 && roi.npixels() >= 1000) {
+        // Possible multiple thread case -- recurse via parallel_image
+        ImageBufAlgo::parallel_image (
+            boost::bind(yee_compare, boost::cref(a), boost::cref(b),
+                        boost::cref(params), boost::ref(result),
+                        boost::ref(mutex), _1 /*roi*/, 1 /*nthreads*/),
+            roi, nthreads);
+        return true;
+    }
+
+    // Serial case
+    const float *cpd = params.cpd, *F_freq = params.F_freq;
+    int adaptation_level = params.adaptation_level;
+    imagesize_t nfail = 0;
+    float maxerror = 0.0f;
+    int maxx = 0, maxy = 0;
+    for (int y = roi.ybegin;  y < roi.yend;  ++y) {
+        imagesize_t row = imagesize_t(y) * a.width;
+        const float *la[PYRAMID_MAX_LEVELS], *lb[PYRAMID_MAX_LEVELS];
+        for (int i = 0;  i < PYRAMID_MAX_LEVELS;  ++i) {
+            la[i] = &a.level[i][row];
+            lb[i] = &b.level[i][row];
+        }
+        const float *aA = &a.A[row], *aB = &a.B[row];
+        const float *bA = &b.A[row], *bB = &b.B[row];
+        for (int x = roi.xbegin;  x < roi.xend;  ++x) {
             float contrast[PYRAMID_MAX_LEVELS - 2];
             float sum_contrast = 0;
             for (int i = 0; i < PYRAMID_MAX_LEVELS - 2; i++) {
-                float n1 = fabsf (la.value(x,y,i) - la.value(x,y,i+1));
-                float n2 = fabsf (lb.value(x,y,i) - lb.value(x,y,i+1));
+                float n1 = fabsf (la[i][x] - la[i+1][x]);
+                float n2 = fabsf (lb[i][x] - lb[i+1][x]);
                 float numerator = std::max (n1, n2);
-                float d1 = fabsf (la.value(x,y,i+2));
-                float d2 = fabsf (lb.value(x,y,i+2));
+                float d1 = fabsf (la[i+2][x]);
+                float d2 = fabsf (lb[i+2][x]);
                 float denominator = std::max (std::max (d1, d2), 1.0e-5f);
                 contrast[i] = numerator / denominator;
                 sum_contrast += contrast[i];
@@ -326,23 +397,25 @@ ImageBufAlgo::compare_Yee (const ImageBuf &img0, const ImageBuf &img1,
             if (sum_contrast < 1e-5)
                 sum_contrast = 1e-5f;
             float F_mask[PYRAMID_MAX_LEVELS - 2];
-            float adapt = la.value(x,y,adaptation_level) + lb.value(x,y,adaptation_level);
+            float adapt = la[adaptation_level][x] + lb[adaptation_level][x];
             adapt *= 0.5f;
             if (adapt < 1e-5)
                 adapt = 1e-5f;
+            float csf_a, csf_b;
+            contrast_sensitivity_coefs (adapt, csf_a, csf_b);
             for (int i = 0; i < PYRAMID_MAX_LEVELS - 2; i++)
-                F_mask[i] = mask(contrast[i] * contrast_sensitivity(cpd[i], adapt)); 
+                F_mask[i] = mask(contrast[i] * contrast_sensitivity(cpd[i], csf_a, csf_b));
             float factor = 0;
             for (int i = 0; i < PYRAMID_MAX_LEVELS - 2; i++)
                 factor += contrast[i] * F_freq[i] * F_mask[i] / sum_contrast;
             factor = Imath::clamp (factor, 1.0f, 10.0f);
-            float delta = fabsf (la.value(x,y,0) - lb.value(x,y,0));
+            float delta = fabsf (la[0][x] - lb[0][x]);
             bool pass = true;
             // pure luminance test
             delta /= tvi(adapt);
             if (delta > factor) {
                 pass = false;
-            } else if (! luminanceOnly) {
+            } else if (! params.luminanceOnly) {
                 // CIE delta E test with modifications
                 float color_scale = 1.0f;
                 // ramp down the color test in scotopic regions
@@ -350,8 +423,8 @@ ImageBufAlgo::compare_Yee (const ImageBuf &img0, const ImageBuf &img1,
                     color_scale = 1.0f - (10.0f - color_scale) / 10.0f;
                     color_scale = color_scale * color_scale;
                 }
-                float da = aLAB.getchannel(x,y,0,1) - bLAB.getchannel(x,y,0,1);  // diff in A
-                float db = aLAB.getchannel(x,y,0,2) - bLAB.getchannel(x,y,0,2);  // diff in B
+                float da = aA[x] - bA[x];  // diff in A
+                float db = aB[x] - bB[x];  // diff in B
                 da = da * da;
                 db = db * db;
                 delta = (da + db) * color_scale;
@@ -359,20 +432,203 @@ ImageBufAlgo::compare_Yee (const ImageBuf &img0, const ImageBuf &img1,
                     pass = false;
             }
             if (!pass) {
-                ++result.nfail;
-                if (factor > result.maxerror) {
-                    result.maxerror = factor;
-                    result.maxx = x;
-                    result.maxy = y;
-//                    result.maxz = z;
+                ++nfail;
+                if (factor > maxerror) {
+                    maxerror = factor;
+                    maxx = x;
+                    maxy = y;
                 }
             }
         }
     }
 
-    return result.nfail;
+    if (nfail) {
+        spin_lock lock (mutex);
+        result.nfail += nfail;
+        if (maxerror > result.maxerror ||
+            (maxerror == result.maxerror &&
+             (maxy < result.maxy || (maxy == result.maxy && maxx < result.maxx)))) {
+            result.maxerror = maxerror;
+            result.maxx = maxx;
+            result.maxy = maxy;
+        }
+    }
+    return true;
+}
+
+}
+
+
+
+ImageBufAlgo::YeePyramid::YeePyramid ()
+    : m_impl(NULL)
+{
+}
+
+
+
+ImageBufAlgo::YeePyramid::YeePyramid (const ImageBuf &img, float luminance,
+                                      ROI roi, int nthreads)
+    : m_impl(NULL)
+{
+    reset (img, luminance, roi, nthreads);
+}
+
+
+
+ImageBufAlgo::YeePyramid::~YeePyramid ()
+{
+    delete m_impl;
+}
+
+
+
+bool
+ImageBufAlgo::YeePyramid::reset (const ImageBuf &img, float luminance,
+                                 ROI roi, int nthreads)
+{
+    delete m_impl;
+    m_impl = NULL;
+    if (! roi.defined())
+        roi = get_roi (img.spec());
+    roi.chend = std::max (roi.chend, roi.chbegin+3);  // max of 3 channels
+    if (roi.width() <= 0 || roi.height() <= 0)
+        return false;
+
+    // assuming colorspaces are in Adobe RGB (1998), convert to LAB
+
+    // paste() to copy of up to 3 channels, converting to float, and
+    // ending up with a 0-origin image.  From that, fill in the
+    // luminance (the top level of the pyramid) and the A and B planes.
+    ImageSpec spec (roi.width(), roi.height(), 3 /*chans*/, TypeDesc::FLOAT);
+    ImageBuf rgb (spec);
+    ImageBufAlgo::paste (rgb, 0, 0, 0, 0, img, roi, nthreads);
+
+    m_impl = new Impl;
+    Impl &p (*m_impl);
+    p.roi = roi;
+    p.luminance = luminance;
+    p.width = spec.width;
+    p.height = spec.height;
+    imagesize_t npixels = imagesize_t(p.width) * p.height;
+    for (int i = 0;  i < PYRAMID_MAX_LEVELS;  ++i)
+        p.level[i].resize (npixels);
+    p.A.resize (npixels);
+    p.B.resize (npixels);
+    yee_convert (rgb, luminance, &p.level[0][0], &p.A[0], &p.B[0],
+                 get_roi(spec), nthreads);
+
+    // Construct Gaussian pyramids (not really pyramids, because they all
+    // have the same resolution, but really just a bunch of successively
+    // more blurred images).
+    float k[5];
+    pyramid_kernel (k);
+    for (int i = 1;  i < PYRAMID_MAX_LEVELS;  ++i)
+        blur_level (&p.level[i][0], &p.level[i-1][0], p.width, p.height,
+                    k, get_roi(spec), nthreads);
+    return true;
+}
+
+
+
+bool
+ImageBufAlgo::YeePyramid::initialized () const
+{
+    return m_impl != NULL;
+}
+
+
+
+const ROI &
+ImageBufAlgo::YeePyramid::roi () const
+{
+    static const ROI empty;
+    return m_impl ? m_impl->roi : empty;
+}
+
+
+
+float
+ImageBufAlgo::YeePyramid::luminance () const
+{
+    return m_impl ? m_impl->luminance : 0.0f;
 }
 
 
+
+int
+ImageBufAlgo::compare_Yee (const YeePyramid &A, const YeePyramid &B,
+                           CompareResults &result, float fov, int nthreads)
+{
+    const YeePyramid::Impl *a = A.impl(), *b = B.impl();
+    if (! a || ! b || a->width != b->width || a->height != b->height ||
+            a->luminance != b->luminance)
+        return -1;
+
+    result.maxerror = 0;
+    result.maxx=0, result.maxy=0, result.maxz=0, result.maxc=0;
+    result.nfail = 0, result.nwarn = 0;
+
+    YeeParams params;
+    params.luminanceOnly = false;
+
+    float num_one_degree_pixels = (float) (2 * tan(fov * 0.5 * M_PI / 180) * 180 / M_PI);
+    float pixels_per_degree = a->width / num_one_degree_pixels;
+
+    params.adaptation_level = 0;
+    for (int i = 0, npixels = 1;
+             i < PYRAMID_MAX_LEVELS && npixels <= num_one_degree_pixels;
+             ++i, npixels *= 2) 
+        params.adaptation_level = i;
+
+    float *cpd = params.cpd;
+    cpd[0] = 0.5f * pixels_per_degree;
+    for (int i = 1;  i < PYRAMID_MAX_LEVELS;  ++i)
+        cpd[i] = 0.5f * cpd[i - 1];
+    float csf_max = contrast_sensitivity (3.248f, 100.0f);
+
+    for (int i = 0; i < PYRAMID_MAX_LEVELS - 2;  ++i)
+        params.F_freq[i] = csf_max / contrast_sensitivity (cpd[i], 100.0f);
+
+    spin_mutex mutex;
+    yee_compare (*a, *b, params, result, mutex,
+                 ROI (0, a->width, 0, a->height), nthreads);
+
+    return int (result.nfail);
+}
+
+
+
+int
+ImageBufAlgo::compare_Yee (const YeePyramid &A, const ImageBuf &img1,
+                           CompareResults &result, float fov, int nthreads)
+{
+    if (! A.initialized())
+        return -1;
+    YeePyramid B (img1, A.luminance(), A.roi(), nthreads);
+    return compare_Yee (A, B, result, fov, nthreads);
+}
+
+
+
+int
+ImageBufAlgo::compare_Yee (const ImageBuf &img0, const ImageBuf &img1,
+                           CompareResults &result,
+                           float luminance, float fov,
+                           ROI roi, int nthreads)
+{
+    if (! roi.defined())
+        roi = roi_union (get_roi(img0.spec()), get_roi(img1.spec()));
+
+    result.maxerror = 0;
+    result.maxx=0, result.maxy=0, result.maxz=0, result.maxc=0;
+    result.nfail = 0, result.nwarn = 0;
+
+    YeePyramid A (img0, luminance, roi, nthreads);
+    if (! A.initialized())
+        return 0;   // nothing to compare
+    return compare_Yee (A, img1, result, fov, nthreads);
+}
+
 }
 OIIO_NAMESPACE_EXIT
@@ -53,6 +53,8 @@ namespace pvt {
 recursive_mutex imageio_mutex;
 atomic_int oiio_threads (boost::thread::hardware_concurrency());
 atomic_int oiio_read_chunk (256);
+atomic_int oiio_scratch_memory (256);
+ustring scratch_directory;
 ustring plugin_searchpath (OIIO_DEFAULT_PLUGIN_SEARCHPATH);
 std::string format_list;   // comma-separated list of all formats
 std::string extension_list;   // list of all extensions for all formats
@@ -147,6 +149,14 @@ attribute (string_view name, TypeDesc type, const void *val)
         plugin_searchpath = ustring (*(const char **)val);
         return true;
     }
+    if (name == "scratch_memory" && type == TypeDesc::TypeInt) {
+        oiio_scratch_memory = std::max (1, *(const int *)val);
+        return true;
+    }
+    if (name == "scratch_directory" && type == TypeDesc::TypeString) {
+        scratch_directory = ustring (*(const char **)val);
+        return true;
+    }
     return false;
 }
 
@@ -168,6 +178,14 @@ getattribute (string_view name, TypeDesc type, void *val)
         *(ustring *)val = plugin_searchpath;
         return true;
     }
+    if (name == "scratch_memory" && type == TypeDesc::TypeInt) {
+        *(int *)val = oiio_scratch_memory;
+        return true;
+    }
+    if (name == "scratch_directory" && type == TypeDesc::TypeString) {
+        *(ustring *)val = scratch_directory;
+        return true;
+    }
     if (name == "format_list" && type == TypeDesc::TypeString) {
         if (format_list.empty())
             pvt::catalog_all_plugins (plugin_searchpath.string());
@@ -43,6 +43,7 @@
 
 #include <boost/bind.hpp>
 #include <boost/foreach.hpp>
+#include <boost/shared_ptr.hpp>
 
 OIIO_NAMESPACE_USING;
 
@@ -471,6 +472,180 @@ time_iterate_pixels_slave_incr (ImageBuf &ib, int iters)
 
 
 
+// Pixel math the way ImageBufAlgo used to do it: iterators, converting
+// every channel value through the proxies.  This is the baseline that
+// the span kernels inside ImageBufAlgo are compared against.
+static float
+time_iterator_add (ImageBuf &ib, int iters)
+{
+    ImageBuf R (ib.spec());
+    for (int i = 0;  i < iters;  ++i) {
+        ImageBuf::ConstIterator<float> a (ib), b (ib);
+        for (ImageBuf::Iterator<float> r (R);  !r.done();  ++r, ++a, ++b)
+            for (int c = 0;  c < R.nchannels();  ++c)
+                r[c] = a[c] + b[c];
+    }
+    return R.getchannel (R.xbegin(), R.ybegin(), R.zbegin(), 0);
+}
+
+
+
+static float
+time_iterator_mad (ImageBuf &ib, int iters)
+{
+    ImageBuf R (ib.spec());
+    for (int i = 0;  i < iters;  ++i) {
+        ImageBuf::ConstIterator<float> a (ib);
+        for (ImageBuf::Iterator<float> r (R);  !r.done();  ++r, ++a)
+            for (int c = 0;  c < R.nchannels();  ++c)
+                r[c] = a[c] * 0.5f + 0.25f;
+    }
+    return R.getchannel (R.xbegin(), R.ybegin(), R.zbegin(), 0);
+}
+
+
+
+static float
+time_iba_add (ImageBuf &ib, int iters)
+{
+    ImageBuf R (ib.spec());
+    for (int i = 0;  i < iters;  ++i)
+        ImageBufAlgo::add (R, ib, ib, ROI::All(), 1);
+    return R.getchannel (R.xbegin(), R.ybegin(), R.zbegin(), 0);
+}
+
+
+
+static float
+time_iba_mad (ImageBuf &ib, int iters)
+{
+    ImageBuf R (ib.spec());
+    for (int i = 0;  i < iters;  ++i)
+        ImageBufAlgo::mad (R, ib, 0.5f, 0.25f, ROI::All(), 1);
+    return R.getchannel (R.xbegin(), R.ybegin(), R.zbegin(), 0);
+}
+
+
+
+static float
+time_iba_clamp (ImageBuf &ib, int iters)
+{
+    ImageBuf R (ib.spec());
+    for (int i = 0;  i < iters;  ++i)
+        ImageBufAlgo::clamp (R, ib, 0.25f, 0.75f, false, ROI::All(), 1);
+    return R.getchannel (R.xbegin(), R.ybegin(), R.zbegin(), 0);
+}
+
+
+
+static float
+time_iba_pow (ImageBuf &ib, int iters)
+{
+    ImageBuf R (ib.spec());
+    for (int i = 0;  i < iters;  ++i)
+        ImageBufAlgo::pow (R, ib, 2.2f, ROI::All(), 1);
+    return R.getchannel (R.xbegin(), R.ybegin(), R.zbegin(), 0);
+}
+
+
+
+static float
+time_iba_premult (ImageBuf &ib, int iters)
+{
+    ImageBuf R (ib.spec());
+    for (int i = 0;  i < iters;  ++i)
+        ImageBufAlgo::premult (R, ib, ROI::All(), 1);
+    return R.getchannel (R.xbegin(), R.ybegin(), R.zbegin(), 0);
+}
+
+
+
+// An RGBA copy of ib with a regular pattern of holes (zero alpha), for
+// timing fillholes_pushpull.
+static void
+make_holes (const ImageBuf &ib, ImageBuf &holes)
+{
+    ImageSpec spec (ib.spec().width, ib.spec().height, 4, TypeDesc::FLOAT);
+    spec.x = ib.spec().x;
+    spec.y = ib.spec().y;
+    holes.reset (spec);
+    int lastchan = ib.nchannels() - 1;
+    ImageBuf::ConstIterator<float> a (ib);
+    for (ImageBuf::Iterator<float> h (holes);  !h.done();  ++h, ++a) {
+        bool hole = ((h.x() / 16 + h.y() / 16) % 3 == 0);
+        for (int c = 0;  c < 3;  ++c)
+            h[c] = hole ? 0.0f : a[std::min (c, lastchan)];
+        h[3] = hole ? 0.0f : 1.0f;
+    }
+}
+
+
+
+// fillholes_pushpull the way ImageBufAlgo used to do it: a pyramid of
+// ImageBufs made by successive resize() halvings, dividing by alpha at
+// each level, then pulled back up with resize() and over().  This is the
+// baseline that the push-pull kernel inside ImageBufAlgo is compared
+// against.
+static void
+fillholes_resize (ImageBuf &dst, const ImageBuf &src)
+{
+    std::vector<boost::shared_ptr<ImageBuf> > pyramid;
+    pyramid.push_back (boost::shared_ptr<ImageBuf>(new ImageBuf (src.spec())));
+    ImageBufAlgo::paste (*pyramid[0], src.xbegin(), src.ybegin(), src.zbegin(),
+                         0, src, ROI::All(), 1);
+    int ac = src.spec().alpha_channel;
+    int w = src.spec().width, h = src.spec().height;
+    while (w > 1 || h > 1) {
+        w = std::max (1, w/2);
+        h = std::max (1, h/2);
+        ImageSpec smallspec (w, h, src.nchannels(), TypeDesc::FLOAT);
+        smallspec.alpha_channel = ac;
+        ImageBuf *small = new ImageBuf (smallspec);
+        ImageBufAlgo::resize (*small, *pyramid.back(), "triangle", 0.0f,
+                              ROI::All(), 1);
+        for (ImageBuf::Iterator<float> p (*small);  !p.done();  ++p) {
+            float alpha = p[ac];
+            if (alpha != 0.0f)
+                for (int c = 0;  c < smallspec.nchannels;  ++c)
+                    p[c] = p[c] / alpha;
+        }
+        pyramid.push_back (boost::shared_ptr<ImageBuf>(small));
+    }
+    for (int i = (int)pyramid.size()-2;  i >= 0;  --i) {
+        ImageBuf &big(*pyramid[i]), &small(*pyramid[i+1]);
+        ImageBuf blowup (big.spec());
+        ImageBufAlgo::resize (blowup, small, "triangle", 0.0f, ROI::All(), 1);
+        ImageBufAlgo::over (big, big, blowup, ROI::All(), 1);
+    }
+    dst.copy (*pyramid[0]);
+}
+
+
+
+static float
+time_fillholes_resize (ImageBuf &ib, int iters)
+{
+    ImageBuf holes, R;
+    make_holes (ib, holes);
+    for (int i = 0;  i < iters;  ++i)
+        fillholes_resize (R, holes);
+    return R.getchannel (R.xbegin(), R.ybegin(), R.zbegin(), 0);
+}
+
+
+
+static float
+time_iba_fillholes (ImageBuf &ib, int iters)
+{
+    ImageBuf holes, R;
+    make_holes (ib, holes);
+    for (int i = 0;  i < iters;  ++i)
+        ImageBufAlgo::fillholes_pushpull (R, holes, ROI::All(), 1);
+    return R.getchannel (R.xbegin(), R.ybegin(), R.zbegin(), 0);
+}
+
+
+
 static void
 test_pixel_iteration (const std::string &explanation,
                       float (*func)(ImageBuf&,int),
@@ -631,6 +806,43 @@ main (int argc, char **argv)
     test_pixel_iteration ("Iterate over a cache image (incr slave) ",
                           time_iterate_pixels_slave_incr, false, iters);
 
+    std::cout << "\nTiming ImageBufAlgo pixel math (1 thread):\n";
+    test_pixel_iteration ("add via iterators (old way)             ",
+                          time_iterator_add, true, iters/8);
+    test_pixel_iteration ("IBA::add on loaded image                ",
+                          time_iba_add, true, iters/8);
+    test_pixel_iteration ("IBA::add on cached image                ",
+                          time_iba_add, false, iters/8);
+    test_pixel_iteration ("mad via iterators (old way)             ",
+                          time_iterator_mad, true, iters/8);
+    test_pixel_iteration ("IBA::mad on loaded image                ",
+                          time_iba_mad, true, iters/8);
+    test_pixel_iteration ("IBA::clamp on loaded image              ",
+                          time_iba_clamp, true, iters/8);
+    test_pixel_iteration ("IBA::pow on loaded image                ",
+                          time_iba_pow, true, iters/8);
+    test_pixel_iteration ("IBA::premult on loaded image            ",
+                          time_iba_premult, true, iters/8);
+
+    std::cout << "\nTiming fillholes_pushpull (1 thread):\n";
+    test_pixel_iteration ("fillholes via resize + over (old way)   ",
+                          time_fillholes_resize, true, 1);
+    test_pixel_iteration ("IBA::fillholes_pushpull                 ",
+                          time_iba_fillholes, true, 1);
+    {
+        // Both ways fill the holes with the same colors
+        ImageBuf ib (input_filename[0].string(), imagecache);
+        ib.read (0, 0, true, TypeDesc::TypeFloat);
+        ImageBuf holes, R1, R2;
+        make_holes (ib, holes);
+        fillholes_resize (R1, holes);
+        ImageBufAlgo::fillholes_pushpull (R2, holes);
+        ImageBufAlgo::CompareResults cr;
+        ImageBufAlgo::compare (R1, R2, 1.0e-4f, 1.0e-4f, cr);
+        std::cout << "  max difference from the old way: " << cr.maxerror << "\n";
+        OIIO_CHECK_EQUAL (cr.nfail, 0);
+    }
+
     if (verbose)
         std::cout << "\n" << imagecache->getstats(2) << "\n";
 
@@ -38,6 +38,7 @@
 
 #include <boost/version.hpp>
 #include <boost/regex.hpp>
+#include <boost/scoped_ptr.hpp>
 #include <boost/shared_ptr.hpp>
 
 #include <OpenEXR/ImathMatrix.h>
@@ -504,6 +505,125 @@ fix_latl_edges (ImageBuf &buf)
 
 
 
+// Cube face environment maps are written in the "3x2" layout (see the
+// discussion in libtexture/environment.cpp): faces px, py, pz across the
+// top row and nx, ny, nz across the bottom, each padded out to at least
+// a tile, with the full/display window giving the face resolution.
+static ImageSpec
+cubeface_spec (const ImageSpec &spec, int faceres)
+{
+    ImageSpec newspec = spec;
+    newspec.x = newspec.y = newspec.full_x = newspec.full_y = 0;
+    newspec.width = 3 * std::max (faceres, spec.tile_width);
+    newspec.height = 2 * std::max (faceres, spec.tile_height);
+    newspec.full_width = newspec.full_height = faceres;
+    return newspec;
+}
+
+
+
+// Pixel origin of face f of a cube face map laid out by cubeface_spec.
+static void
+cubeface_origin (const ImageSpec &spec, int f, int &x, int &y)
+{
+    x = spec.x + (f/2) * (spec.width/3);
+    y = spec.y + (f%2) * (spec.height/2);
+}
+
+
+
+// Rearrange src, whose six faces are either stacked vertically in the
+// order px, nx, py, ny, pz, nz ("1x6") or already in the 3x2 layout, into
+// a new buffer laid out by cubeface_spec (with the tile size of
+// tilespec).  Return false if src doesn't look like either layout.
+static bool
+cubefaces_to_3x2 (boost::shared_ptr<ImageBuf> &src, const ImageSpec &tilespec)
+{
+    const ImageSpec &spec (src->spec());
+    bool onebysix = (spec.height == 6*spec.width);
+    if (! onebysix && 2*spec.width != 3*spec.height)
+        return false;
+    int faceres = onebysix ? spec.width : spec.height/2;
+    ImageSpec newspec = spec;
+    newspec.tile_width = tilespec.tile_width;
+    newspec.tile_height = tilespec.tile_height;
+    newspec = cubeface_spec (newspec, faceres);
+    newspec.tile_width = newspec.tile_height = newspec.tile_depth = 0;
+    boost::shared_ptr<ImageBuf> faces (new ImageBuf (newspec));
+    ImageBufAlgo::zero (*faces);
+    for (int f = 0;  f < 6;  ++f) {
+        int x = spec.x + (onebysix ? 0 : (f/2)*faceres);
+        int y = spec.y + (onebysix ? f*faceres : (f%2)*faceres);
+        int fx, fy;
+        cubeface_origin (newspec, f, fx, fy);
+        ImageBufAlgo::paste (*faces, fx, fy, 0, 0, *src,
+                             ROI (x, x+faceres, y, y+faceres));
+    }
+    std::swap (src, faces);
+    return true;
+}
+
+
+
+// Filter each face of the 3x2 cube face map src (whose faces are srcres
+// pixels on a side) down into the corresponding face of dst, so that no
+// face bleeds into its neighbors in the layout.
+static bool
+resize_cubefaces (ImageBuf &dst, const ImageBuf &src, int srcres,
+                  string_view filtername, int nthreads)
+{
+    int dstres = dst.spec().full_width;
+    ImageBufAlgo::zero (dst, ROI(), nthreads);
+    for (int f = 0;  f < 6;  ++f) {
+        int x, y, dx, dy;
+        cubeface_origin (src.spec(), f, x, y);
+        cubeface_origin (dst.spec(), f, dx, dy);
+        ImageBuf face, smallface;
+        if (! ImageBufAlgo::cut (face, src, ROI (x, x+srcres, y, y+srcres),
+                                 nthreads))
+            return false;
+        ImageSpec smallspec = face.spec();
+        smallspec.width = smallspec.full_width = dstres;
+        smallspec.height = smallspec.full_height = dstres;
+        smallspec.set_format (TypeDesc::FLOAT);
+        smallface.reset (smallspec);
+        if (! ImageBufAlgo::resize (smallface, face, filtername, 0.0f,
+                                    ROI(), nthreads) ||
+            ! ImageBufAlgo::paste (dst, dx, dy, 0, 0, smallface, ROI(),
+                                   nthreads)) {
+            dst.error ("%s%s", smallface.geterror(), dst.geterror());
+            return false;
+        }
+    }
+    return true;
+}
+
+
+
+// Count how many of the tiles (of the given size) of img are a single
+// constant color, and return the total number of tiles in ntiles.
+static int
+count_constant_tiles (const ImageBuf &img, int tile_width, int tile_height,
+                      int &ntiles)
+{
+    ROI roi = img.roi();
+    int nconstant = 0;
+    ntiles = 0;
+    for (int y = roi.ybegin;  y < roi.yend;  y += tile_height) {
+        for (int x = roi.xbegin;  x < roi.xend;  x += tile_width) {
+            ROI tile (x, std::min (x+tile_width, roi.xend),
+                      y, std::min (y+tile_height, roi.yend),
+                      roi.zbegin, roi.zend, roi.chbegin, roi.chend);
+            if (ImageBufAlgo::isConstantColor (img, NULL, tile, 1))
+                ++nconstant;
+            ++ntiles;
+        }
+    }
+    return nconstant;
+}
+
+
+
 static std::string
 formatres (const ImageSpec &spec, bool extended=false)
 {
@@ -543,6 +663,94 @@ maketx_merge_spec (ImageSpec &dstspec, const ImageSpec &srcspec)
 
 
 
+// Timings of one MIP level, for the maketx:runstats report.
+struct MipLevelStats {
+    ImageSpec spec;   // resolution of the level
+    double resize;    // computing it from the level above
+    double write;     // converting, compressing and writing it
+    double stall;     // time spent waiting for the write to finish
+    MipLevelStats (const ImageSpec &spec, double resize)
+        : spec(spec), resize(resize), write(0), stall(0) {}
+};
+
+
+
+// Writes MIP levels to an ImageOutput one at a time, in order, in a
+// background thread, so that the data conversion, compression and I/O of
+// one level overlap the computation of the next.
+class MipLevelWriter {
+public:
+    MipLevelWriter (ImageOutput *out, const std::string &filename)
+        : m_out(out), m_filename(filename), m_append(false), m_ok(true),
+          m_time(0) { }
+    ~MipLevelWriter () { wait (); }
+
+    /// Begin writing img as the next level (after first opening a new
+    /// MIP level or subimage of the file with spec, if append is true).
+    /// If async is false, just do it before returning.  The writer
+    /// holds a reference to img, but the caller must not modify it until
+    /// the next wait().
+    void start (const boost::shared_ptr<ImageBuf> &img, const ImageSpec &spec,
+                bool append, bool async) {
+        ASSERT (! m_thread);
+        m_img = img;
+        m_spec = spec;
+        m_append = append;
+        if (async)
+            m_thread.reset (new boost::thread (&MipLevelWriter::run, this));
+        else
+            run ();
+    }
+
+    /// Wait for the level being written (if any) to be done.  Return
+    /// false if it failed, in which case error() explains why.
+    bool wait () {
+        if (m_thread) {
+            m_thread->join ();
+            m_thread.reset ();
+        }
+        m_img.reset ();
+        return m_ok;
+    }
+
+    const std::string &error () const { return m_error; }
+    /// Time taken by the most recently finished level.
+    double time () const { return m_time; }
+
+private:
+    void run () {
+        Timer timer;
+        // If the format explicitly supports MIP-maps, use that,
+        // otherwise try to simulate MIP-mapping with multi-image.
+        ImageOutput::OpenMode mode = m_out->supports ("mipmap") ?
+            ImageOutput::AppendMIPLevel : ImageOutput::AppendSubimage;
+        if (m_append && ! m_out->open (m_filename, m_spec, mode)) {
+            m_error = Strutil::format ("Could not append \"%s\" : %s",
+                                       m_filename, m_out->geterror());
+            m_ok = false;
+        } else if (! m_img->write (m_out)) {
+            // ImageBuf::write transfers any errors from the
+            // ImageOutput to the ImageBuf.
+            m_error = Strutil::format ("Write failed \"%s\" : %s",
+                                       m_filename, m_img->geterror());
+            m_ok = false;
+        }
+        m_time = timer();
+    }
+
+    ImageOutput *m_out;
+    std::string m_filename;
+    boost::shared_ptr<ImageBuf> m_img;
+    ImageSpec m_spec;
+    bool m_append;
+    bool m_ok;
+    double m_time;
+    std::string m_error;
+    boost::scoped_ptr<boost::thread> m_thread;
+};
+
+
+
 static bool
 write_mipmap (ImageBufAlgo::MakeTextureMode mode,
               boost::shared_ptr<ImageBuf> &img,
@@ -552,13 +760,16 @@ write_mipmap (ImageBufAlgo::MakeTextureMode mode,
               string_view filtername, const ImageSpec &configspec,
               std::ostream &outstream,
               double &stat_writetime, double &stat_miptime,
+              std::vector<MipLevelStats> &levelstats,
               size_t &peak_mem)
 {
     bool envlatlmode = (mode == ImageBufAlgo::MakeTxEnvLatl);
+    bool envcubemode = (mode == ImageBufAlgo::MakeTxEnvCube);
     bool orig_was_overscan =
         (img->spec().x || img->spec().y || img->spec().z ||
          img->spec().full_x || img->spec().full_y || img->spec().full_z);
     ImageSpec outspec = outspec_template;
+    int cuberes = envcubemode ? outspec.full_width : 0;  // cube face res
     outspec.set_format (outputdatatype);
 
     if (mipmap && !out->supports ("multiimage") && !out->supports ("mipmap")) {
@@ -615,16 +826,26 @@ write_mipmap (ImageBufAlgo::MakeTextureMode mode,
         outstream << "  Top level is " << formatres(outspec) << std::endl;
     }
 
-    if (! img->write (out)) {
-        // ImageBuf::write transfers any errors from the ImageOutput to
-        // the ImageBuf.
-        outstream << "maketx ERROR: Write failed \" : " << img->geterror() << "\n";
-        out->close ();
-        return false;
-    }
-
     stat_writetime += writetimer();
 
+    // Levels smaller than this are so quick to compute that spreading
+    // the work over threads costs more than it saves, so the coarse end
+    // of the pyramid is computed and written in this one thread.
+    const imagesize_t coarse_pixels = 128*128;
+
+    // The pixel and display windows of each level are made to match, so
+    // that the resize to the next level works properly.  Don't worry, the
+    // texture engine doesn't care what the upper MIP levels have for the
+    // window sizes, it uses level 0 to determine the relatinship between
+    // texture 0-1 space (display window) and the pixels.  (The file gets
+    // outspec's windows; this only changes img's idea of them.)
+    img->set_full (img->xbegin(), img->xend(), img->ybegin(),
+                   img->yend(), img->zbegin(), img->zend());
+    MipLevelWriter writer (out, outputfilename);
+    levelstats.push_back (MipLevelStats (outspec, 0.0));
+    writer.start (img, outspec, false /* already open */,
+                  mipmap && outspec.image_pixels() > coarse_pixels);
+
     if (mipmap) {  // Mipmap levels:
         if (verbose)
             outstream << "  Mipmapping...\n" << std::flush;
@@ -635,9 +856,15 @@ write_mipmap (ImageBufAlgo::MakeTextureMode mode,
         bool allow_shift = configspec.get_int_attribute("maketx:allow_pixel_shift") != 0;
         
         boost::shared_ptr<ImageBuf> small (new ImageBuf);
-        while (outspec.width > 1 || outspec.height > 1) {
+        while (envcubemode ? cuberes > 1
+                           : (outspec.width > 1 || outspec.height > 1)) {
+            // N.B. img may still be being written by the writer thread,
+            // so until writer.wait() below it must only be read.  small
+            // is free to modify: it's either new or a level whose write
+            // has finished.
             Timer miptimer;
             ImageSpec smallspec;
+            int nthreads = img->spec().image_pixels() > 4*coarse_pixels ? 0 : 1;
 
             if (mipimages.size()) {
                 // Special case -- the user specified a custom MIP level
@@ -656,6 +883,17 @@ write_mipmap (ImageBufAlgo::MakeTextureMode mode,
                 smallspec.tile_height = outspec.tile_height;
                 smallspec.tile_depth = outspec.tile_depth;
                 mipimages.erase (mipimages.begin());
+            } else if (envcubemode) {
+                // Halve each cube face separately, keeping the 3x2 layout
+                smallspec = cubeface_spec (outspec, cuberes/2);
+                smallspec.set_format (TypeDesc::FLOAT);
+                small->reset (smallspec);
+                if (! resize_cubefaces (*small, *img, cuberes, filtername,
+                                        nthreads)) {
+                    outstream << "maketx ERROR: " << small->geterror() << "\n";
+                    return false;
+                }
+                cuberes /= 2;
             } else {
                 // Resize a factor of two smaller
                 smallspec = outspec;
@@ -673,25 +911,16 @@ write_mipmap (ImageBufAlgo::MakeTextureMode mode,
                     configspec.get_int_attribute("maketx:forcefloat", 1))
                     smallspec.set_format (TypeDesc::FLOAT);
 
-                // Trick: to get the resize working properly, we reset
-                // both display and pixel windows to match, and have 0
-                // offset, AND doctor the big image to have its display
-                // and pixel windows match.  Don't worry, the texture
-                // engine doesn't care what the upper MIP levels have
-                // for the window sizes, it uses level 0 to determine
-                // the relatinship between texture 0-1 space (display
-                // window) and the pixels.
+                // See above about making the windows match.
                 smallspec.x = 0;
                 smallspec.y = 0;
                 smallspec.full_x = 0;
                 smallspec.full_y = 0;
                 small->reset (smallspec);  // Realocate with new size
-                img->set_full (img->xbegin(), img->xend(), img->ybegin(),
-                               img->yend(), img->zbegin(), img->zend());
 
                 if (filtername == "box" && !orig_was_overscan && sharpen <= 0.0f) {
                     ImageBufAlgo::parallel_image (boost::bind(resize_block, boost::ref(*small), boost::cref(*img), _1, envlatlmode, allow_shift),
-                                                  OIIO::get_roi(small->spec()));
+                                                  OIIO::get_roi(small->spec()), nthreads);
                 } else {
                     Filter2D *filter = setup_filter (small->spec(), img->spec(), filtername);
                     if (! filter) {
@@ -709,59 +938,66 @@ write_mipmap (ImageBufAlgo::MakeTextureMode mode,
                         }
                         outstream << "\n";
                     }
-                    if (do_highlight_compensation)
-                        ImageBufAlgo::rangecompress (*img, *img);
+                    if (do_highlight_compensation) {
+                        // Not in place -- img may still be being written
+                        boost::shared_ptr<ImageBuf> compressed (new ImageBuf);
+                        ImageBufAlgo::rangecompress (*compressed, *img,
+                                                     false, ROI(), nthreads);
+                        std::swap (img, compressed);
+                    }
                     if (sharpen > 0.0f && sharpen_first) {
                         boost::shared_ptr<ImageBuf> sharp (new ImageBuf);
                         bool uok = ImageBufAlgo::unsharp_mask (*sharp, *img,
-                                                    sharpenfilt, 3.0, sharpen, 0.0f);
+                                                    sharpenfilt, 3.0, sharpen, 0.0f,
+                                                    ROI(), nthreads);
                         if (! uok)
                             outstream << "maketx ERROR: " << sharp->geterror() << "\n";
                         std::swap (img, sharp);
                     }
-                    ImageBufAlgo::resize (*small, *img, filter);
+                    ImageBufAlgo::resize (*small, *img, filter, ROI(), nthreads);
                     if (sharpen > 0.0f && ! sharpen_first) {
                         boost::shared_ptr<ImageBuf> sharp (new ImageBuf);
                         bool uok = ImageBufAlgo::unsharp_mask (*sharp, *small,
-                                                    sharpenfilt, 3.0, sharpen, 0.0f);
+                                                    sharpenfilt, 3.0, sharpen, 0.0f,
+                                                    ROI(), nthreads);
                         if (! uok)
                             outstream << "maketx ERROR: " << sharp->geterror() << "\n";
                         std::swap (small, sharp);
                     }
                     if (do_highlight_compensation) {
-                        ImageBufAlgo::rangeexpand (*small, *small);
+                        ImageBufAlgo::rangeexpand (*small, *small, false,
+                                                   ROI(), nthreads);
                         ImageBufAlgo::clamp (*small, *small, 0.0f,
-                                    std::numeric_limits<float>::max(), true);
+                                    std::numeric_limits<float>::max(), true,
+                                    ROI(), nthreads);
                     }
                     Filter2D::destroy (filter);
                 }
             }
 
-            stat_miptime += miptimer();
             outspec = smallspec;
             outspec.set_format (outputdatatype);
             if (envlatlmode && src_samples_border)
                 fix_latl_edges (*small);
-
-            Timer writetimer;
-            // If the format explicitly supports MIP-maps, use that,
-            // otherwise try to simulate MIP-mapping with multi-image.
-            ImageOutput::OpenMode mode = out->supports ("mipmap") ?
-                ImageOutput::AppendMIPLevel : ImageOutput::AppendSubimage;
-            if (! out->open (outputfilename.c_str(), outspec, mode)) {
-                outstream << "maketx ERROR: Could not append \"" << outputfilename
-                          << "\" : " << out->geterror() << "\n";
-                return false;
-            }
-            if (! small->write (out)) {
-                // ImageBuf::write transfers any errors from the
-                // ImageOutput to the ImageBuf.
-                outstream << "maketx ERROR writing \"" << outputfilename
-                          << "\" : " << small->geterror() << "\n";
+            small->set_full (small->xbegin(), small->xend(), small->ybegin(),
+                             small->yend(), small->zbegin(), small->zend());
+            double resizetime = miptimer();
+            stat_miptime += resizetime;
+
+            // Finish writing the previous level, then start on this one
+            Timer stalltimer;
+            bool wok = writer.wait ();
+            levelstats.back().write = writer.time();
+            levelstats.back().stall = stalltimer();
+            stat_writetime += levelstats.back().stall;
+            if (! wok) {
+                outstream << "maketx ERROR: " << writer.error() << "\n";
                 out->close ();
                 return false;
             }
-            stat_writetime += writetimer();
+            levelstats.push_back (MipLevelStats (outspec, resizetime));
+            writer.start (small, outspec, true /* append */,
+                          outspec.image_pixels() > coarse_pixels);
             if (verbose) {
                 size_t mem = Sysutil::memory_used(true);
                 peak_mem = std::max (peak_mem, mem);
@@ -774,6 +1010,19 @@ write_mipmap (ImageBufAlgo::MakeTextureMode mode,
         }
     }
 
+    // Finish writing the last level
+    writetimer.reset ();
+    writetimer.start ();
+    bool wok = writer.wait ();
+    levelstats.back().write = writer.time();
+    levelstats.back().stall = writetimer();
+    stat_writetime += levelstats.back().stall;
+    if (! wok) {
+        outstream << "maketx ERROR: " << writer.error() << "\n";
+        out->close ();
+        return false;
+    }
+
     if (verbose)
         outstream << "  Wrote file: " << outputfilename << "  ("
                   << Strutil::memformat(Sysutil::memory_used(true)) << ")\n";
@@ -804,6 +1053,7 @@ make_texture_impl (ImageBufAlgo::MakeTextureMode mode,
     double stat_resizetime = 0;
     double stat_miptime = 0;
     double stat_colorconverttime = 0;
+    std::vector<MipLevelStats> levelstats;
     size_t peak_mem = 0;
     Timer alltime;
 
@@ -886,6 +1136,7 @@ make_texture_impl (ImageBufAlgo::MakeTextureMode mode,
     bool shadowmode = (mode == ImageBufAlgo::MakeTxShadow);
     bool envlatlmode = (mode == ImageBufAlgo::MakeTxEnvLatl || 
                         mode == ImageBufAlgo::MakeTxEnvLatlFromLightProbe);
+    bool envcubemode = (mode == ImageBufAlgo::MakeTxEnvCube);
 
     // Find an ImageIO plugin that can open the output file, and open it
     std::string outformat = configspec.get_string_attribute ("maketx:fileformatname",
@@ -902,6 +1153,13 @@ make_texture_impl (ImageBufAlgo::MakeTextureMode mode,
                   << "\" format does not support tiled images\n";
         return false;
     }
+    if (envcubemode && ! strcmp (out->format_name(), "openexr")) {
+        // OpenEXR cube maps are 1x6 stacks whose MIP levels must halve
+        // the whole image, which can't hold the padded 3x2 layout.
+        outstream << "maketx ERROR: cube face environment maps can't be "
+                  << "written as OpenEXR files\n";
+        return false;
+    }
 
     // The cache might mess with the apparent data format, so make sure
     // it's the nativespec that we consult for data format of the file.
@@ -978,7 +1236,7 @@ make_texture_impl (ImageBufAlgo::MakeTextureMode mode,
         isConstantColor = (pixel_stats.min == pixel_stats.max);
         if (isConstantColor)
             constantColor = pixel_stats.min;
-        if (isConstantColor && constant_color_detect) {
+        if (isConstantColor && constant_color_detect && ! envcubemode) {
             // Reset the image, to a new image, at the tile size
             ImageSpec newspec = src->spec();
             newspec.width  = std::min (configspec.tile_width, src->spec().width);
@@ -1086,6 +1344,20 @@ make_texture_impl (ImageBufAlgo::MakeTextureMode mode,
         spec.full_depth = spec.depth;
     }
 
+    if (envcubemode) {
+        // Rearrange the faces into the 3x2 layout, padded to whole tiles
+        ImageSpec tilespec;
+        tilespec.tile_width  = configspec.tile_width  ? configspec.tile_width  : 64;
+        tilespec.tile_height = configspec.tile_height ? configspec.tile_height : 64;
+        if (! cubefaces_to_3x2 (src, tilespec)) {
+            outstream << "maketx ERROR: \"" << src->name() << "\" is "
+                      << formatres(src->spec()) << ", but cube face "
+                      << "environment maps must be 6 square faces stacked "
+                      << "vertically (1x6) or in a 3x2 layout\n";
+            return false;
+        }
+    }
+
     // Copy the input spec
     ImageSpec srcspec = src->spec();
     ImageSpec dstspec = srcspec;
@@ -1106,7 +1378,8 @@ make_texture_impl (ImageBufAlgo::MakeTextureMode mode,
         set_roi (dstspec, roi);
     }
 
-    bool orig_was_overscan = (roi != roi_full);
+    // (A cube face map's display window is just one face, not overscan.)
+    bool orig_was_overscan = (roi != roi_full) && ! envcubemode;
     if (orig_was_overscan) {
         configspec.attribute ("wrapmodes", "black,black");
     }
@@ -1174,6 +1447,11 @@ make_texture_impl (ImageBufAlgo::MakeTextureMode mode,
         configspec.attribute ("wrapmodes", "periodic,clamp");
         if (prman_metadata)
             dstspec.attribute ("PixarTextureFormat", "LatLong Environment");
+    } else if (envcubemode) {
+        dstspec.attribute ("textureformat", "CubeFace Environment");
+        configspec.attribute ("wrapmodes", "clamp,clamp");
+        if (prman_metadata)
+            dstspec.attribute ("PixarTextureFormat", "CubeFace Environment");
     } else {
         dstspec.attribute ("textureformat", "Plain Texture");
         if (prman_metadata)
@@ -1310,7 +1588,8 @@ make_texture_impl (ImageBufAlgo::MakeTextureMode mode,
         dstspec.set_format (TypeDesc::FLOAT);
 
     // Handle resize to power of two, if called for
-    if (configspec.get_int_attribute("maketx:resize")  &&  ! shadowmode) {
+    if (configspec.get_int_attribute("maketx:resize")  &&  ! shadowmode &&
+        ! envcubemode) {
         dstspec.width = pow2roundup (dstspec.width);
         dstspec.height = pow2roundup (dstspec.height);
         dstspec.full_width = dstspec.width;
@@ -1473,6 +1752,19 @@ make_texture_impl (ImageBufAlgo::MakeTextureMode mode,
             outstream << "  AverageColor: " << os.str() << std::endl;
     }
 
+    // Record how many of the top level's tiles are a constant color, so
+    // that the ImageCache knows whether it's worth checking as it reads.
+    if (configspec.get_int_attribute ("maketx:constant_tile_detect") &&
+        out->supports("arbitrary_metadata") && dstspec.tile_width > 0) {
+        int ntiles = 0;
+        int nconstant = count_constant_tiles (*toplevel, dstspec.tile_width,
+                                              dstspec.tile_height, ntiles);
+        dstspec.attribute ("oiio:ConstantTiles", nconstant);
+        if (verbose)
+            outstream << "  Constant tiles: " << nconstant << " of "
+                      << ntiles << std::endl;
+    }
+
     if (updatedDesc) {
         dstspec.attribute ("ImageDescription", desc);
     }
@@ -1492,7 +1784,8 @@ make_texture_impl (ImageBufAlgo::MakeTextureMode mode,
     bool ok = write_mipmap (mode, toplevel, dstspec, tmpfilename,
                             out, out_dataformat, !shadowmode && !nomipmap,
                             filtername, configspec, outstream,
-                            stat_writetime, stat_miptime, peak_mem);
+                            stat_writetime, stat_miptime, levelstats,
+                            peak_mem);
     delete out;  // don't need it any more
 
     // If using update mode, stamp the output file with a modification time
@@ -1525,6 +1818,16 @@ make_texture_impl (ImageBufAlgo::MakeTextureMode mode,
         outstream << Strutil::format ("  unaccounted:     %5.2f  (%5.2f %5.2f %5.2f %5.2f)\n",
                                       all-stat_readtime-stat_writetime-stat_resizetime-stat_hashtime-stat_miptime,
                                       misc_time_1, misc_time_2, misc_time_3, misc_time_4);
+        // Each level is written in the background while the next is
+        // computed, so "file write" above is just the time spent waiting
+        // for writes; here is where the time went for each level.
+        outstream << "  per MIP level:      resize   write   stall\n";
+        for (size_t i = 0;  i < levelstats.size();  ++i)
+            outstream << Strutil::format ("    %-15s  %7.3f %7.3f %7.3f\n",
+                                          formatres (levelstats[i].spec),
+                                          levelstats[i].resize,
+                                          levelstats[i].write,
+                                          levelstats[i].stall);
         outstream << Strutil::format ("maketx peak memory used: %s\n",
                                       Strutil::memformat(peak_mem));
     }
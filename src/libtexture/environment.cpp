@@ -318,6 +318,100 @@ vector_to_latlong (const Imath::V3f& R, bool y_is_up, float &s, float &t)
 
 
 
+// Cube faces, in the order they appear in the "6x1" layout.
+enum CubeFace { FacePX, FaceNX, FacePY, FaceNY, FacePZ, FaceNZ };
+
+// Major axis, +s direction, and +t direction of each face (see the table
+// at the top of this file).
+static const Imath::V3f cube_major[6] = {
+    Imath::V3f ( 1, 0, 0), Imath::V3f (-1, 0, 0), Imath::V3f (0,  1, 0),
+    Imath::V3f ( 0,-1, 0), Imath::V3f ( 0, 0, 1), Imath::V3f (0,  0,-1) };
+static const Imath::V3f cube_sdir[6] = {
+    Imath::V3f ( 0, 0,-1), Imath::V3f ( 0, 0, 1), Imath::V3f (1,  0, 0),
+    Imath::V3f ( 1, 0, 0), Imath::V3f ( 1, 0, 0), Imath::V3f (-1, 0, 0) };
+static const Imath::V3f cube_tdir[6] = {
+    Imath::V3f ( 0,-1, 0), Imath::V3f ( 0,-1, 0), Imath::V3f (0,  0, 1),
+    Imath::V3f ( 0, 0,-1), Imath::V3f ( 0,-1, 0), Imath::V3f (0, -1, 0) };
+
+
+
+/// Convert a direction vector to a cube face and the st coordinates
+/// (0-1 across the face) within it.
+inline void
+vector_to_cubeface (const Imath::V3f& R, int &face, float &s, float &t)
+{
+    float ax = fabsf(R[0]), ay = fabsf(R[1]), az = fabsf(R[2]);
+    float major;
+    if (ax >= ay && ax >= az) {
+        face = R[0] >= 0.0f ? FacePX : FaceNX;
+        major = ax;
+    } else if (ay >= az) {
+        face = R[1] >= 0.0f ? FacePY : FaceNY;
+        major = ay;
+    } else {
+        face = R[2] >= 0.0f ? FacePZ : FaceNZ;
+        major = az;
+    }
+    if (major > 0.0f) {
+        float scale = 0.5f / major;
+        s = 0.5f + scale * R.dot (cube_sdir[face]);
+        t = 0.5f + scale * R.dot (cube_tdir[face]);
+    } else {
+        s = t = 0.5f;   // degenerate R -- beware NaNs
+    }
+}
+
+
+
+/// Where the faces of a cube face environment map lie within the pixels
+/// of one MIP level, given the layout of the file.
+struct CubeLevel {
+    int res;               // face resolution
+    int x[6], y[6];        // pixel origin of each face
+    bool sample_border;    // edge texels lie exactly on the cube edges
+
+    CubeLevel (const ImageSpec &spec, EnvLayout layout, bool border)
+        : sample_border(border)
+    {
+        if (layout == LayoutCubeOneBySix) {
+            int ystride = spec.height / 6;
+            res = std::min (spec.width, ystride);
+            for (int f = 0;  f < 6;  ++f) {
+                x[f] = spec.x;
+                y[f] = spec.y + f*ystride;
+            }
+        } else {
+            // 3x2: faces are padded out to at least a tile, and the
+            // full (display) window gives the valid face size.
+            int xstride = spec.width / 3, ystride = spec.height / 2;
+            res = std::min (xstride, ystride);
+            if (spec.full_width > 0)
+                res = std::min (res, spec.full_width);
+            for (int f = 0;  f < 6;  ++f) {
+                x[f] = spec.x + (f/2)*xstride;
+                y[f] = spec.y + (f%2)*ystride;
+            }
+        }
+        res = std::max (res, 1);
+    }
+
+    /// Texels per unit of face st.
+    float scale () const { return sample_border ? float(res-1) : float(res); }
+
+    /// Face st to continuous texel coordinate (texel centers at integers).
+    float st_to_texel (float st) const {
+        return sample_border ? st * (res-1) : st * res - 0.5f;
+    }
+
+    /// Face st of the center of texel i.
+    float texel_to_st (int i) const {
+        return sample_border ? float(i) / std::max (res-1, 1)
+                             : (i + 0.5f) / res;
+    }
+};
+
+
+
 bool
 TextureSystemImpl::environment (ustring filename, TextureOpt &options,
                                 const Imath::V3f &R,
@@ -379,7 +473,11 @@ TextureSystemImpl::environment (TextureHandle *texture_handle_,
         TextureOpt::WrapPeriodicSharedBorder : TextureOpt::WrapPeriodic;
     options.twrap = TextureOpt::WrapClamp;
 
-    options.envlayout = LayoutLatLong;
+    // Cube face maps are filtered face by face, anything else is assumed
+    // to be a latlong map.
+    bool cubeface = (texturefile->m_envlayout == LayoutCubeThreeByTwo ||
+                     texturefile->m_envlayout == LayoutCubeOneBySix);
+    options.envlayout = cubeface ? texturefile->m_envlayout : LayoutLatLong;
     int actualchannels = Imath::clamp (spec.nchannels - options.firstchannel,
                                        0, nchannels);
 
@@ -452,7 +550,8 @@ TextureSystemImpl::environment (TextureHandle *texture_handle_,
 
     TextureOpt::MipMode mipmode = options.mipmode;
     bool aniso = (mipmode == TextureOpt::MipModeDefault ||
-                  mipmode == TextureOpt::MipModeAniso);
+                  mipmode == TextureOpt::MipModeAniso ||
+                  mipmode == TextureOpt::MipModeStochasticAniso);
 
     float aspect, trueaspect, filtwidth;
     int nsamples;
@@ -472,13 +571,24 @@ TextureSystemImpl::environment (TextureHandle *texture_handle_,
 
     ImageCacheFile::SubimageInfo &subinfo (texturefile->subimageinfo(options.subimage));
 
-    // FIXME -- assuming latlong
     bool ok = true;
     float pos = -0.5f + 0.5f * invsamples;
     for (int sample = 0;  sample < nsamples;  ++sample, pos += invsamples) {
         Imath::V3f Rsamp = R + pos*Rmajor;
         float s, t;
-        vector_to_latlong (Rsamp, texturefile->m_y_up, s, t);
+        int face = -1;
+        float cubescale = 0.0f;
+        if (cubeface) {
+            vector_to_cubeface (Rsamp, face, s, t);
+            // A face spans 2 units of its plane at unit distance, and
+            // texels subtend smaller angles away from the face center by
+            // (roughly) a factor of 1 + a^2 + b^2 (where a,b are the
+            // plane coordinates), so that's how many texels per radian.
+            float a = 2.0f*s - 1.0f, b = 2.0f*t - 1.0f;
+            cubescale = 0.5f * filtwidth * (1.0f + a*a + b*b);
+        } else {
+            vector_to_latlong (Rsamp, texturefile->m_y_up, s, t);
+        }
 
         // Determine the MIP-map level(s) we need: we will blend
         //  data(miplevel[0]) * (1-levelblend) + data(miplevel[1]) * levelblend
@@ -491,7 +601,13 @@ TextureSystemImpl::environment (TextureHandle *texture_handle_,
             // Filters are in radians, and the vertical resolution of a
             // latlong map is PI radians.  So to compute the raster size of
             // our filter width...
-            float filtwidth_ras = subinfo.spec(m).full_height * filtwidth * M_1_PI;
+            float filtwidth_ras;
+            if (cubeface)
+                filtwidth_ras = cubescale * CubeLevel (subinfo.spec(m),
+                                    texturefile->m_envlayout,
+                                    texturefile->m_sample_border).res;
+            else
+                filtwidth_ras = subinfo.spec(m).full_height * filtwidth * M_1_PI;
             // Once the filter width is smaller than one texel at this level,
             // we've gone too far, so we know that we want to interpolate the
             // previous level and the current level.  Note that filtwidth_ras
@@ -535,6 +651,19 @@ TextureSystemImpl::environment (TextureHandle *texture_handle_,
                 continue;
             ++npointson;
             int lev = miplevel[level];
+            if (cubeface) {
+                // Cube faces are interpolated bilinearly (or closest),
+                // fetching across face edges as needed.
+                if (options.interpmode == TextureOpt::InterpClosest)
+                    ++stats.closest_interps;
+                else
+                    ++stats.bilinear_interps;
+                ok &= sample_cubeface (face, s, t, lev, *texturefile,
+                                       thread_info, options, actualchannels,
+                                       levelweight[level]*invsamples,
+                                       result, dresultds, dresultdt);
+                continue;
+            }
             if (options.interpmode == TextureOpt::InterpSmartBicubic) {
                 if (lev == 0 ||
                     (texturefile->spec(options.subimage,lev).full_height < naturalres/2)) {
@@ -570,6 +699,12 @@ TextureSystemImpl::environment (TextureHandle *texture_handle_,
     stats.aniso_probes += nsamples;
     ++stats.aniso_queries;
 
+    if (cubeface && options.fill) {
+        // The cube sampler doesn't fill, so do it for all of them at once
+        for (int c = actualchannels;  c < nchannels;  ++c)
+            result[c] = options.fill;
+    }
+
     if (actualchannels < nchannels && options.firstchannel == 0 && m_gray_to_rgb)
         fill_gray_channels (spec, nchannels, result, dresultds, dresultdt);
 
@@ -578,6 +713,118 @@ TextureSystemImpl::environment (TextureHandle *texture_handle_,
 
 
 
+bool
+TextureSystemImpl::sample_cubeface (int face, float s, float t, int level,
+                                    TextureFile &texturefile,
+                                    PerThreadInfo *thread_info,
+                                    TextureOpt &options, int actualchannels,
+                                    float weight, float *accum,
+                                    float *daccumds, float *daccumdt)
+{
+    const ImageSpec &spec (texturefile.spec (options.subimage, level));
+    CubeLevel cube (spec, texturefile.m_envlayout, texturefile.m_sample_border);
+    int i, j;
+    float ifrac = floorfrac (cube.st_to_texel (s), &i);
+    float jfrac = floorfrac (cube.st_to_texel (t), &j);
+
+    float texel[4][4];
+    if (options.interpmode == TextureOpt::InterpClosest) {
+        if (! cubeface_texel (face, i + (ifrac > 0.5f), j + (jfrac > 0.5f),
+                              level, texturefile, thread_info, options,
+                              actualchannels, texel[0]))
+            return false;
+        for (int c = 0;  c < actualchannels;  ++c)
+            accum[c] += weight * texel[0][c];
+        return true;   // constant interp has 0 derivatives
+    }
+
+    bool ok = true;
+    ok &= cubeface_texel (face, i,   j,   level, texturefile, thread_info,
+                          options, actualchannels, texel[0]);
+    ok &= cubeface_texel (face, i+1, j,   level, texturefile, thread_info,
+                          options, actualchannels, texel[1]);
+    ok &= cubeface_texel (face, i,   j+1, level, texturefile, thread_info,
+                          options, actualchannels, texel[2]);
+    ok &= cubeface_texel (face, i+1, j+1, level, texturefile, thread_info,
+                          options, actualchannels, texel[3]);
+    if (! ok)
+        return false;
+    for (int c = 0;  c < actualchannels;  ++c)
+        accum[c] += weight * bilerp (texel[0][c], texel[1][c],
+                                     texel[2][c], texel[3][c], ifrac, jfrac);
+    if (daccumds) {
+        float scale = weight * cube.scale();
+        for (int c = 0;  c < actualchannels;  ++c) {
+            daccumds[c] += scale * lerp (texel[1][c] - texel[0][c],
+                                         texel[3][c] - texel[2][c], jfrac);
+            daccumdt[c] += scale * lerp (texel[2][c] - texel[0][c],
+                                         texel[3][c] - texel[1][c], ifrac);
+        }
+    }
+    return true;
+}
+
+
+
+bool
+TextureSystemImpl::cubeface_texel (int face, int i, int j, int level,
+                                   TextureFile &texturefile,
+                                   PerThreadInfo *thread_info,
+                                   TextureOpt &options, int actualchannels,
+                                   float *texel)
+{
+    const ImageSpec &spec (texturefile.spec (options.subimage, level));
+    CubeLevel cube (spec, texturefile.m_envlayout, texturefile.m_sample_border);
+    if (i < 0 || j < 0 || i >= cube.res || j >= cube.res) {
+        // Off the edge of this face.  Extend the face's plane to find the
+        // direction of this texel's center, and use the texel of whichever
+        // face that direction really lands on.
+        float s = cube.texel_to_st (i), t = cube.texel_to_st (j);
+        Imath::V3f R = cube_major[face] + (2.0f*s - 1.0f) * cube_sdir[face]
+                                        + (2.0f*t - 1.0f) * cube_tdir[face];
+        vector_to_cubeface (R, face, s, t);
+        i = Imath::clamp ((int) floorf (cube.st_to_texel (s) + 0.5f), 0, cube.res-1);
+        j = Imath::clamp ((int) floorf (cube.st_to_texel (t) + 0.5f), 0, cube.res-1);
+    }
+    int x = cube.x[face] + i, y = cube.y[face] + j;
+    int tile_s = (x - spec.x) % spec.tile_width;
+    int tile_t = (y - spec.y) % spec.tile_height;
+    TileID id (texturefile, options.subimage, level,
+               x - tile_s, y - tile_t, 0);
+    bool ok = find_tile (id, thread_info);
+    if (! ok)
+        error ("%s", m_imagecache->geterror());
+    TileRef &tile (thread_info->tile);
+    if (! tile  ||  ! ok)
+        return false;
+    size_t offset = tile->constant() ? 0 :
+                    texturefile.pixelsize (options.subimage) *
+                        (tile_t * spec.tile_width + tile_s);
+    const unsigned char *p = tile->bytedata() + offset;
+    switch (texturefile.pixeltype (options.subimage)) {
+    case TypeDesc::UINT8 :
+        for (int c = 0;  c < actualchannels;  ++c)
+            texel[c] = uchar2float (p[options.firstchannel+c]);
+        break;
+    case TypeDesc::UINT16 :
+        for (int c = 0;  c < actualchannels;  ++c)
+            texel[c] = convert_type<unsigned short,float> (((const unsigned short *)p)[options.firstchannel+c]);
+        break;
+    case TypeDesc::HALF :
+        for (int c = 0;  c < actualchannels;  ++c)
+            texel[c] = ((const half *)p)[options.firstchannel+c];
+        break;
+    default :
+        DASSERT (texturefile.pixeltype (options.subimage) == TypeDesc::FLOAT);
+        for (int c = 0;  c < actualchannels;  ++c)
+            texel[c] = ((const float *)p)[options.firstchannel+c];
+        break;
+    }
+    return true;
+}
+
+
+
 }  // end namespace pvt
 
 }
@@ -57,6 +57,14 @@
 #include <boost/foreach.hpp>
 #include <boost/algorithm/string.hpp>
 #include <boost/scoped_array.hpp>
+#include <boost/bind.hpp>
+
+#ifndef _WIN32
+# include <cerrno>
+# include <fcntl.h>
+# include <sys/file.h>
+# include <unistd.h>
+#endif
 
 
 OIIO_NAMESPACE_ENTER
@@ -148,6 +156,8 @@ ImageCacheStatistics::init ()
     unique_files = 0;
     fileio_time = 0;
     fileopen_time = 0;
+    fileclose_time = 0;
+    filereopen_time = 0;
     file_locking_time = 0;
     tile_locking_time = 0;
     find_file_time = 0;
@@ -192,6 +202,8 @@ ImageCacheStatistics::merge (const ImageCacheStatistics &s)
     unique_files += s.unique_files;
     fileio_time += s.fileio_time;
     fileopen_time += s.fileopen_time;
+    fileclose_time += s.fileclose_time;
+    filereopen_time += s.filereopen_time;
     file_locking_time += s.file_locking_time;
     tile_locking_time += s.tile_locking_time;
     find_file_time += s.find_file_time;
@@ -240,20 +252,25 @@ ImageCacheFile::ImageCacheFile (ImageCacheImpl &imagecache,
                                 ustring filename,
                                 ImageInput::Creator creator,
                                 const ImageSpec *config)
-    : m_filename(filename), m_used(true), m_broken(false),
-      m_texformat(TexFormatTexture),
+    : m_filename(filename), m_used(true), m_last_use(0), m_next_file(NULL),
+      m_broken(false), m_texformat(TexFormatTexture),
       m_swrap(TextureOpt::WrapBlack), m_twrap(TextureOpt::WrapBlack),
       m_rwrap(TextureOpt::WrapBlack),
       m_envlayout(LayoutTexture), m_y_up(false), m_sample_border(false),
-      m_tilesread(0), m_bytesread(0), m_timesopened(0), m_iotime(0),
+      m_scan_constant_tiles(false), m_tilesread(0), m_bytesread(0), m_timesopened(0), m_iotime(0),
       m_mipused(false), m_validspec(false), 
       m_imagecache(imagecache), m_duplicate(NULL),
       m_total_imagesize(0),
       m_inputcreator(creator),
-      m_configspec(config ? new ImageSpec(*config) : NULL)
+      m_configspec(config ? new ImageSpec(*config) : NULL),
+      m_is_udim(false), m_udim_valid(0), m_udim_nvtiles(0)
 {
     m_filename_original = m_filename;
-    m_filename = imagecache.resolve_filename (m_filename_original.string());
+    // A "<UDIM>" pattern names no file itself, so it's never resolved
+    // against the search path -- its individual tiles will be.
+    m_is_udim = (m_filename.find ("<UDIM>") != ustring::npos);
+    if (! m_is_udim)
+        m_filename = imagecache.resolve_filename (m_filename_original.string());
     // N.B. the file is not opened, the ImageInput is NULL.  This is
     // reflected by the fact that m_validspec is false.
     m_Mlocal.makeIdentity();
@@ -355,6 +372,16 @@ ImageCacheFile::open (ImageCachePerThreadInfo *thread_info)
     if (m_broken)        // Already failed an open -- it's broken
         return false;
 
+    if (m_is_udim) {
+        // There's no single file to open -- only the texture lookups know
+        // how to pick a tile, everything else (specs, pixels) is an error.
+        imagecache().error ("\"%s\" is a UDIM texture, not a single image file",
+                            m_filename);
+        m_broken = true;
+        invalidate_spec ();
+        return false;
+    }
+
     if (m_inputcreator)
         m_input.reset (m_inputcreator());
     else
@@ -373,13 +400,12 @@ ImageCacheFile::open (ImageCachePerThreadInfo *thread_info)
     if (imagecache().unassociatedalpha())
         configspec.attribute ("oiio:UnassociatedAlpha", 1);
 
-    ImageSpec nativespec, tempspec;
+    ImageSpec nativespec;
     m_broken = false;
     bool ok = true;
     for (int tries = 0; tries <= imagecache().failure_retries(); ++tries) {
         ok = m_input->open (m_filename.c_str(), nativespec, configspec);
         if (ok) {
-            tempspec = nativespec;
             if (tries)   // succeeded, but only after a failure!
                 ++thread_info->m_stats.file_retry_success;
             (void) m_input->geterror ();  // Eat the errors
@@ -398,6 +424,7 @@ ImageCacheFile::open (ImageCachePerThreadInfo *thread_info)
     ++m_timesopened;
     m_imagecache.incr_open_files ();
     use ();
+    m_last_use = m_imagecache.next_file_use ();
 
     // If we are simply re-opening a closed file, and the spec is still
     // valid, we're done, no need to reread the subimage and mip headers.
@@ -405,20 +432,64 @@ ImageCacheFile::open (ImageCachePerThreadInfo *thread_info)
         return true;
 
     // From here on, we know that we've opened this file for the very
-    // first time.  So read all the subimages, fill out all the fields
-    // of the ImageCacheFile.
+    // first time.  So read the headers of all the subimages and MIP
+    // levels, and fill out all the fields of the ImageCacheFile.
+    NativeSpecs nativespecs;
+    int nsubimages = 0;
+    do {
+        nativespecs.resize (nsubimages+1);
+        int nmip = 0;
+        do {
+            nativespecs[nsubimages].push_back (nativespec);
+            ++nmip;
+        } while (m_input->seek_subimage (nsubimages, nmip, nativespec));
+        ++nsubimages;
+    } while (m_input->seek_subimage (nsubimages, 0, nativespec));
+
+    if (! init_from_nativespecs (nativespecs, thread_info))
+        return false;
+    if (! m_inputcreator && ! m_configspec)
+        m_imagecache.spec_index_add (m_filename, m_fileformat, nativespecs);
+    return true;
+}
+
+
+
+bool
+ImageCacheFile::open_from_index (ImageCachePerThreadInfo *thread_info)
+{
+    if (m_inputcreator || m_configspec || m_is_udim || m_broken)
+        return false;
+    NativeSpecs nativespecs;
+    ustring fileformat;
+    if (! m_imagecache.spec_index_find (m_filename, fileformat, nativespecs))
+        return false;
+    m_fileformat = fileformat;
+    // N.B. the ImageInput stays closed: open() will notice that the spec
+    // is already valid when pixels are actually needed.
+    return init_from_nativespecs (nativespecs, thread_info);
+}
+
+
+
+bool
+ImageCacheFile::init_from_nativespecs (const NativeSpecs &nativespecs,
+                                       ImageCachePerThreadInfo *thread_info)
+{
     m_subimages.clear ();
     int nsubimages = 0;
+    ImageSpec tempspec;
 
     // Since each subimage can potentially have its own mipmap levels,
     // keep track of the highest level discovered
     imagesize_t old_total_imagesize = m_total_imagesize;
     m_total_imagesize = 0;
-    do {
+    for ( ;  nsubimages < (int)nativespecs.size();  ++nsubimages) {
         m_subimages.resize (nsubimages+1);
         SubimageInfo &si (subimageinfo(nsubimages));
         int nmip = 0;
-        do {
+        for ( ;  nmip < (int)nativespecs[nsubimages].size();  ++nmip) {
+            const ImageSpec &nativespec (nativespecs[nsubimages][nmip]);
             tempspec = nativespec;
             if (nmip == 0) {
                 // Things to do on MIP level 0, i.e. once per subimage
@@ -461,8 +532,7 @@ ImageCacheFile::open (ImageCachePerThreadInfo *thread_info)
             tempspec.channelformats.clear();
             LevelInfo levelinfo (tempspec, nativespec);
             si.levels.push_back (levelinfo);
-            ++nmip;
-        } while (m_input->seek_subimage (nsubimages, nmip, nativespec));
+        }
 
         // Special work for non-MIPmapped images -- but only if "automip"
         // is on, it's a non-mipmapped image, and it doesn't have a
@@ -522,9 +592,7 @@ ImageCacheFile::open (ImageCachePerThreadInfo *thread_info)
             m_input.reset ();
             return false;
         }
-
-        ++nsubimages;
-    } while (m_input->seek_subimage (nsubimages, 0, nativespec));
+    }
     ASSERT ((size_t)nsubimages == m_subimages.size());
 
     thread_info->m_stats.files_totalsize -= old_total_imagesize;
@@ -591,6 +659,11 @@ ImageCacheFile::init_from_spec ()
             m_sample_border = true;
     }
 
+    // maketx --constant-tile-detect records how many of the top level's
+    // tiles are constant; if none are, don't bother checking as we read.
+    m_scan_constant_tiles = m_imagecache.detect_constant_tiles() &&
+                 spec.get_int_attribute ("oiio:ConstantTiles", -1) != 0;
+
     if (m_texformat == TexFormatCubeFaceEnv ||
         m_texformat == TexFormatCubeFaceShadow) {
         int w = std::max (spec.full_width, spec.tile_width);
@@ -648,6 +721,20 @@ ImageCacheFile::read_tile (ImageCachePerThreadInfo *thread_info,
                            TypeDesc format, void *data)
 {
     recursive_lock_guard guard (m_input_mutex);
+    m_last_use = imagecache().next_file_use ();
+
+    // Remember which file this thread tends to read after the last one
+    // it read from.  When we switch to a file whose usual successor has
+    // been closed, ask the janitor to re-open it before we need it.
+    ImageCacheFile *prev = thread_info->last_read_file;
+    if (prev != this) {
+        if (prev)
+            prev->m_next_file = this;
+        thread_info->last_read_file = this;
+        ImageCacheFile *next = m_next_file;
+        if (next && next != this && ! next->opened() && ! next->broken())
+            imagecache().prefetch_file (next);
+    }
 
     if (! m_input && !m_broken) {
         // The file is already in the file cache, but the handle is
@@ -662,7 +749,15 @@ ImageCacheFile::read_tile (ImageCachePerThreadInfo *thread_info,
         m_input_mutex.lock ();
     }
 
-    bool ok = open (thread_info);
+    bool ok;
+    if (! m_input && ! m_broken && validspec()) {
+        // Re-opening a file that was closed to stay under the limit
+        Timer timer;
+        ok = open (thread_info);
+        thread_info->m_stats.filereopen_time += timer();
+    } else {
+        ok = open (thread_info);
+    }
     if (! ok)
         return false;
 
@@ -972,7 +1067,13 @@ ImageCacheFile::invalidate ()
     m_fingerprint.clear ();
     duplicate (NULL);
 
-    m_filename = m_imagecache.resolve_filename (m_filename_original.string());
+    // Rescan for UDIM tiles next time, in case some were added or removed
+    m_udim_valid = 0;
+    m_udim_lookup.clear ();
+    m_udim_nvtiles = 0;
+
+    if (! m_is_udim)
+        m_filename = m_imagecache.resolve_filename (m_filename_original.string());
 
     // Eat any errors that occurred in the open/close
     while (! imagecache().geterror().empty())
@@ -1056,7 +1157,7 @@ ImageCacheImpl::find_file (ustring filename,
 
         if (newfile) {
             check_max_files (thread_info);
-            if (! tf->duplicate())
+            if (! tf->duplicate() && ! tf->is_udim())
                 ++thread_info->m_stats.unique_files;
         }
         thread_info->filename (filename, tf);  // add to the microcache
@@ -1089,7 +1190,8 @@ ImageCacheImpl::verify_file (ImageCacheFile *tf,
             thread_info = get_perthread_info ();
         recursive_lock_guard guard (tf->m_input_mutex);
         if (! tf->validspec()) {
-            tf->open (thread_info);
+            if (! tf->open_from_index (thread_info))
+                tf->open (thread_info);
             DASSERT (tf->m_broken || tf->validspec());
             double createtime = timer();
             ImageCacheStatistics &stats (thread_info->m_stats);
@@ -1174,6 +1276,81 @@ ImageCacheImpl::clear_fingerprints ()
 
 
 
+void
+ImageCacheImpl::build_udim_lookup (ImageCacheFile *udimfile,
+                                   ImageCachePerThreadInfo *thread_info)
+{
+    recursive_lock_guard guard (udimfile->m_input_mutex);
+    if (udimfile->m_udim_valid)
+        return;   // Another thread beat us to it
+
+    // Split the pattern into the directory part and the parts of the
+    // file name before and after the "<UDIM>".  Only the file name may
+    // contain the pattern, the directory must be fixed.
+    const std::string &pattern (udimfile->m_filename_original.string());
+    std::string dir = Filesystem::parent_path (pattern);
+    std::string name = Filesystem::filename (pattern);
+    size_t udimpos = name.find ("<UDIM>");
+    std::vector<ImageCacheFile *> lookup;
+    int nvtiles = 0;
+    if (udimpos == std::string::npos) {
+        error ("UDIM pattern \"%s\" may only appear in the file name",
+               pattern);
+    } else {
+        std::string prefix = name.substr (0, udimpos);
+        std::string suffix = name.substr (udimpos+6);
+        // Look in the same places that find_file would: relative to the
+        // working directory, and relative to each searchpath directory.
+        std::vector<std::string> dirs (1, dir.size() ? dir : std::string("."));
+        if (! Filesystem::path_is_absolute (pattern))
+            for (size_t i = 0, e = m_searchdirs.size();  i < e;  ++i)
+                dirs.push_back (dir.size() ? m_searchdirs[i] + "/" + dir
+                                           : m_searchdirs[i]);
+        std::vector<std::string> entries;
+        std::vector<int> udims;
+        for (size_t d = 0;  d < dirs.size();  ++d) {
+            entries.clear ();
+            Filesystem::get_directory_entries (dirs[d], entries);
+            for (size_t i = 0, e = entries.size();  i < e;  ++i) {
+                std::string f = Filesystem::filename (entries[i]);
+                if (f.size() != prefix.size() + 4 + suffix.size() ||
+                    ! Strutil::starts_with (f, prefix) ||
+                    ! Strutil::ends_with (f, suffix))
+                    continue;
+                const char *digits = f.c_str() + prefix.size();
+                if (! isdigit(digits[0]) || ! isdigit(digits[1]) ||
+                    ! isdigit(digits[2]) || ! isdigit(digits[3]))
+                    continue;
+                int udim = atoi (std::string(digits, 4).c_str());
+                if (udim >= 1001)
+                    udims.push_back (udim);
+            }
+        }
+        for (size_t i = 0;  i < udims.size();  ++i)
+            nvtiles = std::max (nvtiles, (udims[i]-1001)/10 + 1);
+        lookup.resize (10*nvtiles, NULL);
+        for (size_t i = 0;  i < udims.size();  ++i) {
+            ImageCacheFile *&tile (lookup[udims[i]-1001]);
+            if (tile)
+                continue;   // earlier directories take precedence
+            // Name the tile exactly as the user would have, so that it
+            // resolves against the searchpath and shares the file cache
+            // entry with any direct references to it.
+            std::string tilename = pattern;
+            tilename.replace (tilename.rfind ("<UDIM>"), 6,
+                              Strutil::format ("%04d", udims[i]));
+            tile = find_file (ustring(tilename), thread_info);
+        }
+    }
+    udimfile->m_udim_lookup.swap (lookup);
+    udimfile->m_udim_nvtiles = nvtiles;
+    // Publish the table only once it's completely written, so that
+    // resolve_udim() never sees a partial one without locking.
+    udimfile->m_udim_valid.store (1, memory_order_release);
+}
+
+
+
 void
 ImageCacheImpl::check_max_files (ImageCachePerThreadInfo *thread_info)
 {
@@ -1184,9 +1361,15 @@ ImageCacheImpl::check_max_files (ImageCachePerThreadInfo *thread_info)
     }
 #endif
 
-    // Early out if we aren't exceeding the open file handle limit
-    if (m_stat_open_files_current < m_max_open_files)
+    // Early out if we aren't exceeding the open file handle limit.  Past
+    // the soft limit, let the janitor thread close files, so that this
+    // thread doesn't have to wait for the closes.
+    if (m_stat_open_files_current < m_max_open_files) {
+        if (m_async_file_close &&
+              m_stat_open_files_current >= max_open_files_soft())
+            wake_file_janitor ();
         return;
+    }
 
     // Try to grab the file_sweep_mutex lock. If somebody else holds it,
     // just return -- leave the handle limit enforcement to whomever is
@@ -1195,6 +1378,7 @@ ImageCacheImpl::check_max_files (ImageCachePerThreadInfo *thread_info)
     // so be it.
     if (! m_file_sweep_mutex.try_lock())
         return;
+    Timer timer;
 
     // Now, what we want to do is have a "clock hand" that sweeps across
     // the cache, releasing files that haven't been used for a long
@@ -1245,6 +1429,8 @@ ImageCacheImpl::check_max_files (ImageCachePerThreadInfo *thread_info)
     // empty string if we don't have a valid iterator at this point.
     m_file_sweep_name = (sweep == end ? ustring() : sweep->first);
     m_file_sweep_mutex.unlock ();
+    if (thread_info)
+        thread_info->m_stats.fileclose_time += timer();
 
     // N.B. As we exit, the iterators will go out of scope and we will
     // retain no locks on the cache.
@@ -1252,6 +1438,138 @@ ImageCacheImpl::check_max_files (ImageCachePerThreadInfo *thread_info)
 
 
 
+void
+ImageCacheImpl::wake_file_janitor ()
+{
+    // Every request bumps the count, so that a janitor that is finishing
+    // a pass will see it and go around again instead of sleeping.  Only
+    // the first request since the janitor went idle needs to signal it.
+    if (m_janitor_wake++ > 0)
+        return;
+    boost::lock_guard<boost::mutex> lock (m_janitor_mutex);
+    if (m_janitor_quit)
+        return;
+    if (! m_janitor_thread)
+        m_janitor_thread.reset (new boost::thread (
+                          boost::bind (&ImageCacheImpl::file_janitor, this)));
+    m_janitor_cond.notify_one ();
+}
+
+
+
+void
+ImageCacheImpl::stop_file_janitor ()
+{
+    {
+        boost::lock_guard<boost::mutex> lock (m_janitor_mutex);
+        m_janitor_quit = true;
+        m_janitor_cond.notify_one ();
+    }
+    if (m_janitor_thread) {
+        m_janitor_thread->join ();
+        m_janitor_thread.reset ();
+    }
+}
+
+
+
+void
+ImageCacheImpl::prefetch_file (ImageCacheFile *file)
+{
+    if (! m_async_file_close ||
+          m_stat_open_files_current >= max_open_files_soft())
+        return;
+    {
+        boost::lock_guard<boost::mutex> lock (m_janitor_mutex);
+        // Don't let a backlog of stale guesses pile up
+        if (m_janitor_quit || m_prefetch_files.size() >= 16)
+            return;
+        m_prefetch_files.push_back (file);
+    }
+    wake_file_janitor ();
+}
+
+
+
+void
+ImageCacheImpl::file_janitor ()
+{
+    ImageCachePerThreadInfo *thread_info = create_thread_info ();
+    std::vector<ImageCacheFile *> prefetch;
+    boost::unique_lock<boost::mutex> lock (m_janitor_mutex);
+    while (! m_janitor_quit) {
+        if (! m_janitor_wake) {
+            m_janitor_cond.wait (lock);
+            continue;
+        }
+        int requests = m_janitor_wake;
+        prefetch.swap (m_prefetch_files);
+        lock.unlock ();
+
+        // Close down to a bit below the soft limit, so that we aren't
+        // woken up again by the very next file that's opened.
+        int soft = max_open_files_soft ();
+        if (m_stat_open_files_current >= soft)
+            m_stat_janitor_closes += close_lru_files (soft - soft/8 - 1);
+
+        // Re-open the closed files we expect to need soon, as long as
+        // there's room for them.
+        for (size_t i = 0;  i < prefetch.size();  ++i) {
+            if (m_stat_open_files_current >= soft)
+                break;
+            ImageCacheFile *file = prefetch[i];
+            recursive_lock_guard guard (file->m_input_mutex);
+            if (! file->opened() && ! file->broken() && file->validspec()) {
+                file->open (thread_info);
+                ++m_stat_prefetch_opens;
+            }
+        }
+        prefetch.clear ();
+
+        // Go idle only if nobody asked for more work while we were busy.
+        // Anyone who asks after this sees 0 and must take the lock to
+        // signal us, so no request can be lost.
+        lock.lock ();
+        if (m_prefetch_files.empty())
+            m_janitor_wake.bool_compare_and_swap (requests, 0);
+    }
+    lock.unlock ();
+    destroy_thread_info (thread_info);
+}
+
+
+
+int
+ImageCacheImpl::close_lru_files (int target)
+{
+    // Gather the open files along with their last use stamps.  We only
+    // hold the file cache bin locks while iterating, never while closing.
+    std::vector<std::pair<long long, ImageCacheFile *> > openfiles;
+    for (FilenameMap::iterator f = m_files.begin();  f != m_files.end();  ++f) {
+        ImageCacheFile *file = f->second.get();
+        if (file->opened())
+            openfiles.push_back (std::make_pair (file->last_use(), file));
+    }
+    std::sort (openfiles.begin(), openfiles.end());
+
+    // Close the least recently used ones first.
+    int nclosed = 0;
+    for (size_t i = 0;  i < openfiles.size();  ++i) {
+        if (m_stat_open_files_current <= target)
+            break;
+        ImageCacheFile *file = openfiles[i].second;
+        recursive_lock_guard guard (file->m_input_mutex);
+        // Somebody may have read from it (or closed it) since we looked
+        if (file->opened() && file->last_use() == openfiles[i].first) {
+            file->close ();
+            ++nclosed;
+        }
+    }
+    return nclosed;
+}
+
+
+
 void
 ImageCacheImpl::set_min_cache_size (long long newsize)
 {
@@ -1266,10 +1584,60 @@ ImageCacheImpl::set_min_cache_size (long long newsize)
 
 
 
+SharedTilePixels *
+ImageCacheImpl::share_tile_pixels (boost::scoped_array<char> &pixels,
+                                   size_t size)
+{
+    // Don't look at the padding, its values don't matter
+    size_t datasize = size - OIIO_SIMD_MAX_SIZE_BYTES;
+    size_t hash = xxhash::xxhash ((const void *)pixels.get(), datasize);
+    spin_lock lock (m_shared_pixels_mutex);
+    SharedTilePixelsMap::iterator found = m_shared_pixels.find (hash);
+    if (found != m_shared_pixels.end()) {
+        SharedTilePixels *shared = found->second;
+        if (shared->size != size ||
+              memcmp (shared->pixels.get(), pixels.get(), datasize))
+            return NULL;   // Hash collision, keep our own copy
+        ++shared->refcnt;
+        ++m_stat_shared_tiles;
+        m_stat_shared_bytes += size;
+        pixels.reset ();
+        return shared;
+    }
+    SharedTilePixels *shared = new SharedTilePixels;
+    shared->pixels.swap (pixels);
+    shared->size = size;
+    shared->hash = hash;
+    shared->refcnt = 1;
+    m_shared_pixels[hash] = shared;
+    incr_mem (size);
+    return shared;
+}
+
+
+
+void
+ImageCacheImpl::release_tile_pixels (SharedTilePixels *shared)
+{
+    {
+        spin_lock lock (m_shared_pixels_mutex);
+        if (--shared->refcnt) {
+            m_stat_shared_bytes -= shared->size;
+            return;
+        }
+        m_shared_pixels.erase (shared->hash);
+    }
+    m_mem_used -= shared->size;
+    delete shared;
+}
+
+
+
 ImageCacheTile::ImageCacheTile (const TileID &id,
                                 ImageCachePerThreadInfo *thread_info,
                                 bool read_now)
-    : m_id (id), m_valid(true) // , m_used(true)
+    : m_id (id), m_shared(NULL), m_data(NULL), m_valid(true),
+      m_constant(false) // , m_used(true)
 {
     m_used = true;
     m_pixels_ready = false;
@@ -1285,7 +1653,7 @@ ImageCacheTile::ImageCacheTile (const TileID &id,
 ImageCacheTile::ImageCacheTile (const TileID &id, const void *pels,
                     TypeDesc format,
                     stride_t xstride, stride_t ystride, stride_t zstride)
-    : m_id (id) // , m_used(true)
+    : m_id (id), m_shared(NULL), m_data(NULL), m_constant(false) // , m_used(true)
 {
     m_used = true;
     m_pixels_size = 0;
@@ -1301,7 +1669,12 @@ ImageCacheTile::ImageCacheTile (const TileID &id, const void *pels,
                              zstride, &m_pixels[0], file.datatype(id.subimage()),
                              dst_pelsize, dst_pelsize * spec.tile_width,
                              dst_pelsize * spec.tile_width * spec.tile_height);
-    id.file().imagecache().incr_tiles (size);
+    if (m_valid && file.scan_constant_tiles())
+        shrink_if_constant ();
+    if (m_valid && ! m_constant && file.imagecache().deduplicate_tiles())
+        share_pixels ();
+    m_data = m_shared ? m_shared->pixels.get() : m_pixels.get();
+    id.file().imagecache().incr_tiles (m_pixels_size);
     m_pixels_ready = true;  // Caller sent us the pixels, no read necessary
     // FIXME -- for shadow, fill in mindepth, maxdepth
 }
@@ -1311,6 +1684,8 @@ ImageCacheTile::ImageCacheTile (const TileID &id, const void *pels,
 ImageCacheTile::~ImageCacheTile ()
 {
     m_id.file().imagecache().decr_tiles (memsize ());
+    if (m_shared)
+        m_id.file().imagecache().release_tile_pixels (m_shared);
 }
 
 
@@ -1343,7 +1718,12 @@ ImageCacheTile::read (ImageCachePerThreadInfo *thread_info)
     m_valid = file.read_tile (thread_info, m_id.subimage(), m_id.miplevel(),
                               m_id.x(), m_id.y(), m_id.z(),
                               file.datatype(m_id.subimage()), &m_pixels[0]);
-    m_id.file().imagecache().incr_mem (size);
+    if (m_valid && file.scan_constant_tiles())
+        shrink_if_constant ();
+    if (m_valid && ! m_constant && file.imagecache().deduplicate_tiles())
+        share_pixels ();
+    m_data = m_shared ? m_shared->pixels.get() : m_pixels.get();
+    m_id.file().imagecache().incr_mem (m_pixels_size);
     if (! m_valid) {
         m_used = false;  // Don't let it hold mem if invalid
 #if 0
@@ -1360,6 +1740,88 @@ ImageCacheTile::read (ImageCachePerThreadInfo *thread_info)
 
 
 
+void
+ImageCacheTile::shrink_if_constant ()
+{
+    const ImageSpec &spec (file().spec (m_id.subimage(), m_id.miplevel()));
+    size_t pixelsize = file().pixelsize (m_id.subimage());
+    int nx = std::min (spec.tile_width, spec.x + spec.width - m_id.x());
+    int ny = std::min (spec.tile_height, spec.y + spec.height - m_id.y());
+    int nz = std::min (std::max (spec.tile_depth, 1),
+                       spec.z + std::max (spec.depth, 1) - m_id.z());
+    if (nx == spec.tile_width && ny == spec.tile_height &&
+          nz == std::max (spec.tile_depth, 1)) {
+        // The pixels are all the same if and only if the tile equals
+        // itself shifted over by one pixel.
+        size_t n = spec.tile_pixels() - 1;
+        if (memcmp (&m_pixels[0], &m_pixels[pixelsize], n * pixelsize))
+            return;
+    } else {
+        // Edge tile: compare each row of the part within the image to
+        // itself shifted by one pixel, and to the first pixel.
+        for (int z = 0;  z < nz;  ++z) {
+            for (int y = 0;  y < ny;  ++y) {
+                const char *row = &m_pixels[((size_t(z) * spec.tile_height + y)
+                                             * spec.tile_width) * pixelsize];
+                if (memcmp (row, &m_pixels[0], pixelsize) ||
+                    memcmp (row, row + pixelsize, (nx-1) * pixelsize))
+                    return;
+            }
+        }
+    }
+    size_t size = pixelsize + OIIO_SIMD_MAX_SIZE_BYTES;
+    boost::scoped_array<char> pixel (new char [size]);
+    memcpy (&pixel[0], &m_pixels[0], pixelsize);
+    memset (&pixel[pixelsize], 0, OIIO_SIMD_MAX_SIZE_BYTES);
+    m_pixels.swap (pixel);
+    m_pixels_size = size;
+    m_constant = true;
+    file().imagecache().incr_constant_tiles ();
+}
+
+
+
+void
+ImageCacheTile::share_pixels ()
+{
+    SharedTilePixels *shared =
+        file().imagecache().share_tile_pixels (m_pixels, m_pixels_size);
+    if (shared) {
+        // Either way, the memory is now accounted to the shared copy
+        m_shared = shared;
+        m_pixels_size = 0;
+    }
+}
+
+
+
+const void *
+ImageCacheTile::full_data ()
+{
+    if (! m_constant)
+        return m_data;
+    // Other threads may be reading the single stored pixel, so the
+    // expanded copy goes into a separate buffer that lives as long as
+    // the tile does.  This is rare enough for one lock for all tiles.
+    static spin_mutex expand_mutex;
+    spin_lock lock (expand_mutex);
+    if (! m_expanded) {
+        const ImageSpec &spec (file().spec (m_id.subimage(), m_id.miplevel()));
+        size_t pixelsize = file().pixelsize (m_id.subimage());
+        size_t size = memsize_needed ();
+        m_expanded.reset (new char [size]);
+        char *p = &m_expanded[0];
+        for (size_t i = 0, n = spec.tile_pixels();  i < n;  ++i, p += pixelsize)
+            memcpy (p, m_data, pixelsize);
+        memset (p, 0, size - spec.tile_pixels() * pixelsize);
+        m_pixels_size += size;
+        file().imagecache().incr_mem (size);
+    }
+    return &m_expanded[0];
+}
+
+
+
 void
 ImageCacheTile::wait_pixels_ready () const
 {
@@ -1384,8 +1846,10 @@ ImageCacheTile::data (int x, int y, int z) const
     z -= m_id.z();
     if (x < 0 || x >= (int)w || y < 0 || y >= (int)h || z < 0 || z >= (int)d)
         return NULL;
+    if (m_constant)
+        return (const void *)m_data;
     size_t offset = ((z * h + y) * w + x) * m_id.file().pixelsize(m_id.subimage());
-    return (const void *)&m_pixels[offset];
+    return (const void *)(m_data + offset);
 }
 
 
@@ -1402,6 +1866,11 @@ void
 ImageCacheImpl::init ()
 {
     m_max_open_files = 100;
+    m_max_open_files_soft = 0;
+    m_async_file_close = true;
+    m_file_use_counter = 0;
+    m_janitor_wake = 0;
+    m_janitor_quit = false;
     m_max_memory_bytes = 256 * 1024 * 1024;   // 256 MB default cache size
     m_autotile = 0;
     m_autoscanline = false;
@@ -1412,6 +1881,8 @@ ImageCacheImpl::init ()
     m_read_before_insert = false;
     m_deduplicate = true;
     m_unassociatedalpha = false;
+    m_detect_constant_tiles = true;
+    m_deduplicate_tiles = false;
     m_failure_retries = 0;
     m_latlong_y_up_default = true;
     m_Mw2c.makeIdentity();
@@ -1423,6 +1894,14 @@ ImageCacheImpl::init ()
     m_stat_open_files_created = 0;
     m_stat_open_files_current = 0;
     m_stat_open_files_peak = 0;
+    m_stat_constant_tiles = 0;
+    m_stat_janitor_closes = 0;
+    m_stat_shared_tiles = 0;
+    m_stat_shared_bytes = 0;
+    m_stat_prefetch_opens = 0;
+    m_stat_spec_index_hits = 0;
+    m_stat_spec_index_misses = 0;
+    m_spec_index_dirty = false;
 
     // Allow environment variable to override default options
     const char *options = getenv ("OPENIMAGEIO_IMAGECACHE_OPTIONS");
@@ -1434,8 +1913,387 @@ ImageCacheImpl::init ()
 
 ImageCacheImpl::~ImageCacheImpl ()
 {
+    stop_file_janitor ();
     printstats ();
     erase_perthread_info ();
+    lock_guard lock (m_spec_index_mutex);
+    spec_index_write ();
+}
+
+
+
+// Helpers for reading and writing the persistent spec index.  The file
+// is only meant to be read back by the same build on the same machine,
+// so everything is written raw, in native byte order.
+static const char spec_index_magic[] = "OIIOspx1";
+
+template<typename T>
+static void
+spx_put (FILE *f, const T &val)
+{
+    fwrite (&val, sizeof(T), 1, f);
+}
+
+template<typename T>
+static bool
+spx_get (FILE *f, T &val)
+{
+    return fread (&val, sizeof(T), 1, f) == 1;
+}
+
+static void
+spx_put_string (FILE *f, string_view s)
+{
+    spx_put (f, (uint32_t) s.size());
+    fwrite (s.data(), 1, s.size(), f);
+}
+
+static bool
+spx_get_string (FILE *f, std::string &s)
+{
+    uint32_t len = 0;
+    if (! spx_get (f, len) || len > (1<<24))
+        return false;
+    s.resize (len);
+    return len == 0 || fread (&s[0], 1, len, f) == len;
+}
+
+static void
+spx_put_type (FILE *f, TypeDesc t)
+{
+    spx_put (f, t.basetype);
+    spx_put (f, t.aggregate);
+    spx_put (f, t.vecsemantics);
+    spx_put (f, t.arraylen);
+}
+
+static bool
+spx_get_type (FILE *f, TypeDesc &t)
+{
+    t = TypeDesc();
+    return spx_get (f, t.basetype) && spx_get (f, t.aggregate) &&
+           spx_get (f, t.vecsemantics) && spx_get (f, t.arraylen);
+}
+
+static void
+spx_put_spec (FILE *f, const ImageSpec &spec)
+{
+    int ints[] = { spec.x, spec.y, spec.z, spec.width, spec.height,
+                   spec.depth, spec.full_x, spec.full_y, spec.full_z,
+                   spec.full_width, spec.full_height, spec.full_depth,
+                   spec.tile_width, spec.tile_height, spec.tile_depth,
+                   spec.nchannels, spec.alpha_channel, spec.z_channel,
+                   spec.deep };
+    fwrite (ints, sizeof(ints), 1, f);
+    spx_put_type (f, spec.format);
+    spx_put (f, (uint32_t) spec.channelformats.size());
+    for (size_t c = 0;  c < spec.channelformats.size();  ++c)
+        spx_put_type (f, spec.channelformats[c]);
+    spx_put (f, (uint32_t) spec.channelnames.size());
+    for (size_t c = 0;  c < spec.channelnames.size();  ++c)
+        spx_put_string (f, spec.channelnames[c]);
+    spx_put (f, (uint32_t) spec.extra_attribs.size());
+    for (size_t i = 0;  i < spec.extra_attribs.size();  ++i) {
+        const ImageIOParameter &p (spec.extra_attribs[i]);
+        spx_put_string (f, p.name());
+        spx_put_type (f, p.type());
+        spx_put (f, p.nvalues());
+        if (p.type().basetype == TypeDesc::STRING) {
+            // Strings are stored as pointers, write out the characters
+            const ustring *s = (const ustring *) p.data();
+            size_t n = p.nvalues() * p.type().numelements();
+            for (size_t j = 0;  j < n;  ++j)
+                spx_put_string (f, s[j]);
+        } else {
+            fwrite (p.data(), 1, p.datasize(), f);
+        }
+    }
+}
+
+static bool
+spx_get_spec (FILE *f, ImageSpec &spec)
+{
+    int ints[19];
+    if (fread (ints, sizeof(ints), 1, f) != 1)
+        return false;
+    spec.x = ints[0];  spec.y = ints[1];  spec.z = ints[2];
+    spec.width = ints[3];  spec.height = ints[4];  spec.depth = ints[5];
+    spec.full_x = ints[6];  spec.full_y = ints[7];  spec.full_z = ints[8];
+    spec.full_width = ints[9];  spec.full_height = ints[10];
+    spec.full_depth = ints[11];
+    spec.tile_width = ints[12];  spec.tile_height = ints[13];
+    spec.tile_depth = ints[14];
+    spec.nchannels = ints[15];
+    spec.alpha_channel = ints[16];
+    spec.z_channel = ints[17];
+    spec.deep = (ints[18] != 0);
+    uint32_t n = 0;
+    if (! spx_get_type (f, spec.format) || ! spx_get (f, n) || n > (1<<16))
+        return false;
+    spec.channelformats.resize (n);
+    for (uint32_t c = 0;  c < n;  ++c)
+        if (! spx_get_type (f, spec.channelformats[c]))
+            return false;
+    if (! spx_get (f, n) || n > (1<<16))
+        return false;
+    spec.channelnames.resize (n);
+    for (uint32_t c = 0;  c < n;  ++c)
+        if (! spx_get_string (f, spec.channelnames[c]))
+            return false;
+    if (! spx_get (f, n) || n > (1<<16))
+        return false;
+    spec.extra_attribs.clear ();
+    std::string name;
+    std::vector<char> data;
+    for (uint32_t i = 0;  i < n;  ++i) {
+        TypeDesc type;
+        int nvalues = 0;
+        if (! spx_get_string (f, name) || ! spx_get_type (f, type) ||
+            ! spx_get (f, nvalues) || nvalues < 0)
+            return false;
+        if (type.basetype == TypeDesc::STRING) {
+            size_t nstrings = nvalues * type.numelements();
+            std::vector<ustring> strings (nstrings);
+            std::string s;
+            for (size_t j = 0;  j < nstrings;  ++j) {
+                if (! spx_get_string (f, s))
+                    return false;
+                strings[j] = ustring (s);
+            }
+            spec.extra_attribs.push_back (ImageIOParameter (name, type,
+                                   nvalues, nstrings ? &strings[0] : NULL));
+        } else {
+            size_t size = nvalues * type.size();
+            if (size > (1<<24))
+                return false;
+            data.resize (std::max (size, size_t(1)));
+            if (size && fread (&data[0], 1, size, f) != size)
+                return false;
+            spec.extra_attribs.push_back (ImageIOParameter (name, type,
+                                   nvalues, &data[0]));
+        }
+    }
+    return true;
+}
+
+
+
+bool
+ImageCacheImpl::spec_index_find (ustring filename, ustring &fileformat,
+                                 ImageCacheFile::NativeSpecs &specs)
+{
+    if (m_spec_index_filename.empty())
+        return false;
+    SpecIndexEntry entry;
+    {
+        lock_guard lock (m_spec_index_mutex);
+        SpecIndexMap::const_iterator found = m_spec_index.find (filename);
+        if (found == m_spec_index.end()) {
+            ++m_stat_spec_index_misses;
+            return false;
+        }
+        entry = found->second;
+    }
+    // Make sure the file hasn't changed since it was indexed.  Don't hold
+    // the lock for this, it's a trip to the disk.
+    if (entry.unassociatedalpha != m_unassociatedalpha ||
+        entry.mtime != Filesystem::last_write_time (filename.string()) ||
+        entry.size != Filesystem::file_size (filename.string())) {
+        ++m_stat_spec_index_misses;
+        return false;
+    }
+    fileformat = entry.fileformat;
+    specs.swap (entry.specs);
+    ++m_stat_spec_index_hits;
+    return true;
+}
+
+
+
+void
+ImageCacheImpl::spec_index_add (ustring filename, ustring fileformat,
+                                const ImageCacheFile::NativeSpecs &specs)
+{
+    if (m_spec_index_filename.empty())
+        return;
+    SpecIndexEntry entry;
+    entry.mtime = Filesystem::last_write_time (filename.string());
+    entry.size = Filesystem::file_size (filename.string());
+    entry.unassociatedalpha = m_unassociatedalpha;
+    entry.added = true;
+    entry.fileformat = fileformat;
+    entry.specs = specs;
+    lock_guard lock (m_spec_index_mutex);
+    m_spec_index[filename] = entry;
+    m_spec_index_dirty = true;
+}
+
+
+
+bool
+ImageCacheImpl::spec_index_load (const std::string &indexfilename,
+                                 SpecIndexMap &index)
+{
+    index.clear ();
+    FILE *f = Filesystem::fopen (indexfilename, "rb");
+    if (! f)
+        return false;
+    char magic[sizeof(spec_index_magic)];
+    bool ok = (fread (magic, sizeof(magic), 1, f) == 1 &&
+               ! memcmp (magic, spec_index_magic, sizeof(magic)));
+    uint32_t nentries = 0;
+    ok = ok && spx_get (f, nentries);
+    std::string s;
+    for (uint32_t e = 0;  ok && e < nentries;  ++e) {
+        SpecIndexEntry entry;
+        uint8_t unassoc = 0;
+        uint32_t nsubimages = 0;
+        ok = spx_get_string (f, s) && spx_get (f, entry.mtime) &&
+             spx_get (f, entry.size) && spx_get (f, unassoc);
+        ustring filename (s);
+        ok = ok && spx_get_string (f, s) && spx_get (f, nsubimages);
+        entry.unassociatedalpha = unassoc;
+        entry.added = false;
+        entry.fileformat = ustring (s);
+        entry.specs.resize (nsubimages);
+        for (uint32_t i = 0;  ok && i < nsubimages;  ++i) {
+            uint32_t nlevels = 0;
+            ok = spx_get (f, nlevels) && nlevels > 0;
+            if (ok)
+                entry.specs[i].resize (nlevels);
+            for (uint32_t m = 0;  ok && m < nlevels;  ++m)
+                ok = spx_get_spec (f, entry.specs[i][m]);
+        }
+        if (ok && nsubimages)
+            index[filename] = entry;
+    }
+    fclose (f);
+    if (! ok)
+        index.clear ();
+    return ok;
+}
+
+
+
+void
+ImageCacheImpl::spec_index_read (const std::string &indexfilename)
+{
+    m_spec_index.clear ();
+    m_spec_index_dirty = false;
+    m_spec_index_filename = indexfilename;
+    if (indexfilename.empty() || ! Filesystem::exists (indexfilename))
+        return;
+    if (! spec_index_load (indexfilename, m_spec_index)) {
+        // A corrupt or outdated index is not fatal -- we just lose the
+        // entries we couldn't read, and write a fresh one later.
+        error ("Spec index \"%s\" is corrupt, ignoring it", indexfilename);
+    }
+}
+
+
+
+// Exclusive advisory lock on a file (created if need be), held for the
+// lifetime of the object.  It only serializes processes that use the
+// same lock file; if the file can't be created or locked, we go ahead
+// unlocked rather than fail.
+class SpecIndexFileLock {
+public:
+    SpecIndexFileLock (const std::string &filename) {
+#ifdef _WIN32
+        std::wstring wname = Strutil::utf8_to_utf16 (filename);
+        m_handle = CreateFileW (wname.c_str(), GENERIC_READ | GENERIC_WRITE,
+                                FILE_SHARE_READ | FILE_SHARE_WRITE, NULL,
+                                OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+        if (m_handle != INVALID_HANDLE_VALUE) {
+            OVERLAPPED overlapped;
+            memset (&overlapped, 0, sizeof(overlapped));
+            LockFileEx (m_handle, LOCKFILE_EXCLUSIVE_LOCK, 0, 1, 0, &overlapped);
+        }
+#else
+        m_fd = ::open (filename.c_str(), O_RDWR | O_CREAT, 0666);
+        if (m_fd >= 0)
+            while (flock (m_fd, LOCK_EX) < 0 && errno == EINTR)
+                ;
+#endif
+    }
+    ~SpecIndexFileLock () {
+        // Closing the file releases the lock
+#ifdef _WIN32
+        if (m_handle != INVALID_HANDLE_VALUE)
+            CloseHandle (m_handle);
+#else
+        if (m_fd >= 0)
+            ::close (m_fd);
+#endif
+    }
+private:
+#ifdef _WIN32
+    HANDLE m_handle;
+#else
+    int m_fd;
+#endif
+};
+
+
+
+void
+ImageCacheImpl::spec_index_write ()
+{
+    if (! m_spec_index_dirty || m_spec_index_filename.empty())
+        return;
+    m_spec_index_dirty = false;
+
+    // Several processes (for example concurrent "maketx --update-index"
+    // jobs) may share one index.  While holding a lock on it, merge the
+    // entries we've added into what's in the file now, so that we don't
+    // drop anybody else's additions, then write to a uniquely named
+    // temporary file and rename it into place, so that readers never
+    // see a partially-written index.
+    SpecIndexFileLock filelock (m_spec_index_filename + ".lock");
+    SpecIndexMap merged;
+    if (Filesystem::exists (m_spec_index_filename))
+        spec_index_load (m_spec_index_filename, merged);
+    for (SpecIndexMap::iterator i = m_spec_index.begin();
+         i != m_spec_index.end();  ++i) {
+        if (i->second.added || merged.find (i->first) == merged.end()) {
+            SpecIndexEntry &entry (merged[i->first]);
+            entry = i->second;
+            entry.added = false;
+        }
+    }
+    m_spec_index.swap (merged);
+
+    std::string tmpname = m_spec_index_filename + "." +
+                          Filesystem::unique_path ("%%%%-%%%%-%%%%.tmp");
+    FILE *f = Filesystem::fopen (tmpname, "wb");
+    if (! f) {
+        error ("Could not write spec index \"%s\"", tmpname);
+        return;
+    }
+    fwrite (spec_index_magic, sizeof(spec_index_magic), 1, f);
+    spx_put (f, (uint32_t) m_spec_index.size());
+    for (SpecIndexMap::const_iterator i = m_spec_index.begin();
+         i != m_spec_index.end();  ++i) {
+        const SpecIndexEntry &entry (i->second);
+        spx_put_string (f, i->first);
+        spx_put (f, entry.mtime);
+        spx_put (f, entry.size);
+        spx_put (f, (uint8_t) entry.unassociatedalpha);
+        spx_put_string (f, entry.fileformat);
+        spx_put (f, (uint32_t) entry.specs.size());
+        for (size_t s = 0;  s < entry.specs.size();  ++s) {
+            spx_put (f, (uint32_t) entry.specs[s].size());
+            for (size_t m = 0;  m < entry.specs[s].size();  ++m)
+                spx_put_spec (f, entry.specs[s][m]);
+        }
+    }
+    bool ok = ! ferror (f);
+    fclose (f);
+    std::string err;
+    if (! ok || ! Filesystem::rename (tmpname, m_spec_index_filename, err)) {
+        error ("Could not write spec index \"%s\"", m_spec_index_filename);
+        Filesystem::remove (tmpname, err);
+    }
 }
 
 
@@ -1445,8 +2303,10 @@ ImageCacheImpl::mergestats (ImageCacheStatistics &stats) const
 {
     stats.init ();
     spin_lock lock (m_perthread_info_mutex);
+    stats.merge (m_retired_stats);
     for (size_t i = 0;  i < m_all_perthread_info.size();  ++i)
-        stats.merge (m_all_perthread_info[i]->m_stats);
+        if (m_all_perthread_info[i])
+            stats.merge (m_all_perthread_info[i]->m_stats);
 }
 
 
@@ -1552,6 +2412,10 @@ ImageCacheImpl::getstats (int level) const
         } else {
             out << "  No images opened\n";
         }
+        if (m_spec_index_filename.size())
+            out << "    Spec index : " << m_stat_spec_index_hits << " hits, "
+                << m_stat_spec_index_misses << " misses ("
+                << m_spec_index_filename << ")\n";
         if (stats.find_file_time > 0.001)
             out << "    Find file time : " << Strutil::timeintervalformat (stats.find_file_time) << "\n";
         if (stats.fileio_time > 0.001) {
@@ -1559,7 +2423,9 @@ ImageCacheImpl::getstats (int level) const
                 << Strutil::timeintervalformat (stats.fileio_time);
             {
                 spin_lock lock (m_perthread_info_mutex);
-                size_t nthreads = m_all_perthread_info.size();
+                size_t nthreads = 0;
+                for (size_t i = 0;  i < m_all_perthread_info.size();  ++i)
+                    nthreads += (m_all_perthread_info[i] != NULL);
                 if (nthreads > 1) {
                     double perthreadtime = stats.fileio_time / (float)nthreads;
                     out << " (" << Strutil::timeintervalformat (perthreadtime)
@@ -1570,6 +2436,13 @@ ImageCacheImpl::getstats (int level) const
             out << "    File open time only : " 
                 << Strutil::timeintervalformat (stats.fileopen_time) << "\n";
         }
+        if (stats.fileclose_time > 0.001 || stats.filereopen_time > 0.001)
+            out << "    Blocked closing / reopening files : "
+                << Strutil::timeintervalformat (stats.fileclose_time) << " / "
+                << Strutil::timeintervalformat (stats.filereopen_time) << "\n";
+        if (m_stat_janitor_closes || m_stat_prefetch_opens)
+            out << "    Background file closes : " << m_stat_janitor_closes
+                << ", prefetch opens : " << m_stat_prefetch_opens << "\n";
         if (stats.file_locking_time > 0.001)
             out << "    File mutex locking time : " << Strutil::timeintervalformat (stats.file_locking_time) << "\n";
         if (m_stat_tiles_created > 0) {
@@ -1577,6 +2450,12 @@ ImageCacheImpl::getstats (int level) const
             out << "    total tile requests : " << stats.find_tile_calls << "\n";
             out << "    micro-cache misses : " << stats.find_tile_microcache_misses << " (" << 100.0*(double)stats.find_tile_microcache_misses/(double)stats.find_tile_calls << "%)\n";
             out << "    main cache misses : " << stats.find_tile_cache_misses << " (" << 100.0*(double)stats.find_tile_cache_misses/(double)stats.find_tile_calls << "%)\n";
+            if (m_stat_constant_tiles)
+                out << "    constant tiles : " << m_stat_constant_tiles << " (" << 100.0*(double)m_stat_constant_tiles/(double)m_stat_tiles_created << "%)\n";
+            if (m_stat_shared_tiles)
+                out << "    duplicate tiles shared : " << m_stat_shared_tiles
+                    << " (" << Strutil::memformat (m_stat_shared_bytes)
+                    << " currently saved)\n";
         }
         out << "    Peak cache memory : " << Strutil::memformat (m_mem_used) << "\n";
         if (stats.tile_locking_time > 0.001)
@@ -1604,6 +2483,8 @@ ImageCacheImpl::getstats (int level) const
             total_tiles += file->tilesread();
             total_bytes += file->bytesread();
             total_iotime += file->iotime();
+            if (file->is_udim())
+                continue;
             if (file->duplicate()) {
                 ++total_duplicates;
                 continue;
@@ -1629,6 +2510,14 @@ ImageCacheImpl::getstats (int level) const
         for (size_t i = 0;  i < files.size();  ++i) {
             const ImageCacheFileRef &file (files[i]);
             ASSERT (file);
+            if (file->is_udim()) {
+                int ntiles = 0;
+                for (size_t t = 0;  t < file->m_udim_lookup.size();  ++t)
+                    ntiles += (file->m_udim_lookup[t] != NULL);
+                out << Strutil::format ("  UDIM  %-50s", Strutil::format ("%d tiles", ntiles))
+                    << file->filename() << "\n";
+                continue;
+            }
             if (file->broken() || file->subimages() == 0) {
                 out << "  BROKEN                                                  " 
                     << file->filename() << "\n";
@@ -1728,8 +2617,10 @@ ImageCacheImpl::reset_stats ()
 {
     {
         spin_lock lock (m_perthread_info_mutex);
+        m_retired_stats.init ();
         for (size_t i = 0;  i < m_all_perthread_info.size();  ++i)
-            m_all_perthread_info[i]->m_stats.init ();
+            if (m_all_perthread_info[i])
+                m_all_perthread_info[i]->m_stats.init ();
     }
 
     {
@@ -1757,6 +2648,12 @@ ImageCacheImpl::attribute (string_view name, TypeDesc type,
     if (name == "max_open_files" && type == TypeDesc::INT) {
         m_max_open_files = *(const int *)val;
     }
+    else if (name == "max_open_files_soft" && type == TypeDesc::INT) {
+        m_max_open_files_soft = *(const int *)val;
+    }
+    else if (name == "async_file_close" && type == TypeDesc::INT) {
+        m_async_file_close = *(const int *)val;
+    }
     else if (name == "max_memory_MB" && type == TypeDesc::FLOAT) {
         float size = *(const float *)val;
 #ifdef NDEBUG
@@ -1860,6 +2757,16 @@ ImageCacheImpl::attribute (string_view name, TypeDesc type,
             do_invalidate = true;
         }
     }
+    else if (name == "detect_constant_tiles" && type == TypeDesc::INT) {
+        int r = *(const int *)val;
+        if (r != m_detect_constant_tiles) {
+            m_detect_constant_tiles = r;
+            do_invalidate = true;
+        }
+    }
+    else if (name == "deduplicate_tiles" && type == TypeDesc::INT) {
+        m_deduplicate_tiles = *(const int *)val;
+    }
     else if (name == "failure_retries" && type == TypeDesc::INT) {
         m_failure_retries = *(const int *)val;
     }
@@ -1872,6 +2779,14 @@ ImageCacheImpl::attribute (string_view name, TypeDesc type,
     } else if (name == "substitute_image" && type == TypeDesc::STRING) {
         m_substitute_image = ustring (*(const char **)val);
         do_invalidate = true;
+    } else if (name == "spec_index" && type == TypeDesc::STRING) {
+        // Flush any changes to the old index, then switch to the new one.
+        // Setting the same name again just flushes.
+        std::string filename (*(const char **)val);
+        lock_guard lock (m_spec_index_mutex);
+        spec_index_write ();
+        if (filename != m_spec_index_filename)
+            spec_index_read (filename);
     } else {
         // Otherwise, unknown name
         return false;
@@ -1895,6 +2810,8 @@ ImageCacheImpl::getattribute (string_view name, TypeDesc type,
     }
 
     ATTR_DECODE ("max_open_files", int, m_max_open_files);
+    ATTR_DECODE ("max_open_files_soft", int, max_open_files_soft());
+    ATTR_DECODE ("async_file_close", int, m_async_file_close);
     ATTR_DECODE ("max_memory_MB", float, m_max_memory_bytes/(1024.0*1024.0));
     ATTR_DECODE ("max_memory_MB", int, m_max_memory_bytes/(1024*1024));
     ATTR_DECODE ("statistics:level", int, m_statslevel);
@@ -1907,6 +2824,8 @@ ImageCacheImpl::getattribute (string_view name, TypeDesc type,
     ATTR_DECODE ("read_before_insert", int, m_read_before_insert);
     ATTR_DECODE ("deduplicate", int, m_deduplicate);
     ATTR_DECODE ("unassociatedalpha", int, m_unassociatedalpha);
+    ATTR_DECODE ("detect_constant_tiles", int, m_detect_constant_tiles);
+    ATTR_DECODE ("deduplicate_tiles", int, m_deduplicate_tiles);
     ATTR_DECODE ("failure_retries", int, m_failure_retries);
 
     // The cases that don't fit in the simple ATTR_DECODE scheme
@@ -1936,6 +2855,10 @@ ImageCacheImpl::getattribute (string_view name, TypeDesc type,
         *(const char **)val = m_substitute_image.c_str();
         return true;
     }
+    if (name == "spec_index" && type == TypeDesc::STRING) {
+        *(const char **)val = ustring(m_spec_index_filename).c_str();
+        return true;
+    }
 
     // Stats we can just grab
     ATTR_DECODE ("stat:cache_memory_used", long long, m_mem_used);
@@ -1945,6 +2868,13 @@ ImageCacheImpl::getattribute (string_view name, TypeDesc type,
     ATTR_DECODE ("stat:open_files_created", int, m_stat_open_files_created);
     ATTR_DECODE ("stat:open_files_current", int, m_stat_open_files_current);
     ATTR_DECODE ("stat:open_files_peak", int, m_stat_open_files_peak);
+    ATTR_DECODE ("stat:constant_tiles", int, m_stat_constant_tiles);
+    ATTR_DECODE ("stat:janitor_closes", int, m_stat_janitor_closes);
+    ATTR_DECODE ("stat:shared_tiles", int, m_stat_shared_tiles);
+    ATTR_DECODE ("stat:shared_tile_bytes", long long, m_stat_shared_bytes);
+    ATTR_DECODE ("stat:prefetch_opens", int, m_stat_prefetch_opens);
+    ATTR_DECODE ("stat:spec_index_hits", int, m_stat_spec_index_hits);
+    ATTR_DECODE ("stat:spec_index_misses", int, m_stat_spec_index_misses);
 
     if (boost::algorithm::starts_with(name, "stat:")) {
         // All the other stats are those that need to be summed from all
@@ -1954,11 +2884,14 @@ ImageCacheImpl::getattribute (string_view name, TypeDesc type,
         ATTR_DECODE ("stat:find_tile_calls", long long, stats.find_tile_calls);
         ATTR_DECODE ("stat:find_tile_microcache_misses", long long, stats.find_tile_microcache_misses);
         ATTR_DECODE ("stat:find_tile_cache_misses", int, stats.find_tile_cache_misses);
+        ATTR_DECODE ("stat:aniso_probes", long long, stats.aniso_probes);
         ATTR_DECODE ("stat:files_totalsize", long long, stats.files_totalsize);
         ATTR_DECODE ("stat:bytes_read", long long, stats.bytes_read);
         ATTR_DECODE ("stat:unique_files", int, stats.unique_files);
         ATTR_DECODE ("stat:fileio_time", float, stats.fileio_time);
         ATTR_DECODE ("stat:fileopen_time", float, stats.fileopen_time);
+        ATTR_DECODE ("stat:fileclose_time", float, stats.fileclose_time);
+        ATTR_DECODE ("stat:filereopen_time", float, stats.filereopen_time);
         ATTR_DECODE ("stat:file_locking_time", float, stats.file_locking_time);
         ATTR_DECODE ("stat:tile_locking_time", float, stats.tile_locking_time);
         ATTR_DECODE ("stat:find_file_time", float, stats.find_file_time);
@@ -2510,6 +3443,32 @@ ImageCacheImpl::get_pixels (ustring filename,
 
 
 
+namespace {
+
+// One band of a multithreaded get_pixels.
+struct GetPixelBlocksBand {
+    ImageCacheImpl *ic;
+    ImageCacheFile *file;
+    ImageCachePerThreadInfo *thread_info;
+    int subimage, miplevel;
+    int xbegin, xend, ybegin, yend, zbegin, zend, chbegin, chend;
+    TypeDesc format;
+    void *result;
+    stride_t xstride, ystride, zstride;
+    char *ok;
+
+    void operator() () {
+        *ok = ic->get_pixel_blocks (file, thread_info, subimage, miplevel,
+                                    xbegin, xend, ybegin, yend, zbegin, zend,
+                                    chbegin, chend, format, result,
+                                    xstride, ystride, zstride);
+    }
+};
+
+}  // anonymous namespace
+
+
+
 bool
 ImageCacheImpl::get_pixels (ImageCacheFile *file,
                             ImageCachePerThreadInfo *thread_info,
@@ -2537,10 +3496,7 @@ ImageCacheImpl::get_pixels (ImageCacheFile *file,
         return false;
     }
 
-    if (! thread_info)
-        thread_info = get_perthread_info ();
     const ImageSpec &spec (file->spec(subimage, miplevel));
-    bool ok = true;
 
     // Compute channels and stride if not given (assume all channels,
     // contiguous data layout for strides).
@@ -2552,107 +3508,172 @@ ImageCacheImpl::get_pixels (ImageCacheFile *file,
     ImageSpec::auto_stride (xstride, ystride, zstride, format, nchans,
                             xend-xbegin, yend-ybegin);
 
-    // formatpixelsize, scanlinesize, and zplanesize assume contiguous
-    // layout.  This may or may not be the same as the strides passed by
-    // the caller.
+    // Big regions that span several rows of tiles are split into bands
+    // of whole tile rows, each handled by its own thread (with its own
+    // per-thread info, so the microcaches don't collide).  Different
+    // threads then page in different tiles at the same time.  The calling
+    // thread does the last band itself, with its own per-thread info.
+    int nthreads = 1;
+    OIIO::getattribute ("threads", nthreads);
+    imagesize_t npixels = imagesize_t(xend-xbegin) * imagesize_t(yend-ybegin)
+                        * imagesize_t(zend-zbegin);
+    // Count the tile rows from the start of the tile holding ybegin, since
+    // the bands are split on tile boundaries.
+    int ytile = (ybegin - spec.y) % spec.tile_height;
+    if (ytile < 0)
+        ytile += spec.tile_height;
+    ytile = ybegin - ytile;
+    int tilerows = (yend - ytile + spec.tile_height - 1) / spec.tile_height;
+    nthreads = std::min (nthreads, tilerows);
+    if (nthreads <= 1 || npixels < 65536 || zend-zbegin != 1)
+        return get_pixel_blocks (file, thread_info, subimage, miplevel,
+                                 xbegin, xend, ybegin, yend, zbegin, zend,
+                                 chbegin, chend, format, result,
+                                 xstride, ystride, zstride);
+
+    int rows_per_band = ((tilerows + nthreads - 1) / nthreads) * spec.tile_height;
+    std::vector<GetPixelBlocksBand> bands;
+    // The first band ends on a tile boundary, the rest start on one.
+    int yband = ybegin;
+    int ybandend = ytile + rows_per_band;
+    while (yband < yend) {
+        ybandend = std::min (ybandend, yend);
+        char *bandresult = (char *)result + (yband - ybegin) * ystride;
+        GetPixelBlocksBand job = { this, file, thread_info, subimage, miplevel,
+                                   xbegin, xend, yband, ybandend, zbegin, zend,
+                                   chbegin, chend, format, bandresult,
+                                   xstride, ystride, zstride, NULL };
+        bands.push_back (job);
+        yband = ybandend;
+        ybandend += rows_per_band;
+    }
+    // The jobs are copied into their threads, so they report back here.
+    std::vector<char> band_ok (bands.size(), 0);
+    for (size_t b = 0;  b < bands.size();  ++b)
+        bands[b].ok = &band_ok[b];
+    boost::thread_group threads;
+    for (size_t b = 0;  b+1 < bands.size();  ++b) {
+        bands[b].thread_info = create_thread_info ();
+        threads.add_thread (new boost::thread (bands[b]));
+    }
+    bands.back() ();
+    threads.join_all ();
+
+    // Destroying the band infos keeps their statistics and frees their
+    // slots for the next call.
+    bool ok = true;
+    for (size_t b = 0;  b < bands.size();  ++b) {
+        ok &= band_ok[b];
+        if (bands[b].thread_info != thread_info)
+            destroy_thread_info (bands[b].thread_info);
+    }
+    return ok;
+}
+
+
+
+// Zero an nx by ny block of pixels with the given strides.
+static void
+zero_pixel_block (char *ptr, int nx, int ny, stride_t pixelsize,
+                  stride_t xstride, stride_t ystride)
+{
+    for (int y = 0;  y < ny;  ++y, ptr += ystride) {
+        if (xstride == pixelsize) {
+            memset (ptr, 0, nx * pixelsize);
+        } else {
+            char *xptr = ptr;
+            for (int x = 0;  x < nx;  ++x, xptr += xstride)
+                memset (xptr, 0, pixelsize);
+        }
+    }
+}
+
+
+
+bool
+ImageCacheImpl::get_pixel_blocks (ImageCacheFile *file,
+                                  ImageCachePerThreadInfo *thread_info,
+                                  int subimage, int miplevel,
+                                  int xbegin, int xend, int ybegin, int yend,
+                                  int zbegin, int zend, int chbegin, int chend,
+                                  TypeDesc format, void *result,
+                                  stride_t xstride, stride_t ystride,
+                                  stride_t zstride)
+{
+    const ImageSpec &spec (file->spec(subimage, miplevel));
+    int nchans = chend - chbegin;
     TypeDesc cachetype = file->datatype(subimage);
     const size_t cachesize = cachetype.size();
-    const stride_t cache_stride = cachesize * spec.nchannels;
-    size_t formatsize = format.size();
-    stride_t formatpixelsize = nchans * formatsize;
-    bool xcontig = (formatpixelsize == xstride && nchans == spec.nchannels);
-    stride_t scanlinesize = (xend-xbegin) * formatpixelsize;
-    stride_t zplanesize = (yend-ybegin) * scanlinesize;
+    const stride_t cache_xstride = file->pixelsize (subimage);
+    const stride_t cache_ystride = cache_xstride * spec.tile_width;
+    const stride_t formatpixelsize = nchans * format.size();
     DASSERT (spec.depth >= 1 && spec.tile_depth >= 1);
 
+    // The part of the requested x range that lies within the data window
+    int xdbegin = std::max (xbegin, spec.x);
+    int xdend = std::min (xend, spec.x+spec.width);
+    if (xdbegin >= xdend)
+        xdbegin = xdend = xend;   // it's all outside
+
     char *zptr = (char *)result;
     for (int z = zbegin;  z < zend;  ++z, zptr += zstride) {
         if (z < spec.z || z >= (spec.z+spec.depth)) {
             // nonexistant planes
-            if (xstride == formatpixelsize && ystride == scanlinesize) {
-                // Can zero out the plane in one shot
-                memset (zptr, 0, zplanesize);
-            } else {
-                // Non-contiguous strides -- zero out individual pixels
-                char *yptr = zptr;
-                for (int y = ybegin;  y < yend;  ++y, yptr += ystride) {
-                    char *xptr = yptr;
-                    for (int x = xbegin;  x < xend;  ++x, xptr += xstride)
-                        memset (xptr, 0, formatpixelsize);
-                }
-            }
+            zero_pixel_block (zptr, xend-xbegin, yend-ybegin,
+                              formatpixelsize, xstride, ystride);
             continue;
         }
-        int old_tx = -100000, old_ty = -100000, old_tz = -100000;
         int tz = z - ((z - spec.z) % spec.tile_depth);
         char *yptr = zptr;
-        int ty = ybegin - ((ybegin - spec.y) % spec.tile_height);
-        int tyend = ty + spec.tile_height;
-        for (int y = ybegin;  y < yend;  ++y, yptr += ystride) {
-            if (y == tyend) {
-                ty = tyend;
-                tyend += spec.tile_height;
-            }
+        for (int y = ybegin;  y < yend;  ) {
             if (y < spec.y || y >= (spec.y+spec.height)) {
                 // nonexistant scanlines
-                if (xstride == formatpixelsize) {
-                    // Can zero out the scanline in one shot
-                    memset (yptr, 0, scanlinesize);
-                } else {
-                    // Non-contiguous strides -- zero out individual pixels
-                    char *xptr = yptr;
-                    for (int x = xbegin;  x < xend;  ++x, xptr += xstride)
-                        memset (xptr, 0, formatpixelsize);
-                }
+                zero_pixel_block (yptr, xend-xbegin, 1,
+                                  formatpixelsize, xstride, ystride);
+                ++y;
+                yptr += ystride;
                 continue;
             }
-            // int ty = y - ((y - spec.y) % spec.tile_height);
-            char *xptr = yptr;
-            const char *data = NULL;
-            for (int x = xbegin;  x < xend;  ++x, xptr += xstride) {
-                if (x < spec.x || x >= (spec.x+spec.width)) {
-                    // nonexistant columns
-                    memset (xptr, 0, formatpixelsize);
-                    continue;
-                }
+            // Handle all the scanlines from here to the end of this row
+            // of tiles in one pass.
+            int ty = y - ((y - spec.y) % spec.tile_height);
+            int yspanend = std::min (ty + spec.tile_height,
+                                     std::min (yend, spec.y+spec.height));
+            int nrows = yspanend - y;
+            // nonexistant columns on either side
+            if (xdbegin > xbegin)
+                zero_pixel_block (yptr, xdbegin-xbegin, nrows,
+                                  formatpixelsize, xstride, ystride);
+            if (xend > xdend)
+                zero_pixel_block (yptr + (xdend-xbegin)*xstride, xend-xdend,
+                                  nrows, formatpixelsize, xstride, ystride);
+            // Copy (and convert) the overlap with each tile in this row
+            // as a single 2D block.
+            for (int x = xdbegin;  x < xdend;  ) {
                 int tx = x - ((x - spec.x) % spec.tile_width);
-                if (old_tx != tx || old_ty != ty || old_tz != tz) {
-                    // Only do a find_tile and re-setup of the data
-                    // pointer when we move across a tile boundary.
-                    TileID tileid (*file, subimage, miplevel, tx, ty, tz);
-                    ok &= find_tile (tileid, thread_info);
-                    if (! ok)
-                        return false;  // Just stop if file read failed
-                    old_tx = tx;
-                    old_ty = ty;
-                    old_tz = tz;
-                    data = NULL;
-                }
-                if (! data) {
-                    ImageCacheTileRef &tile (thread_info->tile);
-                    ASSERT (tile);
-                    data = (const char *)tile->data (x, y, z);
-                    ASSERT (data);
-                    data += chbegin*cachesize;
-                }
-                if (xcontig) {
-                    // Special case for a contiguous span within one tile
-                    int spanend = std::min (tx + spec.tile_width, xend);
-                    stride_t span = spanend - x;
-                    convert_types (cachetype, data, format, xptr, nchans*span);
-                    x += (span-1);
-                    xptr += xstride * (span-1);
-                    // no need to increment data, since next read will
-                    // be from a different tile
-                } else {
-                    convert_types (cachetype, data, format, xptr, nchans);
-                    data += cache_stride;
-                }
+                int xspanend = std::min (tx + spec.tile_width, xdend);
+                TileID tileid (*file, subimage, miplevel, tx, ty, tz);
+                if (! find_tile (tileid, thread_info))
+                    return false;  // Just stop if file read failed
+                ImageCacheTileRef &tile (thread_info->tile);
+                ASSERT (tile);
+                const char *data = (const char *)tile->data (x, y, z);
+                ASSERT (data);
+                data += chbegin*cachesize;
+                // A constant tile stores one pixel: just don't advance.
+                bool c = tile->constant();
+                convert_image (nchans, xspanend-x, nrows, 1,
+                               data, cachetype, c ? 0 : cache_xstride,
+                               c ? 0 : cache_ystride, AutoStride,
+                               yptr + (x-xbegin)*xstride, format,
+                               xstride, ystride, AutoStride);
+                x = xspanend;
             }
+            y = yspanend;
+            yptr += nrows * ystride;
         }
     }
-
-    return ok;
+    return true;
 }
 
 
@@ -2718,7 +3739,7 @@ ImageCacheImpl::tile_pixels (ImageCache::Tile *tile, TypeDesc &format) const
         return NULL;
     ImageCacheTile * t = (ImageCacheTile *)tile;
     format = t->file().datatype(t->id().subimage());
-    return t->data ();
+    return t->full_data ();
 }
 
 
@@ -2768,6 +3789,14 @@ ImageCacheImpl::add_tile (ustring filename, int subimage, int miplevel,
 void
 ImageCacheImpl::invalidate (ustring filename)
 {
+    // The file may have changed on disk, so stop trusting any specs that
+    // were indexed for it.
+    if (m_spec_index_filename.size()) {
+        lock_guard lock (m_spec_index_mutex);
+        if (m_spec_index.erase (filename))
+            m_spec_index_dirty = true;
+    }
+
     ImageCacheFile *file = NULL;
     {
         FilenameMap::iterator fileit = m_files.find (filename);
@@ -2890,7 +3919,7 @@ ImageCacheImpl::create_thread_info ()
     ImageCachePerThreadInfo *p = new ImageCachePerThreadInfo;
     // printf ("New perthread %p\n", (void *)p);
     spin_lock lock (m_perthread_info_mutex);
-    m_all_perthread_info.push_back (p);
+    add_perthread_info (p);
     p->shared = true;  // both the IC and the caller point to it
     return p;
 }
@@ -2905,6 +3934,8 @@ ImageCacheImpl::destroy_thread_info (ImageCachePerThreadInfo *thread_info)
     spin_lock lock (m_perthread_info_mutex);
     for (size_t i = 0;  i < m_all_perthread_info.size();  ++i) {
         if (m_all_perthread_info[i] == thread_info) {
+            // Keep its statistics, and free its slot for reuse
+            m_retired_stats.merge (thread_info->m_stats);
             m_all_perthread_info[i] = NULL;
             break;
         }
@@ -2914,6 +3945,20 @@ ImageCacheImpl::destroy_thread_info (ImageCachePerThreadInfo *thread_info)
 
 
 
+void
+ImageCacheImpl::add_perthread_info (ImageCachePerThreadInfo *p)
+{
+    for (size_t i = 0;  i < m_all_perthread_info.size();  ++i) {
+        if (! m_all_perthread_info[i]) {
+            m_all_perthread_info[i] = p;
+            return;
+        }
+    }
+    m_all_perthread_info.push_back (p);
+}
+
+
+
 ImageCachePerThreadInfo *
 ImageCacheImpl::get_perthread_info (ImageCachePerThreadInfo *p)
 {
@@ -2924,7 +3969,7 @@ ImageCacheImpl::get_perthread_info (ImageCachePerThreadInfo *p)
         m_perthread_info.reset (p);
         // printf ("New perthread %p\n", (void *)p);
         spin_lock lock (m_perthread_info_mutex);
-        m_all_perthread_info.push_back (p);
+        add_perthread_info (p);
         p->shared = true;  // both the IC and the thread point to it
     }
     if (p->purge) {  // has somebody requested a tile purge?
@@ -3066,20 +4111,26 @@ ImageCache::destroy (ImageCache *x, bool teardown)
 {
     if (! x)
         return;
-    spin_lock guard (shared_image_cache_mutex);
-    if (x == shared_image_cache.get()) {
-        // This is the shared cache, so don't really delete it. Invalidate
-        // it fully, closing the files and throwing out any tiles that 
-        // nobody is currently holding references to.  But only delete the
-        // IC fully if 'teardown' is true, and even then, it won't destroy
-        // until nobody else is still holding a shared_ptr to it.
-        ((ImageCacheImpl *)x)->invalidate_all (teardown);
-        if (teardown)
-            shared_image_cache.reset ();
-    } else {
-        // Not a shared cache, we are the only owner, so truly destroy it.
-        delete (ImageCacheImpl *) x;
+    // The actual destruction happens after we release the lock, because
+    // the destructor prints statistics, which need the lock as well.
+    shared_ptr<ImageCacheImpl> doomed;
+    {
+        spin_lock guard (shared_image_cache_mutex);
+        if (x == shared_image_cache.get()) {
+            // This is the shared cache, so don't really delete it.
+            // Invalidate it fully, closing the files and throwing out any
+            // tiles that nobody is currently holding references to.  But
+            // only delete the IC fully if 'teardown' is true, and even
+            // then, it won't destroy until nobody else is still holding a
+            // shared_ptr to it.
+            ((ImageCacheImpl *)x)->invalidate_all (teardown);
+            if (teardown)
+                doomed.swap (shared_image_cache);
+            return;
+        }
     }
+    // Not a shared cache, we are the only owner, so truly destroy it.
+    delete (ImageCacheImpl *) x;
 }
 
 
@@ -96,6 +96,8 @@ struct ImageCacheStatistics {
     int unique_files;
     double fileio_time;
     double fileopen_time;
+    double fileclose_time;       // closing files to stay under the limit
+    double filereopen_time;      // reopening files closed by the limit
     double file_locking_time;
     double tile_locking_time;
     double find_file_time;
@@ -145,6 +147,12 @@ public:
     ~ImageCacheFile ();
 
     bool broken () const { return m_broken; }
+
+    /// Is this a UDIM texture -- a filename pattern containing "<UDIM>"
+    /// that stands for a grid of concrete texture files, rather than a
+    /// single file of its own?
+    bool is_udim () const { return m_is_udim; }
+
     int subimages () const { return (int)m_subimages.size(); }
     int miplevels (int subimage) const {
         return (int)m_subimages[subimage].levels.size();
@@ -179,6 +187,10 @@ public:
     ///
     void use (void) { m_used = true; }
 
+    /// Stamp of the most recent read from this file (higher is more
+    /// recent), used by the background file janitor for LRU ordering.
+    long long last_use () const { return m_last_use; }
+
     /// Try to release resources for this file -- if recently used, mark
     /// as not recently used; if already not recently used, close the
     /// file and return true.
@@ -191,6 +203,9 @@ public:
     }
     bool mipused (void) const { return m_mipused; }
     bool sample_border (void) const { return m_sample_border; }
+
+    /// Should tiles read from this file be checked for constant color?
+    bool scan_constant_tiles () const { return m_scan_constant_tiles; }
     const std::vector<size_t> &mipreadcount (void) const { return m_mipreadcount; }
 
     void invalidate ();
@@ -209,6 +224,10 @@ public:
     // success, false on failure.
     bool get_average_color (float *avg, int subimage, int chbegin, int chend);
 
+    /// The native specs of every MIP level of every subimage, in the
+    /// form that's stored in the spec index.
+    typedef std::vector<std::vector<ImageSpec> > NativeSpecs;
+
     /// Info for each MIP level that isn't in the ImageSpec, or that we
     /// precompute.
     struct LevelInfo {
@@ -290,6 +309,8 @@ private:
     ustring m_filename_original;    ///< original filename before search path
     ustring m_filename;             ///< Filename
     bool m_used;                    ///< Recently used (in the LRU sense)
+    long long m_last_use;           ///< Stamp of last read_tile
+    ImageCacheFile *m_next_file;    ///< File usually read after this one
     bool m_broken;                  ///< has errors; can't be used properly
     shared_ptr<ImageInput> m_input; ///< Open ImageInput, NULL if closed
     std::vector<SubimageInfo> m_subimages;  ///< Info on each subimage
@@ -304,6 +325,7 @@ private:
     EnvLayout m_envlayout;          ///< env map: which layout?
     bool m_y_up;                    ///< latlong: is y "up"? (else z is up)
     bool m_sample_border;           ///< are edge samples exactly on the border?
+    bool m_scan_constant_tiles;     ///< Check new tiles for constant color?
     ustring m_fileformat;           ///< File format name
     size_t m_tilesread;             ///< Tiles read from this file
     imagesize_t m_bytesread;        ///< Bytes read from this file
@@ -320,6 +342,11 @@ private:
     imagesize_t m_total_imagesize;  ///< Total size, uncompressed
     ImageInput::Creator m_inputcreator; ///< Custom ImageInput-creator
     boost::scoped_ptr<ImageSpec> m_configspec; // Optional configuration hints
+    bool m_is_udim;                 ///< Is a "<UDIM>" filename pattern
+    atomic_int m_udim_valid;        ///< Has m_udim_lookup been built?
+                                    ///<   (set only after it's complete)
+    int m_udim_nvtiles;             ///< Number of rows of UDIM tiles
+    std::vector<ImageCacheFile *> m_udim_lookup; ///< [v*10+u] -> tile file
 
     /// We will need to read pixels from the file, so be sure it's
     /// currently opened.  Return true if ok, false if error.
@@ -327,6 +354,17 @@ private:
 
     bool opened () const { return m_input.get() != NULL; }
 
+    /// Fill in the specs from the ImageCache's spec index, if it has a
+    /// current entry for this file, without opening the file at all.
+    /// Return true if it did.
+    bool open_from_index (ImageCachePerThreadInfo *thread_info);
+
+    /// Set up all the subimage and MIP level info from the native specs
+    /// (read from the file or from the spec index).  Return false (and
+    /// mark the file broken) if it's not usable.
+    bool init_from_nativespecs (const NativeSpecs &nativespecs,
+                                ImageCachePerThreadInfo *thread_info);
+
     /// Force the file to open, thread-safe.
     bool forceopen (ImageCachePerThreadInfo *thread_info) {
         recursive_lock_guard guard (m_input_mutex);
@@ -484,6 +522,19 @@ private:
 
 
 
+/// Pixels shared by all the tiles (from any files) that have identical
+/// contents, when the "deduplicate_tiles" option is on.  The reference
+/// count is only changed with the ImageCacheImpl's m_shared_pixels_mutex
+/// held, so it needn't be atomic.
+struct SharedTilePixels {
+    boost::scoped_array<char> pixels;  ///< The pixel data
+    size_t size;                       ///< Bytes allocated for pixels
+    size_t hash;                       ///< Hash of the pixel values
+    int refcnt;                        ///< Number of tiles using them
+};
+
+
+
 /// Record for a single image tile.
 ///
 class ImageCacheTile : public RefCnt {
@@ -507,25 +558,36 @@ public:
 
     /// Return pointer to the floating-point pixel data
     ///
-    const float *data (void) const { return (const float *)&m_pixels[0]; }
+    const float *data (void) const { return (const float *)m_data; }
 
     /// Return pointer to the floating-point pixel data for a particular
     /// pixel.  Be extremely sure the pixel is within this tile!
     const void *data (int x, int y, int z=0) const;
 
+    /// Is every pixel of the tile identical?  If so, only that one pixel
+    /// is stored: data(x,y,z) returns it for any pixel of the tile, and
+    /// callers who compute their own offsets into data()/bytedata() must
+    /// use offset 0.
+    bool constant () const { return m_constant; }
+
+    /// Return a pointer to a full tile's worth of pixel data, expanding a
+    /// constant tile on the first request.  This is for clients (like
+    /// ImageCache::tile_pixels) that index the tile data themselves.
+    const void *full_data ();
+
     /// Return a pointer to the character data
     const unsigned char *bytedata (void) const {
-        return (unsigned char *) &m_pixels[0];
+        return (unsigned char *) m_data;
     }
 
     /// Return a pointer to unsigned short data
     const unsigned short *ushortdata (void) const {
-        return (unsigned short *) &m_pixels[0];
+        return (unsigned short *) m_data;
     }
 
     /// Return a pointer to half data
     const half *halfdata (void) const {
-        return (half *) &m_pixels[0];
+        return (half *) m_data;
     }
 
     /// Return the id for this tile.
@@ -535,6 +597,8 @@ public:
     const ImageCacheFile & file () const { return m_id.file(); }
 
     /// Return the actual allocated memory size for this tile's pixels.
+    /// Pixels shared with other tiles aren't counted here, but once for
+    /// all of the tiles sharing them.
     ///
     size_t memsize () const {
         return m_pixels_size;
@@ -575,8 +639,22 @@ public:
 private:
     TileID m_id;                  ///< ID of this tile
     boost::scoped_array<char> m_pixels;  ///< The pixel data
-    size_t m_pixels_size;         ///< How much m_pixels has allocated
+    boost::scoped_array<char> m_expanded; ///< Full copy of a constant tile
+    size_t m_pixels_size;         ///< How much m_pixels (+m_expanded) has
+    SharedTilePixels *m_shared;   ///< Pixels shared with identical tiles
+    const char *m_data;           ///< m_pixels or m_shared->pixels
     bool m_valid;                 ///< Valid pixels
+    bool m_constant;              ///< All pixels identical, only 1 stored
+
+    /// If all the pixels just read are identical, shrink the storage to
+    /// that single pixel and mark the tile constant.  Only the part of
+    /// the tile within the image's data window counts; the padding of an
+    /// edge tile is never looked at.
+    void shrink_if_constant ();
+
+    /// Switch to the shared copy of pixels identical to ours, or make
+    /// ours the shared copy if there isn't one yet.
+    void share_pixels ();
     volatile bool m_pixels_ready; ///< The pixels have been read from disk
     atomic_int m_used;            ///< Used recently
 };
@@ -606,6 +684,7 @@ public:
     ustring last_filename[nlastfile];
     ImageCacheFile *last_file[nlastfile];
     int next_last_file;
+    ImageCacheFile *last_read_file;  // File of this thread's last read_tile
     // We have a two-tile "microcache", storing the last two tiles needed.
     ImageCacheTileRef tile, lasttile;
     atomic_int purge;   // If set, tile ptrs need purging!
@@ -613,7 +692,7 @@ public:
     bool shared;   // Pointed to both by the IC and the thread_specific_ptr
 
     ImageCachePerThreadInfo ()
-        : next_last_file(0), shared(false)
+        : next_last_file(0), last_read_file(NULL), shared(false)
     {
         // std::cout << "Creating PerThreadInfo " << (void*)this << "\n";
         for (int i = 0;  i < nlastfile;  ++i)
@@ -702,6 +781,12 @@ public:
 
     // Retrieve options
     int max_open_files () const { return m_max_open_files; }
+    int max_open_files_soft () const {
+        if (m_max_open_files_soft > 0)
+            return std::min (m_max_open_files_soft, m_max_open_files);
+        return std::max (1, m_max_open_files - m_max_open_files/8);
+    }
+    bool async_file_close () const { return m_async_file_close; }
     const std::string &searchpath () const { return m_searchpath; }
     const std::string &plugin_searchpath () const { return m_plugin_searchpath; }
     int autotile () const { return m_autotile; }
@@ -711,6 +796,8 @@ public:
     bool accept_untiled () const { return m_accept_untiled; }
     bool accept_unmipped () const { return m_accept_unmipped; }
     bool unassociatedalpha () const { return m_unassociatedalpha; }
+    bool detect_constant_tiles () const { return m_detect_constant_tiles; }
+    bool deduplicate_tiles () const { return m_deduplicate_tiles; }
     int failure_retries () const { return m_failure_retries; }
     bool latlong_y_up_default () const { return m_latlong_y_up_default; }
     void get_commontoworld (Imath::M44f &result) const {
@@ -773,6 +860,20 @@ public:
                      stride_t xstride=AutoStride, stride_t ystride=AutoStride,
                      stride_t zstride=AutoStride);
 
+    /// Helper for get_pixels: copy an already-validated region (with
+    /// channel range and strides resolved) out of the tiles of the file,
+    /// one tile-sized block at a time, converting to format on the fly.
+    /// Pixels outside the data window are zeroed.  Safe to call
+    /// concurrently from several threads, each with its own thread_info,
+    /// on disjoint regions.
+    bool get_pixel_blocks (ImageCacheFile *file,
+                           ImageCachePerThreadInfo *thread_info,
+                           int subimage, int miplevel, int xbegin, int xend,
+                           int ybegin, int yend, int zbegin, int zend,
+                           int chbegin, int chend, TypeDesc format,
+                           void *result, stride_t xstride,
+                           stride_t ystride, stride_t zstride);
+
     /// Find the ImageCacheFile record for the named image, or NULL if
     /// no such file can be found.  This returns a plain old pointer,
     /// which is ok because the file hash table has ref-counted pointers
@@ -798,6 +899,23 @@ public:
                                  ImageCachePerThreadInfo *thread_info,
                                  bool header_only=false);
     
+    /// For a UDIM file (see ImageCacheFile::is_udim()), return the
+    /// concrete ImageCacheFile for integer tile coordinates (utile,vtile),
+    /// i.e., UDIM number 1001 + utile + 10*vtile, or NULL if there is no
+    /// such tile.  The directory is scanned only once (until the UDIM
+    /// file is invalidated), after which this is a simple table lookup.
+    /// As with find_file(), a call to verify_file() is still needed.
+    ImageCacheFile *resolve_udim (ImageCacheFile *udimfile,
+                                  ImageCachePerThreadInfo *thread_info,
+                                  int utile, int vtile) {
+        if (! udimfile->m_udim_valid.load (memory_order_acquire))
+            build_udim_lookup (udimfile, thread_info);
+        if (utile < 0 || utile >= 10 || vtile < 0 ||
+              vtile >= udimfile->m_udim_nvtiles)
+            return NULL;
+        return udimfile->m_udim_lookup[vtile*10+utile];
+    }
+
     virtual ImageCacheFile * get_image_handle (ustring filename,
                              ImageCachePerThreadInfo *thread_info=NULL) {
         ImageCacheFile *file = find_file (filename, thread_info);
@@ -908,6 +1026,21 @@ public:
         m_mem_used += size;
     }
 
+    /// Called when a newly read tile turns out to be a constant color.
+    void incr_constant_tiles () { ++m_stat_constant_tiles; }
+
+    /// Look for an existing SharedTilePixels with the same contents as
+    /// pixels[0..size-1] (of which the last OIIO_SIMD_MAX_SIZE_BYTES are
+    /// padding).  If found, free pixels and return the shared copy.  If
+    /// there's none, move pixels into a new SharedTilePixels and return
+    /// it.  If a different set of pixels with the same hash is already
+    /// shared, return NULL and leave pixels alone.
+    SharedTilePixels *share_tile_pixels (boost::scoped_array<char> &pixels,
+                                         size_t size);
+
+    /// Called when a tile that used shared pixels is destroyed.
+    void release_tile_pixels (SharedTilePixels *shared);
+
     /// Called when a tile is destroyed, to update all the stats.
     ///
     void decr_tiles (size_t size) {
@@ -946,12 +1079,47 @@ public:
     /// Override the previous value if necessary, with thread-safety.
     void set_min_cache_size (long long newsize);
 
-    /// Enforce the max number of open files.
+    /// Enforce the max number of open files.  Past the soft limit, the
+    /// background file janitor (if "async_file_close" is on) is asked to
+    /// close the least recently used files; only past the hard limit
+    /// (max_open_files) does the calling thread close files itself.
     void check_max_files (ImageCachePerThreadInfo *thread_info);
 
+    /// Return a new stamp for ImageCacheFile::m_last_use.
+    long long next_file_use () { return ++m_file_use_counter; }
+
+    /// Ask the file janitor to re-open a closed file ahead of time,
+    /// because it's likely to be read soon.  Does nothing if the janitor
+    /// is disabled or we're already past the soft open file limit.
+    void prefetch_file (ImageCacheFile *file);
+
+    /// Look up filename in the persistent spec index.  If it has an
+    /// entry whose recorded modification time and size still match the
+    /// file on disk, store its format name and the native specs of all
+    /// its subimages and MIP levels, and return true.  Return false if
+    /// there is no index, no entry, or the entry is stale.  Thread-safe.
+    bool spec_index_find (ustring filename, ustring &fileformat,
+                          ImageCacheFile::NativeSpecs &specs);
+
+    /// Record the native specs of a file that was just opened, so that
+    /// future sessions may skip opening it just to learn its header.
+    /// Does nothing if no spec index is in use.  Thread-safe.
+    void spec_index_add (ustring filename, ustring fileformat,
+                         const ImageCacheFile::NativeSpecs &specs);
+
 private:
     void init ();
 
+    /// Replace the in-memory spec index with the contents of the given
+    /// index file (which need not exist yet).
+    void spec_index_read (const std::string &indexfilename);
+
+    /// Write the in-memory spec index back to its file, if it has
+    /// changed since it was read, merging it with any entries that
+    /// other processes have written there in the meantime.  The caller
+    /// must hold m_spec_index_mutex.
+    void spec_index_write ();
+
     /// Find a tile identified by 'id' in the tile cache, paging it in if
     /// needed, and store a reference to the tile.  Return true if ok,
     /// false if no such tile exists in the file or could not be read.
@@ -961,6 +1129,20 @@ private:
     /// Enforce the max memory for tile data.
     void check_max_mem (ImageCachePerThreadInfo *thread_info);
 
+    /// Wake up the background file janitor, starting it if necessary.
+    void wake_file_janitor ();
+
+    /// Stop the file janitor thread, if it's running, and wait for it.
+    void stop_file_janitor ();
+
+    /// Main loop of the file janitor thread: close least recently used
+    /// files when we're past the soft limit, and open prefetch requests.
+    void file_janitor ();
+
+    /// Close the least recently used open files until no more than
+    /// 'target' remain open.  Return the number of files closed.
+    int close_lru_files (int target);
+
     /// Internal statistics printing routine
     ///
     void printstats () const;
@@ -978,16 +1160,31 @@ private:
     /// fingerprint table.
     ImageCacheFile *find_fingerprint (ustring finger, ImageCacheFile *file);
 
+    /// Scan the directories for the concrete tiles matching a UDIM
+    /// file's "<UDIM>" pattern and build its dense tile lookup table,
+    /// thread-safe.
+    void build_udim_lookup (ImageCacheFile *udimfile,
+                            ImageCachePerThreadInfo *thread_info);
+
     /// Clear all the per-thread microcaches.
     void purge_perthread_microcaches ();
 
+    /// Add a per-thread info to m_all_perthread_info, reusing the slot
+    /// of one that was destroyed if there is any.  The caller must hold
+    /// m_perthread_info_mutex.
+    void add_perthread_info (ImageCachePerThreadInfo *p);
+
     /// Clear the fingerprint list, thread-safe.
     void clear_fingerprints ();
 
     thread_specific_ptr< ImageCachePerThreadInfo > m_perthread_info;
     std::vector<ImageCachePerThreadInfo *> m_all_perthread_info;
+                                 ///< (NULL entries were destroyed)
+    ImageCacheStatistics m_retired_stats; ///< Stats of destroyed perthreads
     static spin_mutex m_perthread_info_mutex; ///< Thread safety for perthread
     int m_max_open_files;
+    int m_max_open_files_soft;   ///< Janitor limit (0 = auto)
+    bool m_async_file_close;     ///< Close files in a background thread?
     atomic_ll m_max_memory_bytes;
     std::string m_searchpath;    ///< Colon-separated image directory list
     std::vector<std::string> m_searchdirs; ///< Searchpath split into dirs
@@ -1001,15 +1198,50 @@ private:
     bool m_read_before_insert;   ///< Read tiles before adding to cache?
     bool m_deduplicate;          ///< Detect duplicate files?
     bool m_unassociatedalpha;    ///< Keep unassociated alpha files as they are?
+    bool m_detect_constant_tiles; ///< Store constant tiles as one pixel?
+    bool m_deduplicate_tiles;    ///< Share identical tiles' pixels?
     int m_failure_retries;       ///< Times to re-try disk failures
     bool m_latlong_y_up_default; ///< Is +y the default "up" for latlong?
     Imath::M44f m_Mw2c;          ///< world-to-"common" matrix
     Imath::M44f m_Mc2w;          ///< common-to-world matrix
     ustring m_substitute_image;  ///< Substitute this image for all others
 
+    /// One record of the persistent spec index.
+    struct SpecIndexEntry {
+        std::time_t mtime;       ///< File modification time when indexed
+        unsigned long long size; ///< File size when indexed
+        bool unassociatedalpha;  ///< Was "unassociatedalpha" requested?
+        bool added;              ///< Added since the file was last read?
+        ustring fileformat;      ///< Name of the format reader
+        ImageCacheFile::NativeSpecs specs; ///< All subimages & levels
+    };
+    typedef boost::unordered_map<ustring,SpecIndexEntry,ustringHash> SpecIndexMap;
+
+    /// Read the entries of an index file into index.  Return false if
+    /// the file could not be read or is corrupt (leaving index empty).
+    static bool spec_index_load (const std::string &indexfilename,
+                                 SpecIndexMap &index);
+    std::string m_spec_index_filename; ///< Persistent spec index file
+    SpecIndexMap m_spec_index;   ///< In-memory copy of the spec index
+    bool m_spec_index_dirty;     ///< Entries added since last write?
+    mutex m_spec_index_mutex;    ///< Protect the spec index
+
     mutable FilenameMap m_files; ///< Map file names to ImageCacheFile's
     ustring m_file_sweep_name;   ///< Sweeper for "clock" paging algorithm
     spin_mutex m_file_sweep_mutex; ///< Ensure only one in check_max_files
+    atomic_ll m_file_use_counter;  ///< Source of ImageCacheFile use stamps
+
+    // The file janitor closes and prefetches files in the background.
+    boost::scoped_ptr<boost::thread> m_janitor_thread;
+    boost::mutex m_janitor_mutex;      ///< Protects the janitor state below
+    boost::condition_variable m_janitor_cond; ///< Signals the janitor
+    atomic_int m_janitor_wake;         ///< Requests since the janitor went idle
+    bool m_janitor_quit;               ///< Tell the janitor to exit
+    std::vector<ImageCacheFile *> m_prefetch_files; ///< Files to re-open
+
+    typedef boost::unordered_map<size_t, SharedTilePixels *> SharedTilePixelsMap;
+    spin_mutex m_shared_pixels_mutex; ///< Protect m_shared_pixels
+    SharedTilePixelsMap m_shared_pixels; ///< Map pixel hashes to pixels
 
     spin_mutex m_fingerprints_mutex; ///< Protect m_fingerprints
     FingerprintMap m_fingerprints;  ///< Map fingerprints to files
@@ -1035,6 +1267,13 @@ private:
     atomic_int m_stat_open_files_created;
     atomic_int m_stat_open_files_current;
     atomic_int m_stat_open_files_peak;
+    atomic_int m_stat_constant_tiles;
+    atomic_int m_stat_janitor_closes;
+    atomic_int m_stat_shared_tiles;    ///< Tiles that found a shared copy
+    atomic_ll m_stat_shared_bytes;     ///< Bytes currently saved by sharing
+    atomic_int m_stat_prefetch_opens;
+    atomic_int m_stat_spec_index_hits;
+    atomic_int m_stat_spec_index_misses;
 
     // Simulate an atomic double with a long long!
     void incr_time_stat (double &stat, double incr) {
@@ -53,6 +53,7 @@ static float default_time = 0;
 static float default_bias = 0;
 static float default_fill = 0;
 static int   default_samples = 1;
+static float default_rnd = -1.0f;
 
 static const ustring wrap_type_name[] = {
     // MUST match the order of TextureOptions::Wrap
@@ -81,6 +82,7 @@ TextureOptions::TextureOptions ()
       fill(default_fill),
       missingcolor(NULL),
       samples(default_samples),
+      rnd(default_rnd),
       rwrap(TextureOptions::WrapDefault),
       rblur(default_blur), rwidth(default_width)
 {
@@ -103,6 +105,7 @@ TextureOptions::TextureOptions (const TextureOpt &opt)
       fill((float *)&opt.fill),
       missingcolor((void *)opt.missingcolor),
       samples((int *)&opt.samples),
+      rnd((float *)&opt.rnd),
       rwrap((Wrap)opt.rwrap), rblur((float *)&opt.rblur),
       rwidth((float *)&opt.rwidth)
 {
@@ -125,6 +128,7 @@ TextureOpt::TextureOpt (const TextureOptions &opt, int index)
       time(opt.time[index]),
       bias(opt.bias[index]),
       samples(opt.samples[index]),
+      rnd(opt.rnd.ptr() ? opt.rnd[index] : -1.0f),
       rwrap((Wrap)opt.rwrap),
       rblur(opt.rblur[index]), rwidth(opt.rwidth[index]),
       envlayout(0)
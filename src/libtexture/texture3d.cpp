@@ -143,6 +143,8 @@ TextureSystemImpl::texture3d (TextureHandle *texture_handle_,
         &TextureSystemImpl::texture3d_lookup_nomip,
         &TextureSystemImpl::texture3d_lookup_trilinear_mipmap,
         &TextureSystemImpl::texture3d_lookup_trilinear_mipmap,
+        &TextureSystemImpl::texture3d_lookup,
+        &TextureSystemImpl::texture3d_lookup_trilinear_mipmap,
         &TextureSystemImpl::texture3d_lookup
     };
     texture3d_lookup_prototype lookup = lookup_functions[(int)options.mipmode];
@@ -390,6 +392,8 @@ TextureSystemImpl::accum3d_sample_closest (const Imath::V3f &P, int miplevel,
     if (! tile  ||  ! ok)
         return false;
     int tilepel = (tile_r * spec.tile_height + tile_t) * spec.tile_width + tile_s;
+    if (tile->constant())
+        tilepel = 0;   // only one pixel is stored
     int offset = spec.nchannels * tilepel + options.firstchannel;
     DASSERT ((size_t)offset < spec.nchannels*spec.tile_pixels());
     if (pixeltype == TypeDesc::UINT8) {
@@ -515,19 +519,23 @@ TextureSystemImpl::accum3d_sample_bilinear (const Imath::V3f &P, int miplevel,
         if (! tile->valid())
             return false;
         size_t tilepel = (tile_r * spec.tile_height + tile_t) * spec.tile_width + tile_s;
+        // A constant tile stores only one pixel, so all 8 are the same.
+        size_t xstep = tile->constant() ? 0 : pixelsize;
+        if (tile->constant())
+            tilepel = 0;
         size_t offset = (spec.nchannels * tilepel + options.firstchannel) * channelsize;
         DASSERT ((size_t)offset < spec.tile_width*spec.tile_height*spec.tile_depth*pixelsize);
 
         const unsigned char *b = tile->bytedata() + offset;
         texel[0][0][0] = b;
-        texel[0][0][1] = b + pixelsize;
-        texel[0][1][0] = b + pixelsize * spec.tile_width;
-        texel[0][1][1] = b + pixelsize * spec.tile_width + pixelsize;
-        b += pixelsize * spec.tile_width * spec.tile_height;
+        texel[0][0][1] = b + xstep;
+        texel[0][1][0] = b + xstep * spec.tile_width;
+        texel[0][1][1] = b + xstep * spec.tile_width + xstep;
+        b += xstep * spec.tile_width * spec.tile_height;
         texel[1][0][0] = b;
-        texel[1][0][1] = b + pixelsize;
-        texel[1][1][0] = b + pixelsize * spec.tile_width;
-        texel[1][1][1] = b + pixelsize * spec.tile_width + pixelsize;
+        texel[1][0][1] = b + xstep;
+        texel[1][1][0] = b + xstep * spec.tile_width;
+        texel[1][1][1] = b + xstep * spec.tile_width + xstep;
     } else {
         for (int k = 0;  k < 2;  ++k) {
             for (int j = 0;  j < 2;  ++j) {
@@ -550,6 +558,8 @@ TextureSystemImpl::accum3d_sample_bilinear (const Imath::V3f &P, int miplevel,
                         return false;
                     savetile[k][j][i] = tile;
                     size_t tilepel = (tile_r * spec.tile_height + tile_t) * spec.tile_width + tile_s;
+                    if (tile->constant())
+                        tilepel = 0;   // only one pixel is stored
                     size_t offset = (spec.nchannels * tilepel + options.firstchannel) * channelsize;
 #ifndef NDEBUG
                     if ((size_t)offset >= spec.tile_width*spec.tile_height*spec.tile_depth*pixelsize)
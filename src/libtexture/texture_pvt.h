@@ -36,8 +36,12 @@
 #ifndef OPENIMAGEIO_TEXTURE_PVT_H
 #define OPENIMAGEIO_TEXTURE_PVT_H
 
+#include <cstdio>
+#include <map>
+
 #include "OpenImageIO/texture.h"
 #include "OpenImageIO/simd.h"
+#include "OpenImageIO/thread.h"
 
 OIIO_NAMESPACE_ENTER
 {
@@ -58,6 +62,32 @@ class ImageCacheTileRef;
 
 
 
+/// Texture lookup traces (written when the "trace_file" attribute is
+/// set, and replayed by testtex --replay) consist of the 8 magic bytes
+/// "OIIOtrc1" followed by a stream of records, each starting with a
+/// uint32 tag.  A TraceFilename tag is followed by a uint32 file id, a
+/// uint32 length and then that many characters of the filename; it
+/// always precedes the first lookup of that file.  A
+/// TraceTexture tag is followed by one TextureTraceRecord.  Everything
+/// is in native byte order.
+enum TextureTraceTag { TraceFilename = 1, TraceTexture = 2 };
+
+struct TextureTraceRecord {
+    uint32_t thread;          ///< Small integer id of the calling thread
+    uint32_t file;            ///< File id from an earlier TraceFilename
+    float s, t, dsdx, dtdx, dsdy, dtdy;
+    int32_t nchannels;
+    int32_t firstchannel;
+    int32_t subimage;
+    int32_t anisotropic;
+    uint8_t swrap, twrap, mipmode, interpmode;
+    uint8_t conservative_filter, pad[3];
+    float sblur, tblur, swidth, twidth;
+    float fill, time, rnd;
+};
+
+
+
 /// Working implementation of the abstract TextureSystem class.
 ///
 class TextureSystemImpl : public TextureSystem {
@@ -136,7 +166,8 @@ public:
     }
 
     virtual bool good (TextureHandle *texture_handle) {
-        return texture_handle && ! ((TextureFile *)texture_handle)->broken();
+        TextureFile *texturefile = (TextureFile *)texture_handle;
+        return texturefile && (texturefile->is_udim() || ! texturefile->broken());
     }
 
     virtual bool texture (ustring filename, TextureOpt &options,
@@ -165,6 +196,8 @@ public:
                           VaryingRef<float> dsdy, VaryingRef<float> dtdy,
                           int nchannels, float *result,
                           float *dresultds=NULL, float *dresultdt=NULL);
+    virtual bool texture_sorted (Perthread *thread_info, int nchannels,
+                                 TextureQuery *queries, int nqueries);
 
 
     virtual bool texture3d (ustring filename, TextureOpt &options,
@@ -312,6 +345,16 @@ private:
 
     void init ();
 
+    /// Start writing a lookup trace to the named file (or just stop
+    /// tracing if the name is empty).
+    bool trace_open (const std::string &filename);
+    void trace_close ();
+    /// Append one 2D lookup to the trace.
+    void trace_texture (PerThreadInfo *thread_info, TextureFile *texturefile,
+                        const TextureOpt &options, float s, float t,
+                        float dsdx, float dtdx, float dsdy, float dtdy,
+                        int nchannels);
+
     /// Find the TextureFile record for the named texture, or NULL if no
     /// such file can be found.
     TextureFile *find_texturefile (ustring filename, PerThreadInfo *thread_info) {
@@ -452,6 +495,23 @@ private:
                 float weight, float *accum,
                 float *daccumds, float *daccumdt, float *daccumdr);
 
+    /// Accumulate weight times the bilinearly interpolated (or closest,
+    /// for InterpClosest) value at face-relative coordinates (s,t) of
+    /// one face of a cube face environment map.
+    bool sample_cubeface (int face, float s, float t, int level,
+                          TextureFile &texturefile, PerThreadInfo *thread_info,
+                          TextureOpt &options, int actualchannels,
+                          float weight, float *accum,
+                          float *daccumds, float *daccumdt);
+
+    /// Retrieve texel (i,j) of one face of a cube face environment map.
+    /// Texels off the edge of the face are fetched from the adjoining
+    /// face, so that filtering is seamless across cube edges.
+    bool cubeface_texel (int face, int i, int j, int level,
+                         TextureFile &texturefile, PerThreadInfo *thread_info,
+                         TextureOpt &options, int actualchannels,
+                         float *texel);
+
     /// Helper function to calculate the anisotropic aspect ratio from
     /// the major and minor ellipse axis lengths.  The "clamped" aspect
     /// ratio is returned (possibly adjusting major and minorlength to
@@ -529,6 +589,12 @@ private:
     mutable thread_specific_ptr< std::string > m_errormessage;
     Filter1D *hq_filter;         ///< Better filter for magnification
     int m_statslevel;
+    // Lookup tracing:
+    std::string m_trace_filename;  ///< Where the trace is going
+    FILE *m_trace_file;            ///< Open trace file, or NULL
+    mutex m_trace_mutex;           ///< Protects all the trace state
+    std::map<const TextureFile*,uint32_t> m_trace_fileids;
+    std::map<const PerThreadInfo*,uint32_t> m_trace_threadids;
     friend class TextureSystem;
 };
 
@@ -34,6 +34,7 @@
 #include <sstream>
 #include <cstring>
 #include <list>
+#include <algorithm>
 
 #include <OpenEXR/half.h>
 #include <OpenEXR/ImathMatrix.h>
@@ -45,6 +46,7 @@
 #include "OpenImageIO/strutil.h"
 #include "OpenImageIO/sysutil.h"
 #include "OpenImageIO/thread.h"
+#include "OpenImageIO/filesystem.h"
 #include "OpenImageIO/fmath.h"
 #include "OpenImageIO/simd.h"
 #include "OpenImageIO/filter.h"
@@ -96,6 +98,20 @@ OIIO_FORCEINLINE float4 half2float4 (const half *h) {
 }
 
 
+// Load the (first four channels of the) texel at p, of the given type.
+OIIO_FORCEINLINE float4 texel2float4 (const unsigned char *p,
+                                      TypeDesc::BASETYPE pixeltype) {
+    if (pixeltype == TypeDesc::UINT8)
+        return uchar2float4 (p);
+    if (pixeltype == TypeDesc::UINT16)
+        return ushort2float4 ((const unsigned short *)p);
+    if (pixeltype == TypeDesc::HALF)
+        return half2float4 ((const half *)p);
+    DASSERT (pixeltype == TypeDesc::FLOAT);
+    return float4 ((const float *)p);
+}
+
+
 static const OIIO_SIMD4_ALIGN mask4 channel_masks[5] = {
     mask4(false, false, false, false),
     mask4(true,  false, false, false),
@@ -331,7 +347,7 @@ texture_type_name (TexFormat f)
 
 
 TextureSystemImpl::TextureSystemImpl (ImageCache *imagecache)
-    : hq_filter(NULL)
+    : hq_filter(NULL), m_trace_file(NULL)
 {
     m_imagecache = (ImageCacheImpl *) imagecache;
     init ();
@@ -363,6 +379,7 @@ TextureSystemImpl::init ()
 TextureSystemImpl::~TextureSystemImpl ()
 {
     printstats ();
+    trace_close ();
     ImageCache::destroy (m_imagecache);
     m_imagecache = NULL;
     delete hq_filter;
@@ -459,6 +476,10 @@ TextureSystemImpl::attribute (string_view name, TypeDesc type,
         m_statslevel = *(const int *)val;
         // DO NOT RETURN! pass the same message to the image cache
     }
+    if (name == "trace_file" && type == TypeDesc::STRING) {
+        const char *filename = *(const char **)val;
+        return trace_open (filename ? filename : "");
+    }
 
     // Maybe it's meant for the cache?
     return m_imagecache->attribute (name, type, val);
@@ -485,6 +506,10 @@ TextureSystemImpl::getattribute (string_view name, TypeDesc type,
         *(int *)val = m_gray_to_rgb;
         return true;
     }
+    if (name == "trace_file" && type == TypeDesc::STRING) {
+        *(const char **)val = ustring(m_trace_filename).c_str();
+        return true;
+    }
 
     // If not one of these, maybe it's an attribute meant for the image cache?
     return m_imagecache->getattribute (name, type, val);
@@ -494,6 +519,92 @@ TextureSystemImpl::getattribute (string_view name, TypeDesc type,
 
 
 
+bool
+TextureSystemImpl::trace_open (const std::string &filename)
+{
+    trace_close ();
+    if (filename.empty())
+        return true;
+    FILE *file = Filesystem::fopen (filename, "wb");
+    if (! file) {
+        error ("Could not open trace file \"%s\"", filename);
+        return false;
+    }
+    setvbuf (file, NULL, _IOFBF, 1<<20);
+    fwrite ("OIIOtrc1", 8, 1, file);
+    lock_guard lock (m_trace_mutex);
+    m_trace_filename = filename;
+    m_trace_fileids.clear ();
+    m_trace_threadids.clear ();
+    m_trace_file = file;
+    return true;
+}
+
+
+
+void
+TextureSystemImpl::trace_close ()
+{
+    lock_guard lock (m_trace_mutex);
+    if (m_trace_file)
+        fclose (m_trace_file);
+    m_trace_file = NULL;
+    m_trace_filename.clear ();
+}
+
+
+
+void
+TextureSystemImpl::trace_texture (PerThreadInfo *thread_info,
+                                  TextureFile *texturefile,
+                                  const TextureOpt &options,
+                                  float s, float t, float dsdx, float dtdx,
+                                  float dsdy, float dtdy, int nchannels)
+{
+    TextureTraceRecord rec;
+    rec.s = s;  rec.t = t;
+    rec.dsdx = dsdx;  rec.dtdx = dtdx;
+    rec.dsdy = dsdy;  rec.dtdy = dtdy;
+    rec.nchannels = nchannels;
+    rec.firstchannel = options.firstchannel;
+    rec.subimage = options.subimage;
+    rec.anisotropic = options.anisotropic;
+    rec.swrap = (uint8_t) options.swrap;
+    rec.twrap = (uint8_t) options.twrap;
+    rec.mipmode = (uint8_t) options.mipmode;
+    rec.interpmode = (uint8_t) options.interpmode;
+    rec.conservative_filter = options.conservative_filter;
+    rec.pad[0] = rec.pad[1] = rec.pad[2] = 0;
+    rec.sblur = options.sblur;  rec.tblur = options.tblur;
+    rec.swidth = options.swidth;  rec.twidth = options.twidth;
+    rec.fill = options.fill;
+    rec.time = options.time;
+    rec.rnd = options.rnd;
+
+    lock_guard lock (m_trace_mutex);
+    if (! m_trace_file)
+        return;
+    std::map<const PerThreadInfo*,uint32_t>::iterator th = m_trace_threadids.find (thread_info);
+    if (th == m_trace_threadids.end())
+        th = m_trace_threadids.insert (std::make_pair (thread_info, (uint32_t)m_trace_threadids.size())).first;
+    rec.thread = th->second;
+    std::map<const TextureFile*,uint32_t>::iterator f = m_trace_fileids.find (texturefile);
+    if (f == m_trace_fileids.end()) {
+        // First time we've seen this file -- give it an id
+        uint32_t header[3] = { TraceFilename, (uint32_t)m_trace_fileids.size(),
+                               (uint32_t)texturefile->filename().length() };
+        fwrite (header, sizeof(header), 1, m_trace_file);
+        fwrite (texturefile->filename().c_str(), header[2], 1, m_trace_file);
+        f = m_trace_fileids.insert (std::make_pair (texturefile, header[1])).first;
+    }
+    rec.file = f->second;
+    uint32_t tag = TraceTexture;
+    fwrite (&tag, sizeof(tag), 1, m_trace_file);
+    fwrite (&rec, sizeof(rec), 1, m_trace_file);
+}
+
+
+
 std::string
 TextureSystemImpl::resolve_filename (const std::string &filename) const
 {
@@ -884,6 +995,24 @@ TextureSystemImpl::texture (TextureHandle *texture_handle_,
                             int nchannels, float *result,
                             float *dresultds, float *dresultdt)
 {
+    PerThreadInfo *thread_info = m_imagecache->get_perthread_info((PerThreadInfo *)thread_info_);
+    TextureFile *texturefile = (TextureFile *)texture_handle_;
+
+    // A UDIM handle stands for a whole grid of textures: the integer
+    // part of (s,t) picks the tile, the fractional part is the lookup
+    // within it.  Missing tiles aren't errors, just "missing" results.
+    if (texturefile && texturefile->is_udim()) {
+        int utile, vtile;
+        s = floorfrac (s, &utile);
+        t = floorfrac (t, &vtile);
+        texturefile = m_imagecache->resolve_udim (texturefile, thread_info,
+                                                  utile, vtile);
+        if (! texturefile)
+            return missing_texture (options, nchannels, result,
+                                    dresultds, dresultdt);
+        texture_handle_ = (TextureHandle *)texturefile;
+    }
+
     // Handle >4 channel lookups by recursion.
     if (nchannels > 4) {
         int save_firstchannel = options.firstchannel;
@@ -910,12 +1039,17 @@ TextureSystemImpl::texture (TextureHandle *texture_handle_,
         &TextureSystemImpl::texture_lookup_nomip,
         &TextureSystemImpl::texture_lookup_trilinear_mipmap,
         &TextureSystemImpl::texture_lookup_trilinear_mipmap,
+        &TextureSystemImpl::texture_lookup,
+        &TextureSystemImpl::texture_lookup_trilinear_mipmap,
         &TextureSystemImpl::texture_lookup
     };
     texture_lookup_prototype lookup = lookup_functions[(int)options.mipmode];
 
-    PerThreadInfo *thread_info = m_imagecache->get_perthread_info((PerThreadInfo *)thread_info_);
-    TextureFile *texturefile = verify_texturefile ((TextureFile *)texture_handle_, thread_info);
+    if (m_trace_file && texturefile)
+        trace_texture (thread_info, texturefile, options,
+                       s, t, dsdx, dtdx, dsdy, dtdy, nchannels);
+
+    texturefile = verify_texturefile (texturefile, thread_info);
     ImageCacheStatistics &stats (thread_info->m_stats);
     ++stats.texture_batches;
     ++stats.texture_queries;
@@ -1024,6 +1158,121 @@ TextureSystemImpl::texture (TextureHandle *texture_handle_,
 
 
 
+namespace {
+
+// Where a texture_sorted() query will most likely read its texels.
+// Sorting queries by this brings together the lookups sharing tiles.
+struct SortedQueryKey {
+    const void *file;
+    int subimage, miplevel, tiley, tilex;
+    int index;
+    bool operator< (const SortedQueryKey &b) const {
+        if (file != b.file)
+            return file < b.file;
+        if (subimage != b.subimage)
+            return subimage < b.subimage;
+        if (miplevel != b.miplevel)
+            return miplevel < b.miplevel;
+        if (tiley != b.tiley)
+            return tiley < b.tiley;
+        if (tilex != b.tilex)
+            return tilex < b.tilex;
+        return index < b.index;  // keep the sort stable
+    }
+};
+
+// Index of the tile containing texel coordinate x, for tiles of size
+// tilesize.  Wild coordinates just need to map to some int.
+inline int
+sorted_tile_index (float x, int tilesize)
+{
+    x = clamp (x / tilesize, -1.0e9f, 1.0e9f);
+    return (int) floorf (x);
+}
+
+}  // end anonymous namespace
+
+
+
+bool
+TextureSystemImpl::texture_sorted (Perthread *thread_info_, int nchannels,
+                                   TextureQuery *queries, int nqueries)
+{
+    PerThreadInfo *thread_info = m_imagecache->get_perthread_info((PerThreadInfo *)thread_info_);
+
+    // Figure out which file, subimage, MIP level, and tile each lookup
+    // is likely to need.  This only affects the order of the lookups,
+    // so a rough guess (center tile, level where the filter is about a
+    // texel wide) is all we need.
+    std::vector<SortedQueryKey> keys (nqueries);
+    for (int i = 0;  i < nqueries;  ++i) {
+        const TextureQuery &q (queries[i]);
+        SortedQueryKey &key (keys[i]);
+        key.index = i;
+        key.subimage = 0;
+        key.miplevel = 0;
+        key.tiley = 0;
+        key.tilex = 0;
+        TextureFile *texturefile = (TextureFile *)q.texture_handle;
+        float s = q.s, t = q.t;
+        if (texturefile && texturefile->is_udim()) {
+            int utile, vtile;
+            s = floorfrac (s, &utile);
+            t = floorfrac (t, &vtile);
+            texturefile = m_imagecache->resolve_udim (texturefile, thread_info,
+                                                      utile, vtile);
+        }
+        texturefile = m_imagecache->verify_file (texturefile, thread_info);
+        key.file = texturefile;
+        if (! texturefile || texturefile->broken())
+            continue;   // Will be a fast "missing" result, order is moot
+        const TextureOpt &opt (*q.options);
+        int subimage = opt.subimage;
+        if (opt.subimagename)
+            subimage = m_imagecache->subimage_from_name (texturefile,
+                                                         opt.subimagename);
+        if (subimage < 0 || subimage >= texturefile->subimages())
+            continue;
+        key.subimage = subimage;
+
+        float sfilt = std::max (fabsf(q.dsdx), fabsf(q.dsdy)) * opt.swidth;
+        float tfilt = std::max (fabsf(q.dtdx), fabsf(q.dtdy)) * opt.twidth;
+        bool aniso = (opt.mipmode == TextureOpt::MipModeDefault ||
+                      opt.mipmode == TextureOpt::MipModeAniso ||
+                      opt.mipmode == TextureOpt::MipModeStochasticAniso);
+        int nmip = (opt.mipmode == TextureOpt::MipModeNoMIP) ? 1
+                 : texturefile->miplevels (subimage);
+        int m = 0;
+        const ImageSpec *spec = &texturefile->spec (subimage, 0);
+        while (m+1 < nmip) {
+            float sw = sfilt * spec->width, tw = tfilt * spec->height;
+            if ((aniso ? std::min (sw, tw) : std::max (sw, tw)) <= 1.0f)
+                break;
+            spec = &texturefile->spec (subimage, ++m);
+        }
+        key.miplevel = m;
+        key.tilex = sorted_tile_index (s * spec->width,
+                                       std::max (1, spec->tile_width));
+        key.tiley = sorted_tile_index (t * spec->height,
+                                       std::max (1, spec->tile_height));
+    }
+    std::sort (keys.begin(), keys.end());
+
+    // Do the lookups in the sorted order.  Each one stores its results
+    // directly where the caller asked, so there is nothing to un-sort.
+    bool ok = true;
+    for (int k = 0;  k < nqueries;  ++k) {
+        TextureQuery &q (queries[keys[k].index]);
+        q.ok = texture (q.texture_handle, (Perthread *)thread_info,
+                        *q.options, q.s, q.t, q.dsdx, q.dtdx, q.dsdy, q.dtdy,
+                        nchannels, q.result, q.dresultds, q.dresultdt);
+        ok &= q.ok;
+    }
+    return ok;
+}
+
+
+
 bool
 TextureSystemImpl::texture_lookup_nomip (TextureFile &texturefile,
                             PerThreadInfo *thread_info, 
@@ -1210,6 +1459,30 @@ compute_miplevels (TextureSystemImpl::TextureFile &texturefile,
 
 
 
+// For the stochastic mip modes: instead of blending two MIPmap levels,
+// pick just one of them with probability equal to its weight (so the
+// expected value is the same as the blend).  The random value rnd is
+// rescaled to [0,1) within the chosen interval so that the caller can
+// reuse it for further stochastic decisions.
+inline void
+stochastic_miplevel (int *miplevel, float *levelweight, float &rnd)
+{
+    if (levelweight[0] == 0.0f || levelweight[1] == 0.0f)
+        return;   // Only one level contributes anyway
+    if (rnd < levelweight[0]) {
+        rnd = rnd / levelweight[0];
+        levelweight[0] = 1.0f;
+        levelweight[1] = 0.0f;
+    } else {
+        rnd = (rnd - levelweight[0]) / levelweight[1];
+        levelweight[0] = 0.0f;
+        levelweight[1] = 1.0f;
+    }
+    rnd = std::min (rnd, 0.99999994f);
+}
+
+
+
 bool
 TextureSystemImpl::texture_lookup_trilinear_mipmap (TextureFile &texturefile,
                             PerThreadInfo *thread_info,
@@ -1243,6 +1516,11 @@ TextureSystemImpl::texture_lookup_trilinear_mipmap (TextureFile &texturefile,
     float aspect = 1.0f;
     compute_miplevels (texturefile, options, filtwidth, filtwidth, aspect,
                        miplevel, levelweight);
+    if (options.mipmode == TextureOpt::MipModeStochasticTrilinear &&
+          options.rnd >= 0.0f) {
+        float rnd = options.rnd;
+        stochastic_miplevel (miplevel, levelweight, rnd);
+    }
 
     static const sampler_prototype sample_functions[] = {
         // Must be in the same order as InterpMode enum
@@ -1416,6 +1694,23 @@ compute_ellipse_sampling (float aspect, float theta,
 
 
 
+// For the stochastic aniso mode: rather than taking all nsamples probes
+// along the major axis, importance sample just one of them according to
+// the line weights, jittered within its interval using what's left of
+// rnd.  Return its position along the axis, in the same [-1,1] units as
+// p_i of compute_ellipse_sampling.
+inline float
+stochastic_ellipse_position (int nsamples, const float *weights, float rnd)
+{
+    int i = 0;
+    for ( ;  i < nsamples-1 && rnd >= weights[i];  ++i)
+        rnd -= weights[i];
+    float u = Imath::clamp (rnd / weights[i], 0.0f, 1.0f);
+    return 2.0f * ((i + u) / nsamples - 0.5f);
+}
+
+
+
 bool
 TextureSystemImpl::texture_lookup (TextureFile &texturefile,
                             PerThreadInfo *thread_info,
@@ -1462,6 +1757,14 @@ TextureSystemImpl::texture_lookup (TextureFile &texturefile,
     compute_miplevels (texturefile, options, majorlength, minorlength, aspect,
                        miplevel, levelweight);
 
+    // Stochastic aniso: one MIP level and one probe per lookup, chosen
+    // by the caller-supplied random value, trading noise for speed.
+    float rnd = options.rnd;
+    bool stochastic = (options.mipmode == TextureOpt::MipModeStochasticAniso
+                       && rnd >= 0.0f);
+    if (stochastic)
+        stochastic_miplevel (miplevel, levelweight, rnd);
+
     float *lineweight = ALLOCA (float, round_to_multiple_of_pow2(2*options.anisotropic, 4));
     float invsamples;
     int nsamples = compute_ellipse_sampling (aspect, theta, majorlength,
@@ -1474,6 +1777,14 @@ TextureSystemImpl::texture_lookup (TextureFile &texturefile,
     smajor *= 0.5f;
     tmajor *= 0.5f;
 
+    float stochastic_pos = 0.0f;
+    if (stochastic && nsamples > 1) {
+        stochastic_pos = stochastic_ellipse_position (nsamples, lineweight, rnd);
+        nsamples = 1;
+        invsamples = 1.0f;
+        lineweight[0] = 1.0f;
+    }
+
     bool ok = true;
     int npointson = 0;
     int closestprobes = 0, bilinearprobes = 0, bicubicprobes = 0;
@@ -1482,26 +1793,31 @@ TextureSystemImpl::texture_lookup (TextureFile &texturefile,
     float *tval = OIIO_ALLOCA (float, nsamples_padded);
 
     // Compute the s and t positions of the samples along the major axis.
+    if (nsamples == 1) {
+        sval[0] = s + stochastic_pos * smajor;
+        tval[0] = t + stochastic_pos * tmajor;
+    } else {
 #if OIIO_SIMD
-    // Do the computations in batches of 4, with SIMD ops.
-    static OIIO_SIMD4_ALIGN float iota_start[4] = { 0.5f, 1.5f, 2.5f, 3.5f };
-    float4 iota = *(const float4 *)iota_start;
-    for (int sample = 0;  sample < nsamples;  sample += 4) {
-        float4 pos = 2.0f * (iota * invsamples - 0.5f);
-        float4 ss = s + pos * smajor;
-        float4 tt = t + pos * tmajor;
-        ss.store (sval+sample);
-        tt.store (tval+sample);
-        iota += 4.0f;
-    }
+        // Do the computations in batches of 4, with SIMD ops.
+        static OIIO_SIMD4_ALIGN float iota_start[4] = { 0.5f, 1.5f, 2.5f, 3.5f };
+        float4 iota = *(const float4 *)iota_start;
+        for (int sample = 0;  sample < nsamples;  sample += 4) {
+            float4 pos = 2.0f * (iota * invsamples - 0.5f);
+            float4 ss = s + pos * smajor;
+            float4 tt = t + pos * tmajor;
+            ss.store (sval+sample);
+            tt.store (tval+sample);
+            iota += 4.0f;
+        }
 #else
-    // Non-SIMD, reference code
-    for (int sample = 0;  sample < nsamples;  ++sample) {
-        float pos = 2.0f * ((sample + 0.5f) * invsamples - 0.5f);
-        sval[sample] = s + pos * smajor;
-        tval[sample] = t + pos * tmajor;
-    }
+        // Non-SIMD, reference code
+        for (int sample = 0;  sample < nsamples;  ++sample) {
+            float pos = 2.0f * ((sample + 0.5f) * invsamples - 0.5f);
+            sval[sample] = s + pos * smajor;
+            tval[sample] = t + pos * tmajor;
+        }
 #endif
+    }
 
     float4 r_sum, drds_sum, drdt_sum;
     r_sum.clear();
@@ -1610,8 +1926,10 @@ TextureSystemImpl::pole_color (TextureFile &texturefile,
                 int y = pole * (spec.height-1);   // 0 or height-1
                 for (int c = 0;  c < spec.nchannels;  ++c)
                     p[c] = 0.0f;
-                const unsigned char *texel = tile->bytedata() + y*spec.tile_width*pixelsize;
-                for (size_t i = 0;  i < width;  ++i, texel += pixelsize)
+                // N.B. a constant tile stores only one pixel
+                size_t texelstride = tile->constant() ? 0 : pixelsize;
+                const unsigned char *texel = tile->bytedata() + y*spec.tile_width*texelstride;
+                for (size_t i = 0;  i < width;  ++i, texel += texelstride)
                     for (int c = 0;  c < spec.nchannels;  ++c) {
                         if (pixeltype == TypeDesc::UINT8)
                             p[c] += uchar2float(texel[c]);
@@ -1728,7 +2046,9 @@ TextureSystemImpl::sample_closest (int nsamples, const float *s_,
             allok = false;
             continue;
         }
-        int offset = spec.nchannels * (tile_t * spec.tile_width + tile_s) + options.firstchannel;
+        int offset = options.firstchannel;
+        if (! tile->constant())
+            offset += spec.nchannels * (tile_t * spec.tile_width + tile_s);
         DASSERT ((size_t)offset < spec.nchannels*spec.tile_pixels());
         simd::float4 texel_simd;
         if (pixeltype == TypeDesc::UINT8) {
@@ -1930,7 +2250,13 @@ TextureSystemImpl::sample_bilinear (int nsamples, const float *s_,
                 return false;
             int offset = pixelsize * (tile_st[T0] * spec.tile_width + tile_st[S0]);
             const unsigned char *p = tile->bytedata() + offset + channelsize * firstchannel;
-            if (pixeltype == TypeDesc::UINT8) {
+            if (tile->constant()) {
+                // All four texels are the one value stored for the tile
+                texel_simd[0][0] = texel2float4 (tile->bytedata() + channelsize * firstchannel, pixeltype);
+                texel_simd[0][1] = texel_simd[0][0];
+                texel_simd[1][0] = texel_simd[0][0];
+                texel_simd[1][1] = texel_simd[0][0];
+            } else if (pixeltype == TypeDesc::UINT8) {
                 texel_simd[0][0] = uchar2float4 (p);
                 texel_simd[0][1] = uchar2float4 (p+pixelsize);
                 p += pixelsize * spec.tile_width;
@@ -1988,7 +2314,7 @@ TextureSystemImpl::sample_bilinear (int nsamples, const float *s_,
                         DASSERT (thread_info->tile->id() == id);
                     }
                     TileRef &tile (thread_info->tile);
-                    int offset = pixelsize * (tile_t * spec.tile_width + tile_s);
+                    int offset = tile->constant() ? 0 : pixelsize * (tile_t * spec.tile_width + tile_s);
                     DASSERT ((size_t)offset < spec.tile_width*spec.tile_height*spec.tile_depth*pixelsize);
                     if (pixeltype == TypeDesc::UINT8)
                         texel_simd[j][i] = uchar2float4 ((const unsigned char *)(tile->bytedata() + offset + channelsize * firstchannel));
@@ -2269,7 +2595,13 @@ TextureSystemImpl::sample_bicubic (int nsamples, const float *s_,
             int offset = pixelsize * (tile_t * spec.tile_width + tile_s);
             const unsigned char *base = tile->bytedata() + offset + firstchannel_offset_bytes;
             DASSERT (tile->data());
-            if (pixeltype == TypeDesc::UINT8) {
+            if (tile->constant()) {
+                // All 16 texels are the one value stored for the tile
+                simd::float4 texel = texel2float4 (tile->bytedata() + firstchannel_offset_bytes, pixeltype);
+                for (int j = 0;  j < 4;  ++j)
+                    for (int i = 0;  i < 4;  ++i)
+                        texel_simd[j][i] = texel;
+            } else if (pixeltype == TypeDesc::UINT8) {
                 for (int j = 0, j_offset = 0;  j < 4;  ++j, j_offset += pixelsize*spec.tile_width)
                     for (int i = 0, i_offset = j_offset;  i < 4;  ++i, i_offset += pixelsize)
                         texel_simd[j][i] = uchar2float4 (base + i_offset);
@@ -2322,7 +2654,8 @@ TextureSystemImpl::sample_bicubic (int nsamples, const float *s_,
                     }
                     TileRef &tile (thread_info->tile);
                     DASSERT (tile->data());
-                    int offset = row_offset_bytes + column_offset_bytes[i];
+                    int offset = tile->constant() ? firstchannel_offset_bytes
+                                 : row_offset_bytes + column_offset_bytes[i];
                     // const unsigned char *pixelptr = tile->bytedata() + offset[i];
                     if (pixeltype == TypeDesc::UINT8)
                         texel_simd[j][i] = uchar2float4 (tile->bytedata() + offset);
@@ -574,6 +574,24 @@ Filesystem::last_write_time (const std::string& path, std::time_t time)
 
 
 
+unsigned long long
+Filesystem::file_size (const std::string& path)
+{
+    try {
+#ifdef _WIN32
+        std::wstring wpath = Strutil::utf8_to_utf16 (path);
+        return boost::filesystem::file_size (wpath);
+#else
+        return boost::filesystem::file_size (path);
+#endif
+    } catch (...) {
+        // File doesn't exist
+        return 0;
+    }
+}
+
+
+
 void
 Filesystem::convert_native_arguments (int argc, const char *argv[])
 {
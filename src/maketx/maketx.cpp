@@ -65,6 +65,7 @@ static std::string outputfilename;
 static bool verbose = false;
 static bool runstats = false;
 static int nthreads = 0;    // default: use #cores threads if available
+static std::string update_index;  // spec index to record the output in
 
 // Conversion modes.  If none are true, we just make an ordinary texture.
 static bool mipmapmode = false;
@@ -202,6 +203,7 @@ getargs (int argc, char *argv[], ImageSpec &configspec)
     bool nomipmap = false;
     bool prman_metadata = false;
     bool constant_color_detect = false;
+    bool constant_tile_detect = false;
     bool monochrome_detect = false;
     bool opaque_detect = false;
     bool compute_average = true;
@@ -271,18 +273,20 @@ getargs (int argc, char *argv[], ImageSpec &configspec)
                   "--sattrib %L %L", &string_attrib_names, &string_attrib_values, "Sets string metadata attribute (name, value)",
                   "--sansattrib", &sansattrib, "Write command line into Software & ImageHistory but remove --sattrib and --attrib options",
                   "--constant-color-detect", &constant_color_detect, "Create 1-tile textures from constant color inputs",
+                  "--constant-tile-detect", &constant_tile_detect, "Record the number of constant color tiles in the metadata",
                   "--monochrome-detect", &monochrome_detect, "Create 1-channel textures from monochrome inputs",
                   "--opaque-detect", &opaque_detect, "Drop alpha channel that is always 1.0",
                   "--no-compute-average %!", &compute_average, "Don't compute and store average color",
                   "--ignore-unassoc", &ignore_unassoc, "Ignore unassociated alpha tags in input (don't autoconvert)",
                   "--runstats", &runstats, "Print runtime statistics",
+                  "--update-index %s", &update_index, "Record the output texture's headers in this ImageCache spec index",
                   "--stats", &runstats, "", // DEPRECATED 1.6
                   "--mipimage %L", &mipimages, "Specify an individual MIP level",
                   "<SEPARATOR>", "Basic modes (default is plain texture):",
                   "--shadow", &shadowmode, "Create shadow map",
                   "--envlatl", &envlatlmode, "Create lat/long environment map",
                   "--lightprobe", &lightprobemode, "Create lat/long environment map from a light probe",
-//                  "--envcube", &envcubemode, "Create cubic env map (file order: px, nx, py, ny, pz, nz) (UNIMP)",
+                  "--envcube", &envcubemode, "Create cube face env map (input faces px, nx, py, ny, pz, nz stacked vertically, or 3x2)",
                   "<SEPARATOR>", colortitle_help_string().c_str(),
                   "--colorconvert %s %s", &incolorspace, &outcolorspace,
                           colorconvert_help_string().c_str(),
@@ -373,6 +377,7 @@ getargs (int argc, char *argv[], ImageSpec &configspec)
     configspec.attribute ("maketx:nomipmap", nomipmap);
     configspec.attribute ("maketx:updatemode", updatemode);
     configspec.attribute ("maketx:constant_color_detect", constant_color_detect);
+    configspec.attribute ("maketx:constant_tile_detect", constant_tile_detect);
     configspec.attribute ("maketx:monochrome_detect", monochrome_detect);
     configspec.attribute ("maketx:opaque_detect", opaque_detect);
     configspec.attribute ("maketx:compute_average", compute_average);
@@ -466,11 +471,28 @@ main (int argc, char *argv[])
         mode = ImageBufAlgo::MakeTxEnvLatl;
     if (lightprobemode)
         mode = ImageBufAlgo::MakeTxEnvLatlFromLightProbe;
+    if (envcubemode)
+        mode = ImageBufAlgo::MakeTxEnvCube;
     bool ok = ImageBufAlgo::make_texture (mode, filenames[0],
                                           outputfilename, configspec,
                                           &std::cout);
     if (runstats)
         std::cout << "\n" << ic->getstats();
 
+    if (ok && update_index.size()) {
+        // Let a private ImageCache read the new texture's headers; it
+        // writes them to the index when it is destroyed.
+        std::string texname = outputfilename;
+        if (texname.empty())
+            texname = Filesystem::replace_extension (filenames[0], ".tx");
+        ImageCache *indexcache = ImageCache::create (false);
+        indexcache->attribute ("spec_index", update_index);
+        indexcache->invalidate (ustring(texname));  // drop any stale entry
+        ImageSpec texspec;
+        if (! indexcache->get_imagespec (ustring(texname), texspec))
+            std::cerr << "maketx WARNING: could not index " << texname << "\n";
+        ImageCache::destroy (indexcache);
+    }
+
     return ok ? 0 : EXIT_FAILURE;
 }
@@ -139,6 +139,9 @@ Oiiotool::clear_options ()
     allsubimages = false;
     printinfo = false;
     printstats = false;
+    printstats_bins = 0;
+    printstats_min = 0.0f;
+    printstats_max = 1.0f;
     dumpdata = false;
     dumpdata_showempty = true;
     hash = false;
@@ -349,6 +352,25 @@ set_dumpdata (int argc, const char *argv[])
 
 
 
+static int
+set_printstats (int argc, const char *argv[])
+{
+    ASSERT (argc == 1);
+    string_view command = ot.express (argv[0]);
+    ot.printstats = true;
+    std::map<std::string,std::string> options;
+    options["bins"] = "0";
+    options["min"] = "0";
+    options["max"] = "1";
+    ot.extract_options (options, command);
+    ot.printstats_bins = Strutil::from_string<int> (options["bins"]);
+    ot.printstats_min = Strutil::from_string<float> (options["min"]);
+    ot.printstats_max = Strutil::from_string<float> (options["max"]);
+    return 0;
+}
+
+
+
 static int
 set_autopremult (int argc, const char *argv[])
 {
@@ -369,6 +391,16 @@ unset_autopremult (int argc, const char *argv[])
 
 
 
+static int
+set_spec_index (int argc, const char *argv[])
+{
+    ASSERT (argc == 2);
+    ot.imagecache->attribute ("spec_index", argv[1]);
+    return 0;
+}
+
+
+
 static int
 action_label (int argc, const char *argv[])
 {
@@ -3196,6 +3228,65 @@ UNARY_IMAGE_OP (flatten, ImageBufAlgo::flatten);
 
 
 
+UNARY_IMAGE_OP (deep_sort, ImageBufAlgo::deep_sort);
+
+
+
+class OpDeepTidy : public OiiotoolOp {
+public:
+    OpDeepTidy (Oiiotool &ot, string_view opname, int argc, const char *argv[])
+        : OiiotoolOp (ot, opname, argc, argv, 1) {}
+    virtual void option_defaults () { options["cull"] = "0"; }
+    virtual int impl (ImageBuf **img) {
+        bool cull = Strutil::from_string<int>(options["cull"]);
+        return ImageBufAlgo::deep_tidy (*img[0], *img[1], cull);
+    }
+};
+
+OP_CUSTOMCLASS (deep_tidy, OpDeepTidy, 1);
+
+
+
+class OpDeepMerge : public OiiotoolOp {
+public:
+    OpDeepMerge (Oiiotool &ot, string_view opname, int argc, const char *argv[])
+        : OiiotoolOp (ot, opname, argc, argv, 2) {}
+    virtual void option_defaults () { options["cull"] = "1"; }
+    virtual int impl (ImageBuf **img) {
+        bool cull = Strutil::from_string<int>(options["cull"]);
+        return ImageBufAlgo::deep_merge (*img[0], *img[1], *img[2], cull);
+    }
+};
+
+OP_CUSTOMCLASS (deep_merge, OpDeepMerge, 2);
+
+
+
+BINARY_IMAGE_OP (deep_holdout, ImageBufAlgo::deep_holdout);
+
+
+
+class OpDeepTrim : public OiiotoolOp {
+public:
+    OpDeepTrim (Oiiotool &ot, string_view opname, int argc, const char *argv[])
+        : OiiotoolOp (ot, opname, argc, argv, 1) {}
+    virtual int impl (ImageBuf **img) {
+        float zmin = 0.0f, zmax = 0.0f;
+        string_view range (args[1]);
+        if (! (Strutil::parse_float (range, zmin) &&
+               Strutil::parse_char (range, ',') &&
+               Strutil::parse_float (range, zmax))) {
+            img[0]->error ("Depth range must be zmin,zmax");
+            return false;
+        }
+        return ImageBufAlgo::deep_trim (*img[0], *img[1], zmin, zmax);
+    }
+};
+
+OP_CUSTOMCLASS (deep_trim, OpDeepTrim, 1);
+
+
+
 static int
 action_fill (int argc, const char *argv[])
 {
@@ -3484,6 +3575,9 @@ input_file (int argc, const char *argv[])
             pio.verbose = ot.verbose;
             pio.subimages = ot.allsubimages;
             pio.compute_stats = ot.printstats;
+            pio.stats_bins = ot.printstats_bins;
+            pio.stats_min = ot.printstats_min;
+            pio.stats_max = ot.printstats_max;
             pio.dumpdata = ot.dumpdata;
             pio.dumpdata_showempty = ot.dumpdata_showempty;
             pio.compute_sha1 = ot.hash;
@@ -3837,7 +3931,7 @@ getargs (int argc, char *argv[])
                     "Regex: which metadata is printed with -info -v",
                 "--no-metamatch %s", &ot.printinfo_nometamatch,
                     "Regex: which metadata is excluded with -info -v",
-                "--stats", &ot.printstats, "Print pixel statistics on all inputs",
+                "--stats %@", set_printstats, NULL, "Print pixel statistics on all inputs (options: bins=N, min=0, max=1 for per-channel histograms)",
                 "--dumpdata %@", set_dumpdata, NULL, "Print all pixel data values (options: empty=0)",
                 "--hash", &ot.hash, "Print SHA-1 hash of each input image",
                 "--colorcount %@ %s", action_colorcount, NULL,
@@ -3860,6 +3954,7 @@ getargs (int argc, char *argv[])
                 "--autocc", &ot.autocc, "Automatically color convert based on filename",
                 "--noautocc %!", &ot.autocc, "Turn off automatic color conversion",
                 "--native", &ot.nativeread, "Force native data type reads if cache would lose precision",
+                "--specindex %@ %s", set_spec_index, NULL, "Use (and update) a persistent index of input image headers",
                 "<SEPARATOR>", "Commands that write images:",
                 "-o %@ %s", output_file, NULL, "Output the current image to the named file",
                 "<SEPARATOR>", "Options that affect subsequent image output:",
@@ -4014,6 +4109,16 @@ getargs (int argc, char *argv[])
                     "Append all images on the stack into a single multi-subimage image",
                 "--deepen %@", action_deepen, NULL, "Deepen normal 2D image to deep",
                 "--flatten %@", action_flatten, NULL, "Flatten deep image to non-deep",
+                "--deep_sort %@", action_deep_sort, NULL,
+                    "Sort the samples of a deep image front to back",
+                "--deep_tidy %@", action_deep_tidy, NULL,
+                    "Sort, split overlapping, and merge coincident deep samples (options: cull=0)",
+                "--deep_merge %@", action_deep_merge, NULL,
+                    "Merge the samples of the last two deep images (options: cull=1)",
+                "--deep_holdout %@", action_deep_holdout, NULL,
+                    "Hold out the next-to-last deep image by the last one",
+                "--deep_trim %@ %s", action_deep_trim, NULL,
+                    "Keep only the deep samples within a depth range (arg: zmin,zmax)",
                 "<SEPARATOR>", "Image stack manipulation:",
                 "--dup %@", action_dup, NULL,
                     "Duplicate the current image (push a copy onto the stack)",
@@ -4316,6 +4421,12 @@ main (int argc, char *argv[])
             ot.warning (Strutil::format ("pending '%s' command never executed", ot.pending_callback_name()));
     }
 
+    // Write back any headers that were newly added to the spec index.
+    const char *specindex = NULL;
+    if (ot.imagecache->getattribute ("spec_index", TypeDesc::STRING, &specindex)
+          && specindex && specindex[0])
+        ot.imagecache->attribute ("spec_index", specindex);
+
     if (ot.runstats) {
         double total_time = totaltime();
         double unaccounted = total_time;
@@ -57,6 +57,8 @@ public:
     bool allsubimages;
     bool printinfo;
     bool printstats;
+    int printstats_bins;              // histogram bins for --stats (0=none)
+    float printstats_min, printstats_max;  // histogram range for --stats
     bool dumpdata;
     bool dumpdata_showempty;
     bool hash;
@@ -386,6 +388,8 @@ struct print_info_options {
     bool subimages;
     bool compute_sha1;
     bool compute_stats;
+    int stats_bins;              // If nonzero, also histogram the stats
+    float stats_min, stats_max;  // Range of the stats histogram
     bool dumpdata;
     bool dumpdata_showempty;
     std::string metamatch;
@@ -394,7 +398,8 @@ struct print_info_options {
 
     print_info_options ()
         : verbose(false), filenameprefix(false), sum(false), subimages(false),
-          compute_sha1(false), compute_stats(false), dumpdata(false),
+          compute_sha1(false), compute_stats(false), stats_bins(0),
+          stats_min(0.0f), stats_max(1.0f), dumpdata(false),
           dumpdata_showempty(true), namefieldlength(20)
     {}
 };
@@ -128,7 +128,7 @@ dump_data (ImageInput *input, const print_info_options &opt)
                         for (int c = 0;  c < nc;  ++c) {
                             std::cout << " " << spec.channelnames[c] << "=";
                             if (dd.channeltypes[c] == TypeDesc::UINT)
-                                std::cout << ((uint32_t *)dd.pointers[pixel*dd.nchannels+c])[s];
+                                std::cout << dd.deep_value_uint (pixel, c, s);
                             else
                                 std::cout << dd.deep_value (pixel, c, s);
                         }
@@ -252,6 +252,7 @@ static void
 print_stats (Oiiotool &ot,
              const std::string &filename,
              const ImageSpec &originalspec,
+             const print_info_options &opt,
              int subimage=0, int miplevel=0, bool indentmip=false)
 {
     const char *indent = indentmip ? "      " : "    ";
@@ -262,8 +263,11 @@ print_stats (Oiiotool &ot,
         return;
     }
     
+    // The histogram, if any, is gathered in the same pass over the
+    // pixels as the rest of the stats.
     PixelStats stats;
-    if (! computePixelStats (stats, input)) {
+    int bins = input.deep() ? 0 : opt.stats_bins;
+    if (! computePixelStats (stats, input, bins, opt.stats_min, opt.stats_max)) {
         ot.error ("stats", "unable to compute");
         return;
     }
@@ -321,6 +325,17 @@ print_stats (Oiiotool &ot,
         printf ("%llu ", (unsigned long long)stats.finitecount[i]);
     }
     printf ("\n");
+
+    if (bins > 0) {
+        printf ("%sStats Histogram (%d bins from %g to %g):\n", indent,
+                bins, opt.stats_min, opt.stats_max);
+        for (int c = 0;  c < input.nchannels();  ++c) {
+            printf ("%s  %s: ", indent, input.spec().channelnames[c].c_str());
+            for (int b = 0;  b < bins;  ++b)
+                printf ("%llu ", (unsigned long long)stats.histogram[c*bins+b]);
+            printf ("\n");
+        }
+    }
     
     if (input.deep()) {
         const DeepData *dd (input.deepdata());
@@ -416,8 +431,14 @@ print_stats (Oiiotool &ot,
                     maxdepth_pixel.x, maxdepth_pixel.y);
         }
     } else {
+        // Two different finite values in a channel already rule out a
+        // constant image, without another pass over the pixels.
+        bool maybe_constant = true;
+        for (unsigned int i=0; i<stats.min.size(); ++i)
+            if (stats.min[i] != stats.max[i])
+                maybe_constant = false;
         std::vector<float> constantValues(input.spec().nchannels);
-        if (isConstantColor(input, &constantValues[0])) {
+        if (maybe_constant && isConstantColor(input, &constantValues[0])) {
             printf ("%sConstant: Yes\n", indent);
             printf ("%sConstant Color: ", indent);
             for (unsigned int i=0; i<constantValues.size(); ++i) {
@@ -643,7 +664,7 @@ print_info_subimage (Oiiotool &ot,
                 printf ("    MIP %d of %d (%d x %d):\n",
                         m, nmip, mipspec.width, mipspec.height);
             }
-            print_stats (ot, filename, spec, current_subimage, m, nmip>1);
+            print_stats (ot, filename, spec, opt, current_subimage, m, nmip>1);
         }
     }
 
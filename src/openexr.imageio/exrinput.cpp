@@ -1145,6 +1145,10 @@ OpenEXRInput::read_native_deep_scanlines (int ybegin, int yend, int z,
         m_spec.get_channelformats (channeltypes);
         deepdata.init (npixels, nchans, &channeltypes[chbegin],
                        &channeltypes[chend]);
+        // OpenEXR wants a pointer per pixel per channel.  We can't fill
+        // it in until the sample counts are known and alloc() has been
+        // called, but its address must be known now.
+        std::vector<void*> pointers (npixels * nchans);
         Imf::DeepFrameBuffer frameBuffer;
         Imf::Slice countslice (Imf::UINT,
                                (char *)(&deepdata.nsamples[0]
@@ -1155,7 +1159,7 @@ OpenEXRInput::read_native_deep_scanlines (int ybegin, int yend, int z,
         frameBuffer.insertSampleCountSlice (countslice);
         for (int c = chbegin;  c < chend;  ++c) {
             Imf::DeepSlice slice (part.pixeltype[c],
-                                  (char *)(&deepdata.pointers[c-chbegin]
+                                  (char *)(&pointers[c-chbegin]
                                            - m_spec.x * nchans
                                            - ybegin*m_spec.width*nchans),
                                   sizeof(void*) * nchans, // xstride of pointer array
@@ -1169,6 +1173,7 @@ OpenEXRInput::read_native_deep_scanlines (int ybegin, int yend, int z,
         // number of samples and resize the data area appropriately.
         m_deep_scanline_input_part->readPixelSampleCounts (ybegin, yend-1);
         deepdata.alloc ();
+        deepdata.get_pointers (pointers);
 
         // Read the pixels
         m_deep_scanline_input_part->readPixels (ybegin, yend-1);
@@ -1214,6 +1219,9 @@ OpenEXRInput::read_native_deep_tiles (int xbegin, int xend,
         m_spec.get_channelformats (channeltypes);
         deepdata.init (npixels, nchans, &channeltypes[chbegin],
                        &channeltypes[chend]);
+        // OpenEXR wants a pointer per pixel per channel, which we fill in
+        // once the sample counts are known and alloc() has been called.
+        std::vector<void*> pointers (npixels * nchans);
         Imf::DeepFrameBuffer frameBuffer;
         Imf::Slice countslice (Imf::UINT,
                                (char *)(&deepdata.nsamples[0]
@@ -1224,7 +1232,7 @@ OpenEXRInput::read_native_deep_tiles (int xbegin, int xend,
         frameBuffer.insertSampleCountSlice (countslice);
         for (int c = chbegin;  c < chend;  ++c) {
             Imf::DeepSlice slice (part.pixeltype[c],
-                                  (char *)(&deepdata.pointers[c-chbegin]
+                                  (char *)(&pointers[c-chbegin]
                                            - xbegin*nchans
                                            - ybegin*width*nchans),
                                   sizeof(void*) * nchans, // xstride of pointer array
@@ -1246,6 +1254,7 @@ OpenEXRInput::read_native_deep_tiles (int xbegin, int xend,
                 firstxtile, firstxtile+xtiles-1,
                 firstytile, firstytile+ytiles-1);
         deepdata.alloc ();
+        deepdata.get_pointers (pointers);
 
         // Read the pixels
         m_deep_tiled_input_part->readTiles (
@@ -1448,6 +1448,8 @@ OpenEXROutput::write_deep_scanlines (int ybegin, int yend, int z,
     int nchans = m_spec.nchannels;
     try {
         // Set up the count and pointers arrays and the Imf framebuffer
+        std::vector<void*> pointers;
+        deepdata.get_pointers (pointers);
         Imf::DeepFrameBuffer frameBuffer;
         Imf::Slice countslice (Imf::UINT,
                                (char *)(&deepdata.nsamples[0]
@@ -1459,7 +1461,7 @@ OpenEXROutput::write_deep_scanlines (int ybegin, int yend, int z,
         for (int c = 0;  c < nchans;  ++c) {
             size_t chanbytes = deepdata.channeltypes[c].size();
             Imf::DeepSlice slice (m_pixeltype[c],
-                                  (char *)(&deepdata.pointers[c]
+                                  (char *)(&pointers[c]
                                            - m_spec.x * nchans
                                            - ybegin*m_spec.width*nchans),
                                   sizeof(void*) * nchans, // xstride of pointer array
@@ -1510,6 +1512,8 @@ OpenEXROutput::write_deep_tiles (int xbegin, int xend, int ybegin, int yend,
         size_t width = (xend - xbegin);
 
         // Set up the count and pointers arrays and the Imf framebuffer
+        std::vector<void*> pointers;
+        deepdata.get_pointers (pointers);
         Imf::DeepFrameBuffer frameBuffer;
         Imf::Slice countslice (Imf::UINT,
                                (char *)(&deepdata.nsamples[0]
@@ -1521,7 +1525,7 @@ OpenEXROutput::write_deep_tiles (int xbegin, int xend, int ybegin, int yend,
         for (int c = 0;  c < nchans;  ++c) {
             size_t chanbytes = m_spec.channelformat(c).size();
             Imf::DeepSlice slice (m_pixeltype[c],
-                                  (char *)(&deepdata.pointers[c]
+                                  (char *)(&pointers[c]
                                            - xbegin*nchans
                                            - ybegin*width*nchans),
                                   sizeof(void*) * nchans, // xstride of pointer array
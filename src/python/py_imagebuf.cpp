@@ -28,8 +28,6 @@
   (This is the Modified BSD License)
 */
 
-#include <boost/scoped_array.hpp>
-
 #include "py_oiio.h"
 #include "OpenImageIO/platform.h"
 
@@ -306,12 +304,16 @@ ImageBuf_get_pixels (const ImageBuf &buf, TypeDesc format, ROI roi=ROI::All())
     roi.chend = std::min (roi.chend, buf.nchannels()+1);
 
     size_t size = (size_t) roi.npixels() * roi.nchannels() * format.size();
-    boost::scoped_array<char> data (new char [size]);
-    if (! buf.get_pixels (roi, format, &data[0])) {
-        return object(handle<>(Py_None));
+    object array = make_Python_array (format, size);
+    ScopedPyBuffer data (array.ptr(), true);
+    bool ok;
+    {
+        ScopedGILRelease gil;
+        ok = buf.get_pixels (roi, format, data.data());
     }
-
-    return C_array_to_Python_array (data.get(), format, size);
+    if (! ok)
+        return object(handle<>(Py_None));
+    return array;
 }
 
 BOOST_PYTHON_FUNCTION_OVERLOADS(ImageBuf_get_pixels_overloads,
@@ -347,7 +349,7 @@ ImageBuf_set_pixels_tuple (ImageBuf &buf, ROI roi, tuple data)
 
 
 bool
-ImageBuf_set_pixels_array (ImageBuf &buf, ROI roi, numeric::array data)
+ImageBuf_set_pixels_buffer (ImageBuf &buf, ROI roi, object data)
 {
     if (! roi.defined())
         roi = buf.roi();
@@ -356,26 +358,82 @@ ImageBuf_set_pixels_array (ImageBuf &buf, ROI roi, numeric::array data)
     if (size == 0)
         return true;   // done
 
-    // Figure out the type of the array
-    object tcobj = data.attr("typecode");
-    extract<char> tce (tcobj);
-    char typecode = tce.check() ? (char)tce : 0;
-    TypeDesc type = typedesc_from_python_array_code (typecode);
-
-    const void *addr = NULL;
-    Py_ssize_t pylen = 0;
-    int success = PyObject_AsReadBuffer(data.ptr(), &addr, &pylen);
-    if (success != 0)
+    // Any object exposing the buffer protocol will do (array.array,
+    // numpy arrays, ...), as long as we can tell its element type.
+    ScopedPyBuffer pybuf (data.ptr(), false);
+    if (! pybuf.valid())
         throw_error_already_set();
-
-    if (type == TypeDesc::UNKNOWN || size*type.size() > (size_t)pylen)
+    TypeDesc type = pybuf.format();
+    if (type == TypeDesc::UNKNOWN || size*type.size() > pybuf.size())
         return false;   // Not enough data to fill our ROI
-    buf.set_pixels (roi, type, addr);
+    ScopedGILRelease gil;
+    buf.set_pixels (roi, type, pybuf.data());
     return true;
 }
 
 
 
+// Support for the Python buffer protocol, so that memoryview(buf) or
+// numpy.asarray(buf) give direct, writable access to the pixels of an
+// ImageBuf whose pixels are in local memory, with no copying. The view
+// is indexed [y][x][channel] (or [z][y][x][channel] for volumes).  It
+// holds a reference to the ImageBuf, but resetting or clearing the
+// ImageBuf while views exist invalidates them.
+static int
+ImageBuf_getbuffer (PyObject *self, Py_buffer *view, int flags)
+{
+    view->obj = NULL;
+    extract<ImageBuf&> ext (self);
+    if (! ext.check()) {
+        PyErr_SetString (PyExc_BufferError, "not an ImageBuf");
+        return -1;
+    }
+    ImageBuf &buf (ext());
+    if (buf.deep() || ! buf.localpixels()) {
+        PyErr_SetString (PyExc_BufferError,
+                         "ImageBuf pixels are not in local memory "
+                         "(use make_writeable() first)");
+        return -1;
+    }
+    const ImageSpec &spec (buf.spec());
+    TypeDesc format = buf.pixeltype();
+    // shape and strides live in view->internal until the view is released
+    Py_ssize_t *dims = new Py_ssize_t[8];
+    int ndim = 0;
+    if (spec.depth > 1) {
+        dims[ndim] = spec.depth;
+        dims[4+ndim++] = (Py_ssize_t) (spec.scanline_bytes() * spec.height);
+    }
+    dims[ndim] = spec.height;  dims[4+ndim++] = (Py_ssize_t) spec.scanline_bytes();
+    dims[ndim] = spec.width;   dims[4+ndim++] = (Py_ssize_t) spec.pixel_bytes();
+    dims[ndim] = spec.nchannels; dims[4+ndim++] = (Py_ssize_t) format.size();
+
+    view->buf = buf.localpixels();
+    view->obj = self;
+    Py_INCREF (self);
+    view->len = (Py_ssize_t) spec.image_bytes();
+    view->readonly = 0;
+    view->itemsize = (Py_ssize_t) format.size();
+    view->format = (flags & PyBUF_FORMAT)
+                 ? const_cast<char *>(python_buffer_format (format)) : NULL;
+    view->ndim = (flags & PyBUF_ND) ? ndim : 1;
+    view->shape = (flags & PyBUF_ND) ? dims : NULL;
+    view->strides = ((flags & PyBUF_STRIDES) == PyBUF_STRIDES) ? dims+4 : NULL;
+    view->suboffsets = NULL;
+    view->internal = dims;
+    return 0;
+}
+
+
+
+static void
+ImageBuf_releasebuffer (PyObject * /*self*/, Py_buffer *view)
+{
+    delete [] (Py_ssize_t *) view->internal;
+}
+
+
+
 DeepData&
 ImageBuf_deepdataref (ImageBuf *ib)
 {
@@ -386,6 +444,8 @@ ImageBuf_deepdataref (ImageBuf *ib)
 
 void declare_imagebuf()
 {
+    static PyBufferProcs buffer_procs;
+
     enum_<ImageBuf::WrapMode>("WrapMode")
         .value("WrapDefault",  ImageBuf::WrapDefault )
         .value("WrapBlack",    ImageBuf::WrapBlack )
@@ -394,7 +454,8 @@ void declare_imagebuf()
         .value("WrapMirror",   ImageBuf::WrapMirror )
         .export_values();
 
-    class_<ImageBuf, boost::noncopyable> ("ImageBuf")
+    class_<ImageBuf, boost::noncopyable> imagebuf_class ("ImageBuf");
+    imagebuf_class
         .def(init<const std::string&>())
         .def(init<const std::string&, int, int>())
         .def(init<const ImageSpec&>())
@@ -491,8 +552,9 @@ void declare_imagebuf()
         .def("setpixel", &ImageBuf_setpixel1)
         .def("get_pixels", &ImageBuf_get_pixels, ImageBuf_get_pixels_overloads())
         .def("get_pixels", &ImageBuf_get_pixels_bt, ImageBuf_get_pixels_bt_overloads())
+        // Registered first so it's tried last: an object matches anything.
+        .def("set_pixels", &ImageBuf_set_pixels_buffer)
         .def("set_pixels", &ImageBuf_set_pixels_tuple)
-        .def("set_pixels", &ImageBuf_set_pixels_array)
 
         .add_property("deep", &ImageBuf::deep)
         .def("deep_samples", &ImageBuf::deep_samples,
@@ -509,6 +571,16 @@ void declare_imagebuf()
         // FIXME -- do we want to provide pixel iterators?
     ;
 
+    // Boost.Python has no notion of the buffer protocol, so install our
+    // handlers directly on the Python type object it made for ImageBuf.
+    PyTypeObject *type = (PyTypeObject *) imagebuf_class.ptr();
+    buffer_procs.bf_getbuffer = ImageBuf_getbuffer;
+    buffer_procs.bf_releasebuffer = ImageBuf_releasebuffer;
+    type->tp_as_buffer = &buffer_procs;
+#if PY_MAJOR_VERSION < 3
+    type->tp_flags |= Py_TPFLAGS_HAVE_NEWBUFFER;
+#endif
+
 }
 
 } // namespace PyOpenImageIO
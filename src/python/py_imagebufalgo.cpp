@@ -1094,6 +1094,7 @@ void declare_imagebufalgo()
         .value("MakeTxEnvLatl", ImageBufAlgo::MakeTxEnvLatl)
         .value("MakeTxEnvLatlFromLightProbe",
                                 ImageBufAlgo::MakeTxEnvLatlFromLightProbe)
+        .value("MakeTxEnvCube", ImageBufAlgo::MakeTxEnvCube)
         .export_values()
     ;
 
@@ -153,28 +153,52 @@ bool ImageInputWrap::seek_subimage(int subimage, int miplevel)
 object
 ImageInputWrap::read_image (TypeDesc format)
 {
-    // Allocate our own temp buffer and try to read the image into it.
+    // Allocate the Python array and read the image directly into it.
     // If the read fails, return None.
     const ImageSpec &spec = m_input->spec();
     if (format.basetype == TypeDesc::UNKNOWN)
         format = spec.format;
     size_t size = (size_t) spec.image_pixels() * spec.nchannels * format.size();
-    char *data = new char[size];
+    object array = make_Python_array (format, size);
+    ScopedPyBuffer data (array.ptr(), true);
     bool ok;
     {
         ScopedGILRelease gil;
-        ok = m_input->read_image(format, data);
+        ok = m_input->read_image(format, data.data());
     }
-    if (! ok) {
-        delete [] data;  // never mind
+    if (! ok)
         return object(handle<>(Py_None));
-    }
+    return array;
+}
 
-    object array = C_array_to_Python_array (data, format, size);
 
-    // clean up and return the array handle
-    delete [] data;
-    return array;
+// Read the whole image directly into a caller-supplied writable buffer
+// (a numpy array, bytearray, array.array, ...), with no intermediate
+// copies. If format is UNKNOWN, the buffer's own element type is used if
+// it has one, otherwise the native format of the file.  The GIL is
+// released for the whole read.
+bool
+ImageInputWrap::read_image_into (TypeDesc format, object &buffer)
+{
+    ScopedPyBuffer buf (buffer.ptr(), true);
+    if (! buf.valid()) {
+        PyErr_SetString (PyExc_TypeError,
+                         "read_image: expected a writable, contiguous buffer");
+        throw_error_already_set();
+    }
+    const ImageSpec &spec = m_input->spec();
+    if (format.basetype == TypeDesc::UNKNOWN)
+        format = buf.format();
+    if (format.basetype == TypeDesc::UNKNOWN)
+        format = spec.format;
+    size_t size = (size_t) spec.image_pixels() * spec.nchannels * format.size();
+    if (buf.size() < size) {
+        PyErr_SetString (PyExc_ValueError,
+                         "read_image: buffer is too small for the image");
+        throw_error_already_set();
+    }
+    ScopedGILRelease gil;
+    return m_input->read_image (format, buf.data());
 }
 
 
@@ -185,6 +209,21 @@ ImageInputWrap_read_image_bt (ImageInputWrap& in, TypeDesc::BASETYPE format)
 }
 
 
+bool
+ImageInputWrap_read_image_into_bt (ImageInputWrap& in,
+                                   TypeDesc::BASETYPE format, object &buffer)
+{
+    return in.read_image_into (format, buffer);
+}
+
+
+bool
+ImageInputWrap_read_image_into_default (ImageInputWrap& in, object &buffer)
+{
+    return in.read_image_into (TypeDesc::UNKNOWN, buffer);
+}
+
+
 object
 ImageInputWrap_read_image_default (ImageInputWrap& in)
 {
@@ -196,27 +235,21 @@ ImageInputWrap_read_image_default (ImageInputWrap& in)
 object
 ImageInputWrap::read_scanline (int y, int z, TypeDesc format)
 {
-    // Allocate our own temp buffer and try to read the scanline into it.
+    // Allocate the Python array and read directly into it.
     // If the read fails, return None.
     const ImageSpec &spec = m_input->spec();
     if (format.basetype == TypeDesc::UNKNOWN)
         format = spec.format;
     size_t size = (size_t) spec.width * spec.nchannels * format.size();
-    char *data = new char[size];
+    object array = make_Python_array (format, size);
+    ScopedPyBuffer data (array.ptr(), true);
     bool ok;
     {
         ScopedGILRelease gil;
-        ok = m_input->read_scanline (y, z, format, data);
+        ok = m_input->read_scanline (y, z, format, data.data());
     }
-    if (!ok) {
-        delete [] data;  // never mind
+    if (! ok)
         return object(handle<>(Py_None));
-    }
-
-    object array = C_array_to_Python_array (data, format, size);
-
-    // clean up and return the array handle
-    delete [] data;
     return array;
 }
 
@@ -241,7 +274,7 @@ object
 ImageInputWrap::read_scanlines (int ybegin, int yend, int z,
                                 int chbegin, int chend, TypeDesc format)
 {
-    // Allocate our own temp buffer and try to read the scanline into it.
+    // Allocate the Python array and read directly into it.
     // If the read fails, return None.
     ASSERT (m_input);
     const ImageSpec &spec = m_input->spec();
@@ -250,21 +283,16 @@ ImageInputWrap::read_scanlines (int ybegin, int yend, int z,
     chend = clamp (chend, chbegin+1, spec.nchannels);
     int nchans = chend - chbegin;
     size_t size = (size_t) spec.width * (yend-ybegin) * nchans * format.size();
-    char *data = new char[size];
+    object array = make_Python_array (format, size);
+    ScopedPyBuffer data (array.ptr(), true);
     bool ok;
     {
         ScopedGILRelease gil;
-        ok = m_input->read_scanlines (ybegin, yend, z, chbegin, chend, format, data);
+        ok = m_input->read_scanlines (ybegin, yend, z, chbegin, chend,
+                                      format, data.data());
     }
-    if (! ok) {
-        delete [] data;  // never mind
+    if (! ok)
         return object(handle<>(Py_None));
-    }
-
-    object array = C_array_to_Python_array (data, format, size);
-
-    // clean up and return the array handle
-    delete [] data;
     return array;
 }
 
@@ -290,27 +318,21 @@ ImageInputWrap_read_scanlines_default (ImageInputWrap& in, int ybegin, int yend,
 object
 ImageInputWrap::read_tile (int x, int y, int z, TypeDesc format)
 {
-    // Allocate our own temp buffer and try to read the scanline into it.
+    // Allocate the Python array and read directly into it.
     // If the read fails, return None.
     const ImageSpec &spec = m_input->spec();
     if (format.basetype == TypeDesc::UNKNOWN)
         format = spec.format;
     size_t size = (size_t) spec.tile_pixels() * spec.nchannels * format.size();
-    char *data = new char[size];
+    object array = make_Python_array (format, size);
+    ScopedPyBuffer data (array.ptr(), true);
     bool ok;
     {
         ScopedGILRelease gil;
-        ok = m_input->read_tile (x, y, z, format, data);
+        ok = m_input->read_tile (x, y, z, format, data.data());
     }
-    if (! ok) {
-        delete [] data;  // never mind
+    if (! ok)
         return object(handle<>(Py_None));
-    }
-
-    object array = C_array_to_Python_array (data, format, size);
-
-    // clean up and return the array handle
-    delete [] data;
     return array;
 }
 
@@ -337,7 +359,7 @@ ImageInputWrap::read_tiles (int xbegin, int xend, int ybegin, int yend,
                             int zbegin, int zend, int chbegin, int chend,
                             TypeDesc format)
 {
-    // Allocate our own temp buffer and try to read the scanline into it.
+    // Allocate the Python array and read directly into it.
     // If the read fails, return None.
     const ImageSpec &spec = m_input->spec();
     if (format.basetype == TypeDesc::UNKNOWN)
@@ -346,22 +368,16 @@ ImageInputWrap::read_tiles (int xbegin, int xend, int ybegin, int yend,
     int nchans = chend - chbegin;
     size_t size = (size_t) ((xend-xbegin) * (yend-ybegin) * 
                             (zend-zbegin) * nchans * format.size());
-    char *data = new char[size];
+    object array = make_Python_array (format, size);
+    ScopedPyBuffer data (array.ptr(), true);
     bool ok;
     {
         ScopedGILRelease gil;
         ok = m_input->read_tiles (xbegin, xend, ybegin, yend,
-                                  zbegin, zend, chbegin, chend, format, data);
+                                  zbegin, zend, chbegin, chend, format, data.data());
     }
-    if (! ok) {
-        delete [] data;  // never mind
+    if (! ok)
         return object(handle<>(Py_None));
-    }
-
-    object array = C_array_to_Python_array (data, format, size);
-
-    // clean up and return the array handle
-    delete [] data;
     return array;
 }
 
@@ -487,6 +503,11 @@ void declare_imageinput()
         .def("read_tiles",       &ImageInputWrap::read_tiles)
         .def("read_tiles",       &ImageInputWrap_read_tiles_bt)
         .def("read_tiles",       &ImageInputWrap_read_tiles_default)
+        // The buffer-filling variants must be registered first so that
+        // they are tried last: an object argument matches anything.
+        .def("read_image",       &ImageInputWrap_read_image_into_default)
+        .def("read_image",       &ImageInputWrap_read_image_into_bt)
+        .def("read_image",       &ImageInputWrap::read_image_into)
         .def("read_image",       &ImageInputWrap::read_image)
         .def("read_image",       &ImageInputWrap_read_image_bt)
         .def("read_image",       &ImageInputWrap_read_image_default)
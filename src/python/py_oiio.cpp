@@ -75,6 +75,88 @@ typedesc_from_python_array_code (char code)
 
 
 
+// Format string for the buffer protocol (struct module syntax), as
+// understood by numpy and memoryview.
+const char *
+python_buffer_format (TypeDesc format)
+{
+    if (format.basetype == TypeDesc::HALF)
+        return "e";
+    return python_array_code (format);
+}
+
+
+
+TypeDesc
+typedesc_from_python_buffer_format (const char *format)
+{
+    if (! format)
+        return TypeDesc::UINT8;   // NULL means unsigned bytes
+    // Skip native byte order/alignment markers, anything else is not a
+    // layout we can use directly.
+    while (*format == '@' || *format == '=' ||
+           (*format == '<' && littleendian()))
+        ++format;
+    if (! format[0] || format[1])
+        return TypeDesc::UNKNOWN;   // empty, or not a single element
+    if (format[0] == 'e')
+        return TypeDesc::HALF;
+    if (format[0] == 'l' || format[0] == 'L')   // long is 64 bits on LP64
+        return sizeof(long) == 8 ? TypeDesc::UNKNOWN
+                                 : typedesc_from_python_array_code (format[0]);
+    return typedesc_from_python_array_code (format[0]);
+}
+
+
+
+ScopedPyBuffer::ScopedPyBuffer (PyObject *obj, bool writable)
+    : m_have_view(false), m_data(NULL), m_size(0), m_format(TypeDesc::UNKNOWN)
+{
+    int flags = PyBUF_C_CONTIGUOUS | PyBUF_FORMAT;
+    if (writable)
+        flags |= PyBUF_WRITABLE;
+    if (PyObject_CheckBuffer (obj) &&
+            PyObject_GetBuffer (obj, &m_view, flags) == 0) {
+        m_have_view = true;
+        m_data = m_view.buf;
+        m_size = (size_t) m_view.len;
+        m_format = typedesc_from_python_buffer_format (m_view.format);
+        if (m_format != TypeDesc::UNKNOWN &&
+                m_format.size() != (size_t)m_view.itemsize)
+            m_format = TypeDesc::UNKNOWN;
+        return;
+    }
+    PyErr_Clear ();
+#if PY_MAJOR_VERSION < 3
+    // Python 2 array.array only knows the old buffer protocol.
+    Py_ssize_t len = 0;
+    int failed = writable ? PyObject_AsWriteBuffer (obj, &m_data, &len)
+                 : PyObject_AsReadBuffer (obj, (const void **)&m_data, &len);
+    if (failed) {
+        PyErr_Clear ();
+        m_data = NULL;
+        return;
+    }
+    m_size = (size_t) len;
+    if (PyObject_HasAttrString (obj, "typecode")) {
+        object tcobj = object(handle<>(borrowed(obj))).attr("typecode");
+        extract<char> tce (tcobj);
+        if (tce.check())
+            m_format = typedesc_from_python_array_code (tce());
+    }
+#endif
+}
+
+
+
+ScopedPyBuffer::~ScopedPyBuffer ()
+{
+    if (m_have_view)
+        PyBuffer_Release (&m_view);
+}
+
+
+
 object
 C_array_to_Python_array (const char *data, TypeDesc type, size_t size)
 {
@@ -97,6 +179,21 @@ C_array_to_Python_array (const char *data, TypeDesc type, size_t size)
 
 
 
+// Construct a zero-filled Python array whose element type corresponds to
+// 'type' and that is big enough to hold 'size' bytes, so that results
+// can be read directly into its memory rather than copied in afterwards.
+object
+make_Python_array (TypeDesc type, size_t size)
+{
+    object arr_module(handle<>(PyImport_ImportModule("array")));
+    object array = arr_module.attr("array")(python_array_code(type),
+                                             make_tuple(0));
+    size_t itemsize = extract<size_t>(array.attr("itemsize"));
+    return array * ((size + itemsize - 1) / itemsize);
+}
+
+
+
 struct ustring_to_python_str {
     static PyObject* convert(ustring const& s) {
         return boost::python::incref(boost::python::object(s.string()).ptr());
@@ -66,8 +66,11 @@ void declare_global();
 
 bool PyProgressCallback(void*, float);
 object C_array_to_Python_array (const char *data, TypeDesc type, size_t size);
+object make_Python_array (TypeDesc type, size_t size);
 const char * python_array_code (TypeDesc format);
 TypeDesc typedesc_from_python_array_code (char code);
+const char * python_buffer_format (TypeDesc format);
+TypeDesc typedesc_from_python_buffer_format (const char *format);
 
 
 
@@ -152,6 +155,37 @@ private:
 
 
 
+// Helper class that gives direct access to the memory of any Python
+// object supporting the buffer protocol (numpy arrays, bytearray,
+// array.array, ...) for as long as it is in scope.  No copies are made.
+// The view is acquired and released with the GIL held, so it's safe to
+// use the memory while a ScopedGILRelease is active in a nested scope.
+class ScopedPyBuffer {
+public:
+    /// Acquire a C-contiguous view of obj.  If writable is true, fail
+    /// unless the object's memory may be written.
+    ScopedPyBuffer (PyObject *obj, bool writable);
+    ~ScopedPyBuffer ();
+
+    /// Did we get a view of the object's memory?
+    bool valid () const { return m_data != NULL; }
+    void *data () const { return m_data; }
+    /// Size of the viewed memory, in bytes.
+    size_t size () const { return m_size; }
+    /// Element type of the buffer, or UNKNOWN if the exporter doesn't
+    /// say or uses a format we don't understand.
+    TypeDesc format () const { return m_format; }
+
+private:
+    Py_buffer m_view;
+    bool m_have_view;
+    void *m_data;
+    size_t m_size;
+    TypeDesc m_format;
+};
+
+
+
 class ImageInputWrap {
 private:
     /// Friend declaration for ImageOutputWrap::copy_image
@@ -173,6 +207,7 @@ public:
     int current_miplevel() const;
     bool seek_subimage (int, int);
     object read_image (TypeDesc);
+    bool read_image_into (TypeDesc, object &buffer);
     object read_scanline (int y, int z, TypeDesc format);
     object read_scanlines (int ybegin, int yend, int z,
                            int chbegin, int chend, TypeDesc format);
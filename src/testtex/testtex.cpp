@@ -51,11 +51,13 @@
 #include "OpenImageIO/imagebufalgo_util.h"
 #include "OpenImageIO/texture.h"
 #include "OpenImageIO/fmath.h"
+#include "OpenImageIO/hash.h"
 #include "OpenImageIO/filesystem.h"
 #include "OpenImageIO/sysutil.h"
 #include "OpenImageIO/strutil.h"
 #include "OpenImageIO/timer.h"
 #include "../libtexture/imagecache_pvt.h"
+#include "../libtexture/texture_pvt.h"
 
 OIIO_NAMESPACE_USING
 
@@ -90,6 +92,10 @@ static float cachesize = -1;
 static int maxfiles = -1;
 static int mipmode = TextureOpt::MipModeDefault;
 static int interpmode = TextureOpt::InterpSmartBicubic;
+static bool stochastic = false;
+static std::string trace_filename;
+static std::string replay_filename;
+static int sorted_batch = 0;
 static float missing[4] = {-1, 0, 0, 1};
 static float fill = -1;  // -1 signifies unset
 static float scalefactor = 1.0f;
@@ -153,6 +159,7 @@ getargs (int argc, const char *argv[])
                       Strutil::format("Set max anisotropy (default: %d)", anisotropic).c_str(),
                   "--mipmode %d", &mipmode, "Set mip mode (default: 0 = aniso)",
                   "--interpmode %d", &interpmode, "Set interp mode (default: 3 = smart bicubic)",
+                  "--stochastic", &stochastic, "Use stochastic mip/aniso filtering (and compare to deterministic)",
                   "--missing %f %f %f", &missing[0], &missing[1], &missing[2],
                         "Specify missing texture color",
                   "--autotile %d", &autotile, "Set auto-tile size for the image cache",
@@ -182,6 +189,9 @@ getargs (int argc, const char *argv[])
                   "--trials %d", &ntrials, "Number of trials for timings",
                   "--wedge", &wedge, "Wedge test",
                   "--testicwrite %d", &testicwrite, "Test ImageCache write ability (1=seeded, 2=generated)",
+                  "--trace %s", &trace_filename, "Record a trace of all texture lookups to this file",
+                  "--replay %s", &replay_filename, "Replay a texture lookup trace (honors --threads, --cachesize, --trials, --wedge)",
+                  "--sorted %d", &sorted_batch, "Replay lookups in batches of this size with texture_sorted()",
                   NULL);
     if (ap.parse (argc, argv) < 0) {
         std::cerr << ap.geterror() << std::endl;
@@ -193,7 +203,7 @@ getargs (int argc, const char *argv[])
         exit (EXIT_FAILURE);
     }
 
-    if (filenames.size() < 1 &&
+    if (filenames.size() < 1 && replay_filename.empty() &&
           !test_construction && !test_getimagespec && !testhash) {
         std::cerr << "testtex: Must have at least one input file\n";
         ap.usage();
@@ -221,6 +231,22 @@ initialize_opt (TextureOpt &opt, int nchannels)
     opt.anisotropic = anisotropic;
     opt.mipmode = (TextureOpt::MipMode) mipmode;
     opt.interpmode = (TextureOpt::InterpMode) interpmode;
+    if (stochastic) {
+        if (opt.mipmode == TextureOpt::MipModeTrilinear)
+            opt.mipmode = TextureOpt::MipModeStochasticTrilinear;
+        else if (opt.mipmode == TextureOpt::MipModeDefault ||
+                 opt.mipmode == TextureOpt::MipModeAniso)
+            opt.mipmode = TextureOpt::MipModeStochasticAniso;
+    }
+}
+
+
+
+// Repeatable per-pixel random value in [0,1) for stochastic filtering.
+inline float
+pixel_rnd (int x, int y)
+{
+    return (bjhash::bjfinal (x, y) >> 8) * (1.0f / (1 << 24));
 }
 
 
@@ -509,6 +535,8 @@ plain_tex_region (ImageBuf &image, ustring filename, Mapping2D mapping,
     for (ImageBuf::Iterator<float> p (image, roi);  ! p.done();  ++p) {
         float s, t, dsdx, dtdx, dsdy, dtdy;
         mapping (p.x(), p.y(), s, t, dsdx, dtdx, dsdy, dtdy);
+        if (stochastic)
+            opt.rnd = pixel_rnd (p.x(), p.y());
 
         // Call the texture system to do the filtering.
         bool ok;
@@ -539,6 +567,60 @@ plain_tex_region (ImageBuf &image, ustring filename, Mapping2D mapping,
 
 
 
+// Fill the image with texture lookups, and return the time it took
+// and how many tile lookups and filter probes the texture system did.
+static double
+timed_tex_pass (ImageBuf &image, ImageBuf *image_ds, ImageBuf *image_dt,
+                ustring filename, Mapping2D mapping,
+                long long &tiles, long long &probes)
+{
+    long long tiles0 = 0, probes0 = 0, tiles1 = 0, probes1 = 0;
+    texsys->getattribute ("stat:find_tile_calls", TypeDesc::INT64, &tiles0);
+    texsys->getattribute ("stat:aniso_probes", TypeDesc::INT64, &probes0);
+    Timer timer;
+    ImageBufAlgo::parallel_image (boost::bind(plain_tex_region, boost::ref(image), filename, mapping,
+                                              image_ds, image_dt, _1),
+                                  get_roi(image.spec()), nthreads);
+    double time = timer();
+    texsys->getattribute ("stat:find_tile_calls", TypeDesc::INT64, &tiles1);
+    texsys->getattribute ("stat:aniso_probes", TypeDesc::INT64, &probes1);
+    tiles = tiles1 - tiles0;
+    probes = probes1 - probes0;
+    return time;
+}
+
+
+
+// Compare the cost of deterministic and stochastic filtering for the
+// same lookups.  The first pass is just to warm up the cache so that
+// neither timing includes disk reads.
+static void
+compare_stochastic (const ImageSpec &spec, ustring filename, Mapping2D mapping)
+{
+    ImageBuf scratch (spec), scratch_ds, scratch_dt;
+    if (test_derivs) {
+        scratch_ds.reset (spec);
+        scratch_dt.reset (spec);
+    }
+    ImageBuf *ds = test_derivs ? &scratch_ds : NULL;
+    ImageBuf *dt = test_derivs ? &scratch_dt : NULL;
+    long long dtiles, dprobes, stiles, sprobes;
+    stochastic = false;
+    timed_tex_pass (scratch, ds, dt, filename, mapping, dtiles, dprobes);
+    double dtime = timed_tex_pass (scratch, ds, dt, filename, mapping, dtiles, dprobes);
+    stochastic = true;
+    double stime = timed_tex_pass (scratch, ds, dt, filename, mapping, stiles, sprobes);
+    std::cout << "Stochastic vs deterministic filtering:\n";
+    std::cout << Strutil::format ("  time        %8.3fs vs %8.3fs  (%.1fx)\n",
+                                  stime, dtime, dtime / std::max (stime, 1e-6));
+    std::cout << Strutil::format ("  tile lookups %9lld vs %9lld  (%.1fx)\n",
+                                  stiles, dtiles, double(dtiles) / std::max (stiles, 1LL));
+    std::cout << Strutil::format ("  probes      %9lld vs %9lld  (%.1fx)\n",
+                                  sprobes, dprobes, double(dprobes) / std::max (sprobes, 1LL));
+}
+
+
+
 void
 test_plain_texture (Mapping2D mapping)
 {
@@ -559,6 +641,9 @@ test_plain_texture (Mapping2D mapping)
 
     ustring filename = filenames[0];
 
+    if (stochastic)
+        compare_stochastic (outspec, filename, mapping);
+
     for (int iter = 0;  iter < iters;  ++iter) {
         if (iters > 1 && filenames.size() > 1) {
             // Use a different filename for each iteration
@@ -962,6 +1047,196 @@ launch_tex_threads (int numthreads, int iterations)
 
 
 
+// A texture lookup trace (as written by the TextureSystem "trace_file"
+// attribute), with the lookups sorted into per-thread streams.
+struct LookupTrace {
+    std::vector<ustring> files;
+    std::vector<std::vector<pvt::TextureTraceRecord> > streams;
+    long long nlookups;
+    LookupTrace () : nlookups(0) { }
+};
+
+
+
+static bool
+read_trace (const std::string &filename, LookupTrace &trace)
+{
+    FILE *file = Filesystem::fopen (filename, "rb");
+    if (! file) {
+        std::cerr << "testtex: could not open trace " << filename << "\n";
+        return false;
+    }
+    char magic[8];
+    bool ok = (fread (magic, 8, 1, file) == 1 && ! memcmp (magic, "OIIOtrc1", 8));
+    uint32_t tag;
+    while (ok && fread (&tag, sizeof(tag), 1, file) == 1) {
+        if (tag == pvt::TraceFilename) {
+            uint32_t header[2];
+            ok = (fread (header, sizeof(header), 1, file) == 1);
+            std::string name (ok ? header[1] : 0, ' ');
+            ok = ok && (header[1] == 0 || fread (&name[0], header[1], 1, file) == 1);
+            if (ok) {
+                if (header[0] >= trace.files.size())
+                    trace.files.resize (header[0]+1);
+                trace.files[header[0]] = ustring (name);
+            }
+        } else if (tag == pvt::TraceTexture) {
+            pvt::TextureTraceRecord rec;
+            ok = (fread (&rec, sizeof(rec), 1, file) == 1) &&
+                 rec.file < trace.files.size();
+            if (ok) {
+                if (rec.thread >= trace.streams.size())
+                    trace.streams.resize (rec.thread+1);
+                trace.streams[rec.thread].push_back (rec);
+                ++trace.nlookups;
+            }
+        } else {
+            ok = false;
+        }
+    }
+    fclose (file);
+    if (! ok)
+        std::cerr << "testtex: " << filename << " is not a valid trace\n";
+    return ok;
+}
+
+
+
+// Set up the TextureOpt that was used for a traced lookup.
+static void
+trace_options (const pvt::TextureTraceRecord &rec, TextureOpt &opt)
+{
+    opt.firstchannel = rec.firstchannel;
+    opt.subimage = rec.subimage;
+    opt.anisotropic = rec.anisotropic;
+    opt.swrap = (TextureOpt::Wrap) rec.swrap;
+    opt.twrap = (TextureOpt::Wrap) rec.twrap;
+    opt.mipmode = (TextureOpt::MipMode) rec.mipmode;
+    opt.interpmode = (TextureOpt::InterpMode) rec.interpmode;
+    opt.conservative_filter = rec.conservative_filter;
+    opt.sblur = rec.sblur;   opt.tblur = rec.tblur;
+    opt.swidth = rec.swidth; opt.twidth = rec.twidth;
+    opt.fill = rec.fill;
+    opt.time = rec.time;
+    opt.rnd = rec.rnd;
+}
+
+
+
+// Replay the traced lookups in [begin,end), which all have the same
+// number of channels, as one call to texture_sorted().
+static void
+replay_sorted (const std::vector<pvt::TextureTraceRecord> &stream,
+               size_t begin, size_t end,
+               const std::vector<TextureSystem::TextureHandle *> &handles,
+               TextureSystem::Perthread *perthread_info)
+{
+    typedef TextureSystem::TextureQuery TextureQuery;
+    int n = int (end - begin);
+    int nchannels = Imath::clamp (stream[begin].nchannels, 1, 64);
+    std::vector<TextureOpt> opts (n);
+    std::vector<TextureQuery> queries (n);
+    std::vector<float> results (3 * n * nchannels);
+    for (int i = 0;  i < n;  ++i) {
+        const pvt::TextureTraceRecord &rec (stream[begin+i]);
+        trace_options (rec, opts[i]);
+        TextureQuery &q (queries[i]);
+        q.texture_handle = handles[rec.file];
+        q.options = &opts[i];
+        q.s = rec.s;  q.t = rec.t;
+        q.dsdx = rec.dsdx;  q.dtdx = rec.dtdx;
+        q.dsdy = rec.dsdy;  q.dtdy = rec.dtdy;
+        q.result = &results[i*nchannels];
+        q.dresultds = test_derivs ? &results[(n+i)*nchannels] : NULL;
+        q.dresultdt = test_derivs ? &results[(2*n+i)*nchannels] : NULL;
+    }
+    texsys->texture_sorted (perthread_info, nchannels, &queries[0], n);
+}
+
+
+
+// Replay the trace streams assigned to this thread, in order.
+static void
+replay_thread (const LookupTrace *trace, int thread, int numthreads)
+{
+    TextureSystem::Perthread *perthread_info = texsys->get_perthread_info ();
+    std::vector<TextureSystem::TextureHandle *> handles (trace->files.size());
+    for (size_t f = 0;  f < handles.size();  ++f)
+        handles[f] = texsys->get_texture_handle (trace->files[f], perthread_info);
+    float result[64], dresultds[64], dresultdt[64];
+    for (size_t st = thread;  st < trace->streams.size();  st += numthreads) {
+        const std::vector<pvt::TextureTraceRecord> &stream (trace->streams[st]);
+        if (sorted_batch > 0) {
+            for (size_t b = 0, e = stream.size();  b < e;  ) {
+                size_t bend = b + 1;
+                while (bend < e && bend - b < size_t(sorted_batch) &&
+                       stream[bend].nchannels == stream[b].nchannels)
+                    ++bend;
+                replay_sorted (stream, b, bend, handles, perthread_info);
+                b = bend;
+            }
+            continue;
+        }
+        for (size_t i = 0, e = stream.size();  i < e;  ++i) {
+            const pvt::TextureTraceRecord &rec (stream[i]);
+            TextureOpt opt;
+            trace_options (rec, opt);
+            int nchannels = Imath::clamp (rec.nchannels, 1, 64);
+            texsys->texture (handles[rec.file], perthread_info, opt,
+                             rec.s, rec.t, rec.dsdx, rec.dtdx, rec.dsdy, rec.dtdy,
+                             nchannels, result,
+                             test_derivs ? dresultds : NULL,
+                             test_derivs ? dresultdt : NULL);
+        }
+    }
+}
+
+
+
+// Replay the whole trace with numthreads threads, starting from an
+// empty cache each time so that hit rates match the original run.
+static void
+launch_replay_threads (const LookupTrace *trace, int numthreads)
+{
+    texsys->invalidate_all (true);
+    boost::thread_group threads;
+    for (int i = 0;  i < numthreads;  ++i)
+        threads.create_thread (boost::bind(replay_thread, trace, i, numthreads));
+    threads.join_all ();
+}
+
+
+
+static void
+test_replay (const std::string &filename)
+{
+    LookupTrace trace;
+    if (! read_trace (filename, trace))
+        return;
+    std::cout << "Replaying " << trace.nlookups << " lookups of "
+              << trace.files.size() << " textures from "
+              << trace.streams.size() << " threads\n";
+    std::cout << "texture cache size = " << cachesize << " MB\n";
+    std::cout << "times are best of " << ntrials << " trials\n\n";
+    std::cout << "threads  time (s)  Mlookups/s\n";
+    std::cout << "-------- --------  ----------\n";
+    int maxthreads = nthreads ? nthreads : boost::thread::hardware_concurrency();
+    static int threadcounts[] = { 1, 2, 4, 8, 12, 16, 24, 32, 64, 128, 1024, 1<<30 };
+    for (int i = 0;  threadcounts[i] <= maxthreads;  ++i) {
+        int nt = wedge ? threadcounts[i] : maxthreads;
+        double range;
+        double t = time_trial (boost::bind(launch_replay_threads, &trace, nt),
+                               ntrials, &range);
+        std::cout << Strutil::format ("%2d      %8.2f  %8.2f    range %.2f\n",
+                                      nt, t, 1.0e-6 * trace.nlookups / t, range);
+        if (! wedge)
+            break;    // don't loop if we're not wedging
+    }
+    std::cout << "\n";
+}
+
+
+
 class GridImageInput : public ImageInput {
 public:
     GridImageInput () : m_miplevel(-1) { }
@@ -1094,6 +1369,8 @@ main (int argc, const char *argv[])
     if (nounmipped)
         texsys->attribute ("accept_unmipped", 0);
     texsys->attribute ("gray_to_rgb", gray_to_rgb);
+    if (trace_filename.size())
+        texsys->attribute ("trace_file", trace_filename);
 
     if (test_construction) {
         Timer t;
@@ -1138,7 +1415,9 @@ main (int argc, const char *argv[])
     xform = persp * rot * trans * scale;
     xform.invert();
 
-    if (threadtimes) {
+    if (replay_filename.size()) {
+        test_replay (replay_filename);
+    } else if (threadtimes) {
         // If the --iters flag was used, do that number of iterations total
         // (divided among the threads). If not supplied (iters will be 1),
         // then use a large constant *per thread*.
@@ -104,6 +104,11 @@ try:
     print "Interpolating bicubic 0.25,0.5 ->", b.interppixel_bicubic(1.0,0.5)
     print "Interpolating NDC bicubic 0.25,0.5 ->", b.interppixel_bicubic_NDC(0.25,0.5)
     print "The whole image is: ", b.get_pixels(oiio.TypeDesc.TypeFloat)
+    # Zero-copy access to the pixels through the buffer protocol
+    m = memoryview (b)
+    print "Buffer view format", m.format, "ndim", m.ndim, "shape", [int(x) for x in m.shape]
+    print "Buffer view contents:", list(bytearray(m.tobytes()))
+    del m
     print ""
     print "Saving file..."
     b.write ("out.tif")